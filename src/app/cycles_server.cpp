@@ -38,6 +38,7 @@ int main(int argc, const char **argv)
   string devicename = "cpu";
   bool list = false, debug = false;
   int threads = 0, verbosity = 1;
+  int buffer_cache_size = 1024;
 
   vector<DeviceType> &types = Device::available_types();
 
@@ -61,6 +62,9 @@ int main(int argc, const char **argv)
              "--threads %d",
              &threads,
              "Number of threads to use for CPU device",
+             "--buffer-cache-size %d",
+             &buffer_cache_size,
+             "Memory in MB for buffers kept across sessions (default 1024)",
 #ifdef WITH_CYCLES_LOGGING
              "--debug",
              &debug,
@@ -112,7 +116,7 @@ int main(int argc, const char **argv)
     Stats stats;
     Device *device = Device::create(device_info, stats, true);
     printf("Cycles Server with device: %s\n", device->info.description.c_str());
-    device->server_run();
+    device->server_run((size_t)buffer_cache_size * 1024 * 1024);
     delete device;
   }
 
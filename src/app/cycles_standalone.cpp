@@ -18,6 +18,7 @@
 
 #include "render/buffers.h"
 #include "render/camera.h"
+#include "render/film.h"
 #include "device/device.h"
 #include "render/scene.h"
 #include "render/session.h"
@@ -51,6 +52,7 @@ struct Options {
   SceneParams scene_params;
   SessionParams session_params;
   bool quiet;
+  bool adaptive;
   bool show_help, interactive, pause;
   string output_path;
 } options;
@@ -119,6 +121,7 @@ static BufferParams &session_buffer_params()
   buffer_params.height = options.height;
   buffer_params.full_width = options.width;
   buffer_params.full_height = options.height;
+  buffer_params.passes = options.scene->film->passes;
 
   return buffer_params;
 }
@@ -142,6 +145,15 @@ static void scene_init()
 
   /* Calculate Viewplane */
   options.scene->camera->compute_auto_viewplane();
+
+  /* Render passes, the session only enables adaptive sampling when its auxiliary passes exist.
+   * The threshold and minimum number of samples are read from the integrator in the file. */
+  vector<Pass> &passes = options.scene->film->passes;
+  Pass::add(PASS_COMBINED, passes);
+  if (options.adaptive) {
+    Pass::add(PASS_ADAPTIVE_AUX_BUFFER, passes);
+    Pass::add(PASS_SAMPLE_COUNT, passes);
+  }
 }
 
 static void session_init()
@@ -369,6 +381,7 @@ static void options_parse(int argc, const char **argv)
   options.filepath = "";
   options.session = NULL;
   options.quiet = false;
+  options.adaptive = false;
 
   /* device names */
   string device_names = "";
@@ -413,6 +426,9 @@ static void options_parse(int argc, const char **argv)
              "--samples %d",
              &options.session_params.samples,
              "Number of samples to render",
+             "--adaptive",
+             &options.adaptive,
+             "Stop sampling pixels once their noise is below the integrator's adaptive threshold",
              "--output %s",
              &options.output_path,
              "File path to write output image",
@@ -431,6 +447,19 @@ static void options_parse(int argc, const char **argv)
              "--tile-height %d",
              &options.session_params.tile_size.y,
              "Tile height in pixels",
+             "--texture-cache-size %d",
+             &options.scene_params.texture_cache_size,
+             "Memory in MB for loading CPU image textures on demand, 0 to load them fully",
+             "--geometry-memory-limit %d",
+             &options.scene_params.geometry_memory_limit,
+             "Memory in MB for mesh geometry, meshes beyond it are paged in from disk, 0 for "
+             "no limit",
+             "--geometry-cache-path %s",
+             &options.scene_params.geometry_cache_path,
+             "Directory for mesh geometry paged out to disk, the temporary directory if empty",
+             "--shader-cache-path %s",
+             &options.scene_params.shader_cache_path,
+             "Directory for compiled SVM shaders reused by later renders, disabled if empty",
              "--list-devices",
              &list,
              "List information about all available devices",
@@ -23,6 +23,7 @@
 #include "blender/blender_session.h"
 
 #include "render/denoising.h"
+#include "render/integrator.h"
 #include "render/merge.h"
 
 #include "util/util_debug.h"
@@ -189,6 +190,7 @@ static PyObject *init_func(PyObject * /*self*/, PyObject *args)
 static PyObject *exit_func(PyObject * /*self*/, PyObject * /*args*/)
 {
   ShaderManager::free_memory();
+  Integrator::free_memory();
   TaskScheduler::free_memory();
   Device::free_memory();
   Py_RETURN_NONE;
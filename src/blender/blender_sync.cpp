@@ -290,6 +290,10 @@ void BlenderSync::sync_integrator()
   integrator->sample_all_lights_direct = get_boolean(cscene, "sample_all_lights_direct");
   integrator->sample_all_lights_indirect = get_boolean(cscene, "sample_all_lights_indirect");
   integrator->light_sampling_threshold = get_float(cscene, "light_sampling_threshold");
+  integrator->use_light_tree = get_boolean(cscene, "use_light_tree");
+
+  integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+  integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
 
   int diffuse_samples = get_int(cscene, "diffuse_samples");
   int glossy_samples = get_int(cscene, "glossy_samples");
@@ -332,6 +336,10 @@ void BlenderSync::sync_integrator()
 
   if (integrator->modified(previntegrator))
     integrator->tag_update(scene);
+
+  /* The light tree is built together with the light distribution. */
+  if (integrator->use_light_tree != previntegrator.use_light_tree)
+    scene->light_manager->tag_update(scene);
 }
 
 /* Film */
@@ -656,6 +664,13 @@ vector<Pass> BlenderSync::sync_render_passes(BL::RenderLayer &b_rlay, BL::ViewLa
   }
   RNA_END;
 
+  /* Internal passes used by adaptive sampling, these are not written back to Blender. */
+  PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
+  if (get_boolean(cscene, "use_adaptive_sampling")) {
+    Pass::add(PASS_ADAPTIVE_AUX_BUFFER, passes);
+    Pass::add(PASS_SAMPLE_COUNT, passes);
+  }
+
   return passes;
 }
 
@@ -701,6 +716,8 @@ SceneParams BlenderSync::get_scene_params(BL::Scene &b_scene, bool background)
   params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
   params.use_bvh_unaligned_nodes = RNA_boolean_get(&cscene, "debug_use_hair_bvh");
   params.num_bvh_time_steps = RNA_int_get(&cscene, "debug_bvh_time_steps");
+  params.use_bvh_indexed_triangles = RNA_boolean_get(&cscene,
+                                                     "debug_use_bvh_indexed_triangles");
 
   if (background && params.shadingsystem != SHADINGSYSTEM_OSL)
     params.persistent_data = r.use_persistent_data();
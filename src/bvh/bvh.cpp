@@ -19,6 +19,7 @@
 
 #include "render/mesh.h"
 #include "render/object.h"
+#include "render/scene.h"
 
 #include "bvh/bvh2.h"
 #include "bvh/bvh4.h"
@@ -36,6 +37,7 @@
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -50,6 +52,8 @@ const char *bvh_layout_name(BVHLayout layout)
       return "BVH4";
     case BVH_LAYOUT_BVH8:
       return "BVH8";
+    case BVH_LAYOUT_BVH8_QUANTIZED:
+      return "BVH8_QUANTIZED";
     case BVH_LAYOUT_NONE:
       return "NONE";
     case BVH_LAYOUT_EMBREE:
@@ -86,6 +90,12 @@ BVHLayout BVHParams::best_bvh_layout(BVHLayout requested_layout, BVHLayoutMask s
   return (BVHLayout)(1 << widest_allowed_layout_mask);
 }
 
+bool BVHParams::layout_supports_indexed_triangles(BVHLayout layout)
+{
+  return (layout & (BVH_LAYOUT_BVH2 | BVH_LAYOUT_BVH4 | BVH_LAYOUT_BVH8 |
+                    BVH_LAYOUT_BVH8_QUANTIZED)) != 0;
+}
+
 /* Pack Utility */
 
 BVHStackEntry::BVHStackEntry(const BVHNode *n, int i) : node(n), idx(i)
@@ -114,6 +124,7 @@ BVH *BVH::create(const BVHParams &params,
     case BVH_LAYOUT_BVH4:
       return new BVH4(params, meshes, objects);
     case BVH_LAYOUT_BVH8:
+    case BVH_LAYOUT_BVH8_QUANTIZED:
       return new BVH8(params, meshes, objects);
     case BVH_LAYOUT_EMBREE:
 #ifdef WITH_EMBREE
@@ -207,9 +218,42 @@ void BVH::refit_primitives(int start, int end, BoundBox &bbox, uint &visibility)
 {
   /* Refit range of primitives. */
   for (int prim = start; prim < end; prim++) {
+    Object *ob = objects[pack.prim_object[prim]];
+
+    bbox.grow(prim_bounds[prim]);
+
+    if (pack.prim_index[prim] != -1 && (pack.prim_type[prim] & PRIMITIVE_ALL_CURVE)) {
+      visibility |= PATH_RAY_CURVE;
+    }
+    visibility |= ob->visibility_for_tracing();
+  }
+}
+
+void BVH::refit_primitive_bounds()
+{
+  /* Computing primitive bounds is where most of the time goes, the nodes are
+   * refit afterwards by merging the bounds of their children. */
+  const size_t num_prims = pack.prim_index.size();
+  const size_t chunk_size = 4096;
+
+  prim_bounds.clear();
+  prim_bounds.resize(num_prims, BoundBox::empty);
+
+  TaskPool pool;
+  for (size_t start = 0; start < num_prims; start += chunk_size) {
+    pool.push(function_bind(
+        &BVH::refit_primitive_bounds_range, this, start, min(start + chunk_size, num_prims)));
+  }
+  pool.wait_work();
+}
+
+void BVH::refit_primitive_bounds_range(size_t start, size_t end)
+{
+  for (size_t prim = start; prim < end; prim++) {
     int pidx = pack.prim_index[prim];
     int tob = pack.prim_object[prim];
     Object *ob = objects[tob];
+    BoundBox &bbox = prim_bounds[prim];
 
     if (pidx == -1) {
       /* Object instance. */
@@ -221,14 +265,11 @@ void BVH::refit_primitives(int start, int end, BoundBox &bbox, uint &visibility)
 
       if (pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
         /* Curves. */
-        int str_offset = (params.top_level) ? mesh->curve_offset : 0;
-        Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
+        Mesh::Curve curve = mesh->get_curve(pidx);
         int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
 
         curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
 
-        visibility |= PATH_RAY_CURVE;
-
         /* Motion curves. */
         if (mesh->use_motion_blur) {
           Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
@@ -245,8 +286,7 @@ void BVH::refit_primitives(int start, int end, BoundBox &bbox, uint &visibility)
       }
       else {
         /* Triangles. */
-        int tri_offset = (params.top_level) ? mesh->tri_offset : 0;
-        Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
+        Mesh::Triangle triangle = mesh->get_triangle(pidx);
         const float3 *vpos = &mesh->verts[0];
 
         triangle.bounds_grow(vpos, bbox);
@@ -266,7 +306,6 @@ void BVH::refit_primitives(int start, int end, BoundBox &bbox, uint &visibility)
         }
       }
     }
-    visibility |= ob->visibility_for_tracing();
   }
 }
 
@@ -306,7 +345,9 @@ void BVH::pack_primitives()
   pack.prim_tri_index.clear();
   pack.prim_tri_index.resize(tidx_size);
   pack.prim_tri_verts.clear();
-  pack.prim_tri_verts.resize(num_prim_triangles * 3);
+  if (!params.use_indexed_triangles) {
+    pack.prim_tri_verts.resize(num_prim_triangles * 3);
+  }
   pack.prim_visibility.clear();
   pack.prim_visibility.resize(tidx_size);
   /* Fill in all the arrays. */
@@ -315,7 +356,9 @@ void BVH::pack_primitives()
     if (pack.prim_index[i] != -1) {
       int tob = pack.prim_object[i];
       Object *ob = objects[tob];
-      if ((pack.prim_type[i] & PRIMITIVE_ALL_TRIANGLE) != 0) {
+      /* With indexed triangles the kernel looks up vertices through the mesh
+       * triangle vertex indices instead. */
+      if ((pack.prim_type[i] & PRIMITIVE_ALL_TRIANGLE) != 0 && !params.use_indexed_triangles) {
         pack_triangle(i, (float4 *)&pack.prim_tri_verts[3 * prim_triangle_index]);
         pack.prim_tri_index[i] = 3 * prim_triangle_index;
         ++prim_triangle_index;
@@ -335,246 +378,158 @@ void BVH::pack_primitives()
   }
 }
 
-/* Pack Instances */
+/* Global Arrays */
 
-void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
+void BVH::pack_global(DeviceScene *dscene, const PackedBVHOffsets &offsets)
 {
-  /* The BVH's for instances are built separately, but for traversal all
-   * BVH's are stored in global arrays. This function merges them into the
-   * top level BVH, adjusting indexes and offsets where appropriate.
+  /* The BVH's for instances and the top level BVH are built and packed
+   * separately, but for traversal all BVH's are stored in global arrays. This
+   * function copies into them, adjusting indexes and offsets where appropriate.
    */
   const bool use_qbvh = (params.bvh_layout == BVH_LAYOUT_BVH4);
-  const bool use_obvh = (params.bvh_layout == BVH_LAYOUT_BVH8);
-
-  /* Adjust primitive index to point to the triangle in the global array, for
-   * meshes with transform applied and already in the top level BVH.
-   */
-  for (size_t i = 0; i < pack.prim_index.size(); i++)
-    if (pack.prim_index[i] != -1) {
-      if (pack.prim_type[i] & PRIMITIVE_ALL_CURVE)
-        pack.prim_index[i] += objects[pack.prim_object[i]]->mesh->curve_offset;
-      else
-        pack.prim_index[i] += objects[pack.prim_object[i]]->mesh->tri_offset;
-    }
-
-  /* track offsets of instanced BVH data in global array */
-  size_t prim_offset = pack.prim_index.size();
-  size_t nodes_offset = nodes_size;
-  size_t nodes_leaf_offset = leaf_nodes_size;
-
-  /* clear array that gives the node indexes for instanced objects */
-  pack.object_node.clear();
-
-  /* reserve */
-  size_t prim_index_size = pack.prim_index.size();
-  size_t prim_tri_verts_size = pack.prim_tri_verts.size();
-
-  size_t pack_prim_index_offset = prim_index_size;
-  size_t pack_prim_tri_verts_offset = prim_tri_verts_size;
-  size_t pack_nodes_offset = nodes_size;
-  size_t pack_leaf_nodes_offset = leaf_nodes_size;
-  size_t object_offset = 0;
-
-  foreach (Mesh *mesh, meshes) {
-    BVH *bvh = mesh->bvh;
-
-    if (mesh->need_build_bvh(params.bvh_layout)) {
-      prim_index_size += bvh->pack.prim_index.size();
-      prim_tri_verts_size += bvh->pack.prim_tri_verts.size();
-      nodes_size += bvh->pack.nodes.size();
-      leaf_nodes_size += bvh->pack.leaf_nodes.size();
-    }
-  }
-
-  pack.prim_index.resize(prim_index_size);
-  pack.prim_type.resize(prim_index_size);
-  pack.prim_object.resize(prim_index_size);
-  pack.prim_visibility.resize(prim_index_size);
-  pack.prim_tri_verts.resize(prim_tri_verts_size);
-  pack.prim_tri_index.resize(prim_index_size);
-  pack.nodes.resize(nodes_size);
-  pack.leaf_nodes.resize(leaf_nodes_size);
-  pack.object_node.resize(objects.size());
-
-  if (params.num_motion_curve_steps > 0 || params.num_motion_triangle_steps > 0) {
-    pack.prim_time.resize(prim_index_size);
-  }
-
-  int *pack_prim_index = (pack.prim_index.size()) ? &pack.prim_index[0] : NULL;
-  int *pack_prim_type = (pack.prim_type.size()) ? &pack.prim_type[0] : NULL;
-  int *pack_prim_object = (pack.prim_object.size()) ? &pack.prim_object[0] : NULL;
-  uint *pack_prim_visibility = (pack.prim_visibility.size()) ? &pack.prim_visibility[0] : NULL;
-  float4 *pack_prim_tri_verts = (pack.prim_tri_verts.size()) ? &pack.prim_tri_verts[0] : NULL;
-  uint *pack_prim_tri_index = (pack.prim_tri_index.size()) ? &pack.prim_tri_index[0] : NULL;
-  int4 *pack_nodes = (pack.nodes.size()) ? &pack.nodes[0] : NULL;
-  int4 *pack_leaf_nodes = (pack.leaf_nodes.size()) ? &pack.leaf_nodes[0] : NULL;
-  float2 *pack_prim_time = (pack.prim_time.size()) ? &pack.prim_time[0] : NULL;
-
-  map<Mesh *, int> mesh_map;
-
-  /* merge */
-  foreach (Object *ob, objects) {
-    Mesh *mesh = ob->mesh;
-
-    /* We assume that if mesh doesn't need own BVH it was already included
-     * into a top-level BVH and no packing here is needed.
-     */
-    if (!mesh->need_build_bvh(params.bvh_layout)) {
-      pack.object_node[object_offset++] = 0;
-      continue;
-    }
-
-    /* if mesh already added once, don't add it again, but used set
-     * node offset for this object */
-    map<Mesh *, int>::iterator it = mesh_map.find(mesh);
-
-    if (mesh_map.find(mesh) != mesh_map.end()) {
-      int noffset = it->second;
-      pack.object_node[object_offset++] = noffset;
-      continue;
-    }
+  const bool use_obvh = (params.bvh_layout & (BVH_LAYOUT_BVH8 | BVH_LAYOUT_BVH8_QUANTIZED)) != 0;
+
+  const int prim_offset = offsets.prims;
+  const int noffset = offsets.nodes;
+  const int noffset_leaf = offsets.leaf_nodes;
+
+  /* merge primitive, object and triangle indexes */
+  const size_t prim_index_size = pack.prim_index.size();
+  if (prim_index_size) {
+    int *pack_prim_index = dscene->prim_index.data() + prim_offset;
+    int *pack_prim_type = dscene->prim_type.data() + prim_offset;
+    int *pack_prim_object = dscene->prim_object.data() + prim_offset;
+    uint *pack_prim_visibility = dscene->prim_visibility.data() + prim_offset;
+    uint *pack_prim_tri_index = dscene->prim_tri_index.data() + prim_offset;
+    float2 *pack_prim_time = (dscene->prim_time.size() && pack.prim_time.size()) ?
+                                 dscene->prim_time.data() + prim_offset :
+                                 NULL;
+
+    for (size_t i = 0; i < prim_index_size; i++) {
+      const int pidx = pack.prim_index[i];
+
+      if (pidx == -1) {
+        pack_prim_index[i] = -1;
+        pack_prim_tri_index[i] = -1;
+      }
+      else {
+        /* Primitive index is local to the mesh, make it point to the primitive
+         * in the global array. Instance BVH's are built for a single mesh. */
+        const Mesh *mesh = (params.top_level) ? objects[pack.prim_object[i]]->mesh : meshes[0];
 
-    BVH *bvh = mesh->bvh;
-
-    int noffset = nodes_offset;
-    int noffset_leaf = nodes_leaf_offset;
-    int mesh_tri_offset = mesh->tri_offset;
-    int mesh_curve_offset = mesh->curve_offset;
-
-    /* fill in node indexes for instances */
-    if (bvh->pack.root_index == -1)
-      pack.object_node[object_offset++] = -noffset_leaf - 1;
-    else
-      pack.object_node[object_offset++] = noffset;
-
-    mesh_map[mesh] = pack.object_node[object_offset - 1];
-
-    /* merge primitive, object and triangle indexes */
-    if (bvh->pack.prim_index.size()) {
-      size_t bvh_prim_index_size = bvh->pack.prim_index.size();
-      int *bvh_prim_index = &bvh->pack.prim_index[0];
-      int *bvh_prim_type = &bvh->pack.prim_type[0];
-      uint *bvh_prim_visibility = &bvh->pack.prim_visibility[0];
-      uint *bvh_prim_tri_index = &bvh->pack.prim_tri_index[0];
-      float2 *bvh_prim_time = bvh->pack.prim_time.size() ? &bvh->pack.prim_time[0] : NULL;
-
-      for (size_t i = 0; i < bvh_prim_index_size; i++) {
-        if (bvh->pack.prim_type[i] & PRIMITIVE_ALL_CURVE) {
-          pack_prim_index[pack_prim_index_offset] = bvh_prim_index[i] + mesh_curve_offset;
-          pack_prim_tri_index[pack_prim_index_offset] = -1;
+        if (pack.prim_type[i] & PRIMITIVE_ALL_CURVE) {
+          pack_prim_index[i] = pidx + mesh->curve_offset;
+          pack_prim_tri_index[i] = -1;
         }
         else {
-          pack_prim_index[pack_prim_index_offset] = bvh_prim_index[i] + mesh_tri_offset;
-          pack_prim_tri_index[pack_prim_index_offset] = bvh_prim_tri_index[i] +
-                                                        pack_prim_tri_verts_offset;
+          pack_prim_index[i] = pidx + mesh->tri_offset;
+          pack_prim_tri_index[i] = (params.use_indexed_triangles) ?
+                                       -1 :
+                                       pack.prim_tri_index[i] + offsets.prim_tri_verts;
         }
+      }
 
-        pack_prim_type[pack_prim_index_offset] = bvh_prim_type[i];
-        pack_prim_visibility[pack_prim_index_offset] = bvh_prim_visibility[i];
-        pack_prim_object[pack_prim_index_offset] = 0;  // unused for instances
-        if (bvh_prim_time != NULL) {
-          pack_prim_time[pack_prim_index_offset] = bvh_prim_time[i];
-        }
-        pack_prim_index_offset++;
+      pack_prim_type[i] = pack.prim_type[i];
+      pack_prim_visibility[i] = pack.prim_visibility[i];
+      /* Unused for instances. */
+      pack_prim_object[i] = (params.top_level) ? pack.prim_object[i] : 0;
+      if (pack_prim_time != NULL) {
+        pack_prim_time[i] = pack.prim_time[i];
       }
     }
+  }
 
-    /* Merge triangle vertices data. */
-    if (bvh->pack.prim_tri_verts.size()) {
-      const size_t prim_tri_size = bvh->pack.prim_tri_verts.size();
-      memcpy(pack_prim_tri_verts + pack_prim_tri_verts_offset,
-             &bvh->pack.prim_tri_verts[0],
-             prim_tri_size * sizeof(float4));
-      pack_prim_tri_verts_offset += prim_tri_size;
-    }
+  /* Merge triangle vertices data. */
+  if (pack.prim_tri_verts.size()) {
+    memcpy(dscene->prim_tri_verts.data() + offsets.prim_tri_verts,
+           &pack.prim_tri_verts[0],
+           pack.prim_tri_verts.size() * sizeof(float4));
+  }
 
-    /* merge nodes */
-    if (bvh->pack.leaf_nodes.size()) {
-      int4 *leaf_nodes_offset = &bvh->pack.leaf_nodes[0];
-      size_t leaf_nodes_offset_size = bvh->pack.leaf_nodes.size();
-      for (size_t i = 0, j = 0; i < leaf_nodes_offset_size; i += BVH_NODE_LEAF_SIZE, j++) {
-        int4 data = leaf_nodes_offset[i];
-        data.x += prim_offset;
-        data.y += prim_offset;
-        pack_leaf_nodes[pack_leaf_nodes_offset] = data;
-        for (int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
-          pack_leaf_nodes[pack_leaf_nodes_offset + j] = leaf_nodes_offset[i + j];
-        }
-        pack_leaf_nodes_offset += BVH_NODE_LEAF_SIZE;
+  /* merge nodes */
+  if (pack.leaf_nodes.size()) {
+    int4 *pack_leaf_nodes = dscene->bvh_leaf_nodes.data() + noffset_leaf;
+    const size_t leaf_nodes_size = pack.leaf_nodes.size();
+
+    for (size_t i = 0; i < leaf_nodes_size; i += BVH_NODE_LEAF_SIZE) {
+      int4 data = pack.leaf_nodes[i];
+      data.x += prim_offset;
+      data.y += prim_offset;
+      pack_leaf_nodes[i] = data;
+      for (int j = 1; j < BVH_NODE_LEAF_SIZE; ++j) {
+        pack_leaf_nodes[i + j] = pack.leaf_nodes[i + j];
       }
     }
+  }
 
-    if (bvh->pack.nodes.size()) {
-      int4 *bvh_nodes = &bvh->pack.nodes[0];
-      size_t bvh_nodes_size = bvh->pack.nodes.size();
+  if (pack.nodes.size()) {
+    int4 *pack_nodes = dscene->bvh_nodes.data() + noffset;
+    const int4 *bvh_nodes = &pack.nodes[0];
+    const size_t bvh_nodes_size = pack.nodes.size();
 
-      for (size_t i = 0, j = 0; i < bvh_nodes_size; j++) {
-        size_t nsize, nsize_bbox;
-        if (bvh_nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
-          if (use_obvh) {
-            nsize = BVH_UNALIGNED_ONODE_SIZE;
-            nsize_bbox = BVH_UNALIGNED_ONODE_SIZE - 1;
-          }
-          else {
-            nsize = use_qbvh ? BVH_UNALIGNED_QNODE_SIZE : BVH_UNALIGNED_NODE_SIZE;
-            nsize_bbox = (use_qbvh) ? BVH_UNALIGNED_QNODE_SIZE - 1 : 0;
-          }
+    for (size_t i = 0; i < bvh_nodes_size;) {
+      size_t nsize, nsize_bbox;
+      if (bvh_nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
+        if (use_obvh) {
+          nsize = BVH_UNALIGNED_ONODE_SIZE;
+          nsize_bbox = BVH_UNALIGNED_ONODE_SIZE - 1;
         }
         else {
-          if (use_obvh) {
-            nsize = BVH_ONODE_SIZE;
-            nsize_bbox = BVH_ONODE_SIZE - 1;
-          }
-          else {
-            nsize = (use_qbvh) ? BVH_QNODE_SIZE : BVH_NODE_SIZE;
-            nsize_bbox = (use_qbvh) ? BVH_QNODE_SIZE - 1 : 0;
-          }
+          nsize = use_qbvh ? BVH_UNALIGNED_QNODE_SIZE : BVH_UNALIGNED_NODE_SIZE;
+          nsize_bbox = (use_qbvh) ? BVH_UNALIGNED_QNODE_SIZE - 1 : 0;
         }
-
-        memcpy(pack_nodes + pack_nodes_offset, bvh_nodes + i, nsize_bbox * sizeof(int4));
-
-        /* Modify offsets into arrays */
-        int4 data = bvh_nodes[i + nsize_bbox];
-        int4 data1 = bvh_nodes[i + nsize_bbox - 1];
+      }
+      else {
         if (use_obvh) {
-          data.z += (data.z < 0) ? -noffset_leaf : noffset;
-          data.w += (data.w < 0) ? -noffset_leaf : noffset;
-          data.x += (data.x < 0) ? -noffset_leaf : noffset;
-          data.y += (data.y < 0) ? -noffset_leaf : noffset;
-          data1.z += (data1.z < 0) ? -noffset_leaf : noffset;
-          data1.w += (data1.w < 0) ? -noffset_leaf : noffset;
-          data1.x += (data1.x < 0) ? -noffset_leaf : noffset;
-          data1.y += (data1.y < 0) ? -noffset_leaf : noffset;
+          nsize = (params.bvh_layout == BVH_LAYOUT_BVH8_QUANTIZED) ? BVH_QUANTIZED_ONODE_SIZE :
+                                                                     BVH_ONODE_SIZE;
+          nsize_bbox = nsize - 1;
         }
         else {
-          data.z += (data.z < 0) ? -noffset_leaf : noffset;
-          data.w += (data.w < 0) ? -noffset_leaf : noffset;
-          if (use_qbvh) {
-            data.x += (data.x < 0) ? -noffset_leaf : noffset;
-            data.y += (data.y < 0) ? -noffset_leaf : noffset;
-          }
-        }
-        pack_nodes[pack_nodes_offset + nsize_bbox] = data;
-        if (use_obvh) {
-          pack_nodes[pack_nodes_offset + nsize_bbox - 1] = data1;
+          nsize = (use_qbvh) ? BVH_QNODE_SIZE : BVH_NODE_SIZE;
+          nsize_bbox = (use_qbvh) ? BVH_QNODE_SIZE - 1 : 0;
         }
+      }
 
-        /* Usually this copies nothing, but we better
-         * be prepared for possible node size extension.
-         */
-        memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox + 1],
-               &bvh_nodes[i + nsize_bbox + 1],
-               sizeof(int4) * (nsize - (nsize_bbox + 1)));
+      memcpy(pack_nodes + i, bvh_nodes + i, nsize_bbox * sizeof(int4));
 
-        pack_nodes_offset += nsize;
-        i += nsize;
+      /* Modify offsets into arrays */
+      int4 data = bvh_nodes[i + nsize_bbox];
+      data.z += (data.z < 0) ? -noffset_leaf : noffset;
+      data.w += (data.w < 0) ? -noffset_leaf : noffset;
+      if (use_qbvh || use_obvh) {
+        data.x += (data.x < 0) ? -noffset_leaf : noffset;
+        data.y += (data.y < 0) ? -noffset_leaf : noffset;
       }
+      pack_nodes[i + nsize_bbox] = data;
+
+      if (use_obvh) {
+        int4 data1 = bvh_nodes[i + nsize_bbox - 1];
+        data1.z += (data1.z < 0) ? -noffset_leaf : noffset;
+        data1.w += (data1.w < 0) ? -noffset_leaf : noffset;
+        data1.x += (data1.x < 0) ? -noffset_leaf : noffset;
+        data1.y += (data1.y < 0) ? -noffset_leaf : noffset;
+        pack_nodes[i + nsize_bbox - 1] = data1;
+      }
+
+      /* Usually this copies nothing, but we better
+       * be prepared for possible node size extension.
+       */
+      memcpy(&pack_nodes[i + nsize_bbox + 1],
+             &bvh_nodes[i + nsize_bbox + 1],
+             sizeof(int4) * (nsize - (nsize_bbox + 1)));
+
+      i += nsize;
     }
+  }
+}
 
-    nodes_offset += bvh->pack.nodes.size();
-    nodes_leaf_offset += bvh->pack.leaf_nodes.size();
-    prim_offset += bvh->pack.prim_index.size();
+int BVH::global_root_index(const PackedBVHOffsets &offsets) const
+{
+  if (pack.root_index == -1) {
+    return -(int)offsets.leaf_nodes - 1;
   }
+  return (int)offsets.nodes + pack.root_index;
 }
 
 CCL_NAMESPACE_END
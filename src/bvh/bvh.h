@@ -20,6 +20,7 @@
 
 #include "bvh/bvh_params.h"
 #include "util/util_array.h"
+#include "util/util_boundbox.h"
 #include "util/util_types.h"
 #include "util/util_vector.h"
 
@@ -31,7 +32,6 @@ class DeviceScene;
 class BVHNode;
 struct BVHStackEntry;
 class BVHParams;
-class BoundBox;
 class LeafNode;
 class Mesh;
 class Object;
@@ -76,6 +76,28 @@ struct PackedBVH {
   }
 };
 
+/* Offsets into the global arrays used for traversal, where the BVH's of all
+ * instanced meshes are stored first, followed by the top level BVH. */
+
+struct PackedBVHOffsets {
+  size_t prims;
+  size_t prim_tri_verts;
+  size_t nodes;
+  size_t leaf_nodes;
+
+  PackedBVHOffsets() : prims(0), prim_tri_verts(0), nodes(0), leaf_nodes(0)
+  {
+  }
+
+  void add(const PackedBVH &pack)
+  {
+    prims += pack.prim_index.size();
+    prim_tri_verts += pack.prim_tri_verts.size();
+    nodes += pack.nodes.size();
+    leaf_nodes += pack.leaf_nodes.size();
+  }
+};
+
 enum BVH_TYPE { bvh2, bvh4, bvh8 };
 
 /* BVH */
@@ -101,24 +123,36 @@ class BVH {
 
   void refit(Progress &progress);
 
+  /* Copy into the global arrays at the given offsets, adjusting node, primitive
+   * and triangle indices. The arrays must already be large enough. */
+  void pack_global(DeviceScene *dscene, const PackedBVHOffsets &offsets);
+
+  /* Index of the root node once packed into the global arrays, as used for the
+   * scene root and for the object to node mapping of instances. */
+  int global_root_index(const PackedBVHOffsets &offsets) const;
+
  protected:
   BVH(const BVHParams &params, const vector<Mesh *> &meshes, const vector<Object *> &objects);
 
   /* Refit range of primitives. */
   void refit_primitives(int start, int end, BoundBox &bbox, uint &visibility);
 
+  /* Compute bounds of all primitives in parallel, ahead of refitting the nodes. */
+  void refit_primitive_bounds();
+  void refit_primitive_bounds_range(size_t start, size_t end);
+
   /* triangles and strands */
   void pack_primitives();
   void pack_triangle(int idx, float4 storage[3]);
 
-  /* merge instance BVH's */
-  void pack_instances(size_t nodes_size, size_t leaf_nodes_size);
-
   /* for subclasses to implement */
   virtual void pack_nodes(const BVHNode *root) = 0;
   virtual void refit_nodes() = 0;
 
   virtual BVHNode *widen_children_nodes(const BVHNode *root) = 0;
+
+  /* Primitive bounds used while refitting. */
+  vector<BoundBox> prim_bounds;
 };
 
 /* Pack Utility */
@@ -115,6 +115,40 @@ BVHNode *bvh_node_merge_children_recursively(const BVHNode *node)
   return node8;
 }
 
+/* Power of two scale for quantized bounds, so that 255 steps from the origin
+ * cover the node bounds and decoding multiplies exactly. */
+float bvh_quantized_scale(float origin, float extent, float bounds_max)
+{
+  int exponent;
+  frexpf(extent / 255.0f, &exponent);
+  /* Avoid denormals, which are flushed to zero when rendering. */
+  float scale = ldexpf(1.0f, max(exponent, -100));
+  while (origin + 255.0f * scale < bounds_max) {
+    scale *= 2.0f;
+  }
+  return scale;
+}
+
+/* Quantize plane of a child box, rounding down for the lower bound and up for
+ * the upper bound, so the decoded box always contains the original one. */
+uchar bvh_quantize_plane(float value, float origin, float scale, bool round_up)
+{
+  if (round_up) {
+    int q = clamp((int)ceilf((value - origin) / scale), 0, 255);
+    while (q < 255 && origin + q * scale < value) {
+      q++;
+    }
+    return (uchar)q;
+  }
+  else {
+    int q = clamp((int)floorf((value - origin) / scale), 0, 255);
+    while (q > 0 && origin + q * scale > value) {
+      q--;
+    }
+    return (uchar)q;
+  }
+}
+
 }  // namespace
 
 BVHNode *BVH8::widen_children_nodes(const BVHNode *root)
@@ -199,6 +233,11 @@ void BVH8::pack_aligned_node(int idx,
                              const float time_to,
                              const int num)
 {
+  if (params.bvh_layout == BVH_LAYOUT_BVH8_QUANTIZED) {
+    pack_quantized_node(idx, bounds, child, visibility, time_from, time_to, num);
+    return;
+  }
+
   float8 data[8];
   memset(data, 0, sizeof(data));
 
@@ -239,6 +278,89 @@ void BVH8::pack_aligned_node(int idx,
   memcpy(&pack.nodes[idx], data, sizeof(float4) * BVH_ONODE_SIZE);
 }
 
+void BVH8::pack_quantized_node(int idx,
+                               const BoundBox *bounds,
+                               const int *child,
+                               const uint visibility,
+                               const float time_from,
+                               const float time_to,
+                               const int num)
+{
+  float4 data[BVH_QUANTIZED_ONODE_SIZE];
+  memset(data, 0, sizeof(data));
+
+  data[0].x = __uint_as_float(visibility & ~PATH_RAY_NODE_UNALIGNED);
+  data[0].y = time_from;
+  data[0].z = time_to;
+
+  BoundBox node_bounds = BoundBox::empty;
+  for (int i = 0; i < num; i++) {
+    if (bounds[i].valid()) {
+      node_bounds.grow(bounds[i]);
+    }
+  }
+  if (!node_bounds.valid()) {
+    node_bounds = BoundBox(make_float3(0.0f, 0.0f, 0.0f));
+  }
+
+  const float3 origin = node_bounds.min;
+  const float3 extent = node_bounds.size();
+  float3 scale;
+  for (int axis = 0; axis < 3; axis++) {
+    scale[axis] = bvh_quantized_scale(origin[axis], extent[axis], node_bounds.max[axis]);
+  }
+  data[1] = float3_to_float4(origin);
+  data[5] = float3_to_float4(scale);
+
+  /* Planes in the order min_x, max_x, min_y, max_y, min_z, max_z. */
+  uchar *planes = (uchar *)&data[2];
+  float *children = (float *)&data[6];
+
+  for (int i = 0; i < 8; i++) {
+    if (i < num && bounds[i].valid()) {
+      for (int axis = 0; axis < 3; axis++) {
+        planes[(axis * 2 + 0) * 8 + i] = bvh_quantize_plane(
+            bounds[i].min[axis], origin[axis], scale[axis], false);
+        planes[(axis * 2 + 1) * 8 + i] = bvh_quantize_plane(
+            bounds[i].max[axis], origin[axis], scale[axis], true);
+      }
+    }
+    else {
+      /* Inverted box which is never recorded as intersection. */
+      for (int axis = 0; axis < 3; axis++) {
+        planes[(axis * 2 + 0) * 8 + i] = 255;
+        planes[(axis * 2 + 1) * 8 + i] = 0;
+      }
+    }
+
+    children[i] = __int_as_float((i < num) ? child[i] : 0);
+  }
+
+  memcpy(&pack.nodes[idx], data, sizeof(float4) * BVH_QUANTIZED_ONODE_SIZE);
+}
+
+int BVH8::aligned_node_size() const
+{
+  return (params.bvh_layout == BVH_LAYOUT_BVH8_QUANTIZED) ? BVH_QUANTIZED_ONODE_SIZE :
+                                                             BVH_ONODE_SIZE;
+}
+
+size_t BVH8::full_precision_nodes_size(const int4 *nodes, size_t size)
+{
+  size_t full_precision_size = 0;
+  for (size_t i = 0; i < size;) {
+    if (nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
+      i += BVH_UNALIGNED_ONODE_SIZE;
+      full_precision_size += BVH_UNALIGNED_ONODE_SIZE;
+    }
+    else {
+      i += BVH_QUANTIZED_ONODE_SIZE;
+      full_precision_size += BVH_ONODE_SIZE;
+    }
+  }
+  return full_precision_size * sizeof(int4);
+}
+
 void BVH8::pack_unaligned_inner(const BVHStackEntry &e, const BVHStackEntry *en, int num)
 {
   Transform aligned_space[8];
@@ -337,22 +459,16 @@ void BVH8::pack_nodes(const BVHNode *root)
   if (params.use_unaligned_nodes) {
     const size_t num_unaligned_nodes = root->getSubtreeSize(BVH_STAT_UNALIGNED_INNER_COUNT);
     node_size = (num_unaligned_nodes * BVH_UNALIGNED_ONODE_SIZE) +
-                (num_inner_nodes - num_unaligned_nodes) * BVH_ONODE_SIZE;
+                (num_inner_nodes - num_unaligned_nodes) * aligned_node_size();
   }
   else {
-    node_size = num_inner_nodes * BVH_ONODE_SIZE;
+    node_size = num_inner_nodes * aligned_node_size();
   }
   /* Resize arrays. */
   pack.nodes.clear();
   pack.leaf_nodes.clear();
-  /* For top level BVH, first merge existing BVH's so we know the offsets. */
-  if (params.top_level) {
-    pack_instances(node_size, num_leaf_nodes * BVH_ONODE_LEAF_SIZE);
-  }
-  else {
-    pack.nodes.resize(node_size);
-    pack.leaf_nodes.resize(num_leaf_nodes * BVH_ONODE_LEAF_SIZE);
-  }
+  pack.nodes.resize(node_size);
+  pack.leaf_nodes.resize(num_leaf_nodes * BVH_ONODE_LEAF_SIZE);
 
   int nextNodeIdx = 0, nextLeafNodeIdx = 0;
 
@@ -363,7 +479,7 @@ void BVH8::pack_nodes(const BVHNode *root)
   }
   else {
     stack.push_back(BVHStackEntry(root, nextNodeIdx));
-    nextNodeIdx += root->has_unaligned() ? BVH_UNALIGNED_ONODE_SIZE : BVH_ONODE_SIZE;
+    nextNodeIdx += root->has_unaligned() ? BVH_UNALIGNED_ONODE_SIZE : aligned_node_size();
   }
 
   while (stack.size()) {
@@ -389,7 +505,8 @@ void BVH8::pack_nodes(const BVHNode *root)
         }
         else {
           idx = nextNodeIdx;
-          nextNodeIdx += children[i]->has_unaligned() ? BVH_UNALIGNED_ONODE_SIZE : BVH_ONODE_SIZE;
+          nextNodeIdx += children[i]->has_unaligned() ? BVH_UNALIGNED_ONODE_SIZE :
+                                                        aligned_node_size();
         }
         stack.push_back(BVHStackEntry(children[i], idx));
       }
@@ -405,11 +522,13 @@ void BVH8::pack_nodes(const BVHNode *root)
 
 void BVH8::refit_nodes()
 {
-  assert(!params.top_level);
+  refit_primitive_bounds();
 
   BoundBox bbox = BoundBox::empty;
   uint visibility = 0;
   refit_node(0, (pack.root_index == -1) ? true : false, bbox, visibility);
+
+  prim_bounds.clear();
 }
 
 void BVH8::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
@@ -418,71 +537,7 @@ void BVH8::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     int4 *data = &pack.leaf_nodes[idx];
     int4 c = data[0];
     /* Refit leaf node. */
-    for (int prim = c.x; prim < c.y; prim++) {
-      int pidx = pack.prim_index[prim];
-      int tob = pack.prim_object[prim];
-      Object *ob = objects[tob];
-
-      if (pidx == -1) {
-        /* Object instance. */
-        bbox.grow(ob->bounds);
-      }
-      else {
-        /* Primitives. */
-        const Mesh *mesh = ob->mesh;
-
-        if (pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-          /* Curves. */
-          int str_offset = (params.top_level) ? mesh->curve_offset : 0;
-          Mesh::Curve curve = mesh->get_curve(pidx - str_offset);
-          int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-          curve.bounds_grow(k, &mesh->curve_keys[0], &mesh->curve_radius[0], bbox);
-
-          visibility |= PATH_RAY_CURVE;
-
-          /* Motion curves. */
-          if (mesh->use_motion_blur) {
-            Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-            if (attr) {
-              size_t mesh_size = mesh->curve_keys.size();
-              size_t steps = mesh->motion_steps - 1;
-              float3 *key_steps = attr->data_float3();
-
-              for (size_t i = 0; i < steps; i++) {
-                curve.bounds_grow(k, key_steps + i * mesh_size, &mesh->curve_radius[0], bbox);
-              }
-            }
-          }
-        }
-        else {
-          /* Triangles. */
-          int tri_offset = (params.top_level) ? mesh->tri_offset : 0;
-          Mesh::Triangle triangle = mesh->get_triangle(pidx - tri_offset);
-          const float3 *vpos = &mesh->verts[0];
-
-          triangle.bounds_grow(vpos, bbox);
-
-          /* Motion triangles. */
-          if (mesh->use_motion_blur) {
-            Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-            if (attr) {
-              size_t mesh_size = mesh->verts.size();
-              size_t steps = mesh->motion_steps - 1;
-              float3 *vert_steps = attr->data_float3();
-
-              for (size_t i = 0; i < steps; i++) {
-                triangle.bounds_grow(vert_steps + i * mesh_size, bbox);
-              }
-            }
-          }
-        }
-      }
-
-      visibility |= ob->visibility;
-    }
+    BVH::refit_primitives(c.x, c.y, bbox, visibility);
 
     float4 leaf_data[BVH_ONODE_LEAF_SIZE];
     leaf_data[0].x = __int_as_float(c.x);
@@ -508,7 +563,8 @@ void BVH8::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     int num_nodes = 0;
 
     for (int i = 0; i < 8; ++i) {
-      child[i] = __float_as_int(data[(is_unaligned) ? 13 : 7][i]);
+      const int child_offset = (is_unaligned) ? 13 : aligned_node_size() / 2 - 1;
+      child[i] = __float_as_int(data[child_offset][i]);
 
       if (child[i] != 0) {
         refit_node((child[i] < 0) ? -child[i] - 1 : child[i],
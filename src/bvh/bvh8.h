@@ -48,12 +48,22 @@ class Progress;
 #define BVH_ONODE_SIZE 16
 #define BVH_ONODE_LEAF_SIZE 1
 #define BVH_UNALIGNED_ONODE_SIZE 28
+#define BVH_QUANTIZED_ONODE_SIZE 8
 
 /* BVH8
  *
  * Octo BVH, with each node having eight children, to use with SIMD instructions.
+ *
+ * With the BVH8_QUANTIZED layout, bounds of children of aligned nodes are stored
+ * with 8 bits per plane relative to the node bounds, which halves the size of
+ * those nodes. Unaligned nodes are kept at full precision.
  */
 class BVH8 : public BVH {
+ public:
+  /* Size of packed inner nodes with full precision bounds, to report the memory
+   * saved by quantized nodes. */
+  static size_t full_precision_nodes_size(const int4 *nodes, size_t size);
+
  protected:
   /* constructor */
   friend class BVH;
@@ -76,6 +86,14 @@ class BVH8 : public BVH {
                          const float time_from,
                          const float time_to,
                          const int num);
+  void pack_quantized_node(int idx,
+                           const BoundBox *bounds,
+                           const int *child,
+                           const uint visibility,
+                           const float time_from,
+                           const float time_to,
+                           const int num);
+  int aligned_node_size() const;
 
   void pack_unaligned_inner(const BVHStackEntry &e, const BVHStackEntry *en, int num);
   void pack_unaligned_node(int idx,
@@ -23,7 +23,9 @@
 
 #include "util/util_algorithm.h"
 #include "util/util_boundbox.h"
+#include "util/util_task.h"
 #include "util/util_types.h"
+#include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -96,74 +98,39 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   num_bins = min(size_t(MAX_BINS), size_t(4.0f + 0.05f * size()));
   scale = rcp(cent_bounds_.size()) * make_float3((float)num_bins);
 
-  /* initialize binning counter and bounds */
-  BoundBox bin_bounds[MAX_BINS][4]; /* bounds for every bin in every dimension */
-  int4 bin_count[MAX_BINS];         /* number of primitives mapped to bin */
+  /* map geometry to bins */
+  Bins bins;
 
-  for (size_t i = 0; i < num_bins; i++) {
-    bin_count[i] = make_int4(0);
-    bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
-  }
+  if (size() >= PARALLEL_MIN_SIZE) {
+    const size_t num_chunks = divide_up(size(), PARALLEL_CHUNK_SIZE);
+    vector<Bins> chunk_bins(num_chunks);
 
-  /* map geometry to bins, unrolled once */
-  {
-    ssize_t i;
-
-    for (i = 0; i < ssize_t(size()) - 1; i += 2) {
-      prefetch_L2(&prims[start() + i + 8]);
-
-      /* map even and odd primitive to bin */
-      const BVHReference &prim0 = prims[start() + i + 0];
-      const BVHReference &prim1 = prims[start() + i + 1];
-
-      BoundBox bounds0 = get_prim_bounds(prim0);
-      BoundBox bounds1 = get_prim_bounds(prim1);
-
-      int4 bin0 = get_bin(bounds0);
-      int4 bin1 = get_bin(bounds1);
-
-      /* increase bounds for bins for even primitive */
-      int b00 = (int)extract<0>(bin0);
-      bin_count[b00][0]++;
-      bin_bounds[b00][0].grow(bounds0);
-      int b01 = (int)extract<1>(bin0);
-      bin_count[b01][1]++;
-      bin_bounds[b01][1].grow(bounds0);
-      int b02 = (int)extract<2>(bin0);
-      bin_count[b02][2]++;
-      bin_bounds[b02][2].grow(bounds0);
-
-      /* increase bounds of bins for odd primitive */
-      int b10 = (int)extract<0>(bin1);
-      bin_count[b10][0]++;
-      bin_bounds[b10][0].grow(bounds1);
-      int b11 = (int)extract<1>(bin1);
-      bin_count[b11][1]++;
-      bin_bounds[b11][1].grow(bounds1);
-      int b12 = (int)extract<2>(bin1);
-      bin_count[b12][2]++;
-      bin_bounds[b12][2].grow(bounds1);
+    TaskPool pool;
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+      const size_t begin = start() + chunk * PARALLEL_CHUNK_SIZE;
+      const size_t end = min(begin + PARALLEL_CHUNK_SIZE, (size_t)this->end());
+      pool.push(function_bind(
+                    &BVHObjectBinning::bin_primitives, this, prims, begin, end, &chunk_bins[chunk]),
+                true);
     }
-
-    /* for uneven number of primitives */
-    if (i < ssize_t(size())) {
-      /* map primitive to bin */
-      const BVHReference &prim0 = prims[start() + i];
-      BoundBox bounds0 = get_prim_bounds(prim0);
-      int4 bin0 = get_bin(bounds0);
-
-      /* increase bounds of bins */
-      int b00 = (int)extract<0>(bin0);
-      bin_count[b00][0]++;
-      bin_bounds[b00][0].grow(bounds0);
-      int b01 = (int)extract<1>(bin0);
-      bin_count[b01][1]++;
-      bin_bounds[b01][1].grow(bounds0);
-      int b02 = (int)extract<2>(bin0);
-      bin_count[b02][2]++;
-      bin_bounds[b02][2].grow(bounds0);
+    pool.wait_work();
+
+    bins = chunk_bins[0];
+    for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+      for (size_t i = 0; i < num_bins; i++) {
+        bins.count[i] = bins.count[i] + chunk_bins[chunk].count[i];
+        for (int dim = 0; dim < 3; dim++) {
+          bins.bounds[i][dim] = merge(bins.bounds[i][dim], chunk_bins[chunk].bounds[i][dim]);
+        }
+      }
     }
   }
+  else {
+    bin_primitives(prims, start(), end(), &bins);
+  }
+
+  int4 *bin_count = bins.count;
+  BoundBox(*bin_bounds)[4] = bins.bounds;
 
   /* sweep from right to left and compute parallel prefix of merged bounds */
   float4 r_area[MAX_BINS];  /* area of bounds of primitives on the right */
@@ -226,54 +193,235 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   leafSAH = bounds_.half_area() * blocks(size());
 }
 
-void BVHObjectBinning::split(BVHReference *prims,
-                             BVHObjectBinning &left_o,
-                             BVHObjectBinning &right_o) const
+void BVHObjectBinning::bin_primitives(const BVHReference *prims,
+                                      size_t begin,
+                                      size_t end,
+                                      Bins *bins) const
 {
-  size_t N = size();
+  /* initialize binning counter and bounds */
+  BoundBox(*bin_bounds)[4] = bins->bounds; /* bounds for every bin in every dimension */
+  int4 *bin_count = bins->count;           /* number of primitives mapped to bin */
 
-  BoundBox lgeom_bounds = BoundBox::empty;
-  BoundBox rgeom_bounds = BoundBox::empty;
-  BoundBox lcent_bounds = BoundBox::empty;
-  BoundBox rcent_bounds = BoundBox::empty;
+  for (size_t i = 0; i < num_bins; i++) {
+    bin_count[i] = make_int4(0);
+    bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
+  }
+
+  /* map geometry to bins, unrolled once */
+  ssize_t i;
+
+  for (i = begin; i < ssize_t(end) - 1; i += 2) {
+    prefetch_L2(&prims[i + 8]);
+
+    /* map even and odd primitive to bin */
+    const BVHReference &prim0 = prims[i + 0];
+    const BVHReference &prim1 = prims[i + 1];
+
+    BoundBox bounds0 = get_prim_bounds(prim0);
+    BoundBox bounds1 = get_prim_bounds(prim1);
+
+    int4 bin0 = get_bin(bounds0);
+    int4 bin1 = get_bin(bounds1);
+
+    /* increase bounds for bins for even primitive */
+    int b00 = (int)extract<0>(bin0);
+    bin_count[b00][0]++;
+    bin_bounds[b00][0].grow(bounds0);
+    int b01 = (int)extract<1>(bin0);
+    bin_count[b01][1]++;
+    bin_bounds[b01][1].grow(bounds0);
+    int b02 = (int)extract<2>(bin0);
+    bin_count[b02][2]++;
+    bin_bounds[b02][2].grow(bounds0);
+
+    /* increase bounds of bins for odd primitive */
+    int b10 = (int)extract<0>(bin1);
+    bin_count[b10][0]++;
+    bin_bounds[b10][0].grow(bounds1);
+    int b11 = (int)extract<1>(bin1);
+    bin_count[b11][1]++;
+    bin_bounds[b11][1].grow(bounds1);
+    int b12 = (int)extract<2>(bin1);
+    bin_count[b12][2]++;
+    bin_bounds[b12][2].grow(bounds1);
+  }
+
+  /* for uneven number of primitives */
+  if (i < ssize_t(end)) {
+    /* map primitive to bin */
+    const BVHReference &prim0 = prims[i];
+    BoundBox bounds0 = get_prim_bounds(prim0);
+    int4 bin0 = get_bin(bounds0);
+
+    /* increase bounds of bins */
+    int b00 = (int)extract<0>(bin0);
+    bin_count[b00][0]++;
+    bin_bounds[b00][0].grow(bounds0);
+    int b01 = (int)extract<1>(bin0);
+    bin_count[b01][1]++;
+    bin_bounds[b01][1].grow(bounds0);
+    int b02 = (int)extract<2>(bin0);
+    bin_count[b02][2]++;
+    bin_bounds[b02][2].grow(bounds0);
+  }
+}
 
-  ssize_t l = 0, r = N - 1;
+/* Partition primitives in the range so the ones left of the split come first,
+ * returning how many there are. */
+size_t BVHObjectBinning::partition(BVHReference *prims,
+                                   size_t begin,
+                                   size_t end,
+                                   SplitBounds *bounds) const
+{
+  ssize_t l = begin, r = end - 1;
 
   while (l <= r) {
-    prefetch_L2(&prims[start() + l + 8]);
-    prefetch_L2(&prims[start() + r - 8]);
+    prefetch_L2(&prims[l + 8]);
+    prefetch_L2(&prims[r - 8]);
 
-    BVHReference prim = prims[start() + l];
+    BVHReference prim = prims[l];
     BoundBox unaligned_bounds = get_prim_bounds(prim);
     float3 unaligned_center = unaligned_bounds.center2();
     float3 center = prim.bounds().center2();
 
     if (get_bin(unaligned_center)[dim] < pos) {
-      lgeom_bounds.grow(prim.bounds());
-      lcent_bounds.grow(center);
+      bounds->lgeom_bounds.grow(prim.bounds());
+      bounds->lcent_bounds.grow(center);
       l++;
     }
     else {
-      rgeom_bounds.grow(prim.bounds());
-      rcent_bounds.grow(center);
-      swap(prims[start() + l], prims[start() + r]);
+      bounds->rgeom_bounds.grow(prim.bounds());
+      bounds->rcent_bounds.grow(center);
+      swap(prims[l], prims[r]);
       r--;
     }
   }
+
+  return l - begin;
+}
+
+void BVHObjectBinning::partition_chunk(BVHReference *prims,
+                                       size_t begin,
+                                       size_t end,
+                                       size_t *num_left,
+                                       SplitBounds *bounds) const
+{
+  *num_left = partition(prims, begin, end, bounds);
+}
+
+static void swap_primitives(BVHReference *prims, size_t a, size_t b, size_t num)
+{
+  std::swap_ranges(prims + a, prims + a + num, prims + b);
+}
+
+size_t BVHObjectBinning::partition_parallel(BVHReference *prims, SplitBounds *bounds) const
+{
+  /* Partition every chunk in place first. */
+  const size_t num_chunks = divide_up(size(), PARALLEL_CHUNK_SIZE);
+  vector<size_t> chunk_left(num_chunks);
+  vector<SplitBounds> chunk_bounds(num_chunks);
+
+  TaskPool pool;
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    const size_t begin = start() + chunk * PARALLEL_CHUNK_SIZE;
+    const size_t end = min(begin + PARALLEL_CHUNK_SIZE, (size_t)this->end());
+    pool.push(function_bind(&BVHObjectBinning::partition_chunk,
+                            this,
+                            prims,
+                            begin,
+                            end,
+                            &chunk_left[chunk],
+                            &chunk_bounds[chunk]),
+              true);
+  }
+  pool.wait_work();
+
+  size_t num_left = 0;
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    num_left += chunk_left[chunk];
+    bounds->lgeom_bounds = merge(bounds->lgeom_bounds, chunk_bounds[chunk].lgeom_bounds);
+    bounds->rgeom_bounds = merge(bounds->rgeom_bounds, chunk_bounds[chunk].rgeom_bounds);
+    bounds->lcent_bounds = merge(bounds->lcent_bounds, chunk_bounds[chunk].lcent_bounds);
+    bounds->rcent_bounds = merge(bounds->rcent_bounds, chunk_bounds[chunk].rcent_bounds);
+  }
+
+  /* Find the runs of right primitives before the split position and of left
+   * primitives after it. Both have the same total size. */
+  const size_t mid = start() + num_left;
+  vector<size_t> right_begin, right_end, left_begin, left_end;
+
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    const size_t begin = start() + chunk * PARALLEL_CHUNK_SIZE;
+    const size_t end = min(begin + PARALLEL_CHUNK_SIZE, (size_t)this->end());
+    const size_t chunk_mid = begin + chunk_left[chunk];
+
+    if (chunk_mid < mid) {
+      right_begin.push_back(chunk_mid);
+      right_end.push_back(min(end, mid));
+    }
+    if (chunk_mid > mid) {
+      left_begin.push_back(max(begin, mid));
+      left_end.push_back(chunk_mid);
+    }
+  }
+
+  /* Swap them in parallel, in pieces that are contiguous in both runs. */
+  size_t r = 0, l = 0;
+  size_t r_pos = (r < right_begin.size()) ? right_begin[0] : 0;
+  size_t l_pos = (l < left_begin.size()) ? left_begin[0] : 0;
+
+  while (r < right_begin.size() && l < left_begin.size()) {
+    const size_t num = min(min(right_end[r] - r_pos, left_end[l] - l_pos),
+                           (size_t)PARALLEL_CHUNK_SIZE);
+    pool.push(function_bind(&swap_primitives, prims, r_pos, l_pos, num), true);
+
+    r_pos += num;
+    l_pos += num;
+    if (r_pos == right_end[r] && ++r < right_begin.size()) {
+      r_pos = right_begin[r];
+    }
+    if (l_pos == left_end[l] && ++l < left_begin.size()) {
+      l_pos = left_begin[l];
+    }
+  }
+  assert(r == right_begin.size() && l == left_begin.size());
+  pool.wait_work();
+
+  return num_left;
+}
+
+void BVHObjectBinning::split(BVHReference *prims,
+                             BVHObjectBinning &left_o,
+                             BVHObjectBinning &right_o) const
+{
+  size_t N = size();
+
+  SplitBounds bounds;
+  size_t num_left;
+
+  if (N >= PARALLEL_MIN_SIZE) {
+    num_left = partition_parallel(prims, &bounds);
+  }
+  else {
+    num_left = partition(prims, start(), end(), &bounds);
+  }
+
   /* finish */
-  if (l != 0 && N - 1 - r != 0) {
-    right_o = BVHObjectBinning(BVHRange(rgeom_bounds, rcent_bounds, start() + l, N - 1 - r),
-                               prims);
-    left_o = BVHObjectBinning(BVHRange(lgeom_bounds, lcent_bounds, start(), l), prims);
+  const size_t num_right = N - num_left;
+  if (num_left != 0 && num_right != 0) {
+    right_o = BVHObjectBinning(
+        BVHRange(bounds.rgeom_bounds, bounds.rcent_bounds, start() + num_left, num_right), prims);
+    left_o = BVHObjectBinning(
+        BVHRange(bounds.lgeom_bounds, bounds.lcent_bounds, start(), num_left), prims);
     return;
   }
 
   /* object medium split if we did not make progress, can happen when all
    * primitives have same centroid */
-  lgeom_bounds = BoundBox::empty;
-  rgeom_bounds = BoundBox::empty;
-  lcent_bounds = BoundBox::empty;
-  rcent_bounds = BoundBox::empty;
+  BoundBox lgeom_bounds = BoundBox::empty;
+  BoundBox rgeom_bounds = BoundBox::empty;
+  BoundBox lcent_bounds = BoundBox::empty;
+  BoundBox rcent_bounds = BoundBox::empty;
 
   for (size_t i = 0; i < N / 2; i++) {
     lgeom_bounds.grow(prims[start() + i].bounds());
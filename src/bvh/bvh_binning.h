@@ -27,12 +27,15 @@ CCL_NAMESPACE_BEGIN
 
 class BVHBuild;
 
-/* Single threaded object binner. Finds the split with the best SAH heuristic
- * by testing for each dimension multiple partitionings for regular spaced
- * partition locations. A partitioning for a partition location is computed,
- * by putting primitives whose centroid is on the left and right of the split
- * location to different sets. The SAH is evaluated by computing the number of
- * blocks occupied by the primitives in the partitions. */
+/* Object binner. Finds the split with the best SAH heuristic by testing for
+ * each dimension multiple partitionings for regular spaced partition locations.
+ * A partitioning for a partition location is computed, by putting primitives
+ * whose centroid is on the left and right of the split location to different
+ * sets. The SAH is evaluated by computing the number of blocks occupied by the
+ * primitives in the partitions.
+ *
+ * Large ranges near the top of the hierarchy are binned and partitioned in
+ * parallel, before there are enough subtrees to build them in separate tasks. */
 
 class BVHObjectBinning : public BVHRange {
  public:
@@ -71,6 +74,44 @@ class BVHObjectBinning : public BVHRange {
   enum { MAX_BINS = 32 };
   enum { LOG_BLOCK_SIZE = 2 };
 
+  /* Ranges with at least this many primitives are binned and partitioned in
+   * parallel, in chunks of a fixed size so the result does not depend on the
+   * number of threads. */
+  enum { PARALLEL_MIN_SIZE = 65536 };
+  enum { PARALLEL_CHUNK_SIZE = 16384 };
+
+  /* Primitive count and bounds for every bin in every dimension. */
+  struct Bins {
+    BoundBox bounds[MAX_BINS][4];
+    int4 count[MAX_BINS];
+  };
+
+  /* Bounds of the primitives and their centroids on either side of a split. */
+  struct SplitBounds {
+    BoundBox lgeom_bounds;
+    BoundBox rgeom_bounds;
+    BoundBox lcent_bounds;
+    BoundBox rcent_bounds;
+
+    SplitBounds()
+        : lgeom_bounds(BoundBox::empty),
+          rgeom_bounds(BoundBox::empty),
+          lcent_bounds(BoundBox::empty),
+          rcent_bounds(BoundBox::empty)
+    {
+    }
+  };
+
+  void bin_primitives(const BVHReference *prims, size_t begin, size_t end, Bins *bins) const;
+
+  size_t partition(BVHReference *prims, size_t begin, size_t end, SplitBounds *bounds) const;
+  void partition_chunk(BVHReference *prims,
+                       size_t begin,
+                       size_t end,
+                       size_t *num_left,
+                       SplitBounds *bounds) const;
+  size_t partition_parallel(BVHReference *prims, SplitBounds *bounds) const;
+
   /* computes the bin numbers for each dimension for a box. */
   __forceinline int4 get_bin(const BoundBox &box) const
   {
@@ -28,6 +28,7 @@
 #include "render/curves.h"
 
 #include "util/util_algorithm.h"
+#include "util/util_atomic.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
@@ -411,28 +412,31 @@ BVHNode *BVHBuild::run()
      * optimized for speed yet and not really clear yet if it has measurable
      * improvement on render time. Needs some extra investigation before
      * enabling spatial split for top level BVH.
+     *
+     * Object leaves also don't support the per-thread storage of spatial
+     * splits, see create_leaf_node().
      */
     params.use_spatial_split = false;
   }
 
   spatial_min_overlap = root.bounds().safe_area() * params.spatial_split_alpha;
   if (params.use_spatial_split) {
-    /* NOTE: The API here tries to be as much ready for multi-threaded build
-     * as possible, but at the same time it tries not to introduce any
-     * changes in behavior for until all refactoring needed for threading is
-     * finished.
-     *
-     * So we currently allocate single storage for now, which is only used by
-     * the only thread working on the spatial BVH build.
+    /* Every thread of the scheduler gets its own storage, with index 0 used
+     * by the thread waiting for the build tasks. The root is split by that
+     * thread, so only its storage is pre-allocated for the full range.
      */
     spatial_storage.resize(TaskScheduler::num_threads() + 1);
     size_t num_bins = max(root.size(), (int)BVHParams::NUM_SPATIAL_BINS) - 1;
     foreach (BVHSpatialStorage &storage, spatial_storage) {
       storage.right_bounds.clear();
+      storage.leaf_prim_type.clear();
+      storage.leaf_prim_index.clear();
+      storage.leaf_prim_object.clear();
+      storage.leaf_prim_time.clear();
+      storage.leaf_nodes.clear();
     }
     spatial_storage[0].right_bounds.resize(num_bins);
   }
-  spatial_free_index = 0;
 
   need_prim_time = params.num_motion_curve_steps > 0 || params.num_motion_triangle_steps > 0;
 
@@ -460,6 +464,7 @@ BVHNode *BVHBuild::run()
     /* Perform multithreaded spatial split build. */
     rootnode = build_node(root, &references, 0, 0);
     task_pool.wait_work();
+    gather_spatial_leaves();
   }
   else {
     /* Perform multithreaded binning build. */
@@ -560,6 +565,67 @@ void BVHBuild::thread_build_spatial_split_node(InnerNode *inner,
 
   /* set child in inner node */
   inner->children[child] = node;
+
+  /* update progress */
+  if (range->size() < THREAD_TASK_SIZE) {
+    thread_scoped_lock lock(build_mutex);
+    progress_update();
+  }
+}
+
+void BVHBuild::thread_gather_spatial_leaves(int storage_index, size_t offset)
+{
+  BVHSpatialStorage &storage = spatial_storage[storage_index];
+  const size_t num_prims = storage.leaf_prim_type.size();
+
+  if (num_prims > 0) {
+    memcpy(&prim_type[offset], &storage.leaf_prim_type[0], sizeof(int) * num_prims);
+    memcpy(&prim_index[offset], &storage.leaf_prim_index[0], sizeof(int) * num_prims);
+    memcpy(&prim_object[offset], &storage.leaf_prim_object[0], sizeof(int) * num_prims);
+    if (need_prim_time) {
+      memcpy(&prim_time[offset], &storage.leaf_prim_time[0], sizeof(float2) * num_prims);
+    }
+  }
+
+  /* Leaves were created with indices into the storage of their thread. */
+  foreach (LeafNode *leaf, storage.leaf_nodes) {
+    leaf->lo += offset;
+    leaf->hi += offset;
+  }
+
+  vector<int>().swap(storage.leaf_prim_type);
+  vector<int>().swap(storage.leaf_prim_index);
+  vector<int>().swap(storage.leaf_prim_object);
+  vector<float2>().swap(storage.leaf_prim_time);
+  vector<LeafNode *>().swap(storage.leaf_nodes);
+}
+
+void BVHBuild::gather_spatial_leaves()
+{
+  /* Each thread's primitives go to their own part of the packed arrays, in
+   * the order of the storages. This doesn't give deterministic packed arrays,
+   * but it shouldn't really matter because order of children in BVH is
+   * deterministic.
+   */
+  size_t num_prims = 0;
+  foreach (const BVHSpatialStorage &storage, spatial_storage) {
+    num_prims += storage.leaf_prim_type.size();
+  }
+
+  prim_type.resize(num_prims);
+  prim_index.resize(num_prims);
+  prim_object.resize(num_prims);
+  if (need_prim_time) {
+    prim_time.resize(num_prims);
+  }
+
+  TaskPool pool;
+  size_t offset = 0;
+  for (int i = 0; i < spatial_storage.size(); i++) {
+    pool.push(function_bind(&BVHBuild::thread_gather_spatial_leaves, this, i, offset), true);
+    offset += spatial_storage[i].leaf_prim_type.size();
+  }
+  pool.wait_work();
 }
 
 bool BVHBuild::range_within_max_leaf_size(const BVHRange &range,
@@ -685,13 +751,8 @@ BVHNode *BVHBuild::build_node(const BVHRange &range,
                               int level,
                               int thread_id)
 {
-  /* Update progress.
-   *
-   * TODO(sergey): Currently it matches old behavior, but we can move it to the
-   * task thread (which will mimic non=split builder) and save some CPU ticks
-   * on checking cancel status.
-   */
-  progress_update();
+  /* Progress is reported from the task threads, like the non-split builder,
+   * the counters are updated atomically since all threads contribute. */
   if (progress.get_cancel()) {
     return NULL;
   }
@@ -699,8 +760,8 @@ BVHNode *BVHBuild::build_node(const BVHRange &range,
   /* Small enough or too deep => create leaf. */
   if (!(range.size() > 0 && params.top_level && level == 0)) {
     if (params.small_enough_for_leaf(range.size(), level)) {
-      progress_count += range.size();
-      return create_leaf_node(range, *references);
+      atomic_add_and_fetch_z(&progress_count, range.size());
+      return create_leaf_node(range, *references, thread_id);
     }
   }
 
@@ -710,8 +771,8 @@ BVHNode *BVHBuild::build_node(const BVHRange &range,
 
   if (!(range.size() > 0 && params.top_level && level == 0)) {
     if (split.no_split) {
-      progress_count += range.size();
-      return create_leaf_node(range, *references);
+      atomic_add_and_fetch_z(&progress_count, range.size());
+      return create_leaf_node(range, *references, thread_id);
     }
   }
   float leafSAH = params.sah_primitive_cost * split.leafSAH;
@@ -746,7 +807,7 @@ BVHNode *BVHBuild::build_node(const BVHRange &range,
     split.split(this, left, right, range);
   }
 
-  progress_total += left.size() + right.size() - range.size();
+  atomic_add_and_fetch_z(&progress_total, left.size() + right.size() - range.size());
 
   BoundBox bounds;
   if (do_unalinged_split) {
@@ -829,7 +890,9 @@ BVHNode *BVHBuild::create_object_leaf_nodes(const BVHReference *ref, int start,
   }
 }
 
-BVHNode *BVHBuild::create_leaf_node(const BVHRange &range, const vector<BVHReference> &references)
+BVHNode *BVHBuild::create_leaf_node(const BVHRange &range,
+                                    const vector<BVHReference> &references,
+                                    int thread_id)
 {
   /* This is a bit overallocating here (considering leaf size into account),
    * but chunk-based re-allocation in vector makes it difficult to use small
@@ -960,50 +1023,23 @@ BVHNode *BVHBuild::create_leaf_node(const BVHRange &range, const vector<BVHRefer
   const size_t new_leaf_data_size = sizeof(int) * num_new_leaf_data;
   /* Copy actual data to the packed array. */
   if (params.use_spatial_split) {
-    spatial_spin_lock.lock();
-    /* We use first free index in the packed arrays and mode pointer to the
-     * end of the current range.
-     *
-     * This doesn't give deterministic packed arrays, but it shouldn't really
-     * matter because order of children in BVH is deterministic.
-     */
-    start_index = spatial_free_index;
-    spatial_free_index += range.size();
-    /* Extend an array when needed. */
-    const size_t range_end = start_index + range.size();
-    if (prim_type.size() < range_end) {
-      /* Avoid extra re-allocations by pre-allocating bigger array in an
-       * advance.
-       */
-      if (range_end >= prim_type.capacity()) {
-        float progress = (float)progress_count / (float)progress_total;
-        float factor = (1.0f - progress);
-        const size_t reserve = (size_t)(range_end + (float)range_end * factor);
-        prim_type.reserve(reserve);
-        prim_index.reserve(reserve);
-        prim_object.reserve(reserve);
-        if (need_prim_time) {
-          prim_time.reserve(reserve);
-        }
-      }
-
-      prim_type.resize(range_end);
-      prim_index.resize(range_end);
-      prim_object.resize(range_end);
-      if (need_prim_time) {
-        prim_time.resize(range_end);
-      }
+    /* Append to the storage of this thread, leaf indices are made global once
+     * all threads are done, see gather_spatial_leaves(). */
+    BVHSpatialStorage &storage = spatial_storage[thread_id];
+    start_index = storage.leaf_prim_type.size();
+    storage.leaf_prim_type.insert(
+        storage.leaf_prim_type.end(), local_prim_type.begin(), local_prim_type.end());
+    storage.leaf_prim_index.insert(
+        storage.leaf_prim_index.end(), local_prim_index.begin(), local_prim_index.end());
+    storage.leaf_prim_object.insert(
+        storage.leaf_prim_object.end(), local_prim_object.begin(), local_prim_object.end());
+    if (need_prim_time) {
+      storage.leaf_prim_time.insert(
+          storage.leaf_prim_time.end(), local_prim_time.begin(), local_prim_time.end());
     }
-    /* Perform actual data copy. */
-    if (new_leaf_data_size > 0) {
-      memcpy(&prim_type[start_index], &local_prim_type[0], new_leaf_data_size);
-      memcpy(&prim_index[start_index], &local_prim_index[0], new_leaf_data_size);
-      memcpy(&prim_object[start_index], &local_prim_object[0], new_leaf_data_size);
-      if (need_prim_time) {
-        memcpy(&prim_time[start_index], &local_prim_time[0], sizeof(float2) * num_new_leaf_data);
-      }
+    for (int i = 0; i < num_leaves; ++i) {
+      storage.leaf_nodes.push_back((LeafNode *)leaves[i]);
     }
-    spatial_spin_lock.unlock();
   }
   else {
     /* For the regular BVH builder we simply copy new data starting at the
@@ -1031,7 +1067,14 @@ BVHNode *BVHBuild::create_leaf_node(const BVHRange &range, const vector<BVHRefer
     leaf->hi += start_index;
   }
 
-  /* Create leaf node for object. */
+  /* Create leaf node for object.
+   *
+   * Object leaves are written straight to the global primitive arrays, not
+   * to the per-thread storage of spatial splits. This only works because
+   * spatial splits are disabled for the top level BVH, which is the only one
+   * with object references.
+   */
+  assert(!params.use_spatial_split || ob_num == 0);
   if (num_leaves == 0 || ob_num) {
     /* Only create object leaf nodes if there are objects or no other
      * nodes created.
@@ -76,7 +76,9 @@ class BVHBuild {
                       int level,
                       int thread_id);
   BVHNode *build_node(const BVHObjectBinning &range, int level);
-  BVHNode *create_leaf_node(const BVHRange &range, const vector<BVHReference> &references);
+  BVHNode *create_leaf_node(const BVHRange &range,
+                            const vector<BVHReference> &references,
+                            int thread_id = 0);
   BVHNode *create_object_leaf_nodes(const BVHReference *ref, int start, int num);
 
   bool range_within_max_leaf_size(const BVHRange &range,
@@ -91,6 +93,8 @@ class BVHBuild {
                                        vector<BVHReference> *references,
                                        int level,
                                        int thread_id);
+  void thread_gather_spatial_leaves(int storage_index, size_t offset);
+  void gather_spatial_leaves();
   thread_mutex build_mutex;
 
   /* Progress. */
@@ -126,8 +130,6 @@ class BVHBuild {
   /* Spatial splitting. */
   float spatial_min_overlap;
   vector<BVHSpatialStorage> spatial_storage;
-  size_t spatial_free_index;
-  thread_spin_lock spatial_spin_lock;
 
   /* Threads. */
   TaskPool task_pool;
@@ -19,11 +19,14 @@
 #define __BVH_PARAMS_H__
 
 #include "util/util_boundbox.h"
+#include "util/util_vector.h"
 
 #include "kernel/kernel_types.h"
 
 CCL_NAMESPACE_BEGIN
 
+class LeafNode;
+
 /* Layout of BVH tree.
  *
  * For example, how wide BVH tree is, in terms of number of children
@@ -88,6 +91,14 @@ class BVHParams {
   /* Same as above, but for triangle primitives. */
   int num_motion_triangle_steps;
 
+  /* Don't copy triangle vertices into the BVH, but let the kernel look them up
+   * in the mesh vertices through the triangle vertex indices.
+   *
+   * Saves memory in the cost of an extra fetch per intersected triangle. Only
+   * supported by the BVH layouts traversed by Cycles itself.
+   */
+  bool use_indexed_triangles;
+
   /* Same as in SceneParams. */
   int bvh_type;
 
@@ -125,6 +136,8 @@ class BVHParams {
     num_motion_curve_steps = 0;
     num_motion_triangle_steps = 0;
 
+    use_indexed_triangles = false;
+
     bvh_type = 0;
 
     curve_flags = 0;
@@ -152,12 +165,30 @@ class BVHParams {
     return (size <= min_leaf_size || level >= MAX_DEPTH);
   }
 
+  /* Test if parameters that affect the structure of the BVH changed, in which
+   * case it must be rebuilt rather than refit. */
+  bool modified(const BVHParams &other) const
+  {
+    return !(top_level == other.top_level && bvh_layout == other.bvh_layout &&
+             use_spatial_split == other.use_spatial_split &&
+             use_unaligned_nodes == other.use_unaligned_nodes &&
+             num_motion_curve_steps == other.num_motion_curve_steps &&
+             num_motion_triangle_steps == other.num_motion_triangle_steps &&
+             use_indexed_triangles == other.use_indexed_triangles &&
+             bvh_type == other.bvh_type && curve_flags == other.curve_flags &&
+             curve_subdivisions == other.curve_subdivisions);
+  }
+
   /* Gets best matching BVH.
    *
    * If the requested layout is supported by the device, it will be used.
    * Otherwise, widest supported layout below that will be used.
    */
   static BVHLayout best_bvh_layout(BVHLayout requested_layout, BVHLayoutMask supported_layouts);
+
+  /* Test whether the layout can be used with indexed triangle storage. Embree
+   * and OptiX build their own acceleration structures from copied vertices. */
+  static bool layout_supports_indexed_triangles(BVHLayout layout);
 };
 
 /* BVH Reference
@@ -314,6 +345,16 @@ struct BVHSpatialStorage {
    * new references in before they're getting inserted into actual array,
    */
   vector<BVHReference> new_references;
+
+  /* Primitives of the leaves created by this thread, and those leaves. They
+   * are gathered into the packed arrays once the build is finished, so that
+   * threads don't have to synchronize for every leaf they create.
+   */
+  vector<int> leaf_prim_type;
+  vector<int> leaf_prim_index;
+  vector<int> leaf_prim_object;
+  vector<float2> leaf_prim_time;
+  vector<LeafNode *> leaf_nodes;
 };
 
 CCL_NAMESPACE_END
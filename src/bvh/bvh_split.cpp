@@ -24,6 +24,7 @@
 #include "render/object.h"
 
 #include "util/util_algorithm.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -129,6 +130,25 @@ void BVHObjectSplit::split(BVHRange &left, BVHRange &right, const BVHRange &rang
 
 /* Spatial Split */
 
+namespace {
+
+struct BVHSpatialChunkBins {
+  BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS];
+
+  BVHSpatialChunkBins()
+  {
+    for (int dim = 0; dim < 3; dim++) {
+      for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+        bins[dim][i].bounds = BoundBox::empty;
+        bins[dim][i].enter = 0;
+        bins[dim][i].exit = 0;
+      }
+    }
+  }
+};
+
+}  // namespace
+
 BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
                                  BVHSpatialStorage *storage,
                                  const BVHRange &range,
@@ -169,33 +189,44 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
   }
 
   /* chop references into bins. */
-  for (unsigned int refIdx = range.start(); refIdx < range.end(); refIdx++) {
-    const BVHReference &ref = references_->at(refIdx);
-    BoundBox prim_bounds = get_prim_bounds(ref);
-    float3 firstBinf = (prim_bounds.min - origin) * invBinSize;
-    float3 lastBinf = (prim_bounds.max - origin) * invBinSize;
-    int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
-    int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
-
-    firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
-    lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
-
-    for (int dim = 0; dim < 3; dim++) {
-      BVHReference currRef(
-          get_prim_bounds(ref), ref.prim_index(), ref.prim_object(), ref.prim_type());
-
-      for (int i = firstBin[dim]; i < lastBin[dim]; i++) {
-        BVHReference leftRef, rightRef;
-
-        split_reference(
-            builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
-        storage_->bins[dim][i].bounds.grow(leftRef.bounds());
-        currRef = rightRef;
+  if (range.size() < PARALLEL_MIN_SIZE) {
+    bin_references(
+        &builder, range.start(), range.end(), origin, binSize, invBinSize, storage_->bins);
+  }
+  else {
+    /* Bin chunks of the range in parallel, and merge their bins after. */
+    const int num_chunks = divide_up(range.size(), PARALLEL_CHUNK_SIZE);
+    vector<BVHSpatialChunkBins> chunk_bins(num_chunks);
+
+    TaskPool pool;
+    for (int i = 0; i < num_chunks; i++) {
+      const int start = range.start() + i * PARALLEL_CHUNK_SIZE;
+      const int end = min(start + PARALLEL_CHUNK_SIZE, range.end());
+      pool.push(function_bind(&BVHSpatialSplit::bin_references,
+                              this,
+                              &builder,
+                              start,
+                              end,
+                              origin,
+                              binSize,
+                              invBinSize,
+                              chunk_bins[i].bins),
+                true);
+    }
+    pool.wait_work();
+
+    /* Bins of a chunk might be empty, so merge rather than grow bounds. */
+    for (int i = 0; i < num_chunks; i++) {
+      for (int dim = 0; dim < 3; dim++) {
+        for (int j = 0; j < BVHParams::NUM_SPATIAL_BINS; j++) {
+          BVHSpatialBin &bin = storage_->bins[dim][j];
+          const BVHSpatialBin &chunk_bin = chunk_bins[i].bins[dim][j];
+
+          bin.bounds = merge(bin.bounds, chunk_bin.bounds);
+          bin.enter += chunk_bin.enter;
+          bin.exit += chunk_bin.exit;
+        }
       }
-
-      storage_->bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
-      storage_->bins[dim][firstBin[dim]].enter++;
-      storage_->bins[dim][lastBin[dim]].exit++;
     }
   }
 
@@ -232,6 +263,49 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
   }
 }
 
+void BVHSpatialSplit::bin_references(const BVHBuild *builder,
+                                     int start,
+                                     int end,
+                                     float3 origin,
+                                     float3 bin_size,
+                                     float3 inv_bin_size,
+                                     BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS])
+{
+  for (int refIdx = start; refIdx < end; refIdx++) {
+    const BVHReference &ref = references_->at(refIdx);
+    BoundBox prim_bounds = get_prim_bounds(ref);
+    float3 firstBinf = (prim_bounds.min - origin) * inv_bin_size;
+    float3 lastBinf = (prim_bounds.max - origin) * inv_bin_size;
+    int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
+    int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+
+    firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
+    lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
+
+    for (int dim = 0; dim < 3; dim++) {
+      BVHReference currRef(
+          get_prim_bounds(ref), ref.prim_index(), ref.prim_object(), ref.prim_type());
+
+      for (int i = firstBin[dim]; i < lastBin[dim]; i++) {
+        BVHReference leftRef, rightRef;
+
+        split_reference(*builder,
+                        leftRef,
+                        rightRef,
+                        currRef,
+                        dim,
+                        origin[dim] + bin_size[dim] * (float)(i + 1));
+        bins[dim][i].bounds.grow(leftRef.bounds());
+        currRef = rightRef;
+      }
+
+      bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
+      bins[dim][firstBin[dim]].enter++;
+      bins[dim][lastBin[dim]].exit++;
+    }
+  }
+}
+
 void BVHSpatialSplit::split(BVHBuild *builder,
                             BVHRange &left,
                             BVHRange &right,
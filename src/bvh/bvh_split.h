@@ -70,6 +70,9 @@ class BVHObjectSplit {
 
 class BVHSpatialSplit {
  public:
+  /* Ranges with at least this many references are binned in parallel chunks. */
+  enum { PARALLEL_MIN_SIZE = 32768, PARALLEL_CHUNK_SIZE = 8192 };
+
   float sah;
   int dim;
   float pos;
@@ -100,6 +103,16 @@ class BVHSpatialSplit {
   const BVHUnaligned *unaligned_heuristic_;
   const Transform *aligned_space_;
 
+  /* Chop references of [start, end[ into bins, adding to their bounds and
+   * counters. */
+  void bin_references(const BVHBuild *builder,
+                      int start,
+                      int end,
+                      float3 origin,
+                      float3 bin_size,
+                      float3 inv_bin_size,
+                      BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS]);
+
   /* Lower-level functions which calculates boundaries of left and right nodes
    * needed for spatial split.
    *
@@ -413,8 +413,8 @@ class Device {
   }
 
 #ifdef WITH_NETWORK
-  /* networking */
-  void server_run();
+  /* networking, keeping up to buffer_cache_size bytes of buffers across sessions */
+  void server_run(size_t buffer_cache_size);
 #endif
 
   /* multi device */
@@ -460,6 +460,14 @@ class Device {
 
   virtual void mem_alloc(device_memory &mem) = 0;
   virtual void mem_copy_to(device_memory &mem) = 0;
+  /* Copy a range of elements to memory that is already allocated on the device
+   * with its current size. Devices that can't copy ranges copy all elements. */
+  virtual void mem_copy_to_range(device_memory &mem, size_t offset, size_t size)
+  {
+    (void)offset;
+    (void)size;
+    mem_copy_to(mem);
+  }
   virtual void mem_copy_from(device_memory &mem, int y, int w, int h, int elem) = 0;
   virtual void mem_zero(device_memory &mem) = 0;
   virtual void mem_free(device_memory &mem) = 0;
@@ -43,6 +43,7 @@
 #include "render/buffers.h"
 #include "render/coverage.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_debug.h"
 #include "util/util_foreach.h"
 #include "util/util_function.h"
@@ -170,15 +171,38 @@ class CPUDevice : public Device {
   device_vector<TextureInfo> texture_info;
   bool need_texture_info;
 
+  /* Copies of textures in the memory of every NUMA node that render threads
+   * run on, so that threads read scene data from memory local to their node. */
+  struct TextureReplicas {
+    vector<void *> data;
+    size_t size;
+    size_t data_size;
+    int flat_slot;
+  };
+
+  vector<int> numa_nodes;
+  map<string, TextureReplicas> texture_replicas;
+
 #ifdef WITH_OSL
   OSLGlobals osl_globals;
 #endif
 
   bool use_split_kernel;
+  bool use_packet_camera_rays;
 
   DeviceRequestedFeatures requested_features;
 
   KernelFunctions<void (*)(KernelGlobals *, float *, int, int, int, int, int)> path_trace_kernel;
+  KernelFunctions<void (*)(KernelGlobals *, float *, int, int, int, int, int, int)>
+      path_trace_packet_kernel;
+  KernelFunctions<void (*)(KernelGlobals *, float *, int, int, int, int, int)>
+      adaptive_stopping_kernel;
+  KernelFunctions<bool (*)(KernelGlobals *, float *, int, int, int, int, int)>
+      adaptive_filter_x_kernel;
+  KernelFunctions<bool (*)(KernelGlobals *, float *, int, int, int, int, int)>
+      adaptive_filter_y_kernel;
+  KernelFunctions<void (*)(KernelGlobals *, float *, int, int, int, int, int)>
+      adaptive_adjust_samples_kernel;
   KernelFunctions<void (*)(KernelGlobals *, uchar4 *, float *, float, int, int, int, int)>
       convert_to_half_float_kernel;
   KernelFunctions<void (*)(KernelGlobals *, uchar4 *, float *, float, int, int, int, int)>
@@ -264,6 +288,11 @@ class CPUDevice : public Device {
         texture_info(this, "__texture_info", MEM_TEXTURE),
 #define REGISTER_KERNEL(name) name##_kernel(KERNEL_FUNCTIONS(name))
         REGISTER_KERNEL(path_trace),
+        REGISTER_KERNEL(path_trace_packet),
+        REGISTER_KERNEL(adaptive_stopping),
+        REGISTER_KERNEL(adaptive_filter_x),
+        REGISTER_KERNEL(adaptive_filter_y),
+        REGISTER_KERNEL(adaptive_adjust_samples),
         REGISTER_KERNEL(convert_to_half_float),
         REGISTER_KERNEL(convert_to_byte),
         REGISTER_KERNEL(shader),
@@ -294,8 +323,29 @@ class CPUDevice : public Device {
     if (use_split_kernel) {
       VLOG(1) << "Will be using split kernel.";
     }
+    use_packet_camera_rays = DebugFlags().cpu.packet_camera_rays;
+    if (use_packet_camera_rays) {
+      VLOG(1) << "Will be tracing camera rays as packets.";
+    }
     need_texture_info = false;
 
+    if (DebugFlags().cpu.numa_replicate) {
+      for (int thread_id = 1; thread_id <= TaskScheduler::num_threads(); thread_id++) {
+        const int node = TaskScheduler::thread_node(thread_id);
+        if (node != -1 &&
+            std::find(numa_nodes.begin(), numa_nodes.end(), node) == numa_nodes.end()) {
+          numa_nodes.push_back(node);
+        }
+      }
+      if (numa_nodes.size() < 2) {
+        VLOG(1) << "Render threads run on a single NUMA node, not replicating textures.";
+        numa_nodes.clear();
+      }
+      else {
+        VLOG(1) << "Will be replicating textures on " << numa_nodes.size() << " NUMA nodes.";
+      }
+    }
+
 #define REGISTER_SPLIT_KERNEL(name) \
   split_kernels[#name] = KernelFunctions<void (*)(KernelGlobals *, KernelData *)>( \
       KERNEL_FUNCTIONS(name))
@@ -340,7 +390,7 @@ class CPUDevice : public Device {
     }
 #if defined(__x86_64__) || defined(_M_X64)
     if (DebugFlags().cpu.has_avx2() && system_cpu_support_avx2()) {
-      bvh_layout_mask |= BVH_LAYOUT_BVH8;
+      bvh_layout_mask |= BVH_LAYOUT_BVH8 | BVH_LAYOUT_BVH8_QUANTIZED;
     }
 #endif
 #ifdef WITH_EMBREE
@@ -354,6 +404,26 @@ class CPUDevice : public Device {
     if (need_texture_info) {
       texture_info.copy_to_device();
       need_texture_info = false;
+
+      /* Point the texture info on every node to the image replicas on that node. */
+      map<string, TextureReplicas>::iterator info_it = texture_replicas.find(texture_info.name);
+      if (info_it != texture_replicas.end()) {
+        TextureReplicas &info_replicas = info_it->second;
+        for (map<string, TextureReplicas>::iterator it = texture_replicas.begin();
+             it != texture_replicas.end();
+             it++) {
+          TextureReplicas &replicas = it->second;
+          if (replicas.flat_slot == -1) {
+            continue;
+          }
+          for (size_t i = 0; i < numa_nodes.size(); i++) {
+            if (info_replicas.data[i] && replicas.data[i]) {
+              TextureInfo *info = (TextureInfo *)info_replicas.data[i];
+              info[replicas.flat_slot].data = (uint64_t)replicas.data[i];
+            }
+          }
+        }
+      }
     }
   }
 
@@ -402,6 +472,28 @@ class CPUDevice : public Device {
     }
   }
 
+  void mem_copy_to_range(device_memory &mem, size_t offset, size_t size)
+  {
+    if (mem.type != MEM_TEXTURE || mem.interpolation != INTERPOLATION_NONE ||
+        mem.device_pointer != (device_ptr)mem.host_pointer) {
+      mem_copy_to(mem);
+      return;
+    }
+
+    /* Data textures point to the host memory, only replicas need the copy. */
+    map<string, TextureReplicas>::iterator it = texture_replicas.find(mem.name);
+    if (it != texture_replicas.end()) {
+      const size_t elem_size = mem.memory_elements_size(1);
+      foreach (void *data, it->second.data) {
+        if (data) {
+          memcpy((char *)data + offset * elem_size,
+                 (char *)mem.host_pointer + offset * elem_size,
+                 size * elem_size);
+        }
+      }
+    }
+  }
+
   void mem_copy_from(device_memory & /*mem*/, int /*y*/, int /*w*/, int /*h*/, int /*elem*/)
   {
     /* no-op */
@@ -449,13 +541,15 @@ class CPUDevice : public Device {
             << string_human_readable_number(mem.memory_size()) << " bytes. ("
             << string_human_readable_size(mem.memory_size()) << ")";
 
+    int flat_slot = -1;
+
     if (mem.interpolation == INTERPOLATION_NONE) {
       /* Data texture. */
       kernel_tex_copy(&kernel_globals, mem.name, mem.host_pointer, mem.data_size);
     }
     else {
       /* Image Texture. */
-      int flat_slot = 0;
+      flat_slot = 0;
       if (string_startswith(mem.name, "__tex_image")) {
         int pos = string(mem.name).rfind("_");
         flat_slot = atoi(mem.name + pos + 1);
@@ -478,6 +572,8 @@ class CPUDevice : public Device {
       info.width = mem.data_width;
       info.height = mem.data_height;
       info.depth = mem.data_depth;
+      info.cache_image = mem.cache_image;
+      info.grid_index = (uint64_t)mem.grid_index;
 
       need_texture_info = true;
     }
@@ -485,6 +581,12 @@ class CPUDevice : public Device {
     mem.device_pointer = (device_ptr)mem.host_pointer;
     mem.device_size = mem.memory_size();
     stats.mem_alloc(mem.device_size);
+
+    /* Memory paged in from disk is not replicated, that would bring it all back into RAM. */
+    if (!numa_nodes.empty() && mem.host_pointer && mem.device_size &&
+        !DeviceMemoryResidency::is_mapped(mem)) {
+      tex_replicate(mem, flat_slot);
+    }
   }
 
   void tex_free(device_memory &mem)
@@ -495,6 +597,36 @@ class CPUDevice : public Device {
       mem.device_size = 0;
       need_texture_info = true;
     }
+
+    map<string, TextureReplicas>::iterator it = texture_replicas.find(mem.name);
+    if (it != texture_replicas.end()) {
+      TextureReplicas &replicas = it->second;
+      foreach (void *data, replicas.data) {
+        if (data) {
+          system_cpu_numa_free(data, replicas.size);
+          stats.mem_free(replicas.size);
+        }
+      }
+      texture_replicas.erase(it);
+    }
+  }
+
+  void tex_replicate(device_memory &mem, int flat_slot)
+  {
+    TextureReplicas &replicas = texture_replicas[mem.name];
+    replicas.size = mem.memory_size();
+    replicas.data_size = mem.data_size;
+    replicas.flat_slot = flat_slot;
+
+    foreach (int node, numa_nodes) {
+      /* Threads on nodes where allocation fails read the original. */
+      void *data = system_cpu_numa_allocate_on_node(replicas.size, node);
+      if (data) {
+        memcpy(data, mem.host_pointer, replicas.size);
+        stats.mem_alloc(replicas.size);
+      }
+      replicas.data.push_back(data);
+    }
   }
 
   void *osl_memory()
@@ -506,22 +638,22 @@ class CPUDevice : public Device {
 #endif
   }
 
-  void thread_run(DeviceTask *task)
+  void thread_run(DeviceTask *task, int thread_id)
   {
     if (task->type == DeviceTask::RENDER) {
-      thread_render(*task);
+      thread_render(*task, thread_id);
     }
     else if (task->type == DeviceTask::FILM_CONVERT)
       thread_film_convert(*task);
     else if (task->type == DeviceTask::SHADER)
-      thread_shader(*task);
+      thread_shader(*task, thread_id);
   }
 
   class CPUDeviceTask : public DeviceTask {
    public:
     CPUDeviceTask(CPUDevice *device, DeviceTask &task) : DeviceTask(task)
     {
-      run = function_bind(&CPUDevice::thread_run, device, this);
+      run = function_bind(&CPUDevice::thread_run, device, this, _1);
     }
   };
 
@@ -844,6 +976,17 @@ class CPUDevice : public Device {
       }
 
       for (int y = tile.y; y < tile.y + tile.h; y++) {
+        if (use_packet_camera_rays && !use_coverage) {
+          /* Trace camera rays of neighboring pixels together, coverage is
+           * accumulated per pixel so it is not supported. */
+          for (int x = tile.x; x < tile.x + tile.w; x += BVH_PACKET_SIZE) {
+            const int w = min(BVH_PACKET_SIZE, tile.x + tile.w - x);
+            path_trace_packet_kernel()(
+                kg, render_buffer, sample, x, y, w, tile.offset, tile.stride);
+          }
+          continue;
+        }
+
         for (int x = tile.x; x < tile.x + tile.w; x++) {
           if (use_coverage) {
             coverage.init_pixel(x, y);
@@ -854,11 +997,62 @@ class CPUDevice : public Device {
 
       tile.sample = sample + 1;
 
+      if (task.adaptive_sampling.use && task.adaptive_sampling.need_filter(sample)) {
+        const bool stop = adaptive_sampling_filter(kg, tile, sample);
+        if (stop) {
+          const int num_progress_samples = end_sample - sample;
+          tile.sample = end_sample;
+          task.update_progress(&tile, tile.w * tile.h * num_progress_samples);
+          break;
+        }
+      }
+
       task.update_progress(&tile, tile.w * tile.h);
     }
     if (use_coverage) {
       coverage.finalize();
     }
+
+    if (task.adaptive_sampling.use) {
+      adaptive_sampling_post(tile, kg);
+    }
+  }
+
+  /* Marks converged pixels and returns true when the whole tile has converged. */
+  bool adaptive_sampling_filter(KernelGlobals *kg, RenderTile &tile, int sample)
+  {
+    float *render_buffer = (float *)tile.buffer;
+
+    for (int y = tile.y; y < tile.y + tile.h; y++) {
+      for (int x = tile.x; x < tile.x + tile.w; x++) {
+        adaptive_stopping_kernel()(kg, render_buffer, sample + 1, x, y, tile.offset, tile.stride);
+      }
+    }
+
+    bool any = false;
+    for (int y = tile.y; y < tile.y + tile.h; y++) {
+      any |= adaptive_filter_x_kernel()(
+          kg, render_buffer, y, tile.x, tile.w, tile.offset, tile.stride);
+    }
+    for (int x = tile.x; x < tile.x + tile.w; x++) {
+      any |= adaptive_filter_y_kernel()(
+          kg, render_buffer, x, tile.y, tile.h, tile.offset, tile.stride);
+    }
+
+    return !any;
+  }
+
+  /* Rescales pixels which stopped early to the number of samples of the tile. */
+  void adaptive_sampling_post(RenderTile &tile, KernelGlobals *kg)
+  {
+    float *render_buffer = (float *)tile.buffer;
+
+    for (int y = tile.y; y < tile.y + tile.h; y++) {
+      for (int x = tile.x; x < tile.x + tile.w; x++) {
+        adaptive_adjust_samples_kernel()(
+            kg, render_buffer, tile.sample, x, y, tile.offset, tile.stride);
+      }
+    }
   }
 
   void denoise(DenoisingTask &denoising, RenderTile &tile)
@@ -892,7 +1086,7 @@ class CPUDevice : public Device {
     denoising.run_denoising(&tile);
   }
 
-  void thread_render(DeviceTask &task)
+  void thread_render(DeviceTask &task, int thread_id)
   {
     if (task_pool.canceled()) {
       if (task.need_finish_queue == false)
@@ -904,7 +1098,7 @@ class CPUDevice : public Device {
     kgbuffer.alloc_to_device(1);
 
     KernelGlobals *kg = new ((void *)kgbuffer.device_pointer)
-        KernelGlobals(thread_kernel_globals_init());
+        KernelGlobals(thread_kernel_globals_init(thread_id));
 
     profiler.add_state(&kg->profiler);
 
@@ -984,9 +1178,9 @@ class CPUDevice : public Device {
     }
   }
 
-  void thread_shader(DeviceTask &task)
+  void thread_shader(DeviceTask &task, int thread_id)
   {
-    KernelGlobals *kg = new KernelGlobals(thread_kernel_globals_init());
+    KernelGlobals *kg = new KernelGlobals(thread_kernel_globals_init(thread_id));
 
     for (int sample = 0; sample < task.num_samples; sample++) {
       for (int x = task.shader_x; x < task.shader_x + task.shader_w; x++)
@@ -1045,9 +1239,27 @@ class CPUDevice : public Device {
   }
 
  protected:
-  inline KernelGlobals thread_kernel_globals_init()
+  inline KernelGlobals thread_kernel_globals_init(int thread_id)
   {
     KernelGlobals kg = kernel_globals;
+
+    /* Use the texture replicas on the NUMA node of this thread. */
+    if (!numa_nodes.empty()) {
+      const int node = TaskScheduler::thread_node(thread_id);
+      const size_t replica = std::find(numa_nodes.begin(), numa_nodes.end(), node) -
+                             numa_nodes.begin();
+      if (replica < numa_nodes.size()) {
+        for (map<string, TextureReplicas>::iterator it = texture_replicas.begin();
+             it != texture_replicas.end();
+             it++) {
+          TextureReplicas &replicas = it->second;
+          if (replicas.flat_slot == -1 && replicas.data[replica]) {
+            kernel_tex_copy(&kg, it->first.c_str(), replicas.data[replica], replicas.data_size);
+          }
+        }
+      }
+    }
+
     kg.transparent_shadow_intersections = NULL;
     const int decoupled_count = sizeof(kg.decoupled_volume_steps) /
                                 sizeof(*kg.decoupled_volume_steps);
@@ -1198,7 +1410,13 @@ int2 CPUSplitKernel::split_kernel_global_size(device_memory & /*kg*/,
                                               device_memory & /*data*/,
                                               DeviceTask * /*task*/)
 {
-  return make_int2(1, 1);
+  /* Trace a batch of paths per thread in wavefront order: every kernel runs over
+   * the whole batch before the next one starts, and shader evaluation walks the
+   * batch sorted by shader. This keeps the instruction and data caches warm for
+   * each stage, at the cost of split state memory for every path in the batch.
+   * Scene intersection traces groups of rays from the batch as packets. The
+   * batch fits in a single shader sort block. */
+  return make_int2(32, 32);
 }
 
 uint64_t CPUSplitKernel::state_buffer_size(device_memory &kernel_globals,
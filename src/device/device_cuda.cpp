@@ -986,6 +986,23 @@ class CUDADevice : public Device {
     }
   }
 
+  void mem_copy_to_range(device_memory &mem, size_t offset, size_t size)
+  {
+    if (mem.type == MEM_PIXELS || (mem.type == MEM_TEXTURE && cuda_mem_map[&mem].array)) {
+      mem_copy_to(mem);
+      return;
+    }
+
+    CUDAContextScope scope(this);
+
+    if (cuda_mem_map[&mem].use_mapped_host == false || mem.host_pointer != mem.shared_pointer) {
+      const size_t elem_size = mem.memory_elements_size(1);
+      cuda_assert(cuMemcpyHtoD(cuda_device_ptr(mem.device_pointer) + offset * elem_size,
+                               (char *)mem.host_pointer + offset * elem_size,
+                               size * elem_size));
+    }
+  }
+
   void mem_copy_from(device_memory &mem, int y, int w, int h, int elem)
   {
     if (mem.type == MEM_PIXELS && !background) {
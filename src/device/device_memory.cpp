@@ -17,8 +17,65 @@
 #include "device/device.h"
 #include "device/device_memory.h"
 
+#include "util/util_mapped_malloc.h"
+
 CCL_NAMESPACE_BEGIN
 
+/* Device Memory Residency */
+
+DeviceMemoryResidency::DeviceMemoryResidency()
+    : mapped_size(0), out_of_core(false)
+{
+}
+
+void DeviceMemoryResidency::set_out_of_core(bool out_of_core, const string &directory)
+{
+  thread_scoped_lock lock(mutex);
+  this->out_of_core = out_of_core;
+  this->directory = directory;
+}
+
+void DeviceMemoryResidency::page_out(device_memory &mem, size_t offset, size_t size)
+{
+  if (size == 0 || !is_mapped(mem)) {
+    return;
+  }
+
+  const size_t element_size = mem.data_elements * datatype_size(mem.data_type);
+  util_mapped_release((char *)mem.host_pointer + offset * element_size, size * element_size);
+}
+
+bool DeviceMemoryResidency::is_mapped(const device_memory &mem)
+{
+  return mem.residency && mem.host_pointer && util_mapped_is_mapped(mem.host_pointer);
+}
+
+void *DeviceMemoryResidency::alloc(size_t size)
+{
+  thread_scoped_lock lock(mutex);
+  if (!out_of_core) {
+    return NULL;
+  }
+
+  /* Fall back to RAM if the file can't be created, for example when the disk is full. */
+  void *ptr = util_mapped_malloc(size, directory);
+  if (ptr) {
+    mapped_size += size;
+  }
+  return ptr;
+}
+
+bool DeviceMemoryResidency::free(void *ptr, size_t size)
+{
+  if (!util_mapped_free(ptr)) {
+    return false;
+  }
+
+  thread_scoped_lock lock(mutex);
+  mapped_size -= size;
+  return true;
+}
+
 /* Device Memory */
 
 device_memory::device_memory(Device *device, const char *name, MemoryType type)
@@ -33,6 +90,9 @@ device_memory::device_memory(Device *device, const char *name, MemoryType type)
       name(name),
       interpolation(INTERPOLATION_NONE),
       extension(EXTENSION_REPEAT),
+      cache_image(0),
+      grid_index(0),
+      residency(NULL),
       device(device),
       device_pointer(0),
       host_pointer(0),
@@ -53,6 +113,13 @@ void *device_memory::host_alloc(size_t size)
     return 0;
   }
 
+  if (residency) {
+    void *ptr = residency->alloc(size);
+    if (ptr) {
+      return ptr;
+    }
+  }
+
   void *ptr = util_aligned_malloc(size, MIN_ALIGNMENT_CPU_DATA_TYPES);
 
   if (ptr) {
@@ -68,8 +135,10 @@ void *device_memory::host_alloc(size_t size)
 void device_memory::host_free()
 {
   if (host_pointer) {
-    util_guarded_mem_free(memory_size());
-    util_aligned_free((void *)host_pointer);
+    if (!(residency && residency->free(host_pointer, memory_size()))) {
+      util_guarded_mem_free(memory_size());
+      util_aligned_free((void *)host_pointer);
+    }
     host_pointer = 0;
   }
 }
@@ -94,6 +163,18 @@ void device_memory::device_copy_to()
   }
 }
 
+void device_memory::device_copy_to_range(size_t offset, size_t size)
+{
+  if (host_pointer) {
+    if (device_pointer && device_size == memory_size()) {
+      device->mem_copy_to_range(*this, offset, size);
+    }
+    else {
+      device->mem_copy_to(*this);
+    }
+  }
+}
+
 void device_memory::device_copy_from(int y, int w, int h, int elem)
 {
   assert(type != MEM_TEXTURE && type != MEM_READ_ONLY);
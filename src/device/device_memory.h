@@ -23,13 +23,16 @@
 
 #include "util/util_array.h"
 #include "util/util_half.h"
+#include "util/util_string.h"
 #include "util/util_texture.h"
+#include "util/util_thread.h"
 #include "util/util_types.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
 class Device;
+class device_memory;
 
 enum MemoryType { MEM_READ_ONLY, MEM_READ_WRITE, MEM_DEVICE_ONLY, MEM_TEXTURE, MEM_PIXELS };
 
@@ -182,6 +185,50 @@ template<> struct device_type_traits<uint64_t> {
   static const int num_elements = 1;
 };
 
+/* Device Memory Residency
+ *
+ * Manages host memory of the device memory attached to it, for data that may
+ * not fit in RAM. Out of core, host memory is allocated from memory-mapped
+ * files in the cache directory instead of RAM, see util_mapped_malloc.h, and
+ * ranges of cold data can be paged out to disk once they are filled in. They
+ * are paged back in when accessed, which the CPU device does directly while
+ * rendering. */
+
+class DeviceMemoryResidency {
+ public:
+  DeviceMemoryResidency();
+
+  /* Allocate from memory-mapped files or from RAM, for following allocations.
+   * An empty directory uses the system temporary directory. */
+  void set_out_of_core(bool out_of_core, const string &directory = "");
+  bool is_out_of_core() const
+  {
+    return out_of_core;
+  }
+
+  /* Write a range of elements to disk and drop it from memory. Does nothing
+   * for host memory in RAM. */
+  void page_out(device_memory &mem, size_t offset, size_t size);
+
+  /* Test if host memory is allocated from a memory-mapped file. */
+  static bool is_mapped(const device_memory &mem);
+
+  /* Host memory allocated from memory-mapped files, in bytes. */
+  size_t mapped_size;
+
+ protected:
+  friend class device_memory;
+
+  /* Allocate host memory, or return NULL to allocate it in RAM. */
+  void *alloc(size_t size);
+  /* Free host memory, returns false if it must be freed from RAM. */
+  bool free(void *ptr, size_t size);
+
+  thread_mutex mutex;
+  bool out_of_core;
+  string directory;
+};
+
 /* Device Memory
  *
  * Base class for all device memory. This should not be allocated directly,
@@ -210,6 +257,12 @@ class device_memory {
   const char *name;
   InterpolationType interpolation;
   ExtensionType extension;
+  /* Texture cache handle, for image textures loaded on demand. */
+  uint64_t cache_image;
+  /* Tile index of sparse volume grids, allocated on the same device. */
+  device_ptr grid_index;
+  /* Manager for host memory that may be paged out to disk, or NULL. */
+  DeviceMemoryResidency *residency;
 
   /* Pointers. */
   Device *device;
@@ -245,6 +298,7 @@ class device_memory {
   void device_alloc();
   void device_free();
   void device_copy_to();
+  void device_copy_to_range(size_t offset, size_t size);
   void device_copy_from(int y, int w, int h, int elem);
   void device_zero();
 
@@ -427,6 +481,14 @@ template<typename T> class device_vector : public device_memory {
     device_copy_to();
   }
 
+  /* Copy only a range of elements, when the device memory was not reallocated
+   * since the last copy. */
+  void copy_to_device(size_t offset, size_t size)
+  {
+    assert(offset + size <= data_size);
+    device_copy_to_range(offset, size);
+  }
+
   void copy_from_device(int y, int w, int h)
   {
     device_copy_from(y, w, h, sizeof(T));
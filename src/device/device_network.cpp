@@ -111,11 +111,37 @@ class NetworkDevice : public Device {
   {
     thread_scoped_lock lock(rpc_lock);
 
+    size_t data_size = mem.memory_size();
+    string hash;
+
+    if (mem.device_pointer && data_size >= NETWORK_CACHE_MIN_SIZE) {
+      /* Let the server copy the content from its cache if it has it. */
+      hash = network_buffer_hash(mem.host_pointer, data_size);
+
+      RPCSend snd(socket, &error_func, "mem_copy_to_cached");
+      snd.add(mem);
+      snd.add(hash);
+      snd.write();
+
+      bool found = false;
+      RPCReceive rcv(socket, &error_func);
+      rcv.read(found);
+
+      if (found) {
+        if (mem.name) {
+          VLOG(3) << "Buffer found in server cache: " << mem.name << ", "
+                  << string_human_readable_size(data_size);
+        }
+        return;
+      }
+    }
+
     RPCSend snd(socket, &error_func, "mem_copy_to");
 
     snd.add(mem);
+    snd.add(hash);
+    snd.add_buffer(mem.host_pointer, data_size);
     snd.write();
-    snd.write_buffer(mem.host_pointer, mem.memory_size());
   }
 
   void mem_copy_from(device_memory &mem, int y, int w, int h, int elem)
@@ -171,8 +197,8 @@ class NetworkDevice : public Device {
 
     snd.add(name_string);
     snd.add(size);
+    snd.add_buffer(host, size);
     snd.write();
-    snd.write_buffer(host, size);
   }
 
   bool load_kernels(const DeviceRequestedFeatures &requested_features)
@@ -183,10 +209,7 @@ class NetworkDevice : public Device {
     thread_scoped_lock lock(rpc_lock);
 
     RPCSend snd(socket, &error_func, "load_kernels");
-    snd.add(requested_features.experimental);
-    snd.add(requested_features.max_closure);
-    snd.add(requested_features.max_nodes_group);
-    snd.add(requested_features.nodes_features);
+    snd.add(requested_features);
     snd.write();
 
     bool result;
@@ -330,8 +353,12 @@ class DeviceServer {
     return error_func.have_error();
   }
 
-  DeviceServer(Device *device_, tcp::socket &socket_)
-      : device(device_), socket(socket_), stop(false), blocked_waiting(false)
+  DeviceServer(Device *device_, tcp::socket &socket_, NetworkBufferCache &buffer_cache_)
+      : device(device_),
+        socket(socket_),
+        buffer_cache(buffer_cache_),
+        stop(false),
+        blocked_waiting(false)
   {
     error_func = NetworkError();
   }
@@ -455,10 +482,39 @@ class DeviceServer {
       /* Store a mapping to/from client_pointer and real device pointer. */
       pointer_mapping_insert(client_pointer, mem.device_pointer);
     }
+    else if (rcv.name == "mem_copy_to_cached") {
+      string name, hash;
+      network_device_memory mem(device);
+      rcv.read(mem, name);
+      rcv.read(hash);
+
+      size_t data_size = mem.memory_size();
+      device_ptr client_pointer = mem.device_pointer;
+
+      /* Lookup existing host side data buffer. */
+      DataVector &data_v = data_vector_find(client_pointer);
+      mem.host_pointer = (data_size) ? (void *)&data_v[0] : 0;
+
+      /* Copy data from the cache into the memory buffer, otherwise the client
+       * follows up with a regular copy. */
+      bool found = buffer_cache.find(hash, mem.host_pointer, data_size);
+
+      RPCSend snd(socket, &error_func, "mem_copy_to_cached");
+      snd.add(found);
+      snd.write();
+      lock.unlock();
+
+      if (found) {
+        /* Copy the data from the memory buffer to the device buffer. */
+        mem.device_pointer = device_ptr_from_client_pointer(client_pointer);
+        device->mem_copy_to(mem);
+      }
+    }
     else if (rcv.name == "mem_copy_to") {
-      string name;
+      string name, hash;
       network_device_memory mem(device);
       rcv.read(mem, name);
+      rcv.read(hash);
       lock.unlock();
 
       size_t data_size = mem.memory_size();
@@ -481,6 +537,11 @@ class DeviceServer {
       /* Copy data from network into memory buffer. */
       rcv.read_buffer((uint8_t *)mem.host_pointer, data_size);
 
+      /* Keep the content for later sessions, if the client hashed it. */
+      if (!hash.empty()) {
+        buffer_cache.insert(hash, mem.host_pointer, data_size);
+      }
+
       /* Copy the data from the memory buffer to the device buffer. */
       device->mem_copy_to(mem);
 
@@ -505,15 +566,15 @@ class DeviceServer {
 
       DataVector &data_v = data_vector_find(client_pointer);
 
-      mem.host_pointer = (device_ptr) & (data_v[0]);
+      mem.host_pointer = (void *)&data_v[0];
 
       device->mem_copy_from(mem, y, w, h, elem);
 
       size_t data_size = mem.memory_size();
 
       RPCSend snd(socket, &error_func, "mem_copy_from");
+      snd.add_buffer(mem.host_pointer, data_size);
       snd.write();
-      snd.write_buffer((uint8_t *)mem.host_pointer, data_size);
       lock.unlock();
     }
     else if (rcv.name == "mem_zero") {
@@ -536,7 +597,7 @@ class DeviceServer {
       else {
         /* Allocate host side data buffer. */
         DataVector &data_v = data_vector_insert(client_pointer, data_size);
-        mem.host_pointer = (void *) ? (device_ptr) & (data_v[0]) : 0;
+        mem.host_pointer = (data_size) ? (void *)&(data_v[0]) : 0;
       }
 
       /* Zero memory. */
@@ -575,10 +636,7 @@ class DeviceServer {
     }
     else if (rcv.name == "load_kernels") {
       DeviceRequestedFeatures requested_features;
-      rcv.read(requested_features.experimental);
-      rcv.read(requested_features.max_closure);
-      rcv.read(requested_features.max_nodes_group);
-      rcv.read(requested_features.nodes_features);
+      rcv.read(requested_features);
 
       bool result;
       result = device->load_kernels(requested_features);
@@ -754,6 +812,7 @@ class DeviceServer {
   /* properties */
   Device *device;
   tcp::socket &socket;
+  NetworkBufferCache &buffer_cache;
 
   /* mapping of remote to local pointer */
   PtrMap ptr_map;
@@ -777,12 +836,15 @@ class DeviceServer {
   /* todo: free memory and device (osl) on network error */
 };
 
-void Device::server_run()
+void Device::server_run(size_t buffer_cache_size)
 {
   try {
     /* starts thread that responds to discovery requests */
     ServerDiscovery discovery;
 
+    /* Buffer content kept across connections. */
+    NetworkBufferCache buffer_cache(buffer_cache_size);
+
     for (;;) {
       /* accept connection */
       boost::asio::io_service io_service;
@@ -794,10 +856,11 @@ void Device::server_run()
       string remote_address = socket.remote_endpoint().address().to_string();
       printf("Connected to remote client at: %s\n", remote_address.c_str());
 
-      DeviceServer server(this, socket);
+      DeviceServer server(this, socket, buffer_cache);
       server.listen();
 
-      printf("Disconnected.\n");
+      printf("Disconnected, %s of buffers cached.\n",
+             string_human_readable_size(buffer_cache.memory_size()).c_str());
     }
   }
   catch (exception &e) {
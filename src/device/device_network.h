@@ -19,25 +19,24 @@
 
 #ifdef WITH_NETWORK
 
-#  include <boost/archive/text_iarchive.hpp>
-#  include <boost/archive/text_oarchive.hpp>
-#  include <boost/archive/binary_iarchive.hpp>
-#  include <boost/archive/binary_oarchive.hpp>
 #  include <boost/array.hpp>
 #  include <boost/asio.hpp>
 #  include <boost/bind.hpp>
-#  include <boost/serialization/vector.hpp>
 #  include <boost/thread.hpp>
 
 #  include <iostream>
 #  include <sstream>
 #  include <deque>
+#  include <type_traits>
 
 #  include "render/buffers.h"
 
+#  include "util/util_algorithm.h"
 #  include "util/util_foreach.h"
 #  include "util/util_list.h"
+#  include "util/util_logging.h"
 #  include "util/util_map.h"
+#  include "util/util_md5.h"
 #  include "util/util_param.h"
 #  include "util/util_string.h"
 
@@ -56,13 +55,28 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
-#  if 0
-typedef boost::archive::text_oarchive o_archive;
-typedef boost::archive::text_iarchive i_archive;
-#  else
-typedef boost::archive::binary_oarchive o_archive;
-typedef boost::archive::binary_iarchive i_archive;
-#  endif
+/* Wire Protocol
+ *
+ * Every remote procedure call is one message: a fixed size header, a payload
+ * with the call name and arguments in binary form, and raw memory chunks whose
+ * sizes follow from the arguments. Chunks are written straight from host memory
+ * with a single scatter/gather write, and read in place into their destination.
+ *
+ * Values are stored in native byte order and size, so client and server must
+ * run on the same architecture. Messages from a different protocol version are
+ * rejected. */
+
+static const uint32_t RPC_MAGIC = 0x504e5943; /* "CYNP" */
+static const uint32_t RPC_VERSION = 2;
+
+struct RPCHeader {
+  uint32_t magic;
+  uint32_t version;
+  /* Size of the name and arguments. */
+  uint64_t payload_size;
+  /* Total size of the raw memory chunks after the payload. */
+  uint64_t chunks_size;
+};
 
 /* Serialization of device memory */
 
@@ -114,11 +128,11 @@ class NetworkError {
 class RPCSend {
  public:
   RPCSend(tcp::socket &socket_, NetworkError *e, const string &name_ = "")
-      : name(name_), socket(socket_), archive(archive_stream), sent(false)
+      : name(name_), socket(socket_), chunks_size(0), sent(false)
   {
-    archive &name_;
+    add(name_);
     error_func = e;
-    fprintf(stderr, "rpc send %s\n", name.c_str());
+    VLOG(4) << "RPC send " << name;
   }
 
   ~RPCSend()
@@ -127,58 +141,97 @@ class RPCSend {
 
   void add(const device_memory &mem)
   {
-    archive &mem.data_type &mem.data_elements &mem.data_size;
-    archive &mem.data_width &mem.data_height &mem.data_depth &mem.device_pointer;
-    archive &mem.type &string(mem.name);
-    archive &mem.interpolation &mem.extension;
-    archive &mem.device_pointer;
+    add(mem.data_type);
+    add(mem.data_elements);
+    add(mem.data_size);
+    add(mem.data_width);
+    add(mem.data_height);
+    add(mem.data_depth);
+    add(mem.type);
+    add(string(mem.name));
+    add(mem.interpolation);
+    add(mem.extension);
+    add(mem.device_pointer);
   }
 
   template<typename T> void add(const T &data)
   {
-    archive &data;
+    static_assert(std::is_trivially_copyable<T>::value, "RPC argument must be plain data");
+    const char *bytes = (const char *)&data;
+    payload.insert(payload.end(), bytes, bytes + sizeof(T));
+  }
+
+  void add(const string &data)
+  {
+    add((uint64_t)data.size());
+    payload.insert(payload.end(), data.begin(), data.end());
   }
 
   void add(const DeviceTask &task)
   {
     int type = (int)task.type;
-    archive &type &task.x &task.y &task.w &task.h;
-    archive &task.rgba_byte &task.rgba_half &task.buffer &task.sample &task.num_samples;
-    archive &task.offset &task.stride;
-    archive &task.shader_input &task.shader_output &task.shader_eval_type;
-    archive &task.shader_x &task.shader_w;
-    archive &task.need_finish_queue;
+    add(type);
+    add(task.x);
+    add(task.y);
+    add(task.w);
+    add(task.h);
+    add(task.rgba_byte);
+    add(task.rgba_half);
+    add(task.buffer);
+    add(task.sample);
+    add(task.num_samples);
+    add(task.offset);
+    add(task.stride);
+    add(task.shader_input);
+    add(task.shader_output);
+    add(task.shader_eval_type);
+    add(task.shader_x);
+    add(task.shader_w);
+    add(task.need_finish_queue);
   }
 
   void add(const RenderTile &tile)
   {
-    archive &tile.x &tile.y &tile.w &tile.h;
-    archive &tile.start_sample &tile.num_samples &tile.sample;
-    archive &tile.resolution &tile.offset &tile.stride;
-    archive &tile.buffer;
+    add(tile.x);
+    add(tile.y);
+    add(tile.w);
+    add(tile.h);
+    add(tile.start_sample);
+    add(tile.num_samples);
+    add(tile.sample);
+    add(tile.resolution);
+    add(tile.offset);
+    add(tile.stride);
+    add(tile.buffer);
+  }
+
+  /* Raw memory sent after the arguments, without copying. The memory must stay
+   * valid until the message is written. */
+  void add_buffer(const void *buffer, size_t size)
+  {
+    if (size) {
+      chunks.push_back(boost::asio::const_buffer(buffer, size));
+      chunks_size += size;
+    }
   }
 
   void write()
   {
     boost::system::error_code error;
 
-    /* get string from stream */
-    string archive_str = archive_stream.str();
+    RPCHeader header;
+    header.magic = RPC_MAGIC;
+    header.version = RPC_VERSION;
+    header.payload_size = payload.size();
+    header.chunks_size = chunks_size;
 
-    /* first send fixed size header with size of following data */
-    ostringstream header_stream;
-    header_stream << setw(8) << hex << archive_str.size();
-    string header_str = header_stream.str();
+    vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(chunks.size() + 2);
+    buffers.push_back(boost::asio::buffer(&header, sizeof(header)));
+    buffers.push_back(boost::asio::buffer(payload));
+    buffers.insert(buffers.end(), chunks.begin(), chunks.end());
 
-    boost::asio::write(
-        socket, boost::asio::buffer(header_str), boost::asio::transfer_all(), error);
-
-    if (error.value())
-      error_func->network_error(error.message());
-
-    /* then send actual data */
-    boost::asio::write(
-        socket, boost::asio::buffer(archive_str), boost::asio::transfer_all(), error);
+    boost::asio::write(socket, buffers, boost::asio::transfer_all(), error);
 
     if (error.value())
       error_func->network_error(error.message());
@@ -186,22 +239,12 @@ class RPCSend {
     sent = true;
   }
 
-  void write_buffer(void *buffer, size_t size)
-  {
-    boost::system::error_code error;
-
-    boost::asio::write(
-        socket, boost::asio::buffer(buffer, size), boost::asio::transfer_all(), error);
-
-    if (error.value())
-      error_func->network_error(error.message());
-  }
-
  protected:
   string name;
   tcp::socket &socket;
-  ostringstream archive_stream;
-  o_archive archive;
+  vector<char> payload;
+  vector<boost::asio::const_buffer> chunks;
+  size_t chunks_size;
   bool sent;
   NetworkError *error_func;
 };
@@ -211,69 +254,76 @@ class RPCSend {
 class RPCReceive {
  public:
   RPCReceive(tcp::socket &socket_, NetworkError *e)
-      : socket(socket_), archive_stream(NULL), archive(NULL)
+      : socket(socket_), payload_offset(0), chunks_remaining(0)
   {
     error_func = e;
     /* read head with fixed size */
-    vector<char> header(8);
+    RPCHeader header;
     boost::system::error_code error;
-    size_t len = boost::asio::read(socket, boost::asio::buffer(header), error);
+    size_t len = boost::asio::read(socket, boost::asio::buffer(&header, sizeof(header)), error);
 
     if (error.value()) {
       error_func->network_error(error.message());
     }
 
     /* verify if we got something */
-    if (len == header.size()) {
-      /* decode header */
-      string header_str(&header[0], header.size());
-      istringstream header_stream(header_str);
-
-      size_t data_size;
-
-      if ((header_stream >> hex >> data_size)) {
-
-        vector<char> data(data_size);
-        size_t len = boost::asio::read(socket, boost::asio::buffer(data), error);
-
-        if (error.value())
-          error_func->network_error(error.message());
-
-        if (len == data_size) {
-          archive_str = (data.size()) ? string(&data[0], data.size()) : string("");
+    if (len != sizeof(header)) {
+      error_func->network_error("Network receive error: invalid header size");
+    }
+    else if (header.magic != RPC_MAGIC) {
+      error_func->network_error("Network receive error: invalid message header");
+    }
+    else if (header.version != RPC_VERSION) {
+      error_func->network_error(
+          string_printf("Network receive error: protocol version %u, expected %u",
+                        header.version,
+                        RPC_VERSION));
+    }
+    else {
+      payload.resize(header.payload_size);
+      len = boost::asio::read(socket, boost::asio::buffer(payload), error);
 
-          archive_stream = new istringstream(archive_str);
-          archive = new i_archive(*archive_stream);
+      if (error.value())
+        error_func->network_error(error.message());
 
-          *archive &name;
-          fprintf(stderr, "rpc receive %s\n", name.c_str());
-        }
-        else {
-          error_func->network_error("Network receive error: data size doesn't match header");
-        }
+      if (len == payload.size()) {
+        chunks_remaining = header.chunks_size;
+        read(name);
+        VLOG(4) << "RPC receive " << name;
       }
       else {
-        error_func->network_error("Network receive error: can't decode data size from header");
+        error_func->network_error("Network receive error: data size doesn't match header");
       }
     }
-    else {
-      error_func->network_error("Network receive error: invalid header size");
-    }
   }
 
   ~RPCReceive()
   {
-    delete archive;
-    delete archive_stream;
+    /* Skip chunks that were not read, to stay in sync with the next message. */
+    char discard[4096];
+    while (chunks_remaining > 0) {
+      boost::system::error_code error;
+      size_t size = min(chunks_remaining, sizeof(discard));
+      if (boost::asio::read(socket, boost::asio::buffer(discard, size), error) != size) {
+        break;
+      }
+      chunks_remaining -= size;
+    }
   }
 
   void read(network_device_memory &mem, string &name)
   {
-    *archive &mem.data_type &mem.data_elements &mem.data_size;
-    *archive &mem.data_width &mem.data_height &mem.data_depth &mem.device_pointer;
-    *archive &mem.type &name;
-    *archive &mem.interpolation &mem.extension;
-    *archive &mem.device_pointer;
+    read(mem.data_type);
+    read(mem.data_elements);
+    read(mem.data_size);
+    read(mem.data_width);
+    read(mem.data_height);
+    read(mem.data_depth);
+    read(mem.type);
+    read(name);
+    read(mem.interpolation);
+    read(mem.extension);
+    read(mem.device_pointer);
 
     mem.name = name.c_str();
     mem.host_pointer = 0;
@@ -286,13 +336,41 @@ class RPCReceive {
 
   template<typename T> void read(T &data)
   {
-    *archive &data;
+    static_assert(std::is_trivially_copyable<T>::value, "RPC argument must be plain data");
+    if (payload_offset + sizeof(T) > payload.size()) {
+      error_func->network_error("Network receive error: arguments don't match header");
+      return;
+    }
+
+    memcpy((void *)&data, &payload[payload_offset], sizeof(T));
+    payload_offset += sizeof(T);
   }
 
+  void read(string &data)
+  {
+    uint64_t size = 0;
+    read(size);
+
+    if (payload_offset + size > payload.size()) {
+      error_func->network_error("Network receive error: arguments don't match header");
+      return;
+    }
+
+    data.assign(&payload[0] + payload_offset, size);
+    payload_offset += size;
+  }
+
+  /* Read the next raw memory chunk of the message in place. */
   void read_buffer(void *buffer, size_t size)
   {
+    if (size > chunks_remaining) {
+      error_func->network_error("Network receive error: buffer size doesn't match header");
+      return;
+    }
+
     boost::system::error_code error;
     size_t len = boost::asio::read(socket, boost::asio::buffer(buffer, size), error);
+    chunks_remaining -= len;
 
     if (error.value()) {
       error_func->network_error(error.message());
@@ -306,22 +384,41 @@ class RPCReceive {
   {
     int type;
 
-    *archive &type &task.x &task.y &task.w &task.h;
-    *archive &task.rgba_byte &task.rgba_half &task.buffer &task.sample &task.num_samples;
-    *archive &task.offset &task.stride;
-    *archive &task.shader_input &task.shader_output &task.shader_eval_type;
-    *archive &task.shader_x &task.shader_w;
-    *archive &task.need_finish_queue;
+    read(type);
+    read(task.x);
+    read(task.y);
+    read(task.w);
+    read(task.h);
+    read(task.rgba_byte);
+    read(task.rgba_half);
+    read(task.buffer);
+    read(task.sample);
+    read(task.num_samples);
+    read(task.offset);
+    read(task.stride);
+    read(task.shader_input);
+    read(task.shader_output);
+    read(task.shader_eval_type);
+    read(task.shader_x);
+    read(task.shader_w);
+    read(task.need_finish_queue);
 
     task.type = (DeviceTask::Type)type;
   }
 
   void read(RenderTile &tile)
   {
-    *archive &tile.x &tile.y &tile.w &tile.h;
-    *archive &tile.start_sample &tile.num_samples &tile.sample;
-    *archive &tile.resolution &tile.offset &tile.stride;
-    *archive &tile.buffer;
+    read(tile.x);
+    read(tile.y);
+    read(tile.w);
+    read(tile.h);
+    read(tile.start_sample);
+    read(tile.num_samples);
+    read(tile.sample);
+    read(tile.resolution);
+    read(tile.offset);
+    read(tile.stride);
+    read(tile.buffer);
 
     tile.buffers = NULL;
   }
@@ -330,12 +427,99 @@ class RPCReceive {
 
  protected:
   tcp::socket &socket;
-  string archive_str;
-  istringstream *archive_stream;
-  i_archive *archive;
+  vector<char> payload;
+  size_t payload_offset;
+  size_t chunks_remaining;
   NetworkError *error_func;
 };
 
+/* Buffer Cache
+ *
+ * Buffers copied to the server are identified by the hash of their content, so
+ * that the client only sends buffers that changed since an earlier copy. The
+ * server keeps the content of recently copied buffers across sessions, as most
+ * arrays stay the same between frames of an animation. */
+
+/* Smaller buffers are always sent, the extra round trip would cost more than
+ * sending them. */
+static const size_t NETWORK_CACHE_MIN_SIZE = 64 * 1024;
+
+inline string network_buffer_hash(const void *data, size_t size)
+{
+  MD5Hash md5;
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (size > 0) {
+    const int chunk_size = (int)min(size, (size_t)(1 << 30));
+    md5.append(bytes, chunk_size);
+    bytes += chunk_size;
+    size -= chunk_size;
+  }
+  return md5.get_hex();
+}
+
+class NetworkBufferCache {
+ public:
+  explicit NetworkBufferCache(size_t max_size_) : max_size(max_size_), size(0), counter(0)
+  {
+  }
+
+  /* Copy the cached content with the given hash into data. */
+  bool find(const string &hash, void *data, size_t data_size)
+  {
+    map<string, Entry>::iterator it = entries.find(hash);
+    if (it == entries.end() || it->second.data.size() != data_size) {
+      return false;
+    }
+
+    if (data_size) {
+      memcpy(data, &it->second.data[0], data_size);
+    }
+    it->second.last_used = ++counter;
+    return true;
+  }
+
+  /* Store content, evicting the least recently used buffers to stay in the
+   * maximum size. */
+  void insert(const string &hash, const void *data, size_t data_size)
+  {
+    if (data_size > max_size || entries.find(hash) != entries.end()) {
+      return;
+    }
+
+    while (size + data_size > max_size) {
+      map<string, Entry>::iterator oldest = entries.begin();
+      for (map<string, Entry>::iterator it = entries.begin(); it != entries.end(); it++) {
+        if (it->second.last_used < oldest->second.last_used) {
+          oldest = it;
+        }
+      }
+      size -= oldest->second.data.size();
+      entries.erase(oldest);
+    }
+
+    Entry &entry = entries[hash];
+    entry.data.assign((const uint8_t *)data, (const uint8_t *)data + data_size);
+    entry.last_used = ++counter;
+    size += data_size;
+  }
+
+  size_t memory_size() const
+  {
+    return size;
+  }
+
+ protected:
+  struct Entry {
+    vector<uint8_t> data;
+    uint64_t last_used;
+  };
+
+  map<string, Entry> entries;
+  size_t max_size;
+  size_t size;
+  uint64_t counter;
+};
+
 /* Server auto discovery */
 
 class ServerDiscovery {
@@ -136,4 +136,22 @@ void DeviceTask::update_progress(RenderTile *rtile, int pixel_samples)
   }
 }
 
+/* Adaptive Sampling */
+
+AdaptiveSampling::AdaptiveSampling() : use(false), adaptive_step(0), min_samples(0)
+{
+}
+
+/* Filtering happens after every adaptive_step samples once the minimum number of samples has
+ * been reached. The step is a power of two, so the total number of samples is always even. */
+bool AdaptiveSampling::need_filter(int sample) const
+{
+  if (sample > min_samples) {
+    return (sample & (adaptive_step - 1)) == (adaptive_step - 1);
+  }
+  else {
+    return false;
+  }
+}
+
 CCL_NAMESPACE_END
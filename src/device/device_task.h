@@ -62,6 +62,17 @@ class DenoiseParams {
   }
 };
 
+class AdaptiveSampling {
+ public:
+  AdaptiveSampling();
+
+  bool need_filter(int sample) const;
+
+  bool use;
+  int adaptive_step;
+  int min_samples;
+};
+
 class DeviceTask : public Task {
  public:
   typedef enum { RENDER, FILM_CONVERT, SHADER } Type;
@@ -116,6 +127,8 @@ class DeviceTask : public Task {
   bool integrator_branched;
   int2 requested_tile_size;
 
+  AdaptiveSampling adaptive_sampling;
+
  protected:
   double last_update_time;
 };
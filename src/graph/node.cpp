@@ -487,6 +487,21 @@ void float3_hash(const Node *node, const SocketType &socket, MD5Hash &md5)
   md5.append(((uint8_t *)node) + socket.struct_offset, sizeof(float) * 3);
 }
 
+void string_hash(const Node *node, const SocketType &socket, MD5Hash &md5)
+{
+  /* Hash the characters rather than the pointer, so the hash is the same in
+   * every session. */
+  md5.append(((const ustring *)(((char *)node) + socket.struct_offset))->string());
+}
+
+void string_array_hash(const Node *node, const SocketType &socket, MD5Hash &md5)
+{
+  const array<ustring> &a = *(const array<ustring> *)(((char *)node) + socket.struct_offset);
+  for (size_t i = 0; i < a.size(); i++) {
+    md5.append(a[i].string());
+  }
+}
+
 template<typename T> void array_hash(const Node *node, const SocketType &socket, MD5Hash &md5)
 {
   const array<T> &a = *(const array<T> *)(((char *)node) + socket.struct_offset);
@@ -544,7 +559,7 @@ void Node::hash(MD5Hash &md5)
       case SocketType::CLOSURE:
         break;
       case SocketType::STRING:
-        value_hash<ustring>(this, socket, md5);
+        string_hash(this, socket, md5);
         break;
       case SocketType::ENUM:
         value_hash<int>(this, socket, md5);
@@ -581,7 +596,7 @@ void Node::hash(MD5Hash &md5)
         array_hash<float2>(this, socket, md5);
         break;
       case SocketType::STRING_ARRAY:
-        array_hash<ustring>(this, socket, md5);
+        string_array_hash(this, socket, md5);
         break;
       case SocketType::TRANSFORM_ARRAY:
         array_hash<Transform>(this, socket, md5);
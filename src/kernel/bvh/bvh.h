@@ -40,6 +40,7 @@ CCL_NAMESPACE_BEGIN
 #    include "kernel/bvh/qbvh_nodes.h"
 #    ifdef __KERNEL_AVX2__
 #      include "kernel/bvh/obvh_nodes.h"
+#      include "kernel/bvh/obvh_packet.h"
 #    endif
 #  endif
 
@@ -281,6 +282,58 @@ ccl_device_intersect bool scene_intersect(KernelGlobals *kg,
 #endif     /* __KERNEL_OPTIX__ */
 }
 
+#ifdef __KERNEL_CPU__
+/* Intersect up to BVH_PACKET_SIZE rays with the scene, returning the mask of
+ * rays which hit something, the others have their primitive set to PRIM_NONE.
+ * Rays are traversed together as a packet when the BVH layout and scene allow,
+ * and one by one otherwise. */
+ccl_device_intersect uint scene_intersect_packet(KernelGlobals *kg,
+                                                 const Ray *rays,
+                                                 const int num_rays,
+                                                 const uint visibility,
+                                                 Intersection *isects)
+{
+  kernel_assert(num_rays <= BVH_PACKET_SIZE);
+
+#  if defined(__KERNEL_AVX2__) && defined(__QBVH__)
+  if ((kernel_data.bvh.bvh_layout & (BVH_LAYOUT_BVH8 | BVH_LAYOUT_BVH8_QUANTIZED)) &&
+      !kernel_data.bvh.have_motion && !kernel_data.bvh.have_curves &&
+      !kernel_data.bvh.have_instancing
+#    ifdef __EMBREE__
+      && !kernel_data.bvh.scene
+#    endif
+  ) {
+    PROFILING_INIT(kg, PROFILING_INTERSECT);
+
+    uint ray_mask = 0;
+    for (int i = 0; i < num_rays; i++) {
+      if (scene_intersect_valid(&rays[i])) {
+        ray_mask |= (1u << i);
+      }
+      else {
+        isects[i].t = rays[i].t;
+        isects[i].prim = PRIM_NONE;
+        isects[i].object = OBJECT_NONE;
+      }
+    }
+
+    return obvh_intersect_packet(kg, rays, isects, ray_mask, visibility);
+  }
+#  endif /* __KERNEL_AVX2__ && __QBVH__ */
+
+  uint hit_mask = 0;
+  for (int i = 0; i < num_rays; i++) {
+    if (scene_intersect(kg, &rays[i], visibility, &isects[i])) {
+      hit_mask |= (1u << i);
+    }
+    else {
+      isects[i].prim = PRIM_NONE;
+    }
+  }
+  return hit_mask;
+}
+#endif /* __KERNEL_CPU__ */
+
 #ifdef __BVH_LOCAL__
 ccl_device_intersect bool scene_intersect_local(KernelGlobals *kg,
                                                 const Ray *ray,
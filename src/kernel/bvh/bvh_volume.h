@@ -307,6 +307,7 @@ ccl_device_inline bool BVH_FUNCTION_NAME(KernelGlobals *kg,
   switch (kernel_data.bvh.bvh_layout) {
 #ifdef __KERNEL_AVX2__
     case BVH_LAYOUT_BVH8:
+    case BVH_LAYOUT_BVH8_QUANTIZED:
       return BVH_FUNCTION_FULL_NAME(OBVH)(kg, ray, isect, visibility);
 #endif
 #ifdef __QBVH__
@@ -230,6 +230,55 @@ ccl_device_inline void obvh_stack_sort(OBVHStackItem *ccl_restrict s1,
   }
 }
 
+/* Axis-aligned nodes bounds
+ *
+ * Planes of the eight child boxes, in the order min_x, max_x, min_y, max_y,
+ * min_z, max_z. Quantized nodes store them as 8 bit multiples of a power of
+ * two scale per axis, as offsets from the lower corner of the node bounds:
+ *
+ *   node_addr + 0: visibility, time_from, time_to
+ *   node_addr + 1: origin
+ *   node_addr + 2..4: quantized planes, 8 bytes each
+ *   node_addr + 5: scale
+ *   node_addr + 6..7: child addresses
+ */
+
+#ifdef __KERNEL_AVX2__
+ccl_device_inline avxf obvh_quantized_node_bounds(KernelGlobals *ccl_restrict kg,
+                                                  const int node_addr,
+                                                  const int plane)
+{
+  const uchar *planes = (const uchar *)&kernel_tex_fetch(__bvh_nodes, node_addr + 2);
+  const int axis = plane >> 1;
+  const float origin = kernel_tex_fetch(__bvh_nodes, node_addr + 1)[axis];
+  const float scale = kernel_tex_fetch(__bvh_nodes, node_addr + 5)[axis];
+  const __m128i q8 = _mm_loadl_epi64((const __m128i *)(planes + plane * 8));
+  const avxf q = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q8));
+  return madd(q, avxf(scale), avxf(origin));
+}
+#endif
+
+ccl_device_inline avxf obvh_aligned_node_bounds(KernelGlobals *ccl_restrict kg,
+                                                const int node_addr,
+                                                const int plane)
+{
+#ifdef __KERNEL_AVX2__
+  if (kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH8_QUANTIZED) {
+    return obvh_quantized_node_bounds(kg, node_addr, plane);
+  }
+#endif
+  return kernel_tex_fetch_avxf(__bvh_nodes, node_addr + 2 + plane * 2);
+}
+
+ccl_device_inline avxf obvh_aligned_node_children(KernelGlobals *ccl_restrict kg,
+                                                  const int node_addr)
+{
+  if (kernel_data.bvh.bvh_layout == BVH_LAYOUT_BVH8_QUANTIZED) {
+    return kernel_tex_fetch_avxf(__bvh_nodes, node_addr + 6);
+  }
+  return kernel_tex_fetch_avxf(__bvh_nodes, node_addr + 14);
+}
+
 /* Axis-aligned nodes intersection */
 
 ccl_device_inline int obvh_aligned_node_intersect(KernelGlobals *ccl_restrict kg,
@@ -250,20 +299,13 @@ ccl_device_inline int obvh_aligned_node_intersect(KernelGlobals *ccl_restrict kg
                                                   const int node_addr,
                                                   avxf *ccl_restrict dist)
 {
-  const int offset = node_addr + 2;
 #ifdef __KERNEL_AVX2__
-  const avxf tnear_x = msub(
-      kernel_tex_fetch_avxf(__bvh_nodes, offset + near_x * 2), idir.x, org_idir.x);
-  const avxf tnear_y = msub(
-      kernel_tex_fetch_avxf(__bvh_nodes, offset + near_y * 2), idir.y, org_idir.y);
-  const avxf tnear_z = msub(
-      kernel_tex_fetch_avxf(__bvh_nodes, offset + near_z * 2), idir.z, org_idir.z);
-  const avxf tfar_x = msub(
-      kernel_tex_fetch_avxf(__bvh_nodes, offset + far_x * 2), idir.x, org_idir.x);
-  const avxf tfar_y = msub(
-      kernel_tex_fetch_avxf(__bvh_nodes, offset + far_y * 2), idir.y, org_idir.y);
-  const avxf tfar_z = msub(
-      kernel_tex_fetch_avxf(__bvh_nodes, offset + far_z * 2), idir.z, org_idir.z);
+  const avxf tnear_x = msub(obvh_aligned_node_bounds(kg, node_addr, near_x), idir.x, org_idir.x);
+  const avxf tnear_y = msub(obvh_aligned_node_bounds(kg, node_addr, near_y), idir.y, org_idir.y);
+  const avxf tnear_z = msub(obvh_aligned_node_bounds(kg, node_addr, near_z), idir.z, org_idir.z);
+  const avxf tfar_x = msub(obvh_aligned_node_bounds(kg, node_addr, far_x), idir.x, org_idir.x);
+  const avxf tfar_y = msub(obvh_aligned_node_bounds(kg, node_addr, far_y), idir.y, org_idir.y);
+  const avxf tfar_z = msub(obvh_aligned_node_bounds(kg, node_addr, far_z), idir.z, org_idir.z);
 
   const avxf tnear = max4(tnear_x, tnear_y, tnear_z, isect_near);
   const avxf tfar = min4(tfar_x, tfar_y, tfar_z, isect_far);
@@ -0,0 +1,364 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* OBVH packet traversal
+ *
+ * Traverses a packet of up to BVH_PACKET_SIZE rays through the OBVH together,
+ * so that node fetches and the traversal stack are shared by all rays. Every
+ * stack item stores the mask of rays which hit the node, and only those rays
+ * are tested against its children.
+ *
+ * When the directions of all rays have the same signs, as for camera rays or
+ * shadow rays towards a light, children are first tested against the frustum
+ * spanned by the packet using interval arithmetic, which culls nodes missed by
+ * all rays without testing the rays one by one.
+ *
+ * Only triangles are supported, without instancing, motion blur or hair. */
+
+struct OBVHPacketStackItem {
+  int addr;
+  uint ray_mask;
+  float dist;
+};
+
+struct OBVHPacketRay {
+  float3 P;
+  float3 dir;
+  avx3f P_idir4;
+  avx3f idir4;
+  int near_x, near_y, near_z;
+  int far_x, far_y, far_z;
+};
+
+/* Bounds of ray origins and inverse directions of the packet. */
+struct OBVHPacketFrustum {
+  float3 P_min, P_max;
+  float3 idir_min, idir_max;
+  float t_max;
+  int near_x, near_y, near_z;
+  int far_x, far_y, far_z;
+};
+
+/* Lower and upper bound of (plane - P) * idir over all rays of the packet. */
+ccl_device_inline avxf obvh_packet_interval_min(
+    const avxf &plane, float P_min, float P_max, float idir_min, float idir_max)
+{
+  const avxf a = plane - P_max, b = plane - P_min;
+  return min(min(a * idir_min, a * idir_max), min(b * idir_min, b * idir_max));
+}
+
+ccl_device_inline avxf obvh_packet_interval_max(
+    const avxf &plane, float P_min, float P_max, float idir_min, float idir_max)
+{
+  const avxf a = plane - P_max, b = plane - P_min;
+  return max(max(a * idir_min, a * idir_max), max(b * idir_min, b * idir_max));
+}
+
+/* Conservative mask of the children hit by any ray of the packet. */
+ccl_device_inline int obvh_packet_frustum_intersect(KernelGlobals *ccl_restrict kg,
+                                                    const OBVHPacketFrustum *frustum,
+                                                    const int node_addr)
+{
+  const float3 P_min = frustum->P_min, P_max = frustum->P_max;
+  const float3 idir_min = frustum->idir_min, idir_max = frustum->idir_max;
+
+  const avxf tnear_x = obvh_packet_interval_min(
+      obvh_aligned_node_bounds(kg, node_addr, frustum->near_x),
+      P_min.x,
+      P_max.x,
+      idir_min.x,
+      idir_max.x);
+  const avxf tnear_y = obvh_packet_interval_min(
+      obvh_aligned_node_bounds(kg, node_addr, frustum->near_y),
+      P_min.y,
+      P_max.y,
+      idir_min.y,
+      idir_max.y);
+  const avxf tnear_z = obvh_packet_interval_min(
+      obvh_aligned_node_bounds(kg, node_addr, frustum->near_z),
+      P_min.z,
+      P_max.z,
+      idir_min.z,
+      idir_max.z);
+  const avxf tfar_x = obvh_packet_interval_max(
+      obvh_aligned_node_bounds(kg, node_addr, frustum->far_x),
+      P_min.x,
+      P_max.x,
+      idir_min.x,
+      idir_max.x);
+  const avxf tfar_y = obvh_packet_interval_max(
+      obvh_aligned_node_bounds(kg, node_addr, frustum->far_y),
+      P_min.y,
+      P_max.y,
+      idir_min.y,
+      idir_max.y);
+  const avxf tfar_z = obvh_packet_interval_max(
+      obvh_aligned_node_bounds(kg, node_addr, frustum->far_z),
+      P_min.z,
+      P_max.z,
+      idir_min.z,
+      idir_max.z);
+
+  const avxf tnear = max4(tnear_x, tnear_y, tnear_z, avxf(0.0f));
+  const avxf tfar = min4(tfar_x, tfar_y, tfar_z, avxf(frustum->t_max));
+  /* Widen a little, so rounding never culls a node that a single ray hits. */
+  return movemask(tnear * (1.0f - 1e-5f) <= tfar * (1.0f + 1e-5f));
+}
+
+/* Returns the mask of rays in ray_mask which hit something. Intersections of
+ * rays outside of ray_mask are left untouched. */
+ccl_device uint obvh_intersect_packet(KernelGlobals *kg,
+                                      const Ray *rays,
+                                      Intersection *isects,
+                                      uint ray_mask,
+                                      const uint visibility)
+{
+  OBVHPacketStackItem traversal_stack[BVH_OSTACK_SIZE];
+  OBVHPacketRay packet[BVH_PACKET_SIZE];
+  OBVHPacketFrustum frustum;
+
+  frustum.P_min = make_float3(FLT_MAX, FLT_MAX, FLT_MAX);
+  frustum.P_max = -frustum.P_min;
+  frustum.idir_min = frustum.P_min;
+  frustum.idir_max = frustum.P_max;
+  frustum.t_max = 0.0f;
+
+  /* Frustum culling needs the same near and far planes for all rays. */
+  bool use_frustum = true;
+  int sign_mask = -1;
+
+  for (uint mask = ray_mask; mask != 0;) {
+    const int i = __bscf(mask);
+    const Ray *ray = &rays[i];
+    OBVHPacketRay *pray = &packet[i];
+
+    Intersection *isect = &isects[i];
+    isect->t = ray->t;
+    isect->u = 0.0f;
+    isect->v = 0.0f;
+    isect->prim = PRIM_NONE;
+    isect->object = OBJECT_NONE;
+    BVH_DEBUG_INIT();
+
+    pray->P = ray->P;
+    pray->dir = bvh_clamp_direction(ray->D);
+    const float3 idir = bvh_inverse_direction(pray->dir);
+    const float3 P_idir = pray->P * idir;
+    pray->P_idir4 = avx3f(P_idir.x, P_idir.y, P_idir.z);
+    pray->idir4 = avx3f(avxf(idir.x), avxf(idir.y), avxf(idir.z));
+    obvh_near_far_idx_calc(idir,
+                           &pray->near_x,
+                           &pray->near_y,
+                           &pray->near_z,
+                           &pray->far_x,
+                           &pray->far_y,
+                           &pray->far_z);
+
+    const int ray_sign_mask = (idir.x < 0.0f) | ((idir.y < 0.0f) << 1) | ((idir.z < 0.0f) << 2);
+    if (sign_mask == -1) {
+      sign_mask = ray_sign_mask;
+      frustum.near_x = pray->near_x;
+      frustum.near_y = pray->near_y;
+      frustum.near_z = pray->near_z;
+      frustum.far_x = pray->far_x;
+      frustum.far_y = pray->far_y;
+      frustum.far_z = pray->far_z;
+    }
+    else if (sign_mask != ray_sign_mask) {
+      use_frustum = false;
+    }
+
+    frustum.P_min = min(frustum.P_min, pray->P);
+    frustum.P_max = max(frustum.P_max, pray->P);
+    frustum.idir_min = min(frustum.idir_min, idir);
+    frustum.idir_max = max(frustum.idir_max, idir);
+    frustum.t_max = max(frustum.t_max, ray->t);
+  }
+
+  uint hit_mask = 0;
+
+  int stack_ptr = 0;
+  traversal_stack[0].addr = kernel_data.bvh.root;
+  traversal_stack[0].ray_mask = ray_mask;
+  traversal_stack[0].dist = -FLT_MAX;
+
+  while (stack_ptr >= 0) {
+    /* Pop. */
+    const int node_addr = traversal_stack[stack_ptr].addr;
+    const float node_dist = traversal_stack[stack_ptr].dist;
+    uint node_rays = traversal_stack[stack_ptr].ray_mask & ray_mask;
+    --stack_ptr;
+
+    /* Drop rays which found a closer hit since the node was pushed. */
+    for (uint mask = node_rays; mask != 0;) {
+      const int i = __bscf(mask);
+      if (node_dist > isects[i].t) {
+        node_rays &= ~(1u << i);
+      }
+    }
+    if (node_rays == 0) {
+      continue;
+    }
+
+    if (node_addr >= 0) {
+      /* Inner node. */
+#ifdef __VISIBILITY_FLAG__
+      const float4 inodes = kernel_tex_fetch(__bvh_nodes, node_addr + 0);
+      if ((__float_as_uint(inodes.x) & visibility) == 0) {
+        continue;
+      }
+#endif
+
+      /* Cull children outside of the frustum of the packet all at once. */
+      int child_mask = 0xff;
+      if (use_frustum && (node_rays & (node_rays - 1)) != 0) {
+        child_mask = obvh_packet_frustum_intersect(kg, &frustum, node_addr);
+        if (child_mask == 0) {
+          continue;
+        }
+      }
+
+      uint child_rays[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      float child_dist[8];
+      int hit_children = 0;
+
+      for (uint mask = node_rays; mask != 0;) {
+        const int i = __bscf(mask);
+        const OBVHPacketRay *pray = &packet[i];
+#ifdef __KERNEL_DEBUG__
+        ++isects[i].num_traversed_nodes;
+#endif
+
+        avxf dist;
+        int ray_child_mask = obvh_aligned_node_intersect(kg,
+                                                         avxf(0.0f),
+                                                         avxf(isects[i].t),
+                                                         pray->P_idir4,
+                                                         pray->idir4,
+                                                         pray->near_x,
+                                                         pray->near_y,
+                                                         pray->near_z,
+                                                         pray->far_x,
+                                                         pray->far_y,
+                                                         pray->far_z,
+                                                         node_addr,
+                                                         &dist) &
+                             child_mask;
+
+        while (ray_child_mask != 0) {
+          const int r = __bscf(ray_child_mask);
+          const float d = ((float *)&dist)[r];
+          if (child_rays[r] == 0 || d < child_dist[r]) {
+            child_dist[r] = d;
+          }
+          child_rays[r] |= (1u << i);
+          hit_children |= (1 << r);
+        }
+      }
+
+      if (hit_children == 0) {
+        continue;
+      }
+
+      /* Push hit children sorted by distance, so that the child closest to any
+       * ray of the packet is traversed next. */
+      const avxf cnodes = obvh_aligned_node_children(kg, node_addr);
+      const int first = stack_ptr + 1;
+
+      while (hit_children != 0) {
+        const int r = __bscf(hit_children);
+        OBVHPacketStackItem item;
+        item.addr = __float_as_int(cnodes[r]);
+        item.ray_mask = child_rays[r];
+        item.dist = child_dist[r];
+
+        ++stack_ptr;
+        kernel_assert(stack_ptr < BVH_OSTACK_SIZE);
+        int j = stack_ptr;
+        while (j > first && traversal_stack[j - 1].dist < item.dist) {
+          traversal_stack[j] = traversal_stack[j - 1];
+          --j;
+        }
+        traversal_stack[j] = item;
+      }
+    }
+    else {
+      /* Leaf node. */
+      const float4 leaf = kernel_tex_fetch(__bvh_leaf_nodes, (-node_addr - 1));
+
+#ifdef __VISIBILITY_FLAG__
+      if ((__float_as_uint(leaf.z) & visibility) == 0) {
+        continue;
+      }
+#endif
+
+      const int prim_addr = __float_as_int(leaf.x);
+      const int prim_addr2 = __float_as_int(leaf.y);
+      const int prim_count = prim_addr2 - prim_addr;
+      kernel_assert(prim_addr >= 0);
+      kernel_assert((__float_as_uint(leaf.w) & PRIMITIVE_ALL) == PRIMITIVE_TRIANGLE);
+
+      for (uint mask = node_rays; mask != 0;) {
+        const int i = __bscf(mask);
+        const OBVHPacketRay *pray = &packet[i];
+        Intersection *isect = &isects[i];
+        bool hit = false;
+
+        if (prim_count < 3) {
+          for (int prim = prim_addr; prim < prim_addr2; prim++) {
+            BVH_DEBUG_NEXT_INTERSECTION();
+            hit |= triangle_intersect(
+                kg, isect, pray->P, pray->dir, visibility, OBJECT_NONE, prim);
+          }
+        }
+        else {
+          hit = triangle_intersect8(kg,
+                                    &isect,
+                                    pray->P,
+                                    pray->dir,
+                                    visibility,
+                                    OBJECT_NONE,
+                                    prim_addr,
+                                    prim_count,
+                                    0,
+                                    0,
+                                    NULL,
+                                    0.0f);
+        }
+
+        if (hit) {
+          hit_mask |= (1u << i);
+          /* Shadow ray early termination. */
+          if (visibility == PATH_RAY_SHADOW_OPAQUE) {
+            ray_mask &= ~(1u << i);
+          }
+        }
+      }
+
+      if (ray_mask == 0) {
+        break;
+      }
+
+      /* Shrink the frustum to the closest hits found so far. */
+      frustum.t_max = 0.0f;
+      for (uint mask = ray_mask; mask != 0;) {
+        frustum.t_max = max(frustum.t_max, isects[__bscf(mask)].t);
+      }
+    }
+  }
+
+  return hit_mask;
+}
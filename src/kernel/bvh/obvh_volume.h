@@ -124,7 +124,7 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(OBVH)(KernelGlobals *kg,
           else
 #endif
           {
-            cnodes = kernel_tex_fetch_avxf(__bvh_nodes, node_addr + 14);
+            cnodes = obvh_aligned_node_children(kg, node_addr);
           }
 
           /* One child is hit, continue with that child. */
@@ -19,6 +19,37 @@ CCL_NAMESPACE_BEGIN
 #define load4_a(buf, ofs) (*((float4 *)((buf) + (ofs))))
 #define load4_u(buf, ofs) load_float4((buf) + (ofs))
 
+#ifdef __KERNEL_AVX2__
+/* With AVX2 the loops below handle two float4 groups at a time, and leave
+ * the last group of a row to the float4 code. That way exactly the same
+ * elements are touched, rows are only padded to multiples of four. */
+#  define load8_u(buf, ofs) avxf(_mm256_loadu_ps((buf) + (ofs)))
+#  define store8_u(buf, ofs, val) _mm256_storeu_ps((buf) + (ofs), (val).m256)
+
+ccl_device_inline avxf nlm_mask8(const avxf &x8, float lowx, float highx, const avxf &a)
+{
+  const __m256 active = _mm256_and_ps(_mm256_cmp_ps(x8, avxf(lowx), _CMP_GE_OQ),
+                                      _mm256_cmp_ps(x8, avxf(highx), _CMP_LT_OQ));
+  return _mm256_and_ps(active, a);
+}
+
+/* Eight-wide version of fast_expf4(). */
+ccl_device_inline avxf nlm_fast_expf8(avxf x)
+{
+  const avxf one(1.0f);
+  x = min(max(x / M_LN2_F, avxf(-126.0f)), avxf(126.0f));
+  const __m256i m = _mm256_cvtps_epi32(x);
+  x = one - (one - (x - avxf(_mm256_cvtepi32_ps(m))));
+  avxf r(1.33336498402e-3f);
+  r = x * r + avxf(9.810352697968e-3f);
+  r = x * r + avxf(5.551834031939e-2f);
+  r = x * r + avxf(0.2401793301105f);
+  r = x * r + avxf(0.693144857883f);
+  r = x * r + one;
+  return _mm256_add_epi32(_mm256_castps_si256(r), _mm256_slli_epi32(m, 23));
+}
+#endif
+
 ccl_device_inline void kernel_filter_nlm_calc_difference(int dx,
                                                          int dy,
                                                          const float *ccl_restrict weight_image,
@@ -40,9 +71,33 @@ ccl_device_inline void kernel_filter_nlm_calc_difference(int dx,
   const float4 channel_fac = make_float4(1.0f / numChannels);
 
   for (int y = rect.y; y < rect.w; y++) {
-    int idx_p = y * stride + aligned_lowx;
-    int idx_q = (y + dy) * stride + aligned_lowx + dx + frame_offset;
-    for (int x = aligned_lowx; x < rect.z; x += 4, idx_p += 4, idx_q += 4) {
+    int x = aligned_lowx;
+#ifdef __KERNEL_AVX2__
+    for (; x + 4 < rect.z; x += 8) {
+      const int idx_p = y * stride + x;
+      const int idx_q = (y + dy) * stride + x + dx + frame_offset;
+      avxf diff(0.0f);
+      avxf scale_fac(1.0f);
+      if (scale_image) {
+        scale_fac = min(max(load8_u(scale_image, idx_p) / load8_u(scale_image, idx_q),
+                            avxf(0.25f)),
+                        avxf(4.0f));
+      }
+      for (int c = 0, chan_ofs = 0; c < numChannels; c++, chan_ofs += channel_offset) {
+        avxf color_p = load8_u(weight_image, idx_p + chan_ofs);
+        avxf color_q = scale_fac * load8_u(weight_image, idx_q + chan_ofs);
+        avxf cdiff = color_p - color_q;
+        avxf var_p = load8_u(variance_image, idx_p + chan_ofs);
+        avxf var_q = scale_fac * scale_fac * load8_u(variance_image, idx_q + chan_ofs);
+        diff = diff + (cdiff * cdiff - a * (var_p + min(var_p, var_q))) /
+                          (avxf(1e-8f) + k_2 * (var_p + var_q));
+      }
+      store8_u(difference_image, idx_p, diff * (1.0f / numChannels));
+    }
+#endif
+    for (; x < rect.z; x += 4) {
+      const int idx_p = y * stride + x;
+      const int idx_q = (y + dy) * stride + x + dx + frame_offset;
       float4 diff = make_float4(0.0f);
       float4 scale_fac;
       if (scale_image) {
@@ -79,7 +134,15 @@ ccl_device_inline void kernel_filter_nlm_blur(
       load4_a(out_image, y * stride + x) = make_float4(0.0f);
     }
     for (int y1 = low; y1 < high; y1++) {
-      for (int x = aligned_lowx; x < rect.z; x += 4) {
+      int x = aligned_lowx;
+#ifdef __KERNEL_AVX2__
+      for (; x + 4 < rect.z; x += 8) {
+        store8_u(out_image,
+                 y * stride + x,
+                 load8_u(out_image, y * stride + x) + load8_u(difference_image, y1 * stride + x));
+      }
+#endif
+      for (; x < rect.z; x += 4) {
         load4_a(out_image, y * stride + x) += load4_a(difference_image, y1 * stride + x);
       }
     }
@@ -106,7 +169,18 @@ ccl_device_inline void nlm_blur_horizontal(
     int4 lowx4 = make_int4(rect.x - min(0, dx));
     int4 highx4 = make_int4(rect.z - max(0, dx));
     for (int y = rect.y; y < rect.w; y++) {
-      for (int x = aligned_lowx; x < highx; x += 4) {
+      int x = aligned_lowx;
+#ifdef __KERNEL_AVX2__
+      for (; x + 4 < highx; x += 8) {
+        const avxf x8 = avxf((float)x) + avxf(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+        const avxf diff = load8_u(difference_image, y * stride + x + dx);
+        store8_u(out_image,
+                 y * stride + x,
+                 load8_u(out_image, y * stride + x) +
+                     nlm_mask8(x8, (float)(rect.x - min(0, dx)), (float)highx, diff));
+      }
+#endif
+      for (; x < highx; x += 4) {
         int4 x4 = make_int4(x) + make_int4(0, 1, 2, 3);
         int4 active = (x4 >= lowx4) & (x4 < highx4);
 
@@ -118,7 +192,16 @@ ccl_device_inline void nlm_blur_horizontal(
 
   aligned_lowx = round_down(rect.x, 4);
   for (int y = rect.y; y < rect.w; y++) {
-    for (int x = aligned_lowx; x < rect.z; x += 4) {
+    int x = aligned_lowx;
+#ifdef __KERNEL_AVX2__
+    for (; x + 4 < rect.z; x += 8) {
+      const avxf x8 = avxf((float)x) + avxf(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+      const avxf low = max(avxf((float)rect.x), x8 - (float)f);
+      const avxf high = min(avxf((float)rect.z), x8 + (float)(f + 1));
+      store8_u(out_image, y * stride + x, load8_u(out_image, y * stride + x) / (high - low));
+    }
+#endif
+    for (; x < rect.z; x += 4) {
       float4 x4 = make_float4(x) + make_float4(0.0f, 1.0f, 2.0f, 3.0f);
       float4 low = max(make_float4(rect.x), x4 - make_float4(f));
       float4 high = min(make_float4(rect.z), x4 + make_float4(f + 1));
@@ -134,7 +217,15 @@ ccl_device_inline void kernel_filter_nlm_calc_weight(
 
   int aligned_lowx = round_down(rect.x, 4);
   for (int y = rect.y; y < rect.w; y++) {
-    for (int x = aligned_lowx; x < rect.z; x += 4) {
+    int x = aligned_lowx;
+#ifdef __KERNEL_AVX2__
+    for (; x + 4 < rect.z; x += 8) {
+      store8_u(out_image,
+               y * stride + x,
+               nlm_fast_expf8(avxf(0.0f) - max(load8_u(out_image, y * stride + x), avxf(0.0f))));
+    }
+#endif
+    for (; x < rect.z; x += 4) {
       load4_a(out_image, y * stride + x) = fast_expf4(
           -max(load4_a(out_image, y * stride + x), make_float4(0.0f)));
     }
@@ -157,7 +248,33 @@ ccl_device_inline void kernel_filter_nlm_update_output(int dx,
 
   int aligned_lowx = round_down(rect.x, 4);
   for (int y = rect.y; y < rect.w; y++) {
-    for (int x = aligned_lowx; x < rect.z; x += 4) {
+    int x = aligned_lowx;
+#ifdef __KERNEL_AVX2__
+    for (; x + 4 < rect.z; x += 8) {
+      const avxf x8 = avxf((float)x) + avxf(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+
+      int idx_p = y * stride + x, idx_q = (y + dy) * stride + (x + dx);
+
+      avxf weight = load8_u(temp_image, idx_p);
+      store8_u(accum_image,
+               idx_p,
+               load8_u(accum_image, idx_p) +
+                   nlm_mask8(x8, (float)rect.x, (float)rect.z, weight));
+
+      avxf val = load8_u(image, idx_q);
+      if (channel_offset) {
+        val = val + load8_u(image, idx_q + channel_offset);
+        val = val + load8_u(image, idx_q + 2 * channel_offset);
+        val = val * (1.0f / 3.0f);
+      }
+
+      store8_u(out_image,
+               idx_p,
+               load8_u(out_image, idx_p) +
+                   nlm_mask8(x8, (float)rect.x, (float)rect.z, weight * val));
+    }
+#endif
+    for (; x < rect.z; x += 4) {
       int4 x4 = make_int4(x) + make_int4(0, 1, 2, 3);
       int4 active = (x4 >= make_int4(rect.x)) & (x4 < make_int4(rect.z));
 
@@ -242,7 +359,14 @@ ccl_device_inline void kernel_filter_nlm_normalize(float *out_image,
                                                    int w)
 {
   for (int y = rect.y; y < rect.w; y++) {
-    for (int x = rect.x; x < rect.z; x++) {
+    int x = rect.x;
+#ifdef __KERNEL_AVX2__
+    for (; x + 8 <= rect.z; x += 8) {
+      const int idx = y * w + x;
+      store8_u(out_image, idx, load8_u(out_image, idx) / load8_u(accum_image, idx));
+    }
+#endif
+    for (; x < rect.z; x++) {
       out_image[y * w + x] /= accum_image[y * w + x];
     }
   }
@@ -250,5 +374,9 @@ ccl_device_inline void kernel_filter_nlm_normalize(float *out_image,
 
 #undef load4_a
 #undef load4_u
+#ifdef __KERNEL_AVX2__
+#  undef load8_u
+#  undef store8_u
+#endif
 
 CCL_NAMESPACE_END
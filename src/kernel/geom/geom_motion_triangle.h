@@ -59,9 +59,10 @@ ccl_device_inline void motion_triangle_verts_for_step(KernelGlobals *kg,
 {
   if (step == numsteps) {
     /* center step: regular vertex location */
-    verts[0] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 0));
-    verts[1] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 1));
-    verts[2] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 2));
+    const uint4 verts_index = triangle_verts_index(kg, tri_vindex);
+    verts[0] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, verts_index.x));
+    verts[1] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, verts_index.y));
+    verts[2] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, verts_index.z));
   }
   else {
     /* center step not store in this array */
@@ -22,14 +22,25 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Indices of the triangle vertices in __prim_tri_verts. With indexed triangle
+ * storage the mesh vertices are stored once and shared by all triangles using
+ * them, otherwise every triangle has its own copy of its three vertices. */
+ccl_device_inline uint4 triangle_verts_index(KernelGlobals *kg, uint4 tri_vindex)
+{
+  if (kernel_data.bvh.use_indexed_triangles) {
+    return tri_vindex;
+  }
+  return make_uint4(tri_vindex.w + 0, tri_vindex.w + 1, tri_vindex.w + 2, tri_vindex.w);
+}
+
 /* normal on triangle  */
 ccl_device_inline float3 triangle_normal(KernelGlobals *kg, ShaderData *sd)
 {
   /* load triangle vertices */
-  const uint4 tri_vindex = kernel_tex_fetch(__tri_vindex, sd->prim);
-  const float3 v0 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 0));
-  const float3 v1 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 1));
-  const float3 v2 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 2));
+  const uint4 tri_vindex = triangle_verts_index(kg, kernel_tex_fetch(__tri_vindex, sd->prim));
+  const float3 v0 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.x));
+  const float3 v1 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.y));
+  const float3 v2 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.z));
 
   /* return normal */
   if (sd->object_flag & SD_OBJECT_NEGATIVE_SCALE_APPLIED) {
@@ -45,10 +56,10 @@ ccl_device_inline void triangle_point_normal(
     KernelGlobals *kg, int object, int prim, float u, float v, float3 *P, float3 *Ng, int *shader)
 {
   /* load triangle vertices */
-  const uint4 tri_vindex = kernel_tex_fetch(__tri_vindex, prim);
-  float3 v0 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 0));
-  float3 v1 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 1));
-  float3 v2 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 2));
+  const uint4 tri_vindex = triangle_verts_index(kg, kernel_tex_fetch(__tri_vindex, prim));
+  float3 v0 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.x));
+  float3 v1 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.y));
+  float3 v2 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.z));
   /* compute point */
   float t = 1.0f - u - v;
   *P = (u * v0 + v * v1 + t * v2);
@@ -69,10 +80,10 @@ ccl_device_inline void triangle_point_normal(
 
 ccl_device_inline void triangle_vertices(KernelGlobals *kg, int prim, float3 P[3])
 {
-  const uint4 tri_vindex = kernel_tex_fetch(__tri_vindex, prim);
-  P[0] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 0));
-  P[1] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 1));
-  P[2] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 2));
+  const uint4 tri_vindex = triangle_verts_index(kg, kernel_tex_fetch(__tri_vindex, prim));
+  P[0] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.x));
+  P[1] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.y));
+  P[2] = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.z));
 }
 
 /* Interpolate smooth vertex normal from vertices */
@@ -99,10 +110,10 @@ ccl_device_inline void triangle_dPdudv(KernelGlobals *kg,
                                        ccl_addr_space float3 *dPdv)
 {
   /* fetch triangle vertex coordinates */
-  const uint4 tri_vindex = kernel_tex_fetch(__tri_vindex, prim);
-  const float3 p0 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 0));
-  const float3 p1 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 1));
-  const float3 p2 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.w + 2));
+  const uint4 tri_vindex = triangle_verts_index(kg, kernel_tex_fetch(__tri_vindex, prim));
+  const float3 p0 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.x));
+  const float3 p1 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.y));
+  const float3 p2 = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.z));
 
   /* compute derivatives of P w.r.t. uv */
   *dPdu = (p0 - p2);
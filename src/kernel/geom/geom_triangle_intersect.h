@@ -17,11 +17,25 @@
 /* Triangle/Ray intersections.
  *
  * For BVH ray intersection we use a precomputed triangle storage to accelerate
- * intersection at the cost of more memory usage.
+ * intersection at the cost of more memory usage. With indexed triangle storage
+ * the vertices are shared with the mesh and looked up through the triangle
+ * vertex indices instead, trading an extra fetch for less memory.
  */
 
 CCL_NAMESPACE_BEGIN
 
+/* Indices of the vertices in __prim_tri_verts of the triangle at the given
+ * primitive address in the BVH. */
+ccl_device_inline uint4 triangle_prim_verts_index(KernelGlobals *kg, int prim_addr)
+{
+  if (kernel_data.bvh.use_indexed_triangles) {
+    const int prim = kernel_tex_fetch(__prim_index, prim_addr);
+    return kernel_tex_fetch(__tri_vindex, prim);
+  }
+  const uint tri_vindex = kernel_tex_fetch(__prim_tri_index, prim_addr);
+  return make_uint4(tri_vindex + 0, tri_vindex + 1, tri_vindex + 2, tri_vindex);
+}
+
 ccl_device_inline bool triangle_intersect(KernelGlobals *kg,
                                           Intersection *isect,
                                           float3 P,
@@ -30,13 +44,15 @@ ccl_device_inline bool triangle_intersect(KernelGlobals *kg,
                                           int object,
                                           int prim_addr)
 {
-  const uint tri_vindex = kernel_tex_fetch(__prim_tri_index, prim_addr);
+  const uint4 tri_vindex = triangle_prim_verts_index(kg, prim_addr);
 #if defined(__KERNEL_SSE2__) && defined(__KERNEL_SSE__)
-  const ssef *ssef_verts = (ssef *)&kg->__prim_tri_verts.data[tri_vindex];
+  const ssef ssef_verts[3] = {*(ssef *)&kg->__prim_tri_verts.data[tri_vindex.x],
+                              *(ssef *)&kg->__prim_tri_verts.data[tri_vindex.y],
+                              *(ssef *)&kg->__prim_tri_verts.data[tri_vindex.z]};
 #else
-  const float4 tri_a = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 0),
-               tri_b = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 1),
-               tri_c = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 2);
+  const float4 tri_a = kernel_tex_fetch(__prim_tri_verts, tri_vindex.x),
+               tri_b = kernel_tex_fetch(__prim_tri_verts, tri_vindex.y),
+               tri_c = kernel_tex_fetch(__prim_tri_verts, tri_vindex.z);
 #endif
   float t, u, v;
   if (ray_triangle_intersect(P,
@@ -378,11 +394,11 @@ ccl_device_inline int triangle_intersect8(KernelGlobals *kg,
 
   int i, r;
 
-  uint tri_vindex = kernel_tex_fetch(__prim_tri_index, prim_addr);
   for (i = 0; i < prim_num; i++) {
-    tri_a[i] = *(__m128 *)&kg->__prim_tri_verts.data[tri_vindex++];
-    tri_b[i] = *(__m128 *)&kg->__prim_tri_verts.data[tri_vindex++];
-    tri_c[i] = *(__m128 *)&kg->__prim_tri_verts.data[tri_vindex++];
+    const uint4 tri_vindex = triangle_prim_verts_index(kg, prim_addr + i);
+    tri_a[i] = *(__m128 *)&kg->__prim_tri_verts.data[tri_vindex.x];
+    tri_b[i] = *(__m128 *)&kg->__prim_tri_verts.data[tri_vindex.y];
+    tri_c[i] = *(__m128 *)&kg->__prim_tri_verts.data[tri_vindex.z];
   }
   // create 9 or  12 placeholders
   tri[0] = _mm256_castps128_ps256(tri_a[0]);  //_mm256_zextps128_ps256
@@ -524,13 +540,15 @@ ccl_device_inline bool triangle_intersect_local(KernelGlobals *kg,
     }
   }
 
-  const uint tri_vindex = kernel_tex_fetch(__prim_tri_index, prim_addr);
+  const uint4 tri_vindex = triangle_prim_verts_index(kg, prim_addr);
 #  if defined(__KERNEL_SSE2__) && defined(__KERNEL_SSE__)
-  const ssef *ssef_verts = (ssef *)&kg->__prim_tri_verts.data[tri_vindex];
+  const ssef ssef_verts[3] = {*(ssef *)&kg->__prim_tri_verts.data[tri_vindex.x],
+                              *(ssef *)&kg->__prim_tri_verts.data[tri_vindex.y],
+                              *(ssef *)&kg->__prim_tri_verts.data[tri_vindex.z]};
 #  else
-  const float3 tri_a = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex + 0)),
-               tri_b = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex + 1)),
-               tri_c = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex + 2));
+  const float3 tri_a = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.x)),
+               tri_b = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.y)),
+               tri_c = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.z));
 #  endif
   float t, u, v;
   if (!ray_triangle_intersect(P,
@@ -598,9 +616,9 @@ ccl_device_inline bool triangle_intersect_local(KernelGlobals *kg,
 
   /* Record geometric normal. */
 #  if defined(__KERNEL_SSE2__) && defined(__KERNEL_SSE__)
-  const float3 tri_a = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex + 0)),
-               tri_b = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex + 1)),
-               tri_c = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex + 2));
+  const float3 tri_a = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.x)),
+               tri_b = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.y)),
+               tri_c = float4_to_float3(kernel_tex_fetch(__prim_tri_verts, tri_vindex.z));
 #  endif
   local_isect->Ng[hit] = normalize(cross(tri_b - tri_a, tri_c - tri_a));
 
@@ -646,10 +664,10 @@ ccl_device_inline float3 triangle_refine(KernelGlobals *kg,
 
   P = P + D * t;
 
-  const uint tri_vindex = kernel_tex_fetch(__prim_tri_index, isect->prim);
-  const float4 tri_a = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 0),
-               tri_b = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 1),
-               tri_c = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 2);
+  const uint4 tri_vindex = triangle_prim_verts_index(kg, isect->prim);
+  const float4 tri_a = kernel_tex_fetch(__prim_tri_verts, tri_vindex.x),
+               tri_b = kernel_tex_fetch(__prim_tri_verts, tri_vindex.y),
+               tri_c = kernel_tex_fetch(__prim_tri_verts, tri_vindex.z);
   float3 edge1 = make_float3(tri_a.x - tri_c.x, tri_a.y - tri_c.y, tri_a.z - tri_c.z);
   float3 edge2 = make_float3(tri_b.x - tri_c.x, tri_b.y - tri_c.y, tri_b.z - tri_c.z);
   float3 tvec = make_float3(P.x - tri_c.x, P.y - tri_c.y, P.z - tri_c.z);
@@ -709,10 +727,10 @@ ccl_device_inline float3 triangle_refine_local(KernelGlobals *kg,
   P = P + D * t;
 
 #ifdef __INTERSECTION_REFINE__
-  const uint tri_vindex = kernel_tex_fetch(__prim_tri_index, isect->prim);
-  const float4 tri_a = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 0),
-               tri_b = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 1),
-               tri_c = kernel_tex_fetch(__prim_tri_verts, tri_vindex + 2);
+  const uint4 tri_vindex = triangle_prim_verts_index(kg, isect->prim);
+  const float4 tri_a = kernel_tex_fetch(__prim_tri_verts, tri_vindex.x),
+               tri_b = kernel_tex_fetch(__prim_tri_verts, tri_vindex.y),
+               tri_c = kernel_tex_fetch(__prim_tri_verts, tri_vindex.z);
   float3 edge1 = make_float3(tri_a.x - tri_c.x, tri_a.y - tri_c.y, tri_a.z - tri_c.z);
   float3 edge2 = make_float3(tri_b.x - tri_c.x, tri_b.y - tri_c.y, tri_b.z - tri_c.z);
   float3 tvec = make_float3(P.x - tri_c.x, P.y - tri_c.y, P.z - tri_c.z);
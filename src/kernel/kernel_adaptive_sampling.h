@@ -0,0 +1,265 @@
+/*
+ * Copyright 2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_ADAPTIVE_SAMPLING_H__
+#define __KERNEL_ADAPTIVE_SAMPLING_H__
+
+CCL_NAMESPACE_BEGIN
+
+/* Adaptive sampling
+ *
+ * Every second sample is accumulated twice as strong into an auxiliary buffer, so the combined
+ * pass and the auxiliary pass are two estimates of the same pixel value. Their difference is
+ * used as a per pixel error estimate, and once it falls below the threshold the fourth
+ * component of the auxiliary pass is set to mark the pixel as converged. */
+
+/* Returns false when the pixel has converged and must not be sampled anymore, otherwise the
+ * sample which is about to be taken is accounted for in the sample count pass. */
+ccl_device_inline bool kernel_adaptive_sample_pixel(KernelGlobals *kg, ccl_global float *buffer)
+{
+  if (kernel_data.film.pass_flag & PASSMASK(ADAPTIVE_AUX_BUFFER)) {
+    if (buffer[kernel_data.film.pass_adaptive_aux_buffer + 3] > 0.0f) {
+      return false;
+    }
+  }
+
+  if (kernel_data.film.pass_flag & PASSMASK(SAMPLE_COUNT)) {
+    kernel_write_pass_float(buffer + kernel_data.film.pass_sample_count, 1.0f);
+  }
+
+  return true;
+}
+
+ccl_device_inline void kernel_adaptive_write_aux_buffer(KernelGlobals *kg,
+                                                        ccl_global float *buffer,
+                                                        int sample,
+                                                        float3 L_sum)
+{
+  if ((kernel_data.film.pass_flag & PASSMASK(ADAPTIVE_AUX_BUFFER)) && (sample & 1)) {
+    kernel_write_pass_float4(buffer + kernel_data.film.pass_adaptive_aux_buffer,
+                             make_float4(L_sum.x * 2.0f, L_sum.y * 2.0f, L_sum.z * 2.0f, 0.0f));
+  }
+}
+
+/* Determines whether to continue sampling a given pixel or if it has sufficiently converged.
+ * The number of samples must be even, so both estimates have seen the same amount of samples. */
+
+ccl_device void kernel_do_adaptive_stopping(KernelGlobals *kg,
+                                            ccl_global float *buffer,
+                                            int num_samples)
+{
+  ccl_global float *combined = buffer + kernel_data.film.pass_combined;
+  ccl_global float *aux = buffer + kernel_data.film.pass_adaptive_aux_buffer;
+
+  /* The per pixel error as seen in section 2.1 of "A hierarchical automatic stopping condition
+   * for Monte Carlo global illumination". A small epsilon avoids a division by zero. */
+  float error = (fabsf(combined[0] - aux[0]) + fabsf(combined[1] - aux[1]) +
+                 fabsf(combined[2] - aux[2])) /
+                (num_samples * 0.0001f + sqrtf(max(combined[0] + combined[1] + combined[2], 0.0f)));
+
+  if (error < kernel_data.integrator.adaptive_threshold * (float)num_samples) {
+    aux[3] += 1.0f;
+  }
+}
+
+/* This is a simple box filter in two passes. When a pixel demands more adaptive samples,
+ * its direct neighbors are marked as unconverged as well. Returns whether any pixel in the
+ * row or column still needs samples. */
+
+ccl_device bool kernel_do_adaptive_filter_x(
+    KernelGlobals *kg, ccl_global float *buffer, int y, int x, int w, int offset, int stride)
+{
+  const int pass_stride = kernel_data.film.pass_stride;
+  const int aux_w = kernel_data.film.pass_adaptive_aux_buffer + 3;
+
+  bool any = false;
+  bool prev = false;
+  for (int px = x; px < x + w; px++) {
+    int index = offset + px + y * stride;
+    ccl_global float *pixel = buffer + index * pass_stride;
+
+    if (pixel[aux_w] == 0.0f) {
+      any = true;
+      if (px > x && !prev) {
+        pixel[aux_w - pass_stride] = 0.0f;
+      }
+      prev = true;
+    }
+    else {
+      if (prev) {
+        pixel[aux_w] = 0.0f;
+      }
+      prev = false;
+    }
+  }
+
+  return any;
+}
+
+ccl_device bool kernel_do_adaptive_filter_y(
+    KernelGlobals *kg, ccl_global float *buffer, int x, int y, int h, int offset, int stride)
+{
+  const int pass_stride = kernel_data.film.pass_stride;
+  const int aux_w = kernel_data.film.pass_adaptive_aux_buffer + 3;
+
+  bool any = false;
+  bool prev = false;
+  for (int py = y; py < y + h; py++) {
+    int index = offset + x + py * stride;
+    ccl_global float *pixel = buffer + index * pass_stride;
+
+    if (pixel[aux_w] == 0.0f) {
+      any = true;
+      if (py > y && !prev) {
+        pixel[aux_w - stride * pass_stride] = 0.0f;
+      }
+      prev = true;
+    }
+    else {
+      if (prev) {
+        pixel[aux_w] = 0.0f;
+      }
+      prev = false;
+    }
+  }
+
+  return any;
+}
+
+ccl_device_inline void kernel_adaptive_scale_pass(ccl_global float *pass,
+                                                  int components,
+                                                  float sample_multiplier)
+{
+  for (int i = 0; i < components; i++) {
+    pass[i] *= sample_multiplier;
+  }
+}
+
+/* Pixels which stopped early have accumulated fewer samples than the rest of the tile.
+ * Scale all accumulated passes, so they can be normalized by the tile's sample count. */
+
+ccl_device void kernel_adaptive_post_adjust(KernelGlobals *kg,
+                                            ccl_global float *buffer,
+                                            float sample_multiplier)
+{
+  int flag = kernel_data.film.pass_flag;
+  int light_flag = kernel_data.film.light_pass_flag;
+
+  kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_combined, 4, sample_multiplier);
+  /* The auxiliary pass has to stay consistent with the combined pass in case the pixel gets
+   * marked as unconverged by one of its neighbors in a later progressive pass. */
+  kernel_adaptive_scale_pass(
+      buffer + kernel_data.film.pass_adaptive_aux_buffer, 3, sample_multiplier);
+
+#ifdef __PASSES__
+  if (flag & PASSMASK(NORMAL))
+    kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_normal, 3, sample_multiplier);
+  if (flag & PASSMASK(UV))
+    kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_uv, 3, sample_multiplier);
+  if (flag & PASSMASK(MOTION)) {
+    kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_motion, 4, sample_multiplier);
+    kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_motion_weight, 1, sample_multiplier);
+  }
+
+  if (kernel_data.film.use_light_pass) {
+    if (light_flag & PASSMASK(DIFFUSE_INDIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_diffuse_indirect, 3, sample_multiplier);
+    if (light_flag & PASSMASK(GLOSSY_INDIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_glossy_indirect, 3, sample_multiplier);
+    if (light_flag & PASSMASK(TRANSMISSION_INDIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_transmission_indirect, 3, sample_multiplier);
+    if (light_flag & PASSMASK(SUBSURFACE_INDIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_subsurface_indirect, 3, sample_multiplier);
+    if (light_flag & PASSMASK(VOLUME_INDIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_volume_indirect, 3, sample_multiplier);
+    if (light_flag & PASSMASK(DIFFUSE_DIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_diffuse_direct, 3, sample_multiplier);
+    if (light_flag & PASSMASK(GLOSSY_DIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_glossy_direct, 3, sample_multiplier);
+    if (light_flag & PASSMASK(TRANSMISSION_DIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_transmission_direct, 3, sample_multiplier);
+    if (light_flag & PASSMASK(SUBSURFACE_DIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_subsurface_direct, 3, sample_multiplier);
+    if (light_flag & PASSMASK(VOLUME_DIRECT))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_volume_direct, 3, sample_multiplier);
+
+    if (light_flag & PASSMASK(EMISSION))
+      kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_emission, 3, sample_multiplier);
+    if (light_flag & PASSMASK(BACKGROUND))
+      kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_background, 3, sample_multiplier);
+    if (light_flag & PASSMASK(AO))
+      kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_ao, 3, sample_multiplier);
+
+    if (light_flag & PASSMASK(DIFFUSE_COLOR))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_diffuse_color, 3, sample_multiplier);
+    if (light_flag & PASSMASK(GLOSSY_COLOR))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_glossy_color, 3, sample_multiplier);
+    if (light_flag & PASSMASK(TRANSMISSION_COLOR))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_transmission_color, 3, sample_multiplier);
+    if (light_flag & PASSMASK(SUBSURFACE_COLOR))
+      kernel_adaptive_scale_pass(
+          buffer + kernel_data.film.pass_subsurface_color, 3, sample_multiplier);
+    if (light_flag & PASSMASK(SHADOW))
+      kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_shadow, 4, sample_multiplier);
+    if (light_flag & PASSMASK(MIST))
+      kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_mist, 1, sample_multiplier);
+  }
+#endif
+
+#ifdef __DENOISING_FEATURES__
+  if (kernel_data.film.pass_denoising_data) {
+    kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_denoising_data,
+                               DENOISING_PASS_SIZE_BASE,
+                               sample_multiplier);
+    if (kernel_data.film.pass_denoising_clean) {
+      kernel_adaptive_scale_pass(buffer + kernel_data.film.pass_denoising_clean,
+                                 DENOISING_PASS_SIZE_CLEAN,
+                                 sample_multiplier);
+    }
+  }
+#endif
+}
+
+/* Brings a pixel which stopped early up to the given number of samples. */
+
+ccl_device void kernel_adaptive_adjust_samples(KernelGlobals *kg,
+                                               ccl_global float *buffer,
+                                               int num_samples)
+{
+  ccl_global float *sample_count = buffer + kernel_data.film.pass_sample_count;
+
+  if (*sample_count > 0.0f && *sample_count < (float)num_samples) {
+    kernel_adaptive_post_adjust(kg, buffer, (float)num_samples / *sample_count);
+    *sample_count = (float)num_samples;
+  }
+}
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_ADAPTIVE_SAMPLING_H__ */
@@ -40,6 +40,8 @@
 #include "util/util_half.h"
 #include "util/util_types.h"
 #include "util/util_texture.h"
+#include "util/util_sparse_grid.h"
+#include "util/util_texture_cache.h"
 
 #define ccl_addr_space
 
@@ -45,7 +45,16 @@ struct OSLThreadData;
 struct OSLShadingSystem;
 #  endif
 
-typedef unordered_map<float, float> CoverageMap;
+/* Fixed size hash table with the coverage of the IDs seen by one pixel, in
+ * flat per tile storage owned by Coverage. Weights of IDs that no longer fit
+ * in the table, or were replaced by an ID with more coverage, are summed in
+ * the overflow. */
+typedef struct CoverageMap {
+  float2 *slots;
+  float *overflow;
+  /* Power of two. */
+  int num_slots;
+} CoverageMap;
 
 struct Intersection;
 struct VolumeStep;
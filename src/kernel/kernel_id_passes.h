@@ -63,6 +63,49 @@ ccl_device_inline void kernel_write_id_slots(ccl_global float *buffer,
   }
 }
 
+#ifdef __KERNEL_CPU__
+/* Add weight to the ID in the coverage hash table, with linear probing. */
+ccl_device_inline void kernel_write_id_coverage(CoverageMap *map, float id, float weight)
+{
+  kernel_assert(id != ID_NONE);
+  if (weight == 0.0f) {
+    return;
+  }
+
+  const uint mask = map->num_slots - 1;
+  uint slot = ((__float_as_uint(id) * 2654435769u) >> 16) & mask;
+  for (int i = 0; i < map->num_slots; i++, slot = (slot + 1) & mask) {
+    float2 &entry = map->slots[slot];
+    if (entry.x == id) {
+      entry.y += weight;
+      return;
+    }
+    else if (entry.x == ID_NONE) {
+      entry = make_float2(id, weight);
+      return;
+    }
+  }
+
+  /* The table is full. Replace the ID with the least coverage if the new one has more, so
+   * the IDs with the most coverage keep their slots. Slots never become empty again, so the
+   * probing above still finds every ID. */
+  float2 *lowest = &map->slots[0];
+  for (int i = 1; i < map->num_slots; i++) {
+    if (map->slots[i].y < lowest->y) {
+      lowest = &map->slots[i];
+    }
+  }
+
+  if (lowest->y < weight) {
+    *map->overflow += lowest->y;
+    *lowest = make_float2(id, weight);
+  }
+  else {
+    *map->overflow += weight;
+  }
+}
+#endif /* __KERNEL_CPU__ */
+
 ccl_device_inline void kernel_sort_id_slots(ccl_global float *buffer, int num_slots)
 {
   ccl_global float2 *id_buffer = (ccl_global float2 *)buffer;
@@ -788,6 +788,158 @@ ccl_device bool lamp_light_eval(
   return true;
 }
 
+/* Light Tree
+ *
+ * Mesh lights are picked by traversing a tree over their bounds, orientation and energy,
+ * choosing each child proportional to its estimated contribution to the shading point.
+ * The triangle light PDFs are computed for the area based light distribution, so they get
+ * scaled by the ratio between both selection probabilities. */
+
+ccl_device float light_tree_node_importance(KernelGlobals *kg, int node_index, float3 P)
+{
+  const ccl_global KernelLightTreeNode *knode = &kernel_tex_fetch(__light_tree_nodes, node_index);
+
+  if (knode->energy == 0.0f) {
+    return 0.0f;
+  }
+
+  const float3 bounds_min = make_float3(
+      knode->bounds_min[0], knode->bounds_min[1], knode->bounds_min[2]);
+  const float3 bounds_max = make_float3(
+      knode->bounds_max[0], knode->bounds_max[1], knode->bounds_max[2]);
+  const float3 centroid = 0.5f * (bounds_min + bounds_max);
+  const float radius_sq = 0.25f * len_squared(bounds_max - bounds_min);
+
+  float dist;
+  const float3 omega = normalize_len(centroid - P, &dist);
+  const float dist_sq = dist * dist;
+
+  /* Inside the bounding sphere the emitters can be in any direction. */
+  if (dist_sq <= radius_sq) {
+    return knode->energy / max(radius_sq, FLT_MIN);
+  }
+
+  /* Smallest angle between the emitter normals and the direction to any point in the
+   * bounding sphere, emitters are two-sided. */
+  const float3 axis = make_float3(knode->axis[0], knode->axis[1], knode->axis[2]);
+  const float theta = fast_acosf(min(fabsf(dot(axis, omega)), 1.0f));
+  const float theta_u = fast_asinf(sqrtf(radius_sq / dist_sq));
+  const float theta_prime = theta - knode->theta_o - theta_u;
+  const float cos_theta_prime = (theta_prime > 0.0f) ? max(fast_cosf(theta_prime), 0.0f) : 1.0f;
+
+  return knode->energy * cos_theta_prime / dist_sq;
+}
+
+/* Probability of picking a mesh light rather than a lamp, matching the distribution. */
+ccl_device_inline float light_tree_mesh_light_probability(KernelGlobals *kg)
+{
+  return (kernel_data.integrator.num_all_lights) ? 0.5f : 1.0f;
+}
+
+/* Ratio between the light tree and light distribution probabilities of picking the mesh
+ * light at the given leaf. */
+ccl_device_inline float light_tree_leaf_pdf_scale(KernelGlobals *kg, int node_index, float pdf)
+{
+  const float area = kernel_tex_fetch(__light_tree_nodes, node_index).area;
+  const float distribution_pdf = area * kernel_data.integrator.pdf_triangles;
+
+  if (distribution_pdf == 0.0f) {
+    return 0.0f;
+  }
+
+  return light_tree_mesh_light_probability(kg) * pdf / distribution_pdf;
+}
+
+/* Picks a mesh light for shading point P and returns its index in the light distribution,
+ * or -1 if no mesh light can contribute. randu is rescaled to be reused. */
+ccl_device int light_tree_sample(KernelGlobals *kg, float3 P, float *randu, float *pdf_scale)
+{
+  int node_index = 0;
+  float pdf = 1.0f;
+  float r = *randu;
+
+  while (true) {
+    const ccl_global KernelLightTreeNode *knode = &kernel_tex_fetch(__light_tree_nodes,
+                                                                    node_index);
+    if (knode->second_child == -1) {
+      *randu = r;
+      *pdf_scale = light_tree_leaf_pdf_scale(kg, node_index, pdf);
+      return (*pdf_scale > 0.0f) ? knode->first_emitter : -1;
+    }
+
+    const int first_child = node_index + 1;
+    const int second_child = knode->second_child;
+    const float importance_first = light_tree_node_importance(kg, first_child, P);
+    const float importance_second = light_tree_node_importance(kg, second_child, P);
+    const float importance = importance_first + importance_second;
+
+    if (importance == 0.0f) {
+      return -1;
+    }
+
+    const float probability_first = importance_first / importance;
+
+    if (r < probability_first) {
+      node_index = first_child;
+      r = r / probability_first;
+      pdf *= probability_first;
+    }
+    else {
+      node_index = second_child;
+      r = (r - probability_first) / (1.0f - probability_first);
+      pdf *= 1.0f - probability_first;
+    }
+  }
+}
+
+/* Same traversal as light_tree_sample, following the path to a given mesh light. */
+ccl_device float light_tree_pdf_scale(KernelGlobals *kg, float3 P, int emitter)
+{
+  int node_index = 0;
+  float pdf = 1.0f;
+
+  while (true) {
+    const ccl_global KernelLightTreeNode *knode = &kernel_tex_fetch(__light_tree_nodes,
+                                                                    node_index);
+    if (knode->second_child == -1) {
+      return light_tree_leaf_pdf_scale(kg, node_index, pdf);
+    }
+
+    const int first_child = node_index + 1;
+    const int second_child = knode->second_child;
+    const float importance_first = light_tree_node_importance(kg, first_child, P);
+    const float importance_second = light_tree_node_importance(kg, second_child, P);
+    const float importance = importance_first + importance_second;
+
+    if (importance == 0.0f) {
+      return 0.0f;
+    }
+
+    const ccl_global KernelLightTreeNode *kfirst = &kernel_tex_fetch(__light_tree_nodes,
+                                                                     first_child);
+    if (emitter < kfirst->first_emitter + kfirst->num_emitters) {
+      node_index = first_child;
+      pdf *= importance_first / importance;
+    }
+    else {
+      node_index = second_child;
+      pdf *= importance_second / importance;
+    }
+  }
+}
+
+/* Index of a triangle in the light distribution, or -1 if it's not a mesh light. */
+ccl_device_inline int light_tree_triangle_emitter(KernelGlobals *kg, int object, int prim)
+{
+  const int offset = kernel_tex_fetch(__light_tree_prim_map, object * 2);
+  if (offset == -1) {
+    return -1;
+  }
+
+  const int tri_offset = kernel_tex_fetch(__light_tree_prim_map, object * 2 + 1);
+  return kernel_tex_fetch(__light_tree_prim_map, offset + prim - tri_offset);
+}
+
 /* Triangle Light */
 
 /* returns true if the triangle is has motion blur or an instancing transform applied */
@@ -836,7 +988,9 @@ ccl_device_inline float triangle_light_pdf_area(KernelGlobals *kg,
   return t * t * pdf / cos_pi;
 }
 
-ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *sd, float t)
+ccl_device_forceinline float triangle_light_distribution_pdf(KernelGlobals *kg,
+                                                             ShaderData *sd,
+                                                             float t)
 {
   /* A naive heuristic to decide between costly solid angle sampling
    * and simple area sampling, comparing the distance to the triangle plane
@@ -905,6 +1059,24 @@ ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *s
   }
 }
 
+ccl_device_forceinline float triangle_light_pdf(KernelGlobals *kg, ShaderData *sd, float t)
+{
+  float pdf = triangle_light_distribution_pdf(kg, sd, t);
+
+  if (kernel_data.integrator.use_light_tree && pdf != 0.0f) {
+    const int emitter = light_tree_triangle_emitter(kg, sd->object, sd->prim);
+    if (emitter == -1) {
+      return 0.0f;
+    }
+
+    /* Evaluate the tree from the shading point the ray came from. */
+    const float3 P = sd->P + sd->I * t;
+    pdf *= light_tree_pdf_scale(kg, P, emitter);
+  }
+
+  return pdf;
+}
+
 ccl_device_forceinline void triangle_light_sample(KernelGlobals *kg,
                                                   int prim,
                                                   int object,
@@ -1120,7 +1292,20 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 {
   if (lamp < 0) {
     /* sample index */
-    int index = light_distribution_sample(kg, &randu);
+    int index;
+    float pdf_scale = 1.0f;
+
+    if (kernel_data.integrator.use_light_tree &&
+        randu < light_tree_mesh_light_probability(kg)) {
+      randu /= light_tree_mesh_light_probability(kg);
+      index = light_tree_sample(kg, P, &randu, &pdf_scale);
+      if (index == -1) {
+        return false;
+      }
+    }
+    else {
+      index = light_distribution_sample(kg, &randu);
+    }
 
     /* fetch light data */
     const ccl_global KernelLightDistribution *kdistribution = &kernel_tex_fetch(
@@ -1133,6 +1318,7 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 
       triangle_light_sample(kg, prim, object, randu, randv, time, ls, P);
       ls->shader |= shader_flag;
+      ls->pdf *= pdf_scale;
       return (ls->pdf > 0.0f);
     }
 
@@ -136,7 +136,7 @@ ccl_device_inline size_t kernel_write_id_pass_cpu(
     float *buffer, size_t depth, float id, float matte_weight, CoverageMap *map)
 {
   if (map) {
-    (*map)[id] += matte_weight;
+    kernel_write_id_coverage(map, id, matte_weight);
     return 0;
   }
 #else /* __KERNEL_CPU__ */
@@ -342,6 +342,8 @@ ccl_device_inline void kernel_write_result(KernelGlobals *kg,
     kernel_write_pass_float4(buffer, make_float4(L_sum.x, L_sum.y, L_sum.z, alpha));
   }
 
+  kernel_adaptive_write_aux_buffer(kg, buffer, sample, L_sum);
+
   kernel_write_light_passes(kg, buffer, L);
 
 #ifdef __DENOISING_FEATURES__
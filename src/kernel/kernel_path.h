@@ -28,6 +28,7 @@
 #include "kernel/bvh/bvh.h"
 
 #include "kernel/kernel_write_passes.h"
+#include "kernel/kernel_adaptive_sampling.h"
 #include "kernel/kernel_accumulate.h"
 #include "kernel/kernel_shader.h"
 #include "kernel/kernel_light.h"
@@ -51,6 +52,21 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Accumulate BVH traversal statistics of an intersection for debug passes. */
+ccl_device_forceinline void kernel_path_scene_intersect_debug(ccl_addr_space PathState *state,
+                                                              Intersection *isect,
+                                                              PathRadiance *L)
+{
+#ifdef __KERNEL_DEBUG__
+  if (state->flag & PATH_RAY_CAMERA) {
+    L->debug_data.num_bvh_traversed_nodes += isect->num_traversed_nodes;
+    L->debug_data.num_bvh_traversed_instances += isect->num_traversed_instances;
+    L->debug_data.num_bvh_intersections += isect->num_intersections;
+  }
+  L->debug_data.num_ray_bounces++;
+#endif /* __KERNEL_DEBUG__ */
+}
+
 ccl_device_forceinline bool kernel_path_scene_intersect(KernelGlobals *kg,
                                                         ccl_addr_space PathState *state,
                                                         Ray *ray,
@@ -68,14 +84,7 @@ ccl_device_forceinline bool kernel_path_scene_intersect(KernelGlobals *kg,
 
   bool hit = scene_intersect(kg, ray, visibility, isect);
 
-#ifdef __KERNEL_DEBUG__
-  if (state->flag & PATH_RAY_CAMERA) {
-    L->debug_data.num_bvh_traversed_nodes += isect->num_traversed_nodes;
-    L->debug_data.num_bvh_traversed_instances += isect->num_traversed_instances;
-    L->debug_data.num_bvh_intersections += isect->num_intersections;
-  }
-  L->debug_data.num_ray_bounces++;
-#endif /* __KERNEL_DEBUG__ */
+  kernel_path_scene_intersect_debug(state, isect, L);
 
   return hit;
 }
@@ -517,7 +526,8 @@ ccl_device_forceinline void kernel_path_integrate(KernelGlobals *kg,
                                                   Ray *ray,
                                                   PathRadiance *L,
                                                   ccl_global float *buffer,
-                                                  ShaderData *emission_sd)
+                                                  ShaderData *emission_sd,
+                                                  const Intersection *camera_isect)
 {
   PROFILING_INIT(kg, PROFILING_PATH_INTEGRATE);
 
@@ -533,9 +543,19 @@ ccl_device_forceinline void kernel_path_integrate(KernelGlobals *kg,
 
     /* path iteration */
     for (;;) {
-      /* Find intersection with objects in scene. */
+      /* Find intersection with objects in scene, unless the camera ray was
+       * already traced as part of a packet. */
       Intersection isect;
-      bool hit = kernel_path_scene_intersect(kg, state, ray, &isect, L);
+      bool hit;
+      if (camera_isect) {
+        isect = *camera_isect;
+        hit = (isect.prim != PRIM_NONE);
+        camera_isect = NULL;
+        kernel_path_scene_intersect_debug(state, &isect, L);
+      }
+      else {
+        hit = kernel_path_scene_intersect(kg, state, ray, &isect, L);
+      }
 
       /* Find intersection with lamps and compute emission for MIS. */
       kernel_path_lamp_emission(kg, state, ray, throughput, &isect, &sd, L);
@@ -656,6 +676,10 @@ ccl_device void kernel_path_trace(
 
   buffer += index * pass_stride;
 
+  if (!kernel_adaptive_sample_pixel(kg, buffer)) {
+    return;
+  }
+
   /* Initialize random numbers and sample ray. */
   uint rng_hash;
   Ray ray;
@@ -688,11 +712,82 @@ ccl_device void kernel_path_trace(
 #  endif
 
   /* Integrate. */
-  kernel_path_integrate(kg, &state, throughput, &ray, &L, buffer, emission_sd);
+  kernel_path_integrate(kg, &state, throughput, &ray, &L, buffer, emission_sd, NULL);
 
   kernel_write_result(kg, buffer, sample, &L);
 }
 
+#  ifdef __KERNEL_CPU__
+/* Path trace a row of up to BVH_PACKET_SIZE pixels, with the camera rays of all
+ * pixels traced together as a packet before each path continues on its own. */
+ccl_device void kernel_path_trace_packet(KernelGlobals *kg,
+                                         ccl_global float *buffer,
+                                         int sample,
+                                         int x,
+                                         int y,
+                                         int num_pixels,
+                                         int offset,
+                                         int stride)
+{
+  PROFILING_INIT(kg, PROFILING_RAY_SETUP);
+
+  kernel_assert(num_pixels <= BVH_PACKET_SIZE);
+
+  int pass_stride = kernel_data.film.pass_stride;
+
+  ShaderDataTinyStorage emission_sd_storage;
+  ShaderData *emission_sd = AS_SHADER_DATA(&emission_sd_storage);
+
+  /* Initialize random numbers, camera rays and state of every pixel. */
+  ccl_global float *pixel_buffer[BVH_PACKET_SIZE];
+  Ray rays[BVH_PACKET_SIZE];
+  PathState states[BVH_PACKET_SIZE];
+  int num_rays = 0;
+
+  for (int i = 0; i < num_pixels; i++) {
+    ccl_global float *pbuffer = buffer + (offset + x + i + y * stride) * pass_stride;
+
+    if (!kernel_adaptive_sample_pixel(kg, pbuffer)) {
+      continue;
+    }
+
+    uint rng_hash;
+    Ray *ray = &rays[num_rays];
+    kernel_path_trace_setup(kg, sample, x + i, y, &rng_hash, ray);
+
+    if (ray->t == 0.0f) {
+      continue;
+    }
+
+    path_state_init(kg, emission_sd, &states[num_rays], rng_hash, sample, ray);
+    pixel_buffer[num_rays] = pbuffer;
+    num_rays++;
+  }
+
+  if (num_rays == 0) {
+    return;
+  }
+
+  /* Camera rays all start with the same visibility. */
+  Intersection isects[BVH_PACKET_SIZE];
+  scene_intersect_packet(
+      kg, rays, num_rays, path_state_ray_visibility(kg, &states[0]), isects);
+
+  /* Integrate. */
+  for (int i = 0; i < num_rays; i++) {
+    float3 throughput = make_float3(1.0f, 1.0f, 1.0f);
+
+    PathRadiance L;
+    path_radiance_init(kg, &L);
+
+    kernel_path_integrate(
+        kg, &states[i], throughput, &rays[i], &L, pixel_buffer[i], emission_sd, &isects[i]);
+
+    kernel_write_result(kg, pixel_buffer[i], sample, &L);
+  }
+}
+#  endif /* __KERNEL_CPU__ */
+
 #endif /* __SPLIT_KERNEL__ */
 
 CCL_NAMESPACE_END
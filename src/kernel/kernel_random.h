@@ -50,6 +50,46 @@ ccl_device uint sobol_dimension(KernelGlobals *kg, int index, int dimension)
 
 #endif /* __SOBOL__ */
 
+/* Progressive Multi-Jitter
+ *
+ * Precomputed (0,2) sequences generated in render/jitter.cpp, stored in the lookup
+ * table as floats in the [1, 2) range. Scrambling the mantissa bits with a hash of
+ * the pixel and dimension keeps every power of two prefix stratified, unlike the
+ * Cranley-Patterson rotation used for Sobol. */
+
+ccl_device_inline float pmj_sample_value(KernelGlobals *kg, int index, uint scramble)
+{
+  float value = kernel_tex_fetch(__lookup_table, kernel_data.tables.pmj_offset + index);
+  return __uint_as_float(__float_as_uint(value) ^ (scramble & 0x007fffff)) - 1.0f;
+}
+
+ccl_device float pmj_sample_1D(KernelGlobals *kg, int sample, uint rng_hash, int dimension)
+{
+  /* Fall back to random numbers past the end of the table. */
+  if (sample >= NUM_PMJ_SAMPLES) {
+    int p = rng_hash + dimension;
+    return cmj_randfloat(sample, p);
+  }
+
+  int index = ((dimension % NUM_PMJ_PATTERNS) * NUM_PMJ_SAMPLES + sample) * 2;
+  return pmj_sample_value(kg, index, cmj_hash_simple(dimension, rng_hash));
+}
+
+ccl_device void pmj_sample_2D(
+    KernelGlobals *kg, int sample, uint rng_hash, int dimension, float *fx, float *fy)
+{
+  if (sample >= NUM_PMJ_SAMPLES) {
+    int p = rng_hash + dimension;
+    *fx = cmj_randfloat(sample, p);
+    *fy = cmj_randfloat(sample, p + 1);
+    return;
+  }
+
+  int index = ((dimension % NUM_PMJ_PATTERNS) * NUM_PMJ_SAMPLES + sample) * 2;
+  *fx = pmj_sample_value(kg, index, cmj_hash_simple(dimension, rng_hash));
+  *fy = pmj_sample_value(kg, index + 1, cmj_hash_simple(dimension + 1, rng_hash));
+}
+
 ccl_device_forceinline float path_rng_1D(
     KernelGlobals *kg, uint rng_hash, int sample, int num_samples, int dimension)
 {
@@ -57,6 +97,11 @@ ccl_device_forceinline float path_rng_1D(
   return (float)drand48();
 #endif
 
+  if (kernel_data.integrator.sampling_pattern == SAMPLING_PATTERN_PMJ) {
+    /* Progressive multi-jitter. */
+    return pmj_sample_1D(kg, sample, rng_hash, dimension);
+  }
+
 #ifdef __CMJ__
 #  ifdef __SOBOL__
   if (kernel_data.integrator.sampling_pattern == SAMPLING_PATTERN_CMJ)
@@ -100,6 +145,12 @@ ccl_device_forceinline void path_rng_2D(KernelGlobals *kg,
   return;
 #endif
 
+  if (kernel_data.integrator.sampling_pattern == SAMPLING_PATTERN_PMJ) {
+    /* Progressive multi-jitter. */
+    pmj_sample_2D(kg, sample, rng_hash, dimension, fx, fy);
+    return;
+  }
+
 #ifdef __CMJ__
 #  ifdef __SOBOL__
   if (kernel_data.integrator.sampling_pattern == SAMPLING_PATTERN_CMJ)
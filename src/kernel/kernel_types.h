@@ -63,6 +63,9 @@ CCL_NAMESPACE_BEGIN
 
 #define VOLUME_STACK_SIZE 32
 
+/* Maximum number of rays traversed together as a packet. */
+#define BVH_PACKET_SIZE 8
+
 /* Split kernel constants */
 #define WORK_POOL_SIZE_GPU 64
 #define WORK_POOL_SIZE_CPU 1
@@ -269,10 +272,16 @@ enum PathTraceDimension {
 enum SamplingPattern {
   SAMPLING_PATTERN_SOBOL = 0,
   SAMPLING_PATTERN_CMJ = 1,
+  SAMPLING_PATTERN_PMJ = 2,
 
   SAMPLING_NUM_PATTERNS,
 };
 
+/* Size of the progressive multi-jittered sequence table, there is one sequence of
+ * samples per pattern and patterns are reused for higher dimensions. */
+#define NUM_PMJ_SAMPLES (64 * 64)
+#define NUM_PMJ_PATTERNS 48
+
 /* these flags values correspond to raytypes in osl.cpp, so keep them in sync! */
 
 enum PathRayFlag {
@@ -375,6 +384,8 @@ typedef enum PassType {
   PASS_CRYPTOMATTE,
   PASS_AOV_COLOR,
   PASS_AOV_VALUE,
+  PASS_ADAPTIVE_AUX_BUFFER,
+  PASS_SAMPLE_COUNT,
   PASS_CATEGORY_MAIN_END = 31,
 
   PASS_MIST = 32,
@@ -1250,8 +1261,8 @@ typedef struct KernelFilm {
 
   int pass_aov_color;
   int pass_aov_value;
-  int pad1;
-  int pad2;
+  int pass_adaptive_aux_buffer;
+  int pass_sample_count;
 
   /* XYZ to rendering color space transform. float4 instead of float3 to
    * ensure consistent padding/alignment across devices. */
@@ -1365,6 +1376,13 @@ typedef struct KernelIntegrator {
 
   int max_closures;
 
+  /* adaptive sampling */
+  int adaptive_min_samples;
+  int adaptive_step;
+  float adaptive_threshold;
+
+  /* light tree */
+  int use_light_tree;
   int pad1;
 } KernelIntegrator;
 static_assert_align(KernelIntegrator, 16);
@@ -1375,9 +1393,11 @@ typedef enum KernelBVHLayout {
   BVH_LAYOUT_BVH2 = (1 << 0),
   BVH_LAYOUT_BVH4 = (1 << 1),
   BVH_LAYOUT_BVH8 = (1 << 2),
+  /* BVH8 with child bounds quantized to 8 bits relative to the node bounds. */
+  BVH_LAYOUT_BVH8_QUANTIZED = (1 << 3),
 
-  BVH_LAYOUT_EMBREE = (1 << 3),
-  BVH_LAYOUT_OPTIX = (1 << 4),
+  BVH_LAYOUT_EMBREE = (1 << 4),
+  BVH_LAYOUT_OPTIX = (1 << 5),
 
   BVH_LAYOUT_DEFAULT = BVH_LAYOUT_BVH8,
   BVH_LAYOUT_ALL = (unsigned int)(~0u),
@@ -1391,6 +1411,9 @@ typedef struct KernelBVH {
   int have_instancing;
   int bvh_layout;
   int use_bvh_steps;
+  /* Triangle vertices are shared with the mesh instead of copied per triangle. */
+  int use_indexed_triangles;
+  int pad1, pad3, pad4;
 
   /* Custom BVH */
 #ifdef __KERNEL_OPTIX__
@@ -1429,7 +1452,8 @@ static_assert_align(KernelCurves, 16);
 
 typedef struct KernelTables {
   int beckmann_offset;
-  int pad1, pad2, pad3;
+  int pmj_offset;
+  int pad1, pad2;
 } KernelTables;
 static_assert_align(KernelTables, 16);
 
@@ -1534,6 +1558,25 @@ typedef struct KernelLightDistribution {
 } KernelLightDistribution;
 static_assert_align(KernelLightDistribution, 16);
 
+/* Light tree node, bounding a range of mesh lights in the light distribution. The first child
+ * of an inner node directly follows its parent in the array. */
+typedef struct KernelLightTreeNode {
+  float bounds_min[3];
+  float energy;
+  float bounds_max[3];
+  /* Spread of the cone around axis which bounds the (two-sided) emitter normals. */
+  float theta_o;
+  float axis[3];
+  /* Index of the second child, -1 for leaf nodes. */
+  int second_child;
+  /* Range of emitters in the light distribution and their total area. */
+  int first_emitter;
+  int num_emitters;
+  float area;
+  int pad;
+} KernelLightTreeNode;
+static_assert_align(KernelLightTreeNode, 16);
+
 typedef struct KernelParticle {
   int index;
   float age;
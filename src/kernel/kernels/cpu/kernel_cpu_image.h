@@ -88,6 +88,21 @@ template<typename T> struct TextureInterpolator {
     return read(data[y * width + x]);
   }
 
+  /* Read voxel of a dense or sparse 3D texture. */
+  static ccl_always_inline float4 read_3d(const TextureInfo &info, int x, int y, int z)
+  {
+    const T *data = (const T *)info.data;
+    if (info.grid_index) {
+      const int3 resolution = make_int3(info.width, info.height, info.depth);
+      const int tile = ((const int *)info.grid_index)[sparse_grid_tile_index(resolution, x, y, z)];
+      if (tile == -1) {
+        return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+      }
+      return read(data[sparse_grid_voxel_offset(tile, x, y, z)]);
+    }
+    return read(data[x + y * info.width + z * info.width * info.height]);
+  }
+
   static ccl_always_inline int wrap_periodic(int x, int width)
   {
     x %= width;
@@ -288,8 +303,7 @@ template<typename T> struct TextureInterpolator {
         return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
 
-    const T *data = (const T *)info.data;
-    return read(data[ix + iy * width + iz * width * height]);
+    return read_3d(info, ix, iy, iz);
   }
 
   static ccl_always_inline float4 interp_3d_linear(const TextureInfo &info,
@@ -336,19 +350,17 @@ template<typename T> struct TextureInterpolator {
         return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
     }
 
-    const T *data = (const T *)info.data;
     float4 r;
 
-    r = (1.0f - tz) * (1.0f - ty) * (1.0f - tx) *
-        read(data[ix + iy * width + iz * width * height]);
-    r += (1.0f - tz) * (1.0f - ty) * tx * read(data[nix + iy * width + iz * width * height]);
-    r += (1.0f - tz) * ty * (1.0f - tx) * read(data[ix + niy * width + iz * width * height]);
-    r += (1.0f - tz) * ty * tx * read(data[nix + niy * width + iz * width * height]);
+    r = (1.0f - tz) * (1.0f - ty) * (1.0f - tx) * read_3d(info, ix, iy, iz);
+    r += (1.0f - tz) * (1.0f - ty) * tx * read_3d(info, nix, iy, iz);
+    r += (1.0f - tz) * ty * (1.0f - tx) * read_3d(info, ix, niy, iz);
+    r += (1.0f - tz) * ty * tx * read_3d(info, nix, niy, iz);
 
-    r += tz * (1.0f - ty) * (1.0f - tx) * read(data[ix + iy * width + niz * width * height]);
-    r += tz * (1.0f - ty) * tx * read(data[nix + iy * width + niz * width * height]);
-    r += tz * ty * (1.0f - tx) * read(data[ix + niy * width + niz * width * height]);
-    r += tz * ty * tx * read(data[nix + niy * width + niz * width * height]);
+    r += tz * (1.0f - ty) * (1.0f - tx) * read_3d(info, ix, iy, niz);
+    r += tz * (1.0f - ty) * tx * read_3d(info, nix, iy, niz);
+    r += tz * ty * (1.0f - tx) * read_3d(info, ix, niy, niz);
+    r += tz * ty * tx * read_3d(info, nix, niy, niz);
 
     return r;
   }
@@ -424,15 +436,14 @@ template<typename T> struct TextureInterpolator {
     }
 
     const int xc[4] = {pix, ix, nix, nnix};
-    const int yc[4] = {width * piy, width * iy, width * niy, width * nniy};
-    const int zc[4] = {
-        width * height * piz, width * height * iz, width * height * niz, width * height * nniz};
+    const int yc[4] = {piy, iy, niy, nniy};
+    const int zc[4] = {piz, iz, niz, nniz};
     float u[4], v[4], w[4];
 
     /* Some helper macro to keep code reasonable size,
      * let compiler to inline all the matrix multiplications.
      */
-#define DATA(x, y, z) (read(data[xc[x] + yc[y] + zc[z]]))
+#define DATA(x, y, z) (read_3d(info, xc[x], yc[y], zc[z]))
 #define COL_TERM(col, row) \
   (v[col] * (u[0] * DATA(0, col, row) + u[1] * DATA(1, col, row) + u[2] * DATA(2, col, row) + \
              u[3] * DATA(3, col, row)))
@@ -444,7 +455,6 @@ template<typename T> struct TextureInterpolator {
     SET_CUBIC_SPLINE_WEIGHTS(w, tz);
 
     /* Actual interpolation. */
-    const T *data = (const T *)info.data;
     return ROW_TERM(0) + ROW_TERM(1) + ROW_TERM(2) + ROW_TERM(3);
 
 #undef COL_TERM
@@ -474,6 +484,10 @@ ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, fl
 {
   const TextureInfo &info = kernel_tex_fetch(__texture_info, id);
 
+  if (info.cache_image) {
+    return texture_cache_lookup(info, x, y, make_float2(0.0f, 0.0f), make_float2(0.0f, 0.0f));
+  }
+
   switch (kernel_tex_type(id)) {
     case IMAGE_DATA_TYPE_HALF:
       return TextureInterpolator<half>::interp(info, x, y);
@@ -498,6 +512,20 @@ ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, fl
   }
 }
 
+/* Lookup with derivatives of the texture coordinates, used to select mipmap levels of
+ * images loaded through the texture cache. Other images ignore the derivatives. */
+ccl_device float4 kernel_tex_image_interp_filtered(
+    KernelGlobals *kg, int id, float x, float y, float2 duv_dx, float2 duv_dy)
+{
+  const TextureInfo &info = kernel_tex_fetch(__texture_info, id);
+
+  if (info.cache_image) {
+    return texture_cache_lookup(info, x, y, duv_dx, duv_dy);
+  }
+
+  return kernel_tex_image_interp(kg, id, x, y);
+}
+
 ccl_device float4 kernel_tex_image_interp_3d(
     KernelGlobals *kg, int id, float x, float y, float z, InterpolationType interp)
 {
@@ -92,6 +92,32 @@ void KERNEL_FUNCTION_FULL_NAME(path_trace)(
 #  endif /* KERNEL_STUB */
 }
 
+void KERNEL_FUNCTION_FULL_NAME(path_trace_packet)(KernelGlobals *kg,
+                                                  float *buffer,
+                                                  int sample,
+                                                  int x,
+                                                  int y,
+                                                  int w,
+                                                  int offset,
+                                                  int stride)
+{
+#  ifdef KERNEL_STUB
+  STUB_ASSERT(KERNEL_ARCH, path_trace_packet);
+#  else
+#    ifdef __BRANCHED_PATH__
+  if (kernel_data.integrator.branched) {
+    for (int i = 0; i < w; i++) {
+      kernel_branched_path_trace(kg, buffer, sample, x + i, y, offset, stride);
+    }
+  }
+  else
+#    endif
+  {
+    kernel_path_trace_packet(kg, buffer, sample, x, y, w, offset, stride);
+  }
+#  endif /* KERNEL_STUB */
+}
+
 /* Film */
 
 void KERNEL_FUNCTION_FULL_NAME(convert_to_byte)(KernelGlobals *kg,
@@ -154,6 +180,52 @@ void KERNEL_FUNCTION_FULL_NAME(shader)(KernelGlobals *kg,
 #  endif /* KERNEL_STUB */
 }
 
+/* Adaptive Sampling */
+
+void KERNEL_FUNCTION_FULL_NAME(adaptive_stopping)(
+    KernelGlobals *kg, float *buffer, int sample, int x, int y, int offset, int stride)
+{
+#  ifdef KERNEL_STUB
+  STUB_ASSERT(KERNEL_ARCH, adaptive_stopping);
+#  else
+  int index = offset + x + y * stride;
+  kernel_do_adaptive_stopping(kg, buffer + index * kernel_data.film.pass_stride, sample);
+#  endif /* KERNEL_STUB */
+}
+
+bool KERNEL_FUNCTION_FULL_NAME(adaptive_filter_x)(
+    KernelGlobals *kg, float *buffer, int y, int x, int w, int offset, int stride)
+{
+#  ifdef KERNEL_STUB
+  STUB_ASSERT(KERNEL_ARCH, adaptive_filter_x);
+  return false;
+#  else
+  return kernel_do_adaptive_filter_x(kg, buffer, y, x, w, offset, stride);
+#  endif /* KERNEL_STUB */
+}
+
+bool KERNEL_FUNCTION_FULL_NAME(adaptive_filter_y)(
+    KernelGlobals *kg, float *buffer, int x, int y, int h, int offset, int stride)
+{
+#  ifdef KERNEL_STUB
+  STUB_ASSERT(KERNEL_ARCH, adaptive_filter_y);
+  return false;
+#  else
+  return kernel_do_adaptive_filter_y(kg, buffer, x, y, h, offset, stride);
+#  endif /* KERNEL_STUB */
+}
+
+void KERNEL_FUNCTION_FULL_NAME(adaptive_adjust_samples)(
+    KernelGlobals *kg, float *buffer, int sample, int x, int y, int offset, int stride)
+{
+#  ifdef KERNEL_STUB
+  STUB_ASSERT(KERNEL_ARCH, adaptive_adjust_samples);
+#  else
+  int index = offset + x + y * stride;
+  kernel_adaptive_adjust_samples(kg, buffer + index * kernel_data.film.pass_stride, sample);
+#  endif /* KERNEL_STUB */
+}
+
 #else /* __SPLIT_KERNEL__ */
 
 /* Split Kernel Path Tracing */
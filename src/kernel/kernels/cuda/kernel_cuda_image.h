@@ -149,6 +149,13 @@ ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, fl
   }
 }
 
+/* Mipmapped images are only supported on the CPU, derivatives are ignored. */
+ccl_device float4 kernel_tex_image_interp_filtered(
+    KernelGlobals *kg, int id, float x, float y, float2 duv_dx, float2 duv_dy)
+{
+  return kernel_tex_image_interp(kg, id, x, y);
+}
+
 ccl_device float4 kernel_tex_image_interp_3d(
     KernelGlobals *kg, int id, float x, float y, float z, InterpolationType interp)
 {
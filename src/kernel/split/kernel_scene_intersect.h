@@ -16,21 +16,14 @@
 
 CCL_NAMESPACE_BEGIN
 
-/* This kernel takes care of scene_intersect function.
- *
- * This kernel changes the ray_state of RAY_REGENERATED rays to RAY_ACTIVE.
- * This kernel processes rays of ray state RAY_ACTIVE
- * This kernel determines the rays that have hit the background and changes
- * their ray state to RAY_HIT_BACKGROUND.
- */
-ccl_device void kernel_scene_intersect(KernelGlobals *kg)
+/* Get the ray of a work item, making regenerated rays active. Returns
+ * QUEUE_EMPTY_SLOT when there is no active ray to intersect. */
+ccl_device_inline int kernel_scene_intersect_ray_index(KernelGlobals *kg,
+                                                       int thread_index,
+                                                       char use_queues_flag)
 {
-  /* Fetch use_queues_flag */
-  char local_use_queues_flag = *kernel_split_params.use_queues_flag;
-  ccl_barrier(CCL_LOCAL_MEM_FENCE);
-
-  int ray_index = ccl_global_id(1) * ccl_global_size(0) + ccl_global_id(0);
-  if (local_use_queues_flag) {
+  int ray_index = thread_index;
+  if (use_queues_flag) {
     ray_index = get_ray_index(kg,
                               ray_index,
                               QUEUE_ACTIVE_AND_REGENERATED_RAYS,
@@ -39,7 +32,7 @@ ccl_device void kernel_scene_intersect(KernelGlobals *kg)
                               0);
 
     if (ray_index == QUEUE_EMPTY_SLOT) {
-      return;
+      return QUEUE_EMPTY_SLOT;
     }
   }
 
@@ -57,16 +50,19 @@ ccl_device void kernel_scene_intersect(KernelGlobals *kg)
   }
 
   if (!IS_STATE(kernel_split_state.ray_state, ray_index, RAY_ACTIVE)) {
-    return;
+    return QUEUE_EMPTY_SLOT;
   }
 
-  ccl_global PathState *state = &kernel_split_state.path_state[ray_index];
-  Ray ray = kernel_split_state.ray[ray_index];
-  PathRadiance *L = &kernel_split_state.path_radiance[ray_index];
+  return ray_index;
+}
 
-  Intersection isect;
-  bool hit = kernel_path_scene_intersect(kg, state, &ray, &isect, L);
-  kernel_split_state.isect[ray_index] = isect;
+/* Store the intersection of a ray, rays that hit nothing go to the background. */
+ccl_device_inline void kernel_scene_intersect_store(KernelGlobals *kg,
+                                                    int ray_index,
+                                                    Intersection *isect,
+                                                    bool hit)
+{
+  kernel_split_state.isect[ray_index] = *isect;
 
   if (!hit) {
     /* Change the state of rays that hit the background;
@@ -77,4 +73,100 @@ ccl_device void kernel_scene_intersect(KernelGlobals *kg)
   }
 }
 
+/* This kernel takes care of scene_intersect function.
+ *
+ * This kernel changes the ray_state of RAY_REGENERATED rays to RAY_ACTIVE.
+ * This kernel processes rays of ray state RAY_ACTIVE
+ * This kernel determines the rays that have hit the background and changes
+ * their ray state to RAY_HIT_BACKGROUND.
+ *
+ * On the CPU work items run one after another, so the first work item of every
+ * group of BVH_PACKET_SIZE takes the rays of the whole group and traces those
+ * with the same visibility together as a packet.
+ */
+ccl_device void kernel_scene_intersect(KernelGlobals *kg)
+{
+  /* Fetch use_queues_flag */
+  char local_use_queues_flag = *kernel_split_params.use_queues_flag;
+  ccl_barrier(CCL_LOCAL_MEM_FENCE);
+
+  int thread_index = ccl_global_id(1) * ccl_global_size(0) + ccl_global_id(0);
+
+#ifdef __KERNEL_CPU__
+  if (thread_index % BVH_PACKET_SIZE != 0) {
+    return;
+  }
+
+  const int num_threads = min(BVH_PACKET_SIZE,
+                              ccl_global_size(0) * ccl_global_size(1) - thread_index);
+
+  int packet_index[BVH_PACKET_SIZE];
+  Ray rays[BVH_PACKET_SIZE];
+  int num_rays = 0;
+  uint packet_visibility = 0;
+
+  for (int i = 0; i < num_threads; i++) {
+    int ray_index = kernel_scene_intersect_ray_index(
+        kg, thread_index + i, local_use_queues_flag);
+    if (ray_index == QUEUE_EMPTY_SLOT) {
+      continue;
+    }
+
+    ccl_global PathState *state = &kernel_split_state.path_state[ray_index];
+    uint visibility = path_state_ray_visibility(kg, state);
+
+    if (num_rays == 0) {
+      packet_visibility = visibility;
+    }
+
+    /* Rays with different visibility or an AO distance are traced on their own. */
+    if (visibility != packet_visibility || path_state_ao_bounce(kg, state)) {
+      Ray ray = kernel_split_state.ray[ray_index];
+      PathRadiance *L = &kernel_split_state.path_radiance[ray_index];
+
+      Intersection isect;
+      bool hit = kernel_path_scene_intersect(kg, state, &ray, &isect, L);
+      kernel_scene_intersect_store(kg, ray_index, &isect, hit);
+      continue;
+    }
+
+    packet_index[num_rays] = ray_index;
+    rays[num_rays] = kernel_split_state.ray[ray_index];
+    num_rays++;
+  }
+
+  if (num_rays == 0) {
+    return;
+  }
+
+  Intersection isects[BVH_PACKET_SIZE];
+  {
+    PROFILING_INIT(kg, PROFILING_SCENE_INTERSECT);
+    scene_intersect_packet(kg, rays, num_rays, packet_visibility, isects);
+  }
+
+  for (int i = 0; i < num_rays; i++) {
+    const int ray_index = packet_index[i];
+    ccl_global PathState *state = &kernel_split_state.path_state[ray_index];
+    PathRadiance *L = &kernel_split_state.path_radiance[ray_index];
+
+    kernel_path_scene_intersect_debug(state, &isects[i], L);
+    kernel_scene_intersect_store(kg, ray_index, &isects[i], isects[i].prim != PRIM_NONE);
+  }
+#else
+  int ray_index = kernel_scene_intersect_ray_index(kg, thread_index, local_use_queues_flag);
+  if (ray_index == QUEUE_EMPTY_SLOT) {
+    return;
+  }
+
+  ccl_global PathState *state = &kernel_split_state.path_state[ray_index];
+  Ray ray = kernel_split_state.ray[ray_index];
+  PathRadiance *L = &kernel_split_state.path_radiance[ray_index];
+
+  Intersection isect;
+  bool hit = kernel_path_scene_intersect(kg, state, &ray, &isect, L);
+  kernel_scene_intersect_store(kg, ray_index, &isect, hit);
+#endif /* __KERNEL_CPU__ */
+}
+
 CCL_NAMESPACE_END
@@ -54,7 +54,6 @@ ccl_device void kernel_shader_sort(KernelGlobals *kg, ccl_local_param ShaderSort
   }
   ccl_barrier(CCL_LOCAL_MEM_FENCE);
 
-  /* skip sorting for cpu split kernel */
 #  ifdef __KERNEL_OPENCL__
 
   /* bitonic sort */
@@ -77,16 +76,47 @@ ccl_device void kernel_shader_sort(KernelGlobals *kg, ccl_local_param ShaderSort
       }
     }
   }
+#  else
+  /* A CPU work item sorts the whole block on its own, with a stable bottom-up
+   * merge sort so paths with the same shader stay in queue order. */
+  int size = min((int)(qsize - offset), SHADER_SORT_BLOCK_SIZE);
+  ccl_local ushort *sorted = &locals->local_temp[0];
+
+  for (int width = 1; width < size; width <<= 1) {
+    for (int left = 0; left < size; left += 2 * width) {
+      int mid = min(left + width, size);
+      int right = min(left + 2 * width, size);
+      int i = left, j = mid, k = left;
+
+      while (i < mid && j < right) {
+        sorted[k++] = (local_value[local_index[j]] < local_value[local_index[i]]) ?
+                          local_index[j++] :
+                          local_index[i++];
+      }
+      while (i < mid) {
+        sorted[k++] = local_index[i++];
+      }
+      while (j < right) {
+        sorted[k++] = local_index[j++];
+      }
+    }
+
+    ccl_local ushort *tmp = local_index;
+    local_index = sorted;
+    sorted = tmp;
+  }
 #  endif /* __KERNEL_OPENCL__ */
 
   /* copy to destination */
   for (uint i = 0; i < SHADER_SORT_BLOCK_SIZE; i += SHADER_SORT_LOCAL_SIZE) {
     uint idx = offset + i + lid;
-    uint lidx = local_index[i + lid];
-    uint outi = output + idx;
-    uint ini = input + offset + lidx;
-    uint value = local_value[lidx];
+    /* Past the end of the queue the indices may not be sorted or even set,
+     * the CPU merge sort only writes the filled part of the block. */
     if (idx < qsize) {
+      uint lidx = local_index[i + lid];
+      uint outi = output + idx;
+      uint ini = input + offset + lidx;
+      uint value = local_value[lidx];
       kernel_split_state.queue_data[outi] = (value == (~0)) ? QUEUE_EMPTY_SLOT :
                                                               kernel_split_state.queue_data[ini];
     }
@@ -18,14 +18,15 @@ CCL_NAMESPACE_BEGIN
 
 #ifdef __TEXTURES__
 
-ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint flags)
+ccl_device float4 svm_image_texture_filtered(
+    KernelGlobals *kg, int id, float x, float y, float2 duv_dx, float2 duv_dy, uint flags)
 {
   if (id == -1) {
     return make_float4(
         TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A);
   }
 
-  float4 r = kernel_tex_image_interp(kg, id, x, y);
+  float4 r = kernel_tex_image_interp_filtered(kg, id, x, y, duv_dx, duv_dy);
   const float alpha = r.w;
 
   if ((flags & NODE_IMAGE_ALPHA_UNASSOCIATE) && alpha != 1.0f && alpha != 0.0f) {
@@ -44,12 +45,42 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
   return r;
 }
 
+ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint flags)
+{
+  const float2 zero = make_float2(0.0f, 0.0f);
+  return svm_image_texture_filtered(kg, id, x, y, zero, zero, flags);
+}
+
 /* Remap coordnate from 0..1 box to -1..-1 */
 ccl_device_inline float3 texco_remap_square(float3 co)
 {
   return (co - make_float3(0.5f, 0.5f, 0.5f)) * 2.0f;
 }
 
+ccl_device_inline float2 svm_image_projection(float3 co, uint projection)
+{
+  if (projection == NODE_IMAGE_PROJ_SPHERE) {
+    return map_to_sphere(texco_remap_square(co));
+  }
+  else if (projection == NODE_IMAGE_PROJ_TUBE) {
+    return map_to_tube(texco_remap_square(co));
+  }
+  else {
+    return make_float2(co.x, co.y);
+  }
+}
+
+/* Difference of texture coordinates for a shifted lookup position, taking the
+ * shortest way around the seam of sphere and tube projections. */
+ccl_device_inline float2 svm_image_projection_delta(float3 co, float2 tex_co, uint projection)
+{
+  float2 delta = svm_image_projection(co, projection) - tex_co;
+  if (projection == NODE_IMAGE_PROJ_SPHERE || projection == NODE_IMAGE_PROJ_TUBE) {
+    delta.x -= floorf(delta.x + 0.5f);
+  }
+  return delta;
+}
+
 ccl_device void svm_node_tex_image(
     KernelGlobals *kg, ShaderData *sd, float *stack, uint4 node, int *offset)
 {
@@ -58,17 +89,15 @@ ccl_device void svm_node_tex_image(
   svm_unpack_node_uchar4(node.z, &co_offset, &out_offset, &alpha_offset, &flags);
 
   float3 co = stack_load_float3(stack, co_offset);
-  float2 tex_co;
-  if (node.w == NODE_IMAGE_PROJ_SPHERE) {
-    co = texco_remap_square(co);
-    tex_co = map_to_sphere(co);
-  }
-  else if (node.w == NODE_IMAGE_PROJ_TUBE) {
-    co = texco_remap_square(co);
-    tex_co = map_to_tube(co);
-  }
-  else {
-    tex_co = make_float2(co.x, co.y);
+  float2 tex_co = svm_image_projection(co, node.w);
+
+  /* Texture coordinate derivatives, from the coordinates shifted by ray differentials. */
+  float2 duv_dx = make_float2(0.0f, 0.0f);
+  float2 duv_dy = make_float2(0.0f, 0.0f);
+  if (flags & NODE_IMAGE_USE_DERIVATIVES) {
+    uint4 deriv_node = read_node(kg, offset);
+    duv_dx = svm_image_projection_delta(stack_load_float3(stack, deriv_node.x), tex_co, node.w);
+    duv_dy = svm_image_projection_delta(stack_load_float3(stack, deriv_node.y), tex_co, node.w);
   }
 
   /* TODO(lukas): Consider moving tile information out of the SVM node.
@@ -114,7 +143,7 @@ ccl_device void svm_node_tex_image(
     id = -num_nodes;
   }
 
-  float4 f = svm_image_texture(kg, id, tex_co.x, tex_co.y, flags);
+  float4 f = svm_image_texture_filtered(kg, id, tex_co.x, tex_co.y, duv_dx, duv_dy, flags);
 
   if (stack_valid(out_offset))
     stack_store_float3(stack, out_offset, make_float3(f.x, f.y, f.z));
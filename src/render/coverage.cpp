@@ -20,14 +20,14 @@
 #include "kernel/kernel_globals.h"
 #include "kernel/kernel_id_passes.h"
 #include "kernel/kernel_types.h"
-#include "util/util_map.h"
+#include "util/util_algorithm.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
-static bool crypomatte_comp(const pair<float, float> &i, const pair<float, float> j)
+static bool crypomatte_comp(const float2 &i, const float2 &j)
 {
-  return i.first > j.first;
+  return i.y > j.y;
 }
 
 void Coverage::finalize()
@@ -51,38 +51,58 @@ void Coverage::init_path_trace()
   kg->coverage_object = kg->coverage_material = kg->coverage_asset = NULL;
 
   if (kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE) {
+    /* Keep the hash tables at most half full for the IDs written to the
+     * passes, so probing stays short. */
+    num_slots = 1;
+    while (num_slots < 4 * kernel_data.film.cryptomatte_depth) {
+      num_slots *= 2;
+    }
+
     if (kernel_data.film.cryptomatte_passes & CRYPT_OBJECT) {
-      coverage_object.clear();
-      coverage_object.resize(tile.w * tile.h);
+      init_buffer(coverage_object);
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_MATERIAL) {
-      coverage_material.clear();
-      coverage_material.resize(tile.w * tile.h);
+      init_buffer(coverage_material);
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_ASSET) {
-      coverage_asset.clear();
-      coverage_asset.resize(tile.w * tile.h);
+      init_buffer(coverage_asset);
     }
   }
 }
 
+void Coverage::init_buffer(CoverageBuffer &coverage)
+{
+  coverage.slots.clear();
+  coverage.slots.resize(tile.w * tile.h * num_slots, make_float2(ID_NONE, 0.0f));
+  coverage.overflow.clear();
+  coverage.overflow.resize(tile.w * tile.h, 0.0f);
+  coverage.map.num_slots = num_slots;
+}
+
+CoverageMap *Coverage::pixel_map(CoverageBuffer &coverage, const int pixel_index)
+{
+  coverage.map.slots = &coverage.slots[pixel_index * num_slots];
+  coverage.map.overflow = &coverage.overflow[pixel_index];
+  return &coverage.map;
+}
+
 void Coverage::init_pixel(int x, int y)
 {
   if (kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE) {
     const int pixel_index = tile.w * (y - tile.y) + x - tile.x;
     if (kernel_data.film.cryptomatte_passes & CRYPT_OBJECT) {
-      kg->coverage_object = &coverage_object[pixel_index];
+      kg->coverage_object = pixel_map(coverage_object, pixel_index);
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_MATERIAL) {
-      kg->coverage_material = &coverage_material[pixel_index];
+      kg->coverage_material = pixel_map(coverage_material, pixel_index);
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_ASSET) {
-      kg->coverage_asset = &coverage_asset[pixel_index];
+      kg->coverage_asset = pixel_map(coverage_asset, pixel_index);
     }
   }
 }
 
-void Coverage::finalize_buffer(vector<CoverageMap> &coverage, const int pass_offset)
+void Coverage::finalize_buffer(CoverageBuffer &coverage, const int pass_offset)
 {
   if (kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE) {
     flatten_buffer(coverage, pass_offset);
@@ -92,41 +112,43 @@ void Coverage::finalize_buffer(vector<CoverageMap> &coverage, const int pass_off
   }
 }
 
-void Coverage::flatten_buffer(vector<CoverageMap> &coverage, const int pass_offset)
+void Coverage::flatten_buffer(CoverageBuffer &coverage, const int pass_offset)
 {
   /* Sort the coverage map and write it to the output */
   int pixel_index = 0;
   int pass_stride = tile.buffers->params.get_passes_size();
+  const int num_pass_slots = 2 * (kernel_data.film.cryptomatte_depth);
   for (int y = 0; y < tile.h; ++y) {
     for (int x = 0; x < tile.w; ++x) {
-      const CoverageMap &pixel = coverage[pixel_index];
-      if (!pixel.empty()) {
+      /* Move the IDs to the front of the hash table, it is not used anymore. */
+      float2 *pixel = &coverage.slots[pixel_index * num_slots];
+      int num_ids = 0;
+      for (int i = 0; i < num_slots; ++i) {
+        if (pixel[i].x != ID_NONE) {
+          pixel[num_ids++] = pixel[i];
+        }
+      }
+
+      if (num_ids > 0) {
         /* buffer offset */
         int index = x + y * tile.stride;
         float *buffer = (float *)tile.buffer + index * pass_stride;
 
-        /* sort the cryptomatte pixel */
-        vector<pair<float, float>> sorted_pixel;
-        for (CoverageMap::const_iterator it = pixel.begin(); it != pixel.end(); ++it) {
-          sorted_pixel.push_back(std::make_pair(it->second, it->first));
-        }
-        sort(sorted_pixel.begin(), sorted_pixel.end(), crypomatte_comp);
-        int num_slots = 2 * (kernel_data.film.cryptomatte_depth);
-        if (sorted_pixel.size() > num_slots) {
-          float leftover = 0.0f;
-          for (vector<pair<float, float>>::iterator it = sorted_pixel.begin() + num_slots;
-               it != sorted_pixel.end();
-               ++it) {
-            leftover += it->first;
-          }
-          sorted_pixel[num_slots - 1].first += leftover;
+        /* Only the IDs with the most coverage are written, the rest of the
+         * coverage is added to the last one. */
+        const int limit = min(num_pass_slots, num_ids);
+        std::partial_sort(pixel, pixel + limit, pixel + num_ids, crypomatte_comp);
+        float leftover = coverage.overflow[pixel_index];
+        for (int i = limit; i < num_ids; ++i) {
+          leftover += pixel[i].y;
         }
-        int limit = min(num_slots, sorted_pixel.size());
+        pixel[limit - 1].y += leftover;
+
         for (int i = 0; i < limit; ++i) {
           kernel_write_id_slots(buffer + kernel_data.film.pass_cryptomatte + pass_offset,
-                                2 * (kernel_data.film.cryptomatte_depth),
-                                sorted_pixel[i].second,
-                                sorted_pixel[i].first);
+                                num_pass_slots,
+                                pixel[i].x,
+                                pixel[i].y);
         }
       }
       ++pixel_index;
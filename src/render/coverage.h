@@ -18,7 +18,6 @@
 #include "kernel/kernel_compat_cpu.h"
 #include "kernel/split/kernel_split_data.h"
 #include "kernel/kernel_globals.h"
-#include "util/util_map.h"
 #include "util/util_vector.h"
 
 #ifndef __COVERAGE_H__
@@ -26,9 +25,17 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Coverage hash tables of all pixels in a tile, for one cryptomatte layer. */
+struct CoverageBuffer {
+  vector<float2> slots;
+  vector<float> overflow;
+  /* Table of the pixel being rendered. */
+  CoverageMap map;
+};
+
 class Coverage {
  public:
-  Coverage(KernelGlobals *kg_, RenderTile &tile_) : kg(kg_), tile(tile_)
+  Coverage(KernelGlobals *kg_, RenderTile &tile_) : kg(kg_), tile(tile_), num_slots(0)
   {
   }
   void init_path_trace();
@@ -36,13 +43,16 @@ class Coverage {
   void finalize();
 
  private:
-  vector<CoverageMap> coverage_object;
-  vector<CoverageMap> coverage_material;
-  vector<CoverageMap> coverage_asset;
+  CoverageBuffer coverage_object;
+  CoverageBuffer coverage_material;
+  CoverageBuffer coverage_asset;
   KernelGlobals *kg;
   RenderTile &tile;
-  void finalize_buffer(vector<CoverageMap> &coverage, const int pass_offset);
-  void flatten_buffer(vector<CoverageMap> &coverage, const int pass_offset);
+  int num_slots;
+  void init_buffer(CoverageBuffer &coverage);
+  CoverageMap *pixel_map(CoverageBuffer &coverage, const int pixel_index);
+  void finalize_buffer(CoverageBuffer &coverage, const int pass_offset);
+  void flatten_buffer(CoverageBuffer &coverage, const int pass_offset);
   void sort_buffer(const int pass_offset);
 };
 
@@ -18,9 +18,12 @@
 
 #include "kernel/filter/filter_defines.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_foreach.h"
+#include "util/util_logging.h"
 #include "util/util_map.h"
 #include "util/util_system.h"
+#include "util/util_task.h"
 #include "util/util_time.h"
 
 #include <OpenImageIO/filesystem.h>
@@ -231,11 +234,14 @@ DenoiseTask::DenoiseTask(Device *device,
       device(device),
       frame(frame),
       neighbor_frames(neighbor_frames),
+      image(NULL),
       current_layer(0),
+      band_y(0),
+      band_height(0),
       input_pixels(device, "filter input buffer", MEM_READ_ONLY),
-      num_tiles(0)
+      num_tiles(0),
+      num_tiles_done(0)
 {
-  image.samples = denoiser->samples_override;
 }
 
 DenoiseTask::~DenoiseTask()
@@ -258,7 +264,7 @@ bool DenoiseTask::acquire_tile(Device *device, Device *tile_device, RenderTile &
 
   device->map_tile(tile_device, tile);
 
-  print_progress(num_tiles - tiles.size(), num_tiles, frame, denoiser->num_frames);
+  print_progress(++num_tiles_done, num_tiles, frame, denoiser->num_frames);
 
   return true;
 }
@@ -280,15 +286,16 @@ void DenoiseTask::map_neighboring_tiles(RenderTile *tiles, Device *tile_device)
 
     int dx = (i % 3) - 1;
     int dy = (i / 3) - 1;
-    tiles[i].x = clamp(tiles[4].x + dx * denoiser->tile_size.x, 0, image.width);
-    tiles[i].w = clamp(tiles[4].x + (dx + 1) * denoiser->tile_size.x, 0, image.width) - tiles[i].x;
-    tiles[i].y = clamp(tiles[4].y + dy * denoiser->tile_size.y, 0, image.height);
-    tiles[i].h = clamp(tiles[4].y + (dy + 1) * denoiser->tile_size.y, 0, image.height) -
+    tiles[i].x = clamp(tiles[4].x + dx * denoiser->tile_size.x, 0, image->width);
+    tiles[i].w = clamp(tiles[4].x + (dx + 1) * denoiser->tile_size.x, 0, image->width) -
+                 tiles[i].x;
+    tiles[i].y = clamp(tiles[4].y + dy * denoiser->tile_size.y, 0, image->height);
+    tiles[i].h = clamp(tiles[4].y + (dy + 1) * denoiser->tile_size.y, 0, image->height) -
                  tiles[i].y;
 
     tiles[i].buffer = tiles[4].buffer;
     tiles[i].offset = tiles[4].offset;
-    tiles[i].stride = image.width;
+    tiles[i].stride = image->width;
   }
 
   /* Allocate output buffer. */
@@ -299,18 +306,19 @@ void DenoiseTask::map_neighboring_tiles(RenderTile *tiles, Device *tile_device)
   /* Fill output buffer with noisy image, assumed by kernel_filter_finalize
    * when skipping denoising of some pixels. */
   float *result = output_mem->data();
-  float *in = &image.pixels[image.num_channels * (tiles[4].y * image.width + tiles[4].x)];
+  const float *in = &image->pixels[(size_t)image->num_channels *
+                                   ((tiles[4].y - image->pixels_y) * image->width + tiles[4].x)];
 
-  const DenoiseImageLayer &layer = image.layers[current_layer];
+  const DenoiseImageLayer &layer = image->layers[current_layer];
   const int *input_to_image_channel = layer.input_to_image_channel.data();
 
   for (int y = 0; y < tiles[4].h; y++) {
     for (int x = 0; x < tiles[4].w; x++, result += OUTPUT_NUM_CHANNELS) {
       for (int i = 0; i < OUTPUT_NUM_CHANNELS; i++) {
-        result[i] = in[image.num_channels * x + input_to_image_channel[INPUT_NOISY_IMAGE + i]];
+        result[i] = in[image->num_channels * x + input_to_image_channel[INPUT_NOISY_IMAGE + i]];
       }
     }
-    in += image.num_channels * image.width;
+    in += image->num_channels * image->width;
   }
 
   output_mem->copy_to_device();
@@ -319,7 +327,7 @@ void DenoiseTask::map_neighboring_tiles(RenderTile *tiles, Device *tile_device)
   tiles[9] = tiles[4];
   tiles[9].buffer = output_mem->device_pointer;
   tiles[9].stride = tiles[9].w;
-  tiles[9].offset -= tiles[9].x + tiles[9].y * tiles[9].stride;
+  tiles[9].offset = -(tiles[9].x + tiles[9].y * tiles[9].stride);
 
   thread_scoped_lock output_lock(output_mutex);
   assert(output_pixels.count(tiles[4].tile_index) == 0);
@@ -338,18 +346,19 @@ void DenoiseTask::unmap_neighboring_tiles(RenderTile *tiles)
   output_mem->copy_from_device(0, OUTPUT_NUM_CHANNELS * tiles[9].w, tiles[9].h);
 
   float *result = output_mem->data();
-  float *out = &image.pixels[image.num_channels * (tiles[9].y * image.width + tiles[9].x)];
+  float *out = &band_pixels[(size_t)image->num_channels *
+                            ((tiles[9].y - band_y) * image->width + tiles[9].x)];
 
-  const DenoiseImageLayer &layer = image.layers[current_layer];
+  const DenoiseImageLayer &layer = image->layers[current_layer];
   const int *output_to_image_channel = layer.output_to_image_channel.data();
 
   for (int y = 0; y < tiles[9].h; y++) {
     for (int x = 0; x < tiles[9].w; x++, result += OUTPUT_NUM_CHANNELS) {
       for (int i = 0; i < OUTPUT_NUM_CHANNELS; i++) {
-        out[image.num_channels * x + output_to_image_channel[i]] = result[i];
+        out[image->num_channels * x + output_to_image_channel[i]] = result[i];
       }
     }
-    out += image.num_channels * image.width;
+    out += image->num_channels * image->width;
   }
 
   /* Free device buffer. */
@@ -391,9 +400,10 @@ void DenoiseTask::create_task(DeviceTask &task)
   task.target_pass_stride = OUTPUT_NUM_CHANNELS;
   task.pass_denoising_data = 0;
   task.pass_denoising_clean = -1;
-  task.frame_stride = image.width * image.height * INPUT_NUM_CHANNELS;
+  task.frame_stride = image->width * image->pixels_height * INPUT_NUM_CHANNELS;
 
-  /* Create tiles. */
+  /* Create tiles for the band, in image coordinates. The input buffer only
+   * holds the loaded scanlines, which the offset accounts for. */
   thread_scoped_lock tile_lock(tiles_mutex);
   thread_scoped_lock output_lock(output_mutex);
 
@@ -401,21 +411,21 @@ void DenoiseTask::create_task(DeviceTask &task)
   assert(output_pixels.empty());
   output_pixels.clear();
 
-  int tiles_x = divide_up(image.width, denoiser->tile_size.x);
-  int tiles_y = divide_up(image.height, denoiser->tile_size.y);
+  int tiles_x = divide_up(image->width, denoiser->tile_size.x);
+  int tiles_y = divide_up(band_height, denoiser->tile_size.y);
 
   for (int ty = 0; ty < tiles_y; ty++) {
     for (int tx = 0; tx < tiles_x; tx++) {
       RenderTile tile;
       tile.x = tx * denoiser->tile_size.x;
-      tile.y = ty * denoiser->tile_size.y;
-      tile.w = min(image.width - tile.x, denoiser->tile_size.x);
-      tile.h = min(image.height - tile.y, denoiser->tile_size.y);
+      tile.y = band_y + ty * denoiser->tile_size.y;
+      tile.w = min(image->width - tile.x, denoiser->tile_size.x);
+      tile.h = min(band_y + band_height - tile.y, denoiser->tile_size.y);
       tile.start_sample = 0;
-      tile.num_samples = image.layers[current_layer].samples;
+      tile.num_samples = image->layers[current_layer].samples;
       tile.sample = 0;
-      tile.offset = 0;
-      tile.stride = image.width;
+      tile.offset = -image->pixels_y * image->width;
+      tile.stride = image->width;
       tile.tile_index = ty * tiles_x + tx;
       tile.task = RenderTile::DENOISE;
       tile.buffers = NULL;
@@ -423,38 +433,38 @@ void DenoiseTask::create_task(DeviceTask &task)
       tiles.push_back(tile);
     }
   }
-
-  num_tiles = tiles.size();
 }
 
 /* Denoiser Operations */
 
 bool DenoiseTask::load_input_pixels(int layer)
 {
-  int w = image.width;
-  int h = image.height;
-  int num_pixels = image.width * image.height;
+  int w = image->width;
+  int h = image->pixels_height;
+  int num_pixels = w * h;
   int frame_stride = num_pixels * INPUT_NUM_CHANNELS;
 
   /* Load center image */
-  DenoiseImageLayer &image_layer = image.layers[layer];
+  DenoiseImageLayer &image_layer = image->layers[layer];
 
   float *buffer_data = input_pixels.data();
-  image.read_pixels(image_layer, buffer_data);
+  image->read_pixels(image_layer.input_to_image_channel, buffer_data);
   buffer_data += frame_stride;
 
   /* Load neighbor images */
-  for (int i = 0; i < image.in_neighbors.size(); i++) {
-    if (!image.read_neighbor_pixels(i, image_layer, buffer_data)) {
+  for (int i = 0; i < neighbors.size(); i++) {
+    if (neighbors[i]->pixels_y != image->pixels_y ||
+        neighbors[i]->pixels_height != image->pixels_height) {
       error = "Failed to read neighbor frame pixels";
       return false;
     }
+    neighbors[i]->read_pixels(image_layer.neighbor_input_to_image_channel[i], buffer_data);
     buffer_data += frame_stride;
   }
 
   /* Preprocess */
   buffer_data = input_pixels.data();
-  for (int neighbor = 0; neighbor < image.in_neighbors.size() + 1; neighbor++) {
+  for (int neighbor = 0; neighbor < neighbors.size() + 1; neighbor++) {
     /* Clamp */
     if (denoiser->params.clamp_input) {
       for (int i = 0; i < num_pixels * INPUT_NUM_CHANNELS; i++) {
@@ -507,9 +517,6 @@ bool DenoiseTask::load_input_pixels(int layer)
     buffer_data += frame_stride;
   }
 
-  /* Copy to device */
-  input_pixels.copy_to_device();
-
   return true;
 }
 
@@ -517,51 +524,125 @@ bool DenoiseTask::load_input_pixels(int layer)
 
 bool DenoiseTask::load()
 {
-  string center_filepath = denoiser->input[frame];
-  if (!image.load(center_filepath, error)) {
+  image = denoiser->images[frame].get();
+  image->samples = denoiser->samples_override;
+  if (!image->load_layers(error)) {
     return false;
   }
 
-  if (!image.load_neighbors(denoiser->input, neighbor_frames, error)) {
+  /* Match channels of neighbor frames. */
+  if (neighbor_frames.size() > DENOISE_MAX_FRAMES - 1) {
+    error = string_printf("Maximum number of neighbors (%d) exceeded\n", DENOISE_MAX_FRAMES - 1);
     return false;
   }
 
-  if (image.layers.empty()) {
-    error = "No image layers found to denoise in " + center_filepath;
-    return false;
+  neighbors.clear();
+  for (int neighbor = 0; neighbor < neighbor_frames.size(); neighbor++) {
+    DenoiseImage *neighbor_image = denoiser->images[neighbor_frames[neighbor]].get();
+    const string &filepath = neighbor_image->filepath;
+
+    if (neighbor_image->width != image->width || neighbor_image->height != image->height) {
+      error = "Neighbor frame has different dimensions: " + filepath;
+      return false;
+    }
+
+    foreach (DenoiseImageLayer &layer, image->layers) {
+      if (!layer.match_channels(
+              neighbor, image->in_spec.channelnames, neighbor_image->in_spec.channelnames)) {
+        error = "Neighbor frame misses denoising data passes: " + filepath;
+        return false;
+      }
+    }
+
+    neighbors.push_back(neighbor_image);
   }
 
-  /* Allocate device buffer. */
-  int num_frames = image.in_neighbors.size() + 1;
-  input_pixels.alloc(image.width * INPUT_NUM_CHANNELS, image.height * num_frames);
-  input_pixels.zero_to_device();
+  /* Save image with identical dimensions, channels and metadata. */
+  ImageSpec out_spec = image->in_spec;
+
+  /* Ensure that the output frame contains sample information even if the input didn't. */
+  for (int i = 0; i < image->layers.size(); i++) {
+    string name = "cycles." + image->layers[i].name + ".samples";
+    if (!out_spec.find_attribute(name, TypeDesc::STRING)) {
+      out_spec.attribute(name, TypeDesc::STRING, string_printf("%d", image->layers[i].samples));
+    }
+  }
+
+  /* Scanlines are written as bands are denoised, which tiled files don't support. */
+  out_spec.tile_width = 0;
+  out_spec.tile_height = 0;
+  out_spec.tile_depth = 0;
+
+  /* Write to temporary file path, so we denoise images in place and don't
+   * risk destroying files when something goes wrong in file saving. */
+  const string &out_filepath = denoiser->output[frame];
+  string extension = OIIO::Filesystem::extension(out_filepath);
+  string unique_name = ".denoise-tmp-" + OIIO::Filesystem::unique_path();
+  tmp_filepath = out_filepath + unique_name + extension;
+  out = unique_ptr<ImageOutput>(ImageOutput::create(tmp_filepath));
+
+  if (!out) {
+    error = "Failed to open temporary file " + tmp_filepath + " for writing";
+    return false;
+  }
 
-  /* Read pixels for first layer. */
-  current_layer = 0;
-  if (!load_input_pixels(current_layer)) {
+  if (!out->open(tmp_filepath, out_spec)) {
+    error = "Failed to open file " + tmp_filepath + " for writing: " + out->geterror();
+    out.reset();
     return false;
   }
 
+  int tiles_x = divide_up(image->width, denoiser->tile_size.x);
+  int tiles_y = divide_up(image->height, denoiser->tile_size.y);
+  num_tiles = tiles_x * tiles_y * image->layers.size();
+  num_tiles_done = 0;
+
   return true;
 }
 
-bool DenoiseTask::exec()
+void DenoiseTask::load_band(int y, int h)
 {
-  for (current_layer = 0; current_layer < image.layers.size(); current_layer++) {
-    /* Read pixels for secondary layers, first was already loaded. */
-    if (current_layer > 0) {
-      if (!load_input_pixels(current_layer)) {
-        return false;
-      }
-    }
+  band_y = y;
+  band_height = h;
+
+  /* Channels that are not denoised are passed through. */
+  const size_t band_size = (size_t)image->width * h * image->num_channels;
+  const size_t band_offset = (size_t)image->width * (y - image->pixels_y) * image->num_channels;
+  band_pixels.resize(band_size);
+  memcpy(band_pixels.data(), image->pixels.data() + band_offset, band_size * sizeof(float));
 
-    /* Run task on device. */
-    DeviceTask task(DeviceTask::RENDER);
-    create_task(task);
-    device->task_add(task);
-    device->task_wait();
+  /* Allocate device buffer. */
+  int num_frames = neighbors.size() + 1;
+  input_pixels.alloc(image->width * INPUT_NUM_CHANNELS, image->pixels_height * num_frames);
+  input_pixels.zero_to_device();
+}
+
+bool DenoiseTask::exec(int layer)
+{
+  current_layer = layer;
+
+  /* Copy to device */
+  input_pixels.copy_to_device();
 
-    printf("\n");
+  /* Run task on device. */
+  DeviceTask task(DeviceTask::RENDER);
+  create_task(task);
+  device->task_add(task);
+  device->task_wait();
+
+  return true;
+}
+
+bool DenoiseTask::save_band()
+{
+  const ImageSpec &spec = out->spec();
+  if (!out->write_scanlines(spec.y + band_y,
+                            spec.y + band_y + band_height,
+                            spec.z,
+                            TypeDesc::FLOAT,
+                            band_pixels.data())) {
+    error = "Failed to write to file " + tmp_filepath + ": " + out->geterror();
+    return false;
   }
 
   return true;
@@ -569,14 +650,46 @@ bool DenoiseTask::exec()
 
 bool DenoiseTask::save()
 {
-  bool ok = image.save_output(denoiser->output[frame], error);
+  printf("\n");
+
+  /* We don't need input anymore at this point, and will possibly
+   * overwrite the same file. It's reopened if a later frame needs it. */
+  image->close_input();
+
+  bool ok = true;
+  if (!out->close()) {
+    error = "Failed to save to file " + tmp_filepath + ": " + out->geterror();
+    ok = false;
+  }
+
+  out.reset();
+
+  /* Copy temporary file to outputput filepath. */
+  const string &out_filepath = denoiser->output[frame];
+  string rename_error;
+  if (ok && !OIIO::Filesystem::rename(tmp_filepath, out_filepath, rename_error)) {
+    error = "Failed to move denoised image to " + out_filepath + ": " + rename_error;
+    ok = false;
+  }
+
+  if (!ok) {
+    OIIO::Filesystem::remove(tmp_filepath);
+  }
+
   free();
   return ok;
 }
 
 void DenoiseTask::free()
 {
-  image.free();
+  /* Remove incomplete output file. */
+  if (out) {
+    out->close();
+    out.reset();
+    OIIO::Filesystem::remove(tmp_filepath);
+  }
+
+  band_pixels.clear();
   input_pixels.free();
   assert(output_pixels.empty());
 }
@@ -589,6 +702,8 @@ DenoiseImage::DenoiseImage()
   height = 0;
   num_channels = 0;
   samples = 0;
+  pixels_y = 0;
+  pixels_height = 0;
 }
 
 DenoiseImage::~DenoiseImage()
@@ -598,13 +713,15 @@ DenoiseImage::~DenoiseImage()
 
 void DenoiseImage::close_input()
 {
-  in_neighbors.clear();
+  in.reset();
 }
 
 void DenoiseImage::free()
 {
   close_input();
   pixels.clear();
+  pixels_y = 0;
+  pixels_height = 0;
 }
 
 bool DenoiseImage::parse_channels(const ImageSpec &in_spec, string &error)
@@ -668,64 +785,45 @@ bool DenoiseImage::parse_channels(const ImageSpec &in_spec, string &error)
   return true;
 }
 
-void DenoiseImage::read_pixels(const DenoiseImageLayer &layer, float *input_pixels)
+void DenoiseImage::read_pixels(const vector<int> &input_to_image_channel,
+                               float *input_pixels) const
 {
-  /* Pixels from center file have already been loaded into pixels.
-   * We copy a subset into the device input buffer with channels reshuffled. */
-  const int *input_to_image_channel = layer.input_to_image_channel.data();
+  /* Copy a subset of the loaded pixels into the device input buffer with
+   * channels reshuffled. */
+  const size_t num_pixels = (size_t)width * (size_t)pixels_height;
 
-  for (int i = 0; i < width * height; i++) {
+  for (size_t i = 0; i < num_pixels; i++) {
     for (int j = 0; j < INPUT_NUM_CHANNELS; j++) {
       int image_channel = input_to_image_channel[j];
-      input_pixels[i * INPUT_NUM_CHANNELS + j] =
-          pixels[((size_t)i) * num_channels + image_channel];
+      input_pixels[i * INPUT_NUM_CHANNELS + j] = pixels[i * num_channels + image_channel];
     }
   }
 }
 
-bool DenoiseImage::read_neighbor_pixels(int neighbor,
-                                        const DenoiseImageLayer &layer,
-                                        float *input_pixels)
-{
-  /* Load pixels from neighboring frames, and copy them into device buffer
-   * with channels reshuffled. */
-  size_t num_pixels = (size_t)width * (size_t)height;
-  array<float> neighbor_pixels(num_pixels * num_channels);
-  if (!in_neighbors[neighbor]->read_image(TypeDesc::FLOAT, neighbor_pixels.data())) {
-    return false;
-  }
-
-  const int *input_to_image_channel = layer.neighbor_input_to_image_channel[neighbor].data();
-
-  for (int i = 0; i < width * height; i++) {
-    for (int j = 0; j < INPUT_NUM_CHANNELS; j++) {
-      int image_channel = input_to_image_channel[j];
-      input_pixels[i * INPUT_NUM_CHANNELS + j] =
-          neighbor_pixels[((size_t)i) * num_channels + image_channel];
-    }
-  }
-
-  return true;
-}
-
-bool DenoiseImage::load(const string &in_filepath, string &error)
+bool DenoiseImage::open(const string &in_filepath, string &error)
 {
   if (!Filesystem::is_regular(in_filepath)) {
     error = "Couldn't find file: " + in_filepath;
     return false;
   }
 
-  unique_ptr<ImageInput> in(ImageInput::open(in_filepath));
+  in = unique_ptr<ImageInput>(ImageInput::open(in_filepath));
   if (!in) {
     error = "Couldn't open file: " + in_filepath;
     return false;
   }
 
+  filepath = in_filepath;
   in_spec = in->spec();
   width = in_spec.width;
   height = in_spec.height;
   num_channels = in_spec.nchannels;
 
+  return true;
+}
+
+bool DenoiseImage::load_layers(string &error)
+{
   if (!parse_channels(in_spec, error)) {
     return false;
   }
@@ -735,148 +833,264 @@ bool DenoiseImage::load(const string &in_filepath, string &error)
     return false;
   }
 
-  size_t num_pixels = (size_t)width * (size_t)height;
-  pixels.resize(num_pixels * num_channels);
+  return true;
+}
+
+bool DenoiseImage::load_pixels(int y, int h)
+{
+  if (pixels_y == y && pixels_height == h && pixels.size() > 0) {
+    return true;
+  }
+
+  if (!in) {
+    in = unique_ptr<ImageInput>(ImageInput::open(filepath));
+    if (!in) {
+      return false;
+    }
+  }
+
+  pixels_y = y;
+  pixels_height = h;
+  pixels.resize((size_t)width * (size_t)h * num_channels);
 
   /* Read all channels into buffer. Reading all channels at once is faster
    * than individually due to interleaved EXR channel storage. */
-  if (!in->read_image(TypeDesc::FLOAT, pixels.data())) {
-    error = "Failed to read image: " + in_filepath;
+  if (!in->read_scanlines(in_spec.y + y,
+                          in_spec.y + y + h,
+                          in_spec.z,
+                          0,
+                          num_channels,
+                          TypeDesc::FLOAT,
+                          pixels.data())) {
+    pixels_height = 0;
     return false;
   }
 
   return true;
 }
 
-bool DenoiseImage::load_neighbors(const vector<string> &filepaths,
-                                  const vector<int> &frames,
-                                  string &error)
+/* File pattern handling and outer loop over frames */
+
+Denoiser::Denoiser(DeviceInfo &device_info)
 {
-  if (frames.size() > DENOISE_MAX_FRAMES - 1) {
-    error = string_printf("Maximum number of neighbors (%d) exceeded\n", DENOISE_MAX_FRAMES - 1);
-    return false;
-  }
+  samples_override = 0;
+  tile_size = make_int2(64, 64);
+  memory_budget = (size_t)1024 * 1024 * 1024;
 
-  for (int neighbor = 0; neighbor < frames.size(); neighbor++) {
-    int frame = frames[neighbor];
-    const string &filepath = filepaths[frame];
+  num_frames = 0;
 
-    if (!Filesystem::is_regular(filepath)) {
-      error = "Couldn't find neighbor frame: " + filepath;
-      return false;
-    }
+  /* Initialize task scheduler. */
+  TaskScheduler::init();
 
-    unique_ptr<ImageInput> in_neighbor(ImageInput::open(filepath));
-    if (!in_neighbor) {
-      error = "Couldn't open neighbor frame: " + filepath;
-      return false;
-    }
+  /* Initialize device. */
+  device = Device::create(device_info, stats, profiler, true);
 
-    const ImageSpec &neighbor_spec = in_neighbor->spec();
-    if (neighbor_spec.width != width || neighbor_spec.height != height) {
-      error = "Neighbor frame has different dimensions: " + filepath;
-      return false;
-    }
+  DeviceRequestedFeatures req;
+  req.use_denoising = true;
+  device->load_kernels(req);
+}
 
-    foreach (DenoiseImageLayer &layer, layers) {
-      if (!layer.match_channels(neighbor, in_spec.channelnames, neighbor_spec.channelnames)) {
-        error = "Neighbor frame misses denoising data passes: " + filepath;
-        return false;
-      }
-    }
+Denoiser::~Denoiser()
+{
+  images.clear();
+  delete device;
+  TaskScheduler::exit();
+}
 
-    in_neighbors.push_back(std::move(in_neighbor));
+DenoiseImage *Denoiser::open_image(int frame)
+{
+  unique_ptr<DenoiseImage> &image = images[frame];
+  if (!image) {
+    image.reset(new DenoiseImage());
+    if (!image->open(input[frame], error)) {
+      images.erase(frame);
+      return NULL;
+    }
   }
-
-  return true;
+  return image.get();
 }
 
-bool DenoiseImage::save_output(const string &out_filepath, string &error)
+void Denoiser::close_images(int frame_begin, int frame_end)
 {
-  /* Save image with identical dimensions, channels and metadata. */
-  ImageSpec out_spec = in_spec;
-
-  /* Ensure that the output frame contains sample information even if the input didn't. */
-  for (int i = 0; i < layers.size(); i++) {
-    string name = "cycles." + layers[i].name + ".samples";
-    if (!out_spec.find_attribute(name, TypeDesc::STRING)) {
-      out_spec.attribute(name, TypeDesc::STRING, string_printf("%d", layers[i].samples));
+  for (map<int, unique_ptr<DenoiseImage>>::iterator it = images.begin(); it != images.end();) {
+    if (it->first < frame_begin || it->first >= frame_end) {
+      it = images.erase(it);
+    }
+    else {
+      ++it;
     }
   }
+}
 
-  /* We don't need input anymore at this point, and will possibly
-   * overwrite the same file. */
-  close_input();
+/* Scanlines loaded around a band, for the neighboring tiles and the box blur
+ * of the intensity pass to be the same as for the full frame. */
+static int band_overlap(const Denoiser *denoiser)
+{
+  return denoiser->tile_size.y + 5 * denoiser->params.radius;
+}
 
-  /* Write to temporary file path, so we denoise images in place and don't
-   * risk destroying files when something goes wrong in file saving. */
-  string extension = OIIO::Filesystem::extension(out_filepath);
-  string unique_name = ".denoise-tmp-" + OIIO::Filesystem::unique_path();
-  string tmp_filepath = out_filepath + unique_name + extension;
-  unique_ptr<ImageOutput> out(ImageOutput::create(tmp_filepath));
+/* Memory used to denoise output frames in bands, for the scanlines loaded
+ * from input frames, the device input buffers and the denoised scanlines. */
+static size_t band_memory_size(
+    const DenoiseImage *image, int band_height, int overlap, int num_outputs, int num_neighbors)
+{
+  const size_t load_height = min(band_height + 2 * overlap, image->height);
+  const size_t num_inputs = num_outputs + 2 * num_neighbors;
+  const size_t num_task_frames = 2 * num_neighbors + 1;
+
+  return (size_t)image->width * sizeof(float) *
+         (load_height * (num_inputs * image->num_channels +
+                         num_outputs * num_task_frames * INPUT_NUM_CHANNELS) +
+          band_height * num_outputs * image->num_channels);
+}
 
-  if (!out) {
-    error = "Failed to open temporary file " + tmp_filepath + " for writing";
-    return false;
+int Denoiser::batch_num_frames(const DenoiseImage *image, int num_outputs)
+{
+  /* Output frames are preprocessed in parallel, more than there are threads
+   * only adds to memory usage. */
+  const int overlap = band_overlap(this);
+  const int max_num_outputs = min(num_outputs, max(TaskScheduler::num_threads(), 1));
+
+  int num_batch_frames = 1;
+  while (num_batch_frames < max_num_outputs &&
+         band_memory_size(
+             image, tile_size.y, overlap, num_batch_frames + 1, params.neighbor_frames) <=
+             memory_budget) {
+    num_batch_frames++;
   }
 
-  /* Open temporary file and write image buffers. */
-  if (!out->open(tmp_filepath, out_spec)) {
-    error = "Failed to open file " + tmp_filepath + " for writing: " + out->geterror();
-    return false;
-  }
+  return num_batch_frames;
+}
 
-  bool ok = true;
-  if (!out->write_image(TypeDesc::FLOAT, pixels.data())) {
-    error = "Failed to write to file " + tmp_filepath + ": " + out->geterror();
-    ok = false;
+int Denoiser::batch_band_height(const DenoiseImage *image, int num_outputs)
+{
+  const int overlap = band_overlap(this);
+
+  int band_height = tile_size.y;
+  while (band_height < image->height &&
+         band_memory_size(
+             image, band_height + tile_size.y, overlap, num_outputs, params.neighbor_frames) <=
+             memory_budget) {
+    band_height += tile_size.y;
   }
 
-  if (!out->close()) {
-    error = "Failed to save to file " + tmp_filepath + ": " + out->geterror();
-    ok = false;
-  }
+  return band_height;
+}
 
-  out.reset();
+static void task_load_input_pixels(DenoiseTask *task, int layer, int *ok)
+{
+  *ok = task->load_input_pixels(layer);
+}
 
-  /* Copy temporary file to outputput filepath. */
-  string rename_error;
-  if (ok && !OIIO::Filesystem::rename(tmp_filepath, out_filepath, rename_error)) {
-    error = "Failed to move denoised image to " + out_filepath + ": " + rename_error;
-    ok = false;
-  }
+static void task_save_band(DenoiseTask *task, int *ok)
+{
+  *ok = task->save_band();
+}
 
-  if (!ok) {
-    OIIO::Filesystem::remove(tmp_filepath);
+static void image_load_pixels(DenoiseImage *image, int y, int h, int *ok)
+{
+  *ok = image->load_pixels(y, h);
+}
+
+bool Denoiser::run_batch(vector<unique_ptr<DenoiseTask>> &tasks)
+{
+  const DenoiseImage *first_image = tasks[0]->image;
+  const int width = first_image->width;
+  const int height = first_image->height;
+  const int overlap = band_overlap(this);
+  const int band_height = batch_band_height(first_image, tasks.size());
+
+  /* Input frames used by the batch, loaded once for all tasks. */
+  vector<DenoiseImage *> batch_images;
+  int num_layers = 0;
+  for (unique_ptr<DenoiseTask> &task : tasks) {
+    batch_images.push_back(task->image);
+    batch_images.insert(batch_images.end(), task->neighbors.begin(), task->neighbors.end());
+    num_layers = max(num_layers, (int)task->image->layers.size());
   }
+  std::sort(batch_images.begin(), batch_images.end());
+  batch_images.erase(std::unique(batch_images.begin(), batch_images.end()), batch_images.end());
 
-  return ok;
-}
+  VLOG(1) << "Denoising " << tasks.size() << " frames of " << width << "x" << height
+          << " in bands of " << band_height << " scanlines.";
 
-/* File pattern handling and outer loop over frames */
+  TaskPool pool;
+  vector<int> ok(max(batch_images.size(), tasks.size()));
 
-Denoiser::Denoiser(DeviceInfo &device_info)
-{
-  samples_override = 0;
-  tile_size = make_int2(64, 64);
+  for (int y = 0; y < height; y += band_height) {
+    const int h = min(band_height, height - y);
+    const int load_y = max(y - overlap, 0);
+    const int load_h = min(y + h + overlap, height) - load_y;
 
-  num_frames = 0;
+    /* Load scanlines of all input frames in parallel. */
+    for (int i = 0; i < batch_images.size(); i++) {
+      pool.push(function_bind(
+          &image_load_pixels, batch_images[i], load_y, load_h, &ok[i]));
+    }
+    pool.wait_work();
 
-  /* Initialize task scheduler. */
-  TaskScheduler::init();
+    for (int i = 0; i < batch_images.size(); i++) {
+      if (!ok[i]) {
+        error = "Failed to read image: " + batch_images[i]->filepath;
+        return false;
+      }
+    }
 
-  /* Initialize device. */
-  device = Device::create(device_info, stats, profiler, true);
+    foreach (unique_ptr<DenoiseTask> &task, tasks) {
+      task->load_band(y, h);
+    }
 
-  DeviceRequestedFeatures req;
-  req.use_denoising = true;
-  device->load_kernels(req);
-}
+    for (int layer = 0; layer < num_layers; layer++) {
+      /* Preprocess input of all output frames in parallel, then denoise them
+       * on the device one after the other. */
+      for (int i = 0; i < tasks.size(); i++) {
+        ok[i] = true;
+        if (layer < tasks[i]->image->layers.size()) {
+          pool.push(function_bind(&task_load_input_pixels, tasks[i].get(), layer, &ok[i]));
+        }
+      }
+      pool.wait_work();
 
-Denoiser::~Denoiser()
-{
-  delete device;
-  TaskScheduler::exit();
+      for (int i = 0; i < tasks.size(); i++) {
+        if (!ok[i]) {
+          error = tasks[i]->error;
+          return false;
+        }
+        if (layer < tasks[i]->image->layers.size() && !tasks[i]->exec(layer)) {
+          error = tasks[i]->error;
+          return false;
+        }
+      }
+    }
+
+    /* Write denoised scanlines of all output frames. */
+    for (int i = 0; i < tasks.size(); i++) {
+      pool.push(function_bind(&task_save_band, tasks[i].get(), &ok[i]));
+    }
+    pool.wait_work();
+
+    for (int i = 0; i < tasks.size(); i++) {
+      if (!ok[i]) {
+        error = tasks[i]->error;
+        return false;
+      }
+    }
+  }
+
+  /* Free scanlines of input frames, before they are loaded for the next batch. */
+  foreach (DenoiseImage *image, batch_images) {
+    image->pixels.clear();
+    image->pixels_height = 0;
+  }
+
+  foreach (unique_ptr<DenoiseTask> &task, tasks) {
+    if (!task->save()) {
+      error = task->error;
+      return false;
+    }
+  }
+
+  return true;
 }
 
 bool Denoiser::run()
@@ -885,40 +1099,69 @@ bool Denoiser::run()
 
   num_frames = output.size();
 
+  /* Skip empty output paths. */
+  vector<int> output_frames;
   for (int frame = 0; frame < num_frames; frame++) {
-    /* Skip empty output paths. */
-    if (output[frame].empty()) {
-      continue;
+    if (!output[frame].empty()) {
+      output_frames.push_back(frame);
     }
+  }
 
-    /* Determine neighbor frame numbers that should be used for filtering. */
-    vector<int> neighbor_frames;
-    for (int f = frame - params.neighbor_frames; f <= frame + params.neighbor_frames; f++) {
-      if (f >= 0 && f < num_frames && f != frame) {
-        neighbor_frames.push_back(f);
-      }
+  for (size_t next = 0; next < output_frames.size();) {
+    /* Determine output frames to process at once, with matching dimensions. */
+    DenoiseImage *first_image = open_image(output_frames[next]);
+    if (!first_image) {
+      return false;
     }
 
-    /* Execute task. */
-    DenoiseTask task(device, this, frame, neighbor_frames);
-    if (!task.load()) {
-      error = task.error;
-      return false;
+    const int max_batch_frames = batch_num_frames(first_image, output_frames.size() - next);
+    vector<int> batch_frames;
+    for (; next < output_frames.size() && batch_frames.size() < max_batch_frames; next++) {
+      DenoiseImage *image = open_image(output_frames[next]);
+      if (!image) {
+        return false;
+      }
+      if (image->width != first_image->width || image->height != first_image->height ||
+          image->num_channels != first_image->num_channels) {
+        break;
+      }
+      batch_frames.push_back(output_frames[next]);
     }
 
-    if (!task.exec()) {
-      error = task.error;
-      return false;
+    /* Keep input frames shared with the previous batch open, and close others. */
+    close_images(batch_frames.front() - params.neighbor_frames,
+                 batch_frames.back() + params.neighbor_frames + 1);
+
+    vector<unique_ptr<DenoiseTask>> tasks;
+    foreach (int frame, batch_frames) {
+      /* Determine neighbor frame numbers that should be used for filtering. */
+      vector<int> neighbor_frames;
+      for (int f = frame - params.neighbor_frames; f <= frame + params.neighbor_frames; f++) {
+        if (f >= 0 && f < num_frames && f != frame) {
+          if (!open_image(f)) {
+            return false;
+          }
+          neighbor_frames.push_back(f);
+        }
+      }
+
+      /* Create task. */
+      unique_ptr<DenoiseTask> task(new DenoiseTask(device, this, frame, neighbor_frames));
+      if (!task->load()) {
+        error = task->error;
+        return false;
+      }
+      tasks.push_back(std::move(task));
     }
 
-    if (!task.save()) {
-      error = task.error;
+    /* Execute tasks. */
+    if (!run_batch(tasks)) {
       return false;
     }
-
-    task.free();
   }
 
+  images.clear();
+
   return true;
 }
 
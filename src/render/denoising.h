@@ -22,6 +22,7 @@
 
 #include "render/buffers.h"
 
+#include "util/util_map.h"
 #include "util/util_string.h"
 #include "util/util_vector.h"
 #include "util/util_unique_ptr.h"
@@ -32,7 +33,16 @@ OIIO_NAMESPACE_USING
 
 CCL_NAMESPACE_BEGIN
 
-/* Denoiser */
+class DenoiseImage;
+class DenoiseTask;
+
+/* Denoiser
+ *
+ * Frames are streamed from their files in bands of tile rows, with enough
+ * scanlines around them for the tiles to be denoised exactly like a full
+ * frame. Output frames are processed in batches, sharing the scanlines of
+ * input frames that are neighbors of several of them, and writing their
+ * denoised scanlines as soon as each band is done. */
 
 class Denoiser {
  public:
@@ -55,6 +65,10 @@ class Denoiser {
   int samples_override;
   /* Tile size for processing on device. */
   int2 tile_size;
+  /* Memory budget in bytes for image data, which determines how many output
+   * frames and tile rows are processed at once. At least one output frame and
+   * one tile row are processed, regardless of the budget. */
+  size_t memory_budget;
 
   /* Equivalent to the settings in the regular denoiser. */
   DenoiseParams params;
@@ -67,6 +81,22 @@ class Denoiser {
   Device *device;
 
   int num_frames;
+
+  /* Input frames that are open, by frame number. Frames stay open while
+   * consecutive batches of output frames use them. */
+  map<int, unique_ptr<DenoiseImage>> images;
+
+  /* Open input frame, or return it if it's already open. */
+  DenoiseImage *open_image(int frame);
+  /* Close input frames outside of the range. */
+  void close_images(int frame_begin, int frame_end);
+
+  /* Number of output frames and tile rows to process at once. */
+  int batch_num_frames(const DenoiseImage *image, int num_outputs);
+  int batch_band_height(const DenoiseImage *image, int num_outputs);
+
+  /* Denoise the output frames of a batch, band by band. */
+  bool run_batch(vector<unique_ptr<DenoiseTask>> &tasks);
 };
 
 /* Denoise Image Layer */
@@ -116,39 +146,44 @@ class DenoiseImage {
   /* Samples */
   int samples;
 
-  /* Pixel buffer with interleaved channels. */
+  /* Pixel buffer with interleaved channels, for the loaded scanlines. */
   array<float> pixels;
+  int pixels_y, pixels_height;
 
-  /* Image file handles */
+  /* Image file handle */
+  string filepath;
   ImageSpec in_spec;
-  vector<unique_ptr<ImageInput>> in_neighbors;
+  unique_ptr<ImageInput> in;
 
   /* Render layers */
   vector<DenoiseImageLayer> layers;
 
   void free();
 
-  /* Open the input image, parse its channels, open the output image and allocate the output
-   * buffer. */
-  bool load(const string &in_filepath, string &error);
+  /* Open the input image and read its specification. */
+  bool open(const string &in_filepath, string &error);
 
-  /* Load neighboring frames. */
-  bool load_neighbors(const vector<string> &filepaths, const vector<int> &frames, string &error);
+  /* Parse the input file channels into layers, needed for images that are
+   * denoised rather than only used as neighbors. */
+  bool load_layers(string &error);
 
-  /* Load subset of pixels from file buffer into input buffer, as needed for denoising
-   * on the device. Channels are reshuffled following the provided mapping. */
-  void read_pixels(const DenoiseImageLayer &layer, float *input_pixels);
-  bool read_neighbor_pixels(int neighbor, const DenoiseImageLayer &layer, float *input_pixels);
+  /* Load scanlines with all channels into the pixel buffer, reopening the file
+   * if it was closed. */
+  bool load_pixels(int y, int h);
 
-  bool save_output(const string &out_filepath, string &error);
+  /* Copy subset of the loaded pixels into the input buffer, as needed for
+   * denoising on the device. Channels are reshuffled following the provided
+   * mapping. */
+  void read_pixels(const vector<int> &input_to_image_channel, float *input_pixels) const;
+
+  /* Close the file handle, so the file can be overwritten. */
+  void close_input();
 
  protected:
   /* Parse input file channels, separate them into DenoiseImageLayers,
    * detect DenoiseImageLayers with full channel sets,
    * fill layers and set up the output channels and passthrough map. */
   bool parse_channels(const ImageSpec &in_spec, string &error);
-
-  void close_input();
 };
 
 /* Denoise Task */
@@ -160,13 +195,18 @@ class DenoiseTask {
 
   /* Task stages */
   bool load();
-  bool exec();
+  void load_band(int y, int h);
+  bool load_input_pixels(int layer);
+  bool exec(int layer);
+  bool save_band();
   bool save();
   void free();
 
   string error;
 
  protected:
+  friend class Denoiser;
+
   /* Denoiser parameters and device */
   Denoiser *denoiser;
   Device *device;
@@ -175,10 +215,19 @@ class DenoiseTask {
   int frame;
   vector<int> neighbor_frames;
 
-  /* Image file data */
-  DenoiseImage image;
+  /* Image file data, owned by the denoiser */
+  DenoiseImage *image;
+  vector<DenoiseImage *> neighbors;
   int current_layer;
 
+  /* Band of scanlines being denoised, with all channels of the image. */
+  int band_y, band_height;
+  array<float> band_pixels;
+
+  /* Output file, written to a temporary path until it is complete. */
+  unique_ptr<ImageOutput> out;
+  string tmp_filepath;
+
   /* Device input buffer */
   device_vector<float> input_pixels;
 
@@ -186,12 +235,12 @@ class DenoiseTask {
   thread_mutex tiles_mutex;
   list<RenderTile> tiles;
   int num_tiles;
+  int num_tiles_done;
 
   thread_mutex output_mutex;
   map<int, device_vector<float> *> output_pixels;
 
   /* Task handling */
-  bool load_input_pixels(int layer);
   void create_task(DeviceTask &task);
 
   /* Device task callbacks */
@@ -16,6 +16,7 @@
 
 #include "render/attribute.h"
 #include "render/graph.h"
+#include "render/image.h"
 #include "render/nodes.h"
 #include "render/scene.h"
 #include "render/shader.h"
@@ -366,6 +367,10 @@ void ShaderGraph::simplify(Scene *scene)
     clean(scene);
     refine_bump_nodes();
 
+    if (!scene->shader_manager->use_osl() && scene->image_manager->use_texture_cache(scene)) {
+      refine_image_derivatives();
+    }
+
     simplified = true;
   }
 }
@@ -953,6 +958,53 @@ void ShaderGraph::refine_bump_nodes()
   }
 }
 
+void ShaderGraph::refine_image_derivatives()
+{
+  /* images loaded through the texture cache select mipmap levels from the
+   * derivatives of their texture coordinates. like in refine_bump_nodes(), we
+   * copy the sub-graph defined from the "vector" input twice, with texture
+   * coordinates shifted by dx/dy, and connect them to "vectordx" and "vectordy". */
+
+  vector<ImageTextureNode *> image_nodes;
+  foreach (ShaderNode *node, nodes) {
+    if (node->type == ImageTextureNode::node_type &&
+        (node->bump == SHADER_BUMP_NONE || node->bump == SHADER_BUMP_CENTER)) {
+      ImageTextureNode *image_node = (ImageTextureNode *)node;
+      if (!image_node->builtin_data && image_node->projection != NODE_IMAGE_PROJ_BOX &&
+          image_node->input("Vector")->link) {
+        image_nodes.push_back(image_node);
+      }
+    }
+  }
+
+  foreach (ImageTextureNode *node, image_nodes) {
+    ShaderInput *vector_input = node->input("Vector");
+    ShaderNodeSet nodes_vector;
+
+    ShaderNodeMap nodes_dx;
+    ShaderNodeMap nodes_dy;
+
+    find_dependencies(nodes_vector, vector_input);
+
+    copy_nodes(nodes_vector, nodes_dx);
+    copy_nodes(nodes_vector, nodes_dy);
+
+    foreach (NodePair &pair, nodes_dx)
+      pair.second->bump = SHADER_BUMP_DX;
+    foreach (NodePair &pair, nodes_dy)
+      pair.second->bump = SHADER_BUMP_DY;
+
+    ShaderOutput *out = vector_input->link;
+    connect(nodes_dx[out->parent]->output(out->name()), node->input("VectorDx"));
+    connect(nodes_dy[out->parent]->output(out->name()), node->input("VectorDy"));
+
+    foreach (NodePair &pair, nodes_dx)
+      add(pair.second);
+    foreach (NodePair &pair, nodes_dy)
+      add(pair.second);
+  }
+}
+
 void ShaderGraph::bump_from_displacement(bool use_object_space)
 {
   /* generate bump mapping automatically from displacement. bump mapping is
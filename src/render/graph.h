@@ -224,6 +224,12 @@ class ShaderNode : public Node {
   {
     return false;
   }
+  /* The compiled node refers to image, light or pass slots of the scene, so
+   * the SVM nodes can't be reused by other shaders. */
+  virtual bool has_slot_dependency()
+  {
+    return false;
+  }
   vector<ShaderInput *> inputs;
   vector<ShaderOutput *> outputs;
 
@@ -359,6 +365,7 @@ class ShaderGraph {
   void break_cycles(ShaderNode *node, vector<bool> &visited, vector<bool> &on_stack);
   void bump_from_displacement(bool use_object_space);
   void refine_bump_nodes();
+  void refine_image_derivatives();
   void expand();
   void default_inputs(bool do_osl);
   void transform_multi_closure(ShaderNode *node, ShaderOutput *weight_out, bool volume);
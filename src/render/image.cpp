@@ -23,9 +23,12 @@
 #include "util/util_foreach.h"
 #include "util/util_image_impl.h"
 #include "util/util_logging.h"
+#include "util/util_md5.h"
 #include "util/util_path.h"
 #include "util/util_progress.h"
+#include "util/util_sparse_grid.h"
 #include "util/util_texture.h"
+#include "util/util_texture_cache.h"
 #include "util/util_unique_ptr.h"
 
 #ifdef WITH_OSL
@@ -104,6 +107,11 @@ ImageManager::ImageManager(const DeviceInfo &info)
   max_num_images = TEX_NUM_MAX;
   has_half_images = info.has_half_images;
 
+  /* Texture cache lookups are done on the host. */
+  has_texture_cache = (info.type == DEVICE_CPU);
+  has_sparse_grids = (info.type == DEVICE_CPU);
+  texture_cache = NULL;
+
   for (size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
     tex_num_images[type] = 0;
   }
@@ -115,6 +123,8 @@ ImageManager::~ImageManager()
     for (size_t slot = 0; slot < images[type].size(); slot++)
       assert(!images[type][slot]);
   }
+
+  delete texture_cache;
 }
 
 void ImageManager::set_osl_texture_system(void *texture_system)
@@ -122,6 +132,11 @@ void ImageManager::set_osl_texture_system(void *texture_system)
   osl_texture_system = texture_system;
 }
 
+bool ImageManager::use_texture_cache(Scene *scene) const
+{
+  return has_texture_cache && scene->params.texture_cache_size > 0;
+}
+
 bool ImageManager::set_animation_frame_update(int frame)
 {
   if (frame != animation_frame) {
@@ -148,6 +163,16 @@ device_memory *ImageManager::image_memory(int flat_slot)
   return img->mem;
 }
 
+const int *ImageManager::image_grid_index(int flat_slot)
+{
+  ImageDataType type;
+  int slot = flattened_slot_to_type_index(flat_slot, &type);
+
+  Image *img = images[type][slot];
+
+  return (img->grid_index) ? img->grid_index->data() : NULL;
+}
+
 bool ImageManager::get_image_metadata(int flat_slot, ImageMetaData &metadata)
 {
   if (flat_slot == -1) {
@@ -402,7 +427,9 @@ int ImageManager::add_image(const string &filename,
   img->users = 1;
   img->alpha_type = alpha_type;
   img->colorspace = colorspace;
+  img->need_upload = false;
   img->mem = NULL;
+  img->grid_index = NULL;
 
   images[type][slot] = img;
 
@@ -774,6 +801,113 @@ bool ImageManager::file_load_image(Image *img,
   return true;
 }
 
+string ImageManager::texture_cache_filename(Image *img, ImageDataType type, int texture_limit)
+{
+  /* Identify converted files by everything that affects the loaded pixels. */
+  MD5Hash md5;
+  md5.append(img->filename);
+  md5.append(img->colorspace.string());
+  md5.append(string_printf("%d %d %d", (int)img->alpha_type, (int)type, texture_limit));
+  return path_cache_get(path_join("textures", md5.get_hex() + ".tx"));
+}
+
+template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
+bool ImageManager::texture_cache_load_image(
+    Device *device, Scene *scene, Image *img, ImageDataType type, int texture_limit)
+{
+  const string filename = texture_cache_filename(img, type, texture_limit);
+
+  {
+    /* Convert to a tiled and mipmapped file when missing or outdated. Conversions
+     * are done one at a time, so at most one image is fully loaded in memory. */
+    thread_scoped_lock cache_lock(texture_cache_mutex);
+
+    if (!texture_cache) {
+      texture_cache = new TextureCache();
+      texture_cache->set_max_memory(scene->params.texture_cache_size);
+    }
+
+    if (!path_exists(filename) ||
+        path_modified_time(filename) < path_modified_time(img->filename)) {
+      device_vector<DeviceType> pixels(device, img->mem_name.c_str(), MEM_TEXTURE);
+      if (!file_load_image<FileFormat, StorageType>(img, type, texture_limit, pixels)) {
+        return false;
+      }
+
+      VLOG(1) << "Converting " << img->filename << " to tiled and mipmapped " << filename;
+
+      path_create_directories(filename);
+      if (!texture_cache->write_image(
+              filename, pixels.data(), type, pixels.data_width, pixels.data_height)) {
+        return false;
+      }
+    }
+  }
+
+  const uint64_t cache_image = texture_cache->get_image(filename);
+  if (!cache_image) {
+    return false;
+  }
+
+  /* Only a placeholder pixel is allocated, lookups go through the texture cache. */
+  device_vector<DeviceType> *tex_img = new device_vector<DeviceType>(
+      device, img->mem_name.c_str(), MEM_TEXTURE);
+
+  DeviceType *pixels = tex_img->alloc(1, 1);
+  memset(pixels, 0, sizeof(DeviceType));
+
+  img->mem = tex_img;
+  img->mem->interpolation = img->interpolation;
+  img->mem->extension = img->extension;
+  img->mem->cache_image = cache_image;
+
+  return true;
+}
+
+template<typename DeviceType>
+device_vector<DeviceType> *ImageManager::sparse_grid_load_image(Device *device,
+                                                                Image *img,
+                                                                device_vector<DeviceType> *tex_img)
+{
+  const int3 resolution = make_int3(
+      tex_img->data_width, tex_img->data_height, tex_img->data_depth);
+  const size_t index_size = sparse_grid_index_size(resolution);
+
+  device_vector<int> *grid_index = new device_vector<int>(
+      device, "__tex_image_grid_index", MEM_READ_ONLY);
+  int *index = grid_index->alloc(index_size);
+  const int num_tiles = sparse_grid_build_index(tex_img->data(), resolution, index);
+
+  /* Keep the dense grid if the sparse grid would not use less memory. */
+  const size_t tile_size = SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE;
+  const size_t num_voxels = max(num_tiles, 1) * tile_size;
+  if (num_voxels * sizeof(DeviceType) + index_size * sizeof(int) >=
+      tex_img->size() * sizeof(DeviceType)) {
+    delete grid_index;
+    return tex_img;
+  }
+
+  device_vector<DeviceType> *sparse_img = new device_vector<DeviceType>(
+      device, img->mem_name.c_str(), MEM_TEXTURE);
+  DeviceType *tiles = sparse_img->alloc(num_voxels);
+  sparse_grid_fill_tiles(tex_img->data(), resolution, index, tiles);
+
+  /* Lookups are done with the resolution of the full grid. */
+  sparse_img->data_width = resolution.x;
+  sparse_img->data_height = resolution.y;
+  sparse_img->data_depth = resolution.z;
+
+  VLOG(1) << "Sparse volume grid " << path_filename(img->filename) << ": " << num_tiles << " of "
+          << index_size << " tiles, "
+          << string_human_readable_size(sparse_img->memory_size() + grid_index->memory_size())
+          << " instead of " << string_human_readable_size(tex_img->memory_size());
+
+  delete tex_img;
+  img->grid_index = grid_index;
+
+  return sparse_img;
+}
+
 void ImageManager::device_load_image(
     Device *device, Scene *scene, ImageDataType type, int slot, Progress *progress)
 {
@@ -785,6 +919,12 @@ void ImageManager::device_load_image(
   if (osl_texture_system && !img->builtin_data)
     return;
 
+  /* The same image may be requested by multiple scene updates running in
+   * parallel, the first one loads it and the others wait for it. */
+  thread_scoped_lock load_lock(img->load_mutex);
+  if (!img->need_load)
+    return;
+
   string filename = path_filename(images[type][slot]->filename);
   progress->set_status("Updating Images", "Loading " + filename);
 
@@ -799,6 +939,56 @@ void ImageManager::device_load_image(
     thread_scoped_lock device_lock(device_mutex);
     delete img->mem;
     img->mem = NULL;
+    delete img->grid_index;
+    img->grid_index = NULL;
+  }
+
+  /* Load image files on demand through the texture cache, falling back to loading
+   * the full image if it can't be converted. */
+  if (use_texture_cache(scene) && !img->builtin_data && img->metadata.depth <= 1) {
+    bool loaded = false;
+    switch (type) {
+      case IMAGE_DATA_TYPE_FLOAT4:
+        loaded = texture_cache_load_image<TypeDesc::FLOAT, float, float4>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_FLOAT:
+        loaded = texture_cache_load_image<TypeDesc::FLOAT, float, float>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_BYTE4:
+        loaded = texture_cache_load_image<TypeDesc::UINT8, uchar, uchar4>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_BYTE:
+        loaded = texture_cache_load_image<TypeDesc::UINT8, uchar, uchar>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_HALF4:
+        loaded = texture_cache_load_image<TypeDesc::HALF, half, half4>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_HALF:
+        loaded = texture_cache_load_image<TypeDesc::HALF, half, half>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_USHORT4:
+        loaded = texture_cache_load_image<TypeDesc::USHORT, uint16_t, ushort4>(
+            device, scene, img, type, texture_limit);
+        break;
+      case IMAGE_DATA_TYPE_USHORT:
+        loaded = texture_cache_load_image<TypeDesc::USHORT, uint16_t, uint16_t>(
+            device, scene, img, type, texture_limit);
+        break;
+      default:
+        break;
+    }
+
+    if (loaded) {
+      img->need_load = false;
+      img->need_upload = true;
+      return;
+    }
   }
 
   /* Create new texture. */
@@ -816,13 +1006,13 @@ void ImageManager::device_load_image(
       pixels[2] = TEX_IMAGE_MISSING_B;
       pixels[3] = TEX_IMAGE_MISSING_A;
     }
+    else if (has_sparse_grids && tex_img->data_depth > 1) {
+      tex_img = sparse_grid_load_image(device, img, tex_img);
+    }
 
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_FLOAT) {
     device_vector<float> *tex_img = new device_vector<float>(
@@ -835,13 +1025,13 @@ void ImageManager::device_load_image(
 
       pixels[0] = TEX_IMAGE_MISSING_R;
     }
+    else if (has_sparse_grids && tex_img->data_depth > 1) {
+      tex_img = sparse_grid_load_image(device, img, tex_img);
+    }
 
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_BYTE4) {
     device_vector<uchar4> *tex_img = new device_vector<uchar4>(
@@ -861,9 +1051,6 @@ void ImageManager::device_load_image(
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_BYTE) {
     device_vector<uchar> *tex_img = new device_vector<uchar>(
@@ -880,9 +1067,6 @@ void ImageManager::device_load_image(
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_HALF4) {
     device_vector<half4> *tex_img = new device_vector<half4>(
@@ -902,9 +1086,6 @@ void ImageManager::device_load_image(
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_USHORT) {
     device_vector<uint16_t> *tex_img = new device_vector<uint16_t>(
@@ -921,9 +1102,6 @@ void ImageManager::device_load_image(
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_USHORT4) {
     device_vector<ushort4> *tex_img = new device_vector<ushort4>(
@@ -943,9 +1121,6 @@ void ImageManager::device_load_image(
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   else if (type == IMAGE_DATA_TYPE_HALF) {
     device_vector<half> *tex_img = new device_vector<half>(
@@ -962,11 +1137,53 @@ void ImageManager::device_load_image(
     img->mem = tex_img;
     img->mem->interpolation = img->interpolation;
     img->mem->extension = img->extension;
-
-    thread_scoped_lock device_lock(device_mutex);
-    tex_img->copy_to_device();
   }
   img->need_load = false;
+  img->need_upload = true;
+}
+
+void ImageManager::device_upload_image(ImageDataType type, int slot)
+{
+  Image *img = images[type][slot];
+
+  thread_scoped_lock load_lock(img->load_mutex);
+  if (!img->need_upload)
+    return;
+
+  thread_scoped_lock device_lock(device_mutex);
+  if (img->grid_index) {
+    img->grid_index->copy_to_device();
+    img->mem->grid_index = img->grid_index->device_pointer;
+  }
+  switch (type) {
+    case IMAGE_DATA_TYPE_FLOAT4:
+      ((device_vector<float4> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_FLOAT:
+      ((device_vector<float> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_BYTE4:
+      ((device_vector<uchar4> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_BYTE:
+      ((device_vector<uchar> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_HALF4:
+      ((device_vector<half4> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_HALF:
+      ((device_vector<half> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_USHORT4:
+      ((device_vector<ushort4> *)img->mem)->copy_to_device();
+      break;
+    case IMAGE_DATA_TYPE_USHORT:
+      ((device_vector<uint16_t> *)img->mem)->copy_to_device();
+      break;
+    default:
+      break;
+  }
+  img->need_upload = false;
 }
 
 void ImageManager::device_free_image(Device *, ImageDataType type, int slot)
@@ -984,6 +1201,7 @@ void ImageManager::device_free_image(Device *, ImageDataType type, int slot)
     if (img->mem) {
       thread_scoped_lock device_lock(device_mutex);
       delete img->mem;
+      delete img->grid_index;
     }
 
     delete img;
@@ -993,21 +1211,52 @@ void ImageManager::device_free_image(Device *, ImageDataType type, int slot)
 }
 
 void ImageManager::device_update(Device *device, Scene *scene, Progress &progress)
+{
+  device_update_preprocess(device);
+  device_load_images(device, scene, progress);
+  device_upload_images(device);
+}
+
+void ImageManager::device_update_preprocess(Device *device)
 {
   if (!need_update) {
     return;
   }
 
-  TaskPool pool;
   for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
     for (size_t slot = 0; slot < images[type].size(); slot++) {
-      if (!images[type][slot])
+      Image *img = images[type][slot];
+      if (!img)
         continue;
 
-      if (images[type][slot]->users == 0) {
+      if (img->users == 0) {
         device_free_image(device, (ImageDataType)type, slot);
       }
-      else if (images[type][slot]->need_load) {
+      else if (img->need_load && img->mem) {
+        /* Free previous texture, so that loading doesn't need the device. */
+        thread_scoped_lock device_lock(device_mutex);
+        delete img->mem;
+        img->mem = NULL;
+        delete img->grid_index;
+        img->grid_index = NULL;
+      }
+    }
+  }
+}
+
+void ImageManager::device_load_images(Device *device, Scene *scene, Progress &progress)
+{
+  if (!need_update) {
+    return;
+  }
+
+  TaskPool pool;
+  for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+    for (size_t slot = 0; slot < images[type].size(); slot++) {
+      if (!images[type][slot])
+        continue;
+
+      if (images[type][slot]->need_load) {
         if (!osl_texture_system || images[type][slot]->builtin_data)
           pool.push(function_bind(&ImageManager::device_load_image,
                                   this,
@@ -1021,6 +1270,21 @@ void ImageManager::device_update(Device *device, Scene *scene, Progress &progres
   }
 
   pool.wait_work();
+}
+
+void ImageManager::device_upload_images(Device *)
+{
+  if (!need_update) {
+    return;
+  }
+
+  for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+    for (size_t slot = 0; slot < images[type].size(); slot++) {
+      if (images[type][slot]) {
+        device_upload_image((ImageDataType)type, slot);
+      }
+    }
+  }
 
   need_update = false;
 }
@@ -1039,9 +1303,9 @@ void ImageManager::device_update_slot(Device *device,
   if (image->users == 0) {
     device_free_image(device, type, slot);
   }
-  else if (image->need_load) {
-    if (!osl_texture_system || image->builtin_data)
-      device_load_image(device, scene, type, slot, progress);
+  else {
+    device_load_image(device, scene, type, slot, progress);
+    device_upload_image(type, slot);
   }
 }
 
@@ -1074,6 +1338,14 @@ void ImageManager::device_load_builtin(Device *device, Scene *scene, Progress &p
   }
 
   pool.wait_work();
+
+  for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+    for (size_t slot = 0; slot < images[type].size(); slot++) {
+      if (images[type][slot] && images[type][slot]->builtin_data) {
+        device_upload_image((ImageDataType)type, slot);
+      }
+    }
+  }
 }
 
 void ImageManager::device_free_builtin(Device *device)
@@ -1100,10 +1372,17 @@ void ImageManager::collect_statistics(RenderStats *stats)
 {
   for (int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
     foreach (const Image *image, images[type]) {
-      stats->image.textures.add_entry(
-          NamedSizeEntry(path_filename(image->filename), image->mem->memory_size()));
+      size_t mem_size = image->mem->memory_size();
+      if (image->grid_index) {
+        mem_size += image->grid_index->memory_size();
+      }
+      stats->image.textures.add_entry(NamedSizeEntry(path_filename(image->filename), mem_size));
     }
   }
+
+  if (texture_cache) {
+    stats->image.texture_cache = texture_cache->stats();
+  }
 }
 
 CCL_NAMESPACE_END
@@ -35,6 +35,7 @@ class Progress;
 class RenderStats;
 class Scene;
 class ColorSpaceProcessor;
+class TextureCache;
 
 class ImageMetaData {
  public:
@@ -107,6 +108,11 @@ class ImageManager {
   bool get_image_metadata(int flat_slot, ImageMetaData &metadata);
 
   void device_update(Device *device, Scene *scene, Progress &progress);
+  /* Device update in steps, where loading images doesn't access the device and
+   * can run in parallel with other scene updates. */
+  void device_update_preprocess(Device *device);
+  void device_load_images(Device *device, Scene *scene, Progress &progress);
+  void device_upload_images(Device *device);
   void device_update_slot(Device *device, Scene *scene, int flat_slot, Progress *progress);
   void device_free(Device *device);
 
@@ -116,7 +122,13 @@ class ImageManager {
   void set_osl_texture_system(void *texture_system);
   bool set_animation_frame_update(int frame);
 
+  /* Image files are loaded on demand through the texture cache, instead of
+   * fully into memory. */
+  bool use_texture_cache(Scene *scene) const;
+
   device_memory *image_memory(int flat_slot);
+  /* Tile index of sparse volume grids, NULL for dense images. */
+  const int *image_grid_index(int flat_slot);
 
   void collect_statistics(RenderStats *stats);
 
@@ -153,6 +165,7 @@ class ImageManager {
     ustring colorspace;
     ImageAlphaType alpha_type;
     bool need_load;
+    bool need_upload;
     bool animated;
     float frame;
     InterpolationType interpolation;
@@ -160,6 +173,8 @@ class ImageManager {
 
     string mem_name;
     device_memory *mem;
+    device_vector<int> *grid_index;
+    thread_mutex load_mutex;
 
     int users;
   };
@@ -168,6 +183,8 @@ class ImageManager {
   int tex_num_images[IMAGE_DATA_NUM_TYPES];
   int max_num_images;
   bool has_half_images;
+  bool has_texture_cache;
+  bool has_sparse_grids;
 
   thread_mutex device_mutex;
   int animation_frame;
@@ -175,6 +192,9 @@ class ImageManager {
   vector<Image *> images[IMAGE_DATA_NUM_TYPES];
   void *osl_texture_system;
 
+  TextureCache *texture_cache;
+  thread_mutex texture_cache_mutex;
+
   bool file_load_image_generic(Image *img, unique_ptr<ImageInput> *in);
 
   template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
@@ -183,10 +203,22 @@ class ImageManager {
                        int texture_limit,
                        device_vector<DeviceType> &tex_img);
 
+  string texture_cache_filename(Image *img, ImageDataType type, int texture_limit);
+
+  template<TypeDesc::BASETYPE FileFormat, typename StorageType, typename DeviceType>
+  bool texture_cache_load_image(
+      Device *device, Scene *scene, Image *img, ImageDataType type, int texture_limit);
+
+  template<typename DeviceType>
+  device_vector<DeviceType> *sparse_grid_load_image(Device *device,
+                                                    Image *img,
+                                                    device_vector<DeviceType> *tex_img);
+
   void metadata_detect_colorspace(ImageMetaData &metadata, const char *file_format);
 
   void device_load_image(
       Device *device, Scene *scene, ImageDataType type, int slot, Progress *progress);
+  void device_upload_image(ImageDataType type, int slot);
   void device_free_image(Device *device, ImageDataType type, int slot);
 };
 
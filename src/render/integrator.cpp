@@ -18,10 +18,12 @@
 #include "render/background.h"
 #include "render/integrator.h"
 #include "render/film.h"
+#include "render/jitter.h"
 #include "render/light.h"
 #include "render/scene.h"
 #include "render/shader.h"
 #include "render/sobol.h"
+#include "render/tables.h"
 
 #include "util/util_foreach.h"
 #include "util/util_hash.h"
@@ -69,6 +71,10 @@ NODE_DEFINE(Integrator)
   SOCKET_BOOLEAN(sample_all_lights_direct, "Sample All Lights Direct", true);
   SOCKET_BOOLEAN(sample_all_lights_indirect, "Sample All Lights Indirect", true);
   SOCKET_FLOAT(light_sampling_threshold, "Light Sampling Threshold", 0.05f);
+  SOCKET_BOOLEAN(use_light_tree, "Use Light Tree", false);
+
+  SOCKET_INT(adaptive_min_samples, "Adaptive Min Samples", 0);
+  SOCKET_FLOAT(adaptive_threshold, "Adaptive Threshold", 0.0f);
 
   static NodeEnum method_enum;
   method_enum.insert("path", PATH);
@@ -78,26 +84,49 @@ NODE_DEFINE(Integrator)
   static NodeEnum sampling_pattern_enum;
   sampling_pattern_enum.insert("sobol", SAMPLING_PATTERN_SOBOL);
   sampling_pattern_enum.insert("cmj", SAMPLING_PATTERN_CMJ);
+  sampling_pattern_enum.insert("pmj", SAMPLING_PATTERN_PMJ);
   SOCKET_ENUM(sampling_pattern, "Sampling Pattern", sampling_pattern_enum, SAMPLING_PATTERN_SOBOL);
 
   return type;
 }
 
+thread_mutex Integrator::pmj_table_mutex;
+vector<float> Integrator::pmj_table;
+
 Integrator::Integrator() : Node(node_type)
 {
   need_update = true;
+  pmj_table_offset = TABLE_OFFSET_INVALID;
 }
 
 Integrator::~Integrator()
 {
 }
 
+/* Sequences are stored as floats in the [1, 2) range, so the kernel can scramble
+ * the mantissa bits directly. */
+static void pmj_table_build(vector<float> &table)
+{
+  vector<float2> points(NUM_PMJ_SAMPLES);
+  table.resize(NUM_PMJ_PATTERNS * NUM_PMJ_SAMPLES * 2);
+
+  for (int pattern = 0; pattern < NUM_PMJ_PATTERNS; pattern++) {
+    progressive_multi_jitter_02_generate_2D(&points[0], NUM_PMJ_SAMPLES, pattern);
+
+    float *data = &table[pattern * NUM_PMJ_SAMPLES * 2];
+    for (int i = 0; i < NUM_PMJ_SAMPLES; i++) {
+      data[i * 2 + 0] = 1.0f + points[i].x;
+      data[i * 2 + 1] = 1.0f + points[i].y;
+    }
+  }
+}
+
 void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 {
   if (!need_update)
     return;
 
-  device_free(device, dscene);
+  device_free(device, dscene, scene);
 
   KernelIntegrator *kintegrator = &dscene->data.integrator;
 
@@ -175,6 +204,24 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
   kintegrator->sampling_pattern = sampling_pattern;
   kintegrator->aa_samples = aa_samples;
 
+  /* Zero means automatic, derived from the number of AA samples. */
+  if (aa_samples > 0 && adaptive_threshold == 0.0f) {
+    kintegrator->adaptive_threshold = max(0.001f, 1.0f / (float)aa_samples);
+  }
+  else {
+    kintegrator->adaptive_threshold = adaptive_threshold;
+  }
+
+  if (aa_samples > 0 && adaptive_min_samples == 0) {
+    kintegrator->adaptive_min_samples = max(4, (int)sqrtf(aa_samples));
+  }
+  else {
+    kintegrator->adaptive_min_samples = adaptive_min_samples;
+  }
+
+  /* Filtering relies on an even number of samples, see kernel_adaptive_sampling.h. */
+  kintegrator->adaptive_step = 4;
+
   if (light_sampling_threshold > 0.0f) {
     kintegrator->light_inv_rr_threshold = 1.0f / light_sampling_threshold;
   }
@@ -209,12 +256,31 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 
   dscene->sobol_directions.copy_to_device();
 
+  /* progressive multi-jitter table */
+  if (sampling_pattern == SAMPLING_PATTERN_PMJ) {
+    /* Scenes can be updated in parallel, the lock costs nothing next to
+     * uploading the table. */
+    thread_scoped_lock lock(pmj_table_mutex);
+    if (pmj_table.empty()) {
+      pmj_table_build(pmj_table);
+    }
+    pmj_table_offset = scene->lookup_tables->add_table(dscene, pmj_table);
+  }
+  dscene->data.tables.pmj_offset = (int)pmj_table_offset;
+
   need_update = false;
 }
 
-void Integrator::device_free(Device *, DeviceScene *dscene)
+void Integrator::device_free(Device *, DeviceScene *dscene, Scene *scene)
 {
   dscene->sobol_directions.free();
+  scene->lookup_tables->remove_table(&pmj_table_offset);
+}
+
+void Integrator::free_memory()
+{
+  thread_scoped_lock lock(pmj_table_mutex);
+  pmj_table.free_memory();
 }
 
 bool Integrator::modified(const Integrator &integrator)
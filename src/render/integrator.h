@@ -21,6 +21,9 @@
 
 #include "graph/node.h"
 
+#include "util/util_thread.h"
+#include "util/util_vector.h"
+
 CCL_NAMESPACE_BEGIN
 
 class Device;
@@ -74,6 +77,10 @@ class Integrator : public Node {
   bool sample_all_lights_direct;
   bool sample_all_lights_indirect;
   float light_sampling_threshold;
+  bool use_light_tree;
+
+  int adaptive_min_samples;
+  float adaptive_threshold;
 
   enum Method {
     BRANCHED_PATH = 0,
@@ -92,10 +99,20 @@ class Integrator : public Node {
   ~Integrator();
 
   void device_update(Device *device, DeviceScene *dscene, Scene *scene);
-  void device_free(Device *device, DeviceScene *dscene);
+  void device_free(Device *device, DeviceScene *dscene, Scene *scene);
 
   bool modified(const Integrator &integrator);
   void tag_update(Scene *scene);
+
+  static void free_memory();
+
+ protected:
+  /* Progressive multi-jitter sequences are the same for every scene, so they are
+   * generated once and shared. */
+  static thread_mutex pmj_table_mutex;
+  static vector<float> pmj_table;
+
+  size_t pmj_table_offset;
 };
 
 CCL_NAMESPACE_END
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/jitter.h"
+
+#include "util/util_math.h"
+#include "util/util_hash.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* The sequence is built in fixed point, so checking which strata a point falls
+ * into is exact and the points survive the conversion to float unchanged. */
+
+class PMJ02_Generator {
+ public:
+  PMJ02_Generator(uint rng_seed) : seed(rng_seed), rng_index(0), log_num_points(0)
+  {
+  }
+
+  void generate(float2 points[], int size)
+  {
+    xs.clear();
+    ys.clear();
+    xs.reserve(size);
+    ys.reserve(size);
+
+    xs.push_back(random_bits(PMJ_BITS));
+    ys.push_back(random_bits(PMJ_BITS));
+
+    /* Each iteration quadruples the number of points, going from N = n * n points
+     * with one point in each cell of an n * n grid to 4N points. */
+    for (int N = 1, log_n = 0; N < size; N *= 4, log_n++) {
+      extend_sequence_even(N, log_n);
+      extend_sequence_odd(2 * N, log_n);
+    }
+
+    const float scale = 1.0f / (float)(1 << PMJ_BITS);
+    for (int i = 0; i < size; i++) {
+      points[i] = make_float2(xs[i] * scale, ys[i] * scale);
+    }
+  }
+
+ protected:
+  uint random_bits(int num_bits)
+  {
+    const uint r = hash_uint2(seed, rng_index++);
+    return (num_bits == 0) ? 0 : r >> (32 - num_bits);
+  }
+
+  int random_index(int size)
+  {
+    return (int)(hash_uint2(seed, rng_index++) % (uint)size);
+  }
+
+  /* Index of the elementary interval with 2^k columns and 2^(m - k) rows containing
+   * the point, where 2^m is the number of points the strata are marked for. */
+  int stratum(uint x, uint y, int k) const
+  {
+    return ((x >> (PMJ_BITS - k)) << (log_num_points - k)) |
+           (y >> (PMJ_BITS - (log_num_points - k)));
+  }
+
+  void mark_occupied_strata(int num_points)
+  {
+    log_num_points = 0;
+    while ((1 << log_num_points) < num_points) {
+      log_num_points++;
+    }
+
+    occupied.resize(log_num_points + 1);
+    for (int k = 0; k <= log_num_points; k++) {
+      occupied[k].clear();
+      occupied[k].resize(num_points, false);
+    }
+
+    for (size_t i = 0; i < xs.size(); i++) {
+      mark_occupied(xs[i], ys[i]);
+    }
+  }
+
+  void mark_occupied(uint x, uint y)
+  {
+    for (int k = 0; k <= log_num_points; k++) {
+      occupied[k][stratum(x, y, k)] = true;
+    }
+  }
+
+  bool is_occupied(uint x, uint y) const
+  {
+    for (int k = 0; k <= log_num_points; k++) {
+      if (occupied[k][stratum(x, y, k)]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* Add a point in the given subquadrant of cell (i, j) of the n * n grid, in a
+   * position where it doesn't share any elementary interval with existing points. */
+  void generate_sample_point(int i, int j, int xhalf, int yhalf, int log_n)
+  {
+    const int sub_shift = PMJ_BITS - (log_n + 1);
+    const uint x_min = (uint)(2 * i + xhalf) << sub_shift;
+    const uint y_min = (uint)(2 * j + yhalf) << sub_shift;
+    const uint sub_size = 1u << sub_shift;
+
+    /* Only the finest one dimensional strata that are still free are candidates. */
+    const int stratum_shift = PMJ_BITS - log_num_points;
+    free_x.clear();
+    free_y.clear();
+    for (uint s = x_min >> stratum_shift; s < (x_min + sub_size) >> stratum_shift; s++) {
+      if (!occupied[log_num_points][s]) {
+        free_x.push_back(s);
+      }
+    }
+    for (uint s = y_min >> stratum_shift; s < (y_min + sub_size) >> stratum_shift; s++) {
+      if (!occupied[0][s]) {
+        free_y.push_back(s);
+      }
+    }
+
+    /* Pick a random free column, and a random row in it that is valid for all the
+     * two dimensional strata. Columns without any valid row are discarded. */
+    while (!free_x.empty()) {
+      const int ix = random_index(free_x.size());
+      const uint x = (free_x[ix] << stratum_shift) | random_bits(stratum_shift);
+
+      valid_y.clear();
+      for (size_t iy = 0; iy < free_y.size(); iy++) {
+        if (!is_occupied(x, free_y[iy] << stratum_shift)) {
+          valid_y.push_back(free_y[iy]);
+        }
+      }
+
+      if (!valid_y.empty()) {
+        const uint y = (valid_y[random_index(valid_y.size())] << stratum_shift) |
+                       random_bits(stratum_shift);
+        mark_occupied(x, y);
+        xs.push_back(x);
+        ys.push_back(y);
+        return;
+      }
+
+      free_x[ix] = free_x.back();
+      free_x.pop_back();
+    }
+
+    /* Never happens in practice, keep the sequence complete regardless. */
+    assert(!"No valid position for progressive multi-jittered sample");
+    xs.push_back(x_min | random_bits(sub_shift));
+    ys.push_back(y_min | random_bits(sub_shift));
+  }
+
+  /* From N = n * n to 2N points, placing each new point in the subquadrant
+   * diagonally opposite to the existing point in its cell. */
+  void extend_sequence_even(int N, int log_n)
+  {
+    mark_occupied_strata(2 * N);
+
+    for (int s = 0; s < N; s++) {
+      int i, j, xhalf, yhalf;
+      cell_and_subquadrant(s, log_n, &i, &j, &xhalf, &yhalf);
+      generate_sample_point(i, j, 1 - xhalf, 1 - yhalf, log_n);
+    }
+  }
+
+  /* From N = 2 * n * n to 2N points, filling the two empty subquadrants of each
+   * cell of the n * n grid, in random order. */
+  void extend_sequence_odd(int N, int log_n)
+  {
+    mark_occupied_strata(2 * N);
+
+    const int half_N = N / 2;
+    xhalves.resize(half_N);
+    yhalves.resize(half_N);
+
+    for (int s = 0; s < half_N; s++) {
+      int i, j, xhalf, yhalf;
+      cell_and_subquadrant(s, log_n, &i, &j, &xhalf, &yhalf);
+
+      if (random_bits(1)) {
+        xhalf = 1 - xhalf;
+      }
+      else {
+        yhalf = 1 - yhalf;
+      }
+      xhalves[s] = xhalf;
+      yhalves[s] = yhalf;
+
+      generate_sample_point(i, j, xhalf, yhalf, log_n);
+    }
+
+    for (int s = 0; s < half_N; s++) {
+      int i, j, xhalf, yhalf;
+      cell_and_subquadrant(s, log_n, &i, &j, &xhalf, &yhalf);
+      generate_sample_point(i, j, 1 - xhalves[s], 1 - yhalves[s], log_n);
+    }
+  }
+
+  void cell_and_subquadrant(int s, int log_n, int *i, int *j, int *xhalf, int *yhalf) const
+  {
+    *i = xs[s] >> (PMJ_BITS - log_n);
+    *j = ys[s] >> (PMJ_BITS - log_n);
+    *xhalf = (xs[s] >> (PMJ_BITS - log_n - 1)) & 1;
+    *yhalf = (ys[s] >> (PMJ_BITS - log_n - 1)) & 1;
+  }
+
+  uint seed;
+  uint rng_index;
+
+  vector<uint> xs, ys;
+
+  int log_num_points;
+  vector<vector<bool>> occupied;
+
+  vector<uint> free_x, free_y, valid_y;
+  vector<int> xhalves, yhalves;
+};
+
+void progressive_multi_jitter_02_generate_2D(float2 points[], int size, uint rng_seed)
+{
+  PMJ02_Generator generator(rng_seed);
+  generator.generate(points, size);
+}
+
+CCL_NAMESPACE_END
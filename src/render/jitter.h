@@ -0,0 +1,38 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __JITTER_H__
+#define __JITTER_H__
+
+#include "util/util_types.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Number of fractional bits of the generated points, so that they are exactly
+ * representable as the mantissa of a float in the [1, 2) range. */
+#define PMJ_BITS 23
+
+/* Generate a progressive multi-jittered (0,2) sequence, following "Progressive
+ * Multi-Jittered Sample Sequences" by Christensen, Kensler and Kilpatrick.
+ *
+ * Every prefix of the sequence with a power of two length is stratified over all
+ * elementary intervals of that many points. The size must be a power of four and
+ * points are in the [0, 1) range with PMJ_BITS bits of precision. */
+void progressive_multi_jitter_02_generate_2D(float2 points[], int size, uint rng_seed);
+
+CCL_NAMESPACE_END
+
+#endif /* __JITTER_H__ */
@@ -20,6 +20,7 @@
 #include "render/film.h"
 #include "render/graph.h"
 #include "render/light.h"
+#include "render/light_tree.h"
 #include "render/mesh.h"
 #include "render/nodes.h"
 #include "render/object.h"
@@ -310,6 +311,13 @@ void LightManager::device_update_distribution(Device *,
   KernelLightDistribution *distribution = dscene->light_distribution.alloc(num_distribution + 1);
   float totarea = 0.0f;
 
+  /* light tree */
+  const bool use_light_tree = scene->integrator->use_light_tree && num_triangles > 0;
+  vector<LightTreePrimitive> light_tree_prims;
+  if (use_light_tree) {
+    light_tree_prims.reserve(num_triangles);
+  }
+
   /* triangles */
   size_t offset = 0;
   int j = 0;
@@ -346,6 +354,19 @@ void LightManager::device_update_distribution(Device *,
       use_light_visibility = true;
     }
 
+    /* Estimated emission strength per shader, for the light tree. Shaders with
+     * non-constant emission are assumed to emit one unit per area. */
+    vector<float> shader_strength;
+    if (use_light_tree) {
+      shader_strength.resize(mesh->used_shaders.size(), 1.0f);
+      for (size_t i = 0; i < mesh->used_shaders.size(); i++) {
+        float3 emission;
+        if (mesh->used_shaders[i]->is_constant_emission(&emission)) {
+          shader_strength[i] = average(fabs(emission));
+        }
+      }
+    }
+
     size_t mesh_num_triangles = mesh->num_triangles();
     for (size_t i = 0; i < mesh_num_triangles; i++) {
       int shader_index = mesh->shader[i];
@@ -358,6 +379,18 @@ void LightManager::device_update_distribution(Device *,
         distribution[offset].prim = i + mesh->tri_offset;
         distribution[offset].mesh_light.shader_flag = shader_flag;
         distribution[offset].mesh_light.object_id = object_id;
+
+        LightTreePrimitive *tree_prim = NULL;
+        if (use_light_tree) {
+          light_tree_prims.push_back(LightTreePrimitive());
+          tree_prim = &light_tree_prims.back();
+          /* Degenerate triangles don't emit, but still need a place in the tree. */
+          tree_prim->bounds = BoundBox(transform_get_column(&tfm, 3));
+          tree_prim->energy = 0.0f;
+          tree_prim->area = 0.0f;
+          tree_prim->index = offset;
+        }
+
         offset++;
 
         Mesh::Triangle t = mesh->get_triangle(i);
@@ -374,13 +407,30 @@ void LightManager::device_update_distribution(Device *,
           p3 = transform_point(&tfm, p3);
         }
 
-        totarea += triangle_area(p1, p2, p3);
+        const float area = triangle_area(p1, p2, p3);
+        totarea += area;
+
+        if (tree_prim) {
+          const float strength = (shader_index < mesh->used_shaders.size()) ?
+                                     shader_strength[shader_index] :
+                                     1.0f;
+          tree_prim->bounds = BoundBox(p1);
+          tree_prim->bounds.grow(p2);
+          tree_prim->bounds.grow(p3);
+          tree_prim->cone = LightTreeCone(safe_normalize(cross(p2 - p1, p3 - p1)), 0.0f);
+          tree_prim->energy = area * strength;
+          tree_prim->area = area;
+        }
       }
     }
 
     j++;
   }
 
+  if (use_light_tree) {
+    totarea = device_update_light_tree(dscene, scene, distribution, light_tree_prims);
+  }
+
   float trianglearea = totarea;
 
   /* point lights */
@@ -435,6 +485,8 @@ void LightManager::device_update_distribution(Device *,
   KernelIntegrator *kintegrator = &dscene->data.integrator;
   KernelFilm *kfilm = &dscene->data.film;
   kintegrator->use_direct_light = (totarea > 0.0f);
+  kintegrator->use_light_tree = use_light_tree && kintegrator->use_direct_light &&
+                                trianglearea > 0.0f;
 
   if (kintegrator->use_direct_light) {
     /* number of emissives */
@@ -474,6 +526,15 @@ void LightManager::device_update_distribution(Device *,
     /* CDF */
     dscene->light_distribution.copy_to_device();
 
+    if (kintegrator->use_light_tree) {
+      dscene->light_tree_nodes.copy_to_device();
+      dscene->light_tree_prim_map.copy_to_device();
+    }
+    else {
+      dscene->light_tree_nodes.free();
+      dscene->light_tree_prim_map.free();
+    }
+
     /* Portals */
     if (num_portals > 0) {
       kintegrator->portal_offset = light_index;
@@ -488,6 +549,8 @@ void LightManager::device_update_distribution(Device *,
   }
   else {
     dscene->light_distribution.free();
+    dscene->light_tree_nodes.free();
+    dscene->light_tree_prim_map.free();
 
     kintegrator->num_distribution = 0;
     kintegrator->num_all_lights = 0;
@@ -502,6 +565,63 @@ void LightManager::device_update_distribution(Device *,
   }
 }
 
+/* Builds the light tree over the mesh lights at the start of the distribution and reorders
+ * them to match the tree. Returns the total area of the reordered mesh lights. */
+float LightManager::device_update_light_tree(DeviceScene *dscene,
+                                             Scene *scene,
+                                             KernelLightDistribution *distribution,
+                                             vector<LightTreePrimitive> &prims)
+{
+  const size_t num_triangles = prims.size();
+  vector<KernelLightDistribution> triangles(distribution, distribution + num_triangles);
+
+  LightTree tree(prims);
+
+  float totarea = 0.0f;
+  for (size_t i = 0; i < num_triangles; i++) {
+    distribution[i] = triangles[prims[i].index];
+    distribution[i].totarea = totarea;
+    totarea += prims[i].area;
+  }
+
+  const vector<KernelLightTreeNode> &nodes = tree.get_nodes();
+  KernelLightTreeNode *knodes = dscene->light_tree_nodes.alloc(nodes.size());
+  std::copy(nodes.begin(), nodes.end(), knodes);
+
+  VLOG(1) << "Total " << nodes.size() << " light tree nodes.";
+
+  /* Map from object and triangle to the mesh light in the distribution, needed to evaluate
+   * the light tree PDF for multiple importance sampling. Every object has a pair of offset
+   * into the map (or -1) and its first triangle index, followed by per triangle entries. */
+  const size_t num_objects = scene->objects.size();
+  vector<int> object_offset(num_objects, -1);
+  size_t map_size = 2 * num_objects;
+
+  for (size_t i = 0; i < num_triangles; i++) {
+    const int object_id = distribution[i].mesh_light.object_id;
+    if (object_offset[object_id] == -1) {
+      object_offset[object_id] = map_size;
+      map_size += scene->objects[object_id]->mesh->num_triangles();
+    }
+  }
+
+  int *prim_map = dscene->light_tree_prim_map.alloc(map_size);
+  std::fill(prim_map, prim_map + map_size, -1);
+
+  for (size_t object_id = 0; object_id < num_objects; object_id++) {
+    prim_map[object_id * 2] = object_offset[object_id];
+    prim_map[object_id * 2 + 1] = scene->objects[object_id]->mesh->tri_offset;
+  }
+
+  for (size_t i = 0; i < num_triangles; i++) {
+    const int object_id = distribution[i].mesh_light.object_id;
+    const int tri_offset = prim_map[object_id * 2 + 1];
+    prim_map[object_offset[object_id] + distribution[i].prim - tri_offset] = i;
+  }
+
+  return totarea;
+}
+
 static void background_cdf(
     int start, int end, int res_x, int res_y, const vector<float3> *pixels, float2 *cond_cdf)
 {
@@ -934,6 +1054,8 @@ void LightManager::device_update(Device *device,
 void LightManager::device_free(Device *, DeviceScene *dscene)
 {
   dscene->light_distribution.free();
+  dscene->light_tree_nodes.free();
+  dscene->light_tree_prim_map.free();
   dscene->lights.free();
   dscene->light_background_marginal_cdf.free();
   dscene->light_background_conditional_cdf.free();
@@ -30,6 +30,7 @@ CCL_NAMESPACE_BEGIN
 
 class Device;
 class DeviceScene;
+struct LightTreePrimitive;
 class Object;
 class Progress;
 class Scene;
@@ -116,6 +117,10 @@ class LightManager {
                                   DeviceScene *dscene,
                                   Scene *scene,
                                   Progress &progress);
+  float device_update_light_tree(DeviceScene *dscene,
+                                 Scene *scene,
+                                 KernelLightDistribution *distribution,
+                                 vector<LightTreePrimitive> &prims);
   void device_update_background(Device *device,
                                 DeviceScene *dscene,
                                 Scene *scene,
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/light_tree.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Number of buckets used to find the split with the lowest cost along each axis. */
+static const int LIGHT_TREE_NUM_BUCKETS = 12;
+
+LightTreeCone merge(const LightTreeCone &a, const LightTreeCone &b)
+{
+  /* Normals are two-sided, so flip b to the same hemisphere as a. */
+  const float3 b_axis = (dot(a.axis, b.axis) < 0.0f) ? -b.axis : b.axis;
+  const float theta_d = safe_acosf(dot(a.axis, b_axis));
+
+  if (min(theta_d + b.theta_o, M_PI_2_F) <= a.theta_o) {
+    return a;
+  }
+  if (min(theta_d + a.theta_o, M_PI_2_F) <= b.theta_o) {
+    return LightTreeCone(b_axis, b.theta_o);
+  }
+
+  const float theta_o = 0.5f * (a.theta_o + theta_d + b.theta_o);
+  if (theta_o >= M_PI_2_F) {
+    return LightTreeCone(a.axis, M_PI_2_F);
+  }
+
+  /* Rotate the axis of a towards b, so the new cone just covers both. */
+  const float theta_r = theta_o - a.theta_o;
+  const float3 axis = normalize(a.axis * sinf(theta_d - theta_r) + b_axis * sinf(theta_r));
+  return LightTreeCone(axis, theta_o);
+}
+
+/* Measure of the solid angle the emitters bounded by the cone can emit into, with an
+ * emission spread of half pi as for area lights. */
+static float light_tree_orientation_measure(const LightTreeCone &cone)
+{
+  const float theta_o = cone.theta_o;
+  const float theta_w = min(theta_o + M_PI_2_F, M_PI_F);
+  const float sin_theta_o = sinf(theta_o);
+  const float cos_theta_o = cosf(theta_o);
+
+  return M_2PI_F * (1.0f - cos_theta_o) +
+         M_PI_2_F * (2.0f * theta_w * sin_theta_o - cosf(theta_o - 2.0f * theta_w) -
+                     2.0f * theta_o * sin_theta_o + cos_theta_o);
+}
+
+LightTree::LightTree(vector<LightTreePrimitive> &prims_) : prims(prims_)
+{
+  if (prims.empty()) {
+    return;
+  }
+
+  nodes.reserve(2 * prims.size() - 1);
+  recursive_build(0, prims.size());
+}
+
+int LightTree::recursive_build(int start, int end)
+{
+  BoundBox bounds = BoundBox::empty;
+  BoundBox centroid_bounds = BoundBox::empty;
+  LightTreeCone cone = prims[start].cone;
+  float energy = 0.0f;
+  float area = 0.0f;
+
+  for (int i = start; i < end; i++) {
+    const LightTreePrimitive &prim = prims[i];
+    bounds.grow(prim.bounds);
+    centroid_bounds.grow(prim.centroid());
+    if (i != start) {
+      cone = merge(cone, prim.cone);
+    }
+    energy += prim.energy;
+    area += prim.area;
+  }
+
+  const int index = nodes.size();
+  nodes.push_back(KernelLightTreeNode());
+
+  KernelLightTreeNode &knode = nodes[index];
+  knode.bounds_min[0] = bounds.min.x;
+  knode.bounds_min[1] = bounds.min.y;
+  knode.bounds_min[2] = bounds.min.z;
+  knode.energy = energy;
+  knode.bounds_max[0] = bounds.max.x;
+  knode.bounds_max[1] = bounds.max.y;
+  knode.bounds_max[2] = bounds.max.z;
+  knode.theta_o = cone.theta_o;
+  knode.axis[0] = cone.axis.x;
+  knode.axis[1] = cone.axis.y;
+  knode.axis[2] = cone.axis.z;
+  knode.second_child = -1;
+  knode.first_emitter = start;
+  knode.num_emitters = end - start;
+  knode.area = area;
+  knode.pad = 0;
+
+  if (end - start == 1) {
+    return index;
+  }
+
+  const int middle = split(start, end, centroid_bounds);
+
+  /* The first child directly follows its parent. */
+  recursive_build(start, middle);
+  const int second_child = recursive_build(middle, end);
+
+  nodes[index].second_child = second_child;
+
+  return index;
+}
+
+int LightTree::split(int start, int end, const BoundBox &centroid_bounds)
+{
+  const float3 extent = centroid_bounds.size();
+  const float max_extent = max3(extent);
+
+  if (max_extent == 0.0f) {
+    /* All emitters are at the same position, nothing to gain from a smart split. */
+    return (start + end) / 2;
+  }
+
+  struct Bucket {
+    BoundBox bounds;
+    LightTreeCone cone;
+    float energy;
+    int count;
+
+    Bucket() : bounds(BoundBox::empty), energy(0.0f), count(0)
+    {
+    }
+
+    void add(const BoundBox &other_bounds, const LightTreeCone &other_cone, float other_energy)
+    {
+      bounds.grow(other_bounds);
+      cone = (count == 0) ? other_cone : merge(cone, other_cone);
+      energy += other_energy;
+      count++;
+    }
+
+    float cost() const
+    {
+      return energy * bounds.safe_area() * light_tree_orientation_measure(cone);
+    }
+  };
+
+  /* Find the split with the lowest surface area orientation heuristic cost. */
+  float best_cost = FLT_MAX;
+  int best_axis = -1;
+  int best_bucket = -1;
+
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] == 0.0f) {
+      continue;
+    }
+
+    const float inv_extent = 1.0f / extent[axis];
+    Bucket buckets[LIGHT_TREE_NUM_BUCKETS];
+
+    for (int i = start; i < end; i++) {
+      const LightTreePrimitive &prim = prims[i];
+      const float offset = (prim.centroid()[axis] - centroid_bounds.min[axis]) * inv_extent;
+      const int b = min((int)(offset * LIGHT_TREE_NUM_BUCKETS), LIGHT_TREE_NUM_BUCKETS - 1);
+      buckets[b].add(prim.bounds, prim.cone, prim.energy);
+    }
+
+    /* Regularize towards splitting along the longest axis, for cube shaped nodes. */
+    const float regularization = max_extent * inv_extent;
+
+    for (int split_bucket = 1; split_bucket < LIGHT_TREE_NUM_BUCKETS; split_bucket++) {
+      Bucket left, right;
+      for (int b = 0; b < split_bucket; b++) {
+        if (buckets[b].count) {
+          left.add(buckets[b].bounds, buckets[b].cone, buckets[b].energy);
+        }
+      }
+      for (int b = split_bucket; b < LIGHT_TREE_NUM_BUCKETS; b++) {
+        if (buckets[b].count) {
+          right.add(buckets[b].bounds, buckets[b].cone, buckets[b].energy);
+        }
+      }
+
+      if (left.count == 0 || right.count == 0) {
+        continue;
+      }
+
+      const float cost = (left.cost() + right.cost()) * regularization;
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bucket = split_bucket;
+      }
+    }
+  }
+
+  const int middle_fallback = (start + end) / 2;
+
+  if (best_axis == -1) {
+    return middle_fallback;
+  }
+
+  const float centroid_min = centroid_bounds.min[best_axis];
+  const float inv_extent = 1.0f / extent[best_axis];
+  const int axis = best_axis;
+  const int split_bucket = best_bucket;
+
+  vector<LightTreePrimitive>::iterator middle = std::partition(
+      prims.begin() + start,
+      prims.begin() + end,
+      [centroid_min, inv_extent, axis, split_bucket](const LightTreePrimitive &prim) {
+        const float offset = (prim.centroid()[axis] - centroid_min) * inv_extent;
+        const int b = std::min((int)(offset * LIGHT_TREE_NUM_BUCKETS),
+                               LIGHT_TREE_NUM_BUCKETS - 1);
+        return b < split_bucket;
+      });
+
+  const int middle_index = middle - prims.begin();
+  if (middle_index == start || middle_index == end) {
+    return middle_fallback;
+  }
+
+  return middle_index;
+}
+
+CCL_NAMESPACE_END
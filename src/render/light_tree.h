@@ -0,0 +1,96 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "kernel/kernel_types.h"
+
+#include "util/util_boundbox.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Cone bounding a set of two-sided emitter normals, so only the line along the
+ * axis matters and the spread never exceeds half pi. */
+
+struct LightTreeCone {
+  float3 axis;
+  float theta_o;
+
+  LightTreeCone() : axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(0.0f)
+  {
+  }
+
+  LightTreeCone(const float3 &axis, float theta_o) : axis(axis), theta_o(theta_o)
+  {
+  }
+};
+
+LightTreeCone merge(const LightTreeCone &a, const LightTreeCone &b);
+
+/* Emitter as seen by the tree builder. */
+
+struct LightTreePrimitive {
+  BoundBox bounds;
+  LightTreeCone cone;
+  float energy;
+  float area;
+  /* Index of the emitter in the light distribution. */
+  int index;
+
+  float3 centroid() const
+  {
+    return bounds.center();
+  }
+};
+
+/* Light Tree
+ *
+ * Bounding volume hierarchy over emissive triangles with the total energy and an
+ * orientation cone per node, following "Importance Sampling of Many Lights with
+ * Adaptive Tree Splitting" by Estevez and Kulla. The kernel traverses it to pick
+ * mesh lights proportional to their estimated contribution to a shading point.
+ *
+ * Building reorders the primitives so that every node covers a contiguous range,
+ * the light distribution is expected to be laid out in the same order. */
+
+class LightTree {
+ public:
+  explicit LightTree(vector<LightTreePrimitive> &prims);
+
+  const vector<LightTreePrimitive> &get_primitives() const
+  {
+    return prims;
+  }
+
+  const vector<KernelLightTreeNode> &get_nodes() const
+  {
+    return nodes;
+  }
+
+ protected:
+  int recursive_build(int start, int end);
+  int split(int start, int end, const BoundBox &centroid_bounds);
+
+  vector<LightTreePrimitive> &prims;
+  vector<KernelLightTreeNode> nodes;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
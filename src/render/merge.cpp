@@ -16,9 +16,12 @@
 
 #include "render/merge.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_array.h"
 #include "util/util_map.h"
+#include "util/util_math.h"
 #include "util/util_system.h"
+#include "util/util_task.h"
 #include "util/util_time.h"
 #include "util/util_unique_ptr.h"
 
@@ -60,6 +63,19 @@ struct MergeImageLayer {
   int samples;
 };
 
+/* Consecutive channels that are merged with the same operation into
+ * consecutive channels of the merged image. */
+struct MergeChannelRun {
+  /* Copy or weighted sum. */
+  MergeChannelOp op;
+  /* Offset of first channel in input image. */
+  int offset;
+  /* Offset of first channel in merged image. */
+  int merge_offset;
+  /* Number of channels. */
+  int num_channels;
+};
+
 /* Merge Image */
 
 struct MergeImage {
@@ -69,6 +85,15 @@ struct MergeImage {
   string filepath;
   /* Render layers. */
   vector<MergeImageLayer> layers;
+
+  /* Channel runs to merge, built from the layer passes. */
+  vector<MergeChannelRun> runs;
+  /* Weight of every input channel in summed runs. */
+  vector<float> weights;
+  /* Pixels of the band of scanlines being merged. */
+  array<float> pixels;
+  /* Set when reading the band of scanlines failed. */
+  bool read_error;
 };
 
 /* Channel Parsing */
@@ -349,108 +374,261 @@ static void merge_channels_metadata(vector<MergeImage> &images,
   }
 }
 
-static void alloc_pixels(const ImageSpec &spec, array<float> &pixels)
+/* Number of pixels merged by each task. */
+static const size_t MERGE_TASK_PIXELS = 16 * 1024;
+
+static void merge_channel_runs(vector<MergeImage> &images,
+                               const vector<int> &channel_total_samples)
+{
+  for (MergeImage &image : images) {
+    const int num_channels = image.in->spec().nchannels;
+
+    /* Operation and weight per input channel. */
+    vector<MergeChannelOp> ops(num_channels, MERGE_CHANNEL_NOP);
+    vector<int> merge_offsets(num_channels, 0);
+    image.weights.resize(num_channels);
+    std::fill(image.weights.begin(), image.weights.end(), 0.0f);
+
+    for (const MergeImageLayer &layer : image.layers) {
+      for (const MergeImagePass &pass : layer.passes) {
+        ops[pass.offset] = pass.op;
+        merge_offsets[pass.offset] = pass.merge_offset;
+
+        if (pass.op == MERGE_CHANNEL_SUM) {
+          image.weights[pass.offset] = 1.0f;
+        }
+        else if (pass.op == MERGE_CHANNEL_AVERAGE) {
+          /* Weights based on sample metadata. Per channel since not
+           * all files are guaranteed to have the same channels. */
+          const int total_samples = channel_total_samples[pass.merge_offset];
+          image.weights[pass.offset] = (float)layer.samples / (float)total_samples;
+        }
+      }
+    }
+
+    /* Group channels into runs, summing and averaging are the same weighted sum. */
+    image.runs.clear();
+    for (int i = 0; i < num_channels; i++) {
+      const MergeChannelOp op = (ops[i] == MERGE_CHANNEL_AVERAGE) ? MERGE_CHANNEL_SUM : ops[i];
+      if (op == MERGE_CHANNEL_NOP) {
+        continue;
+      }
+
+      if (!image.runs.empty()) {
+        MergeChannelRun &run = image.runs.back();
+        if (run.op == op && run.offset + run.num_channels == i &&
+            run.merge_offset + run.num_channels == merge_offsets[i]) {
+          run.num_channels++;
+          continue;
+        }
+      }
+
+      MergeChannelRun run;
+      run.op = op;
+      run.offset = i;
+      run.merge_offset = merge_offsets[i];
+      run.num_channels = 1;
+      image.runs.push_back(run);
+    }
+  }
+}
+
+/* Pixels are merged in bands of scanlines, read from all input images and
+ * written to the output as soon as they are merged. This bounds memory usage
+ * to the band size rather than the full image resolution. For tiled inputs
+ * bands are made of whole rows of tiles, otherwise every band that ends
+ * inside a row of tiles would decode that row again. */
+static int merge_band_height(const vector<MergeImage> &images,
+                             const ImageSpec &out_spec,
+                             size_t memory_budget)
+{
+  size_t scanline_channels = out_spec.nchannels;
+  int tile_height = 1;
+  for (const MergeImage &image : images) {
+    const ImageSpec &spec = image.in->spec();
+    scanline_channels += spec.nchannels;
+    if (spec.tile_width > 0) {
+      tile_height = max(tile_height, spec.tile_height);
+    }
+  }
+
+  const size_t scanline_size = (size_t)max(out_spec.width, 1) * scanline_channels * sizeof(float);
+  const size_t band_height = memory_budget / scanline_size;
+  if (band_height >= (size_t)out_spec.height) {
+    return out_spec.height;
+  }
+  return max((int)band_height / tile_height, 1) * tile_height;
+}
+
+static void read_band(MergeImage *image, int y, int height)
+{
+  const ImageSpec &spec = image->in->spec();
+  image->pixels.resize((size_t)spec.width * height * spec.nchannels);
+
+  /* Read all channels at once, that is faster than individually due to
+   * interleaved EXR channel storage. */
+  image->read_error = !image->in->read_scanlines(
+      spec.y + y, spec.y + y + height, spec.z, 0, spec.nchannels, TypeDesc::FLOAT,
+      image->pixels.data());
+}
+
+/* Weighted sum of consecutive channels. */
+static void merge_channels_sum(float *out, const float *in, const float *weights, int num)
+{
+  int i = 0;
+#ifdef __KERNEL_SSE2__
+  for (; i + 4 <= num; i += 4) {
+    const ssef result = madd(loadu4f(weights + i), loadu4f(in + i), loadu4f(out + i));
+    _mm_storeu_ps(out + i, result);
+  }
+#endif
+  for (; i < num; i++) {
+    out[i] += weights[i] * in[i];
+  }
+}
+
+static void merge_band_pixels(const vector<MergeImage> *images,
+                              int out_stride,
+                              size_t pixel_begin,
+                              size_t pixel_end,
+                              float *out_pixels)
 {
-  const size_t width = spec.width;
-  const size_t height = spec.height;
-  const size_t num_channels = spec.nchannels;
+  float *out_begin = out_pixels + pixel_begin * out_stride;
+  memset(out_begin, 0, (pixel_end - pixel_begin) * out_stride * sizeof(float));
+
+  /* Images are merged in order, so results don't depend on scheduling. */
+  for (const MergeImage &image : *images) {
+    const size_t stride = image.in->spec().nchannels;
+    const float *weights = image.weights.data();
+
+    for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+      const float *in = image.pixels.data() + pixel * stride;
+      float *out = out_pixels + pixel * out_stride;
+
+      for (const MergeChannelRun &run : image.runs) {
+        if (run.op == MERGE_CHANNEL_COPY) {
+          memcpy(out + run.merge_offset, in + run.offset, run.num_channels * sizeof(float));
+        }
+        else {
+          merge_channels_sum(out + run.merge_offset,
+                             in + run.offset,
+                             weights + run.offset,
+                             run.num_channels);
+        }
+      }
+    }
+  }
+}
 
-  const size_t num_pixels = (size_t)width * (size_t)height;
-  pixels.resize(num_pixels * num_channels);
+static void write_band(ImageOutput *out, int y, int height, const float *pixels, bool *ok)
+{
+  const ImageSpec &spec = out->spec();
+  *ok = out->write_scanlines(spec.y + y, spec.y + y + height, spec.z, TypeDesc::FLOAT, pixels);
 }
 
-static bool merge_pixels(const vector<MergeImage> &images,
+static bool merge_pixels(vector<MergeImage> &images,
                          const ImageSpec &out_spec,
                          const vector<int> &channel_total_samples,
-                         array<float> &out_pixels,
+                         size_t memory_budget,
+                         ImageOutput *out,
+                         const string &out_filepath,
                          string &error)
 {
-  alloc_pixels(out_spec, out_pixels);
-  memset(out_pixels.data(), 0, out_pixels.size() * sizeof(float));
+  merge_channel_runs(images, channel_total_samples);
 
-  for (const MergeImage &image : images) {
-    /* Read all channels into buffer. Reading all channels at once is
-     * faster than individually due to interleaved EXR channel storage. */
-    array<float> pixels;
-    alloc_pixels(image.in->spec(), pixels);
+  const int band_height = merge_band_height(images, out_spec, memory_budget);
+  const size_t out_stride = out_spec.nchannels;
 
-    if (!image.in->read_image(TypeDesc::FLOAT, pixels.data())) {
-      error = "Failed to read image: " + image.filepath;
-      return false;
-    }
+  /* Reading the next band overlaps with writing the previous one, which
+   * is done by the time the band is merged. */
+  array<float> out_pixels;
+  bool write_ok = true;
 
-    for (size_t li = 0; li < image.layers.size(); li++) {
-      const MergeImageLayer &layer = image.layers[li];
+  TaskPool pool;
 
-      const size_t stride = image.in->spec().nchannels;
-      const size_t out_stride = out_spec.nchannels;
-      const size_t num_pixels = pixels.size();
+  for (int y = 0; y < out_spec.height; y += band_height) {
+    const int height = min(band_height, out_spec.height - y);
+    const size_t num_pixels = (size_t)out_spec.width * height;
 
-      for (const MergeImagePass &pass : layer.passes) {
-        size_t offset = pass.offset;
-        size_t out_offset = pass.merge_offset;
+    for (MergeImage &image : images) {
+      pool.push(function_bind(&read_band, &image, y, height));
+    }
+    pool.wait_work();
 
-        switch (pass.op) {
-          case MERGE_CHANNEL_NOP:
-            break;
-          case MERGE_CHANNEL_COPY:
-            for (; offset < num_pixels; offset += stride, out_offset += out_stride) {
-              out_pixels[out_offset] = pixels[offset];
-            }
-            break;
-          case MERGE_CHANNEL_SUM:
-            for (; offset < num_pixels; offset += stride, out_offset += out_stride) {
-              out_pixels[out_offset] += pixels[offset];
-            }
-            break;
-          case MERGE_CHANNEL_AVERAGE:
-            /* Weights based on sample metadata. Per channel since not
-             * all files are guaranteed to have the same channels. */
-            const int total_samples = channel_total_samples[out_offset];
-            const float t = (float)layer.samples / (float)total_samples;
-
-            for (; offset < num_pixels; offset += stride, out_offset += out_stride) {
-              out_pixels[out_offset] += t * pixels[offset];
-            }
-            break;
-        }
+    if (!write_ok) {
+      error = "Failed to write to file " + out_filepath + ": " + out->geterror();
+      return false;
+    }
+    for (const MergeImage &image : images) {
+      if (image.read_error) {
+        error = "Failed to read image: " + image.filepath;
+        return false;
       }
     }
+
+    out_pixels.resize(num_pixels * out_stride);
+
+    for (size_t pixel = 0; pixel < num_pixels; pixel += MERGE_TASK_PIXELS) {
+      pool.push(function_bind(&merge_band_pixels,
+                              &images,
+                              (int)out_stride,
+                              pixel,
+                              std::min(pixel + MERGE_TASK_PIXELS, num_pixels),
+                              out_pixels.data()));
+    }
+    pool.wait_work();
+
+    pool.push(function_bind(&write_band, out, y, height, out_pixels.data(), &write_ok));
+  }
+
+  pool.wait_work();
+
+  if (!write_ok) {
+    error = "Failed to write to file " + out_filepath + ": " + out->geterror();
+    return false;
   }
 
   return true;
 }
 
-static bool save_output(const string &filepath,
-                        const ImageSpec &spec,
-                        const array<float> &pixels,
-                        string &error)
+static unique_ptr<ImageOutput> open_output(const string &filepath,
+                                           ImageSpec &spec,
+                                           string &tmp_filepath,
+                                           string &error)
 {
   /* Write to temporary file path, so we merge images in place and don't
    * risk destroying files when something goes wrong in file saving. */
   string extension = OIIO::Filesystem::extension(filepath);
   string unique_name = ".merge-tmp-" + OIIO::Filesystem::unique_path();
-  string tmp_filepath = filepath + unique_name + extension;
+  tmp_filepath = filepath + unique_name + extension;
   unique_ptr<ImageOutput> out(ImageOutput::create(tmp_filepath));
 
   if (!out) {
     error = "Failed to open temporary file " + tmp_filepath + " for writing";
-    return false;
+    return NULL;
   }
 
-  /* Open temporary file and write image buffers. */
+  /* Scanlines are written as they are merged, which tiled files don't support. */
+  spec.tile_width = 0;
+  spec.tile_height = 0;
+  spec.tile_depth = 0;
+
+  /* Open temporary file for writing image buffers. */
   if (!out->open(tmp_filepath, spec)) {
     error = "Failed to open file " + tmp_filepath + " for writing: " + out->geterror();
-    return false;
+    return NULL;
   }
 
-  bool ok = true;
-  if (!out->write_image(TypeDesc::FLOAT, pixels.data())) {
-    error = "Failed to write to file " + tmp_filepath + ": " + out->geterror();
-    ok = false;
-  }
+  return out;
+}
 
-  if (!out->close()) {
+static bool save_output(const string &filepath,
+                        const string &tmp_filepath,
+                        unique_ptr<ImageOutput> out,
+                        bool ok,
+                        string &error)
+{
+  if (!out->close() && ok) {
     error = "Failed to save to file " + tmp_filepath + ": " + out->geterror();
     ok = false;
   }
@@ -475,6 +653,15 @@ static bool save_output(const string &filepath,
 
 ImageMerger::ImageMerger()
 {
+  memory_budget = (size_t)256 * 1024 * 1024;
+
+  /* Initialize task scheduler. */
+  TaskScheduler::init();
+}
+
+ImageMerger::~ImageMerger()
+{
+  TaskScheduler::exit();
 }
 
 bool ImageMerger::run()
@@ -499,18 +686,28 @@ bool ImageMerger::run()
   vector<int> channel_total_samples;
   merge_channels_metadata(images, out_spec, channel_total_samples);
 
-  /* Merge pixels. */
-  array<float> out_pixels;
-  if (!merge_pixels(images, out_spec, channel_total_samples, out_pixels, error)) {
+  /* Open output file. */
+  string tmp_filepath;
+  unique_ptr<ImageOutput> out = open_output(output, out_spec, tmp_filepath, error);
+  if (!out) {
     return false;
   }
 
+  /* Merge pixels, streaming them from input to output file. */
+  const bool ok = merge_pixels(images,
+                               out_spec,
+                               channel_total_samples,
+                               memory_budget,
+                               out.get(),
+                               tmp_filepath,
+                               error);
+
   /* We don't need input anymore at this point, and will possibly
    * overwrite the same file. */
   images.clear();
 
   /* Save output file. */
-  return save_output(output, out_spec, out_pixels, error);
+  return save_output(output, tmp_filepath, std::move(out), ok, error);
 }
 
 CCL_NAMESPACE_END
@@ -27,6 +27,8 @@ CCL_NAMESPACE_BEGIN
 class ImageMerger {
  public:
   ImageMerger();
+  ~ImageMerger();
+
   bool run();
 
   /* Error message after running, in case of failure. */
@@ -36,6 +38,10 @@ class ImageMerger {
   vector<string> input;
   /* Output filepath. */
   string output;
+  /* Memory budget in bytes for image data, which determines how many scanlines
+   * are merged at once. At least one scanline, or one row of tiles for tiled
+   * inputs, is merged regardless of the budget. */
+  size_t memory_budget;
 };
 
 CCL_NAMESPACE_END
@@ -15,6 +15,7 @@
  */
 
 #include "bvh/bvh.h"
+#include "bvh/bvh8.h"
 #include "bvh/bvh_build.h"
 
 #include "render/camera.h"
@@ -34,10 +35,12 @@
 #include "subd/subd_split.h"
 #include "subd/subd_patch_table.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
 #include "util/util_set.h"
+#include "util/util_time.h"
 
 #ifdef WITH_EMBREE
 #  include "bvh/bvh_embree.h"
@@ -437,6 +440,8 @@ Mesh::Mesh() : Node(node_type)
 
   num_subd_verts = 0;
 
+  out_of_core = false;
+
   attributes.triangle_mesh = this;
   curve_attributes.curve_mesh = this;
   subd_attributes.subd_mesh = this;
@@ -1097,6 +1102,8 @@ void Mesh::compute_bvh(
                                     params->use_bvh_unaligned_nodes;
       bparams.num_motion_triangle_steps = params->num_bvh_time_steps;
       bparams.num_motion_curve_steps = params->num_bvh_time_steps;
+      bparams.use_indexed_triangles = params->use_bvh_indexed_triangles &&
+                                      BVHParams::layout_supports_indexed_triangles(bvh_layout);
       bparams.bvh_type = params->bvh_type;
       bparams.curve_flags = dscene->data.curve.curveflags;
       bparams.curve_subdivisions = dscene->data.curve.subdivisions;
@@ -1204,10 +1211,12 @@ MeshManager::MeshManager()
 {
   need_update = true;
   need_flags_update = true;
+  scene_bvh = NULL;
 }
 
 MeshManager::~MeshManager()
 {
+  delete scene_bvh;
 }
 
 void MeshManager::update_osl_attributes(Device *device,
@@ -1688,6 +1697,11 @@ void MeshManager::device_update_attributes(Device *device,
     Mesh *mesh = scene->meshes[i];
     AttributeRequestSet &attributes = mesh_attributes[i];
 
+    const size_t mesh_attr_float_offset = attr_float_offset;
+    const size_t mesh_attr_float2_offset = attr_float2_offset;
+    const size_t mesh_attr_float3_offset = attr_float3_offset;
+    const size_t mesh_attr_uchar4_offset = attr_uchar4_offset;
+
     /* todo: we now store std and name attributes from requests even if
      * they actually refer to the same mesh attributes, optimize */
     foreach (AttributeRequest &req, attributes.requests) {
@@ -1740,6 +1754,23 @@ void MeshManager::device_update_attributes(Device *device,
       if (progress.get_cancel())
         return;
     }
+
+    /* Attributes of a mesh are stored consecutively in each array. */
+    if (mesh->out_of_core) {
+      DeviceMemoryResidency &residency = dscene->geometry_residency;
+      residency.page_out(dscene->attributes_float,
+                         mesh_attr_float_offset,
+                         attr_float_offset - mesh_attr_float_offset);
+      residency.page_out(dscene->attributes_float2,
+                         mesh_attr_float2_offset,
+                         attr_float2_offset - mesh_attr_float2_offset);
+      residency.page_out(dscene->attributes_float3,
+                         mesh_attr_float3_offset,
+                         attr_float3_offset - mesh_attr_float3_offset);
+      residency.page_out(dscene->attributes_uchar4,
+                         mesh_attr_uchar4_offset,
+                         attr_uchar4_offset - mesh_attr_uchar4_offset);
+    }
   }
 
   /* create attribute lookup maps */
@@ -1824,8 +1855,99 @@ void MeshManager::mesh_calc_offset(Scene *scene)
   }
 }
 
+/* Estimated size of the packed geometry and attributes of a mesh, in bytes. */
+static size_t mesh_packed_size(const Mesh *mesh)
+{
+  size_t size = mesh->verts.size() * (sizeof(float4) + sizeof(float2)) +
+                mesh->num_triangles() * (sizeof(uint) + sizeof(uint4) + sizeof(uint)) +
+                mesh->curve_keys.size() * sizeof(float4) + mesh->num_curves() * sizeof(float4);
+
+  const AttributeSet *attribute_sets[] = {
+      &mesh->attributes, &mesh->curve_attributes, &mesh->subd_attributes};
+  for (int i = 0; i < 3; i++) {
+    foreach (const Attribute &attr, attribute_sets[i]->attributes) {
+      size += attr.buffer.size();
+    }
+  }
+
+  return size;
+}
+
+namespace {
+
+/* Order in which meshes are kept in memory: meshes seen directly by the camera
+ * first, then smaller meshes first so more of them fit. */
+struct MeshResidencyOrder {
+  bool camera_visible;
+  size_t size;
+  size_t index;
+
+  bool operator<(const MeshResidencyOrder &other) const
+  {
+    if (camera_visible != other.camera_visible) {
+      return camera_visible;
+    }
+    if (size != other.size) {
+      return size < other.size;
+    }
+    return index < other.index;
+  }
+};
+
+}  // namespace
+
+void MeshManager::device_update_residency(DeviceScene *dscene, Scene *scene)
+{
+  const size_t limit = (size_t)scene->params.geometry_memory_limit * 1024 * 1024;
+
+  foreach (Mesh *mesh, scene->meshes) {
+    mesh->out_of_core = false;
+  }
+
+  if (limit == 0) {
+    dscene->geometry_residency.set_out_of_core(false);
+    return;
+  }
+
+  set<const Mesh *> camera_meshes;
+  foreach (Object *object, scene->objects) {
+    if (object->visibility & PATH_RAY_CAMERA) {
+      camera_meshes.insert(object->mesh);
+    }
+  }
+
+  vector<MeshResidencyOrder> order(scene->meshes.size());
+  for (size_t i = 0; i < scene->meshes.size(); i++) {
+    const Mesh *mesh = scene->meshes[i];
+    order[i].camera_visible = camera_meshes.find(mesh) != camera_meshes.end();
+    order[i].size = mesh_packed_size(mesh);
+    order[i].index = i;
+  }
+  std::sort(order.begin(), order.end());
+
+  /* Meshes that don't fit are paged out to disk once packed, and paged back in
+   * by the operating system when rendering accesses them. */
+  size_t resident_size = 0;
+  size_t num_out_of_core = 0;
+  foreach (const MeshResidencyOrder &entry, order) {
+    if (resident_size + entry.size <= limit) {
+      resident_size += entry.size;
+    }
+    else {
+      scene->meshes[entry.index]->out_of_core = true;
+      num_out_of_core++;
+    }
+  }
+
+  VLOG(1) << "Paging out geometry of " << num_out_of_core << " of " << scene->meshes.size()
+          << " meshes, " << string_human_readable_size(resident_size) << " stays in memory.";
+
+  dscene->geometry_residency.set_out_of_core(num_out_of_core != 0,
+                                             scene->params.geometry_cache_path);
+}
+
 void MeshManager::device_update_mesh(
-    Device *, DeviceScene *dscene, Scene *scene, bool for_displacement, Progress &progress)
+    Device *device, DeviceScene *dscene, Scene *scene, bool for_displacement, Progress &progress)
 {
   /* Count. */
   size_t vert_size = 0;
@@ -1855,6 +1977,11 @@ void MeshManager::device_update_mesh(
     }
   }
 
+  const BVHLayout bvh_layout = BVHParams::best_bvh_layout(scene->params.bvh_layout,
+                                                          device->get_bvh_layout_mask());
+  const bool use_indexed_triangles = scene->params.use_bvh_indexed_triangles &&
+                                     BVHParams::layout_supports_indexed_triangles(bvh_layout);
+
   /* Create mapping from triangle to primitive triangle array. */
   vector<uint> tri_prim_index(tri_size);
   if (for_displacement) {
@@ -1897,6 +2024,14 @@ void MeshManager::device_update_mesh(
                        &tri_patch_uv[mesh->vert_offset],
                        mesh->vert_offset,
                        mesh->tri_offset);
+      if (mesh->out_of_core) {
+        DeviceMemoryResidency &residency = dscene->geometry_residency;
+        residency.page_out(dscene->tri_shader, mesh->tri_offset, mesh->num_triangles());
+        residency.page_out(dscene->tri_vnormal, mesh->vert_offset, mesh->verts.size());
+        residency.page_out(dscene->tri_vindex, mesh->tri_offset, mesh->num_triangles());
+        residency.page_out(dscene->tri_patch, mesh->tri_offset, mesh->num_triangles());
+        residency.page_out(dscene->tri_patch_uv, mesh->vert_offset, mesh->verts.size());
+      }
       if (progress.get_cancel())
         return;
     }
@@ -1922,6 +2057,11 @@ void MeshManager::device_update_mesh(
                         &curve_keys[mesh->curvekey_offset],
                         &curves[mesh->curve_offset],
                         mesh->curvekey_offset);
+      if (mesh->out_of_core) {
+        DeviceMemoryResidency &residency = dscene->geometry_residency;
+        residency.page_out(dscene->curve_keys, mesh->curvekey_offset, mesh->curve_keys.size());
+        residency.page_out(dscene->curves, mesh->curve_offset, mesh->num_curves());
+      }
       if (progress.get_cancel())
         return;
     }
@@ -1946,6 +2086,15 @@ void MeshManager::device_update_mesh(
                                                   mesh->patch_table_offset);
       }
 
+      if (mesh->out_of_core && mesh->subd_faces.size()) {
+        const Mesh::SubdFace &last = mesh->subd_faces[mesh->subd_faces.size() - 1];
+        size_t mesh_patch_size = (last.ptex_offset + last.num_ptex_faces()) * 8;
+        if (mesh->patch_table) {
+          mesh_patch_size += mesh->patch_table->total_size();
+        }
+        dscene->geometry_residency.page_out(dscene->patches, mesh->patch_offset, mesh_patch_size);
+      }
+
       if (progress.get_cancel())
         return;
     }
@@ -1966,16 +2115,157 @@ void MeshManager::device_update_mesh(
     }
     dscene->prim_tri_verts.copy_to_device();
   }
+  else if (use_indexed_triangles) {
+    /* The BVH doesn't store triangle vertices, the kernel fetches the mesh
+     * vertices through the triangle vertex indices instead. */
+    float4 *prim_tri_verts = dscene->prim_tri_verts.alloc(vert_size);
+    foreach (Mesh *mesh, scene->meshes) {
+      for (size_t i = 0; i < mesh->verts.size(); ++i) {
+        prim_tri_verts[mesh->vert_offset + i] = float3_to_float4(mesh->verts[i]);
+      }
+    }
+    dscene->prim_tri_verts.copy_to_device();
+  }
+
+  /* Displacement kernels always use the triangle vertices copied above. */
+  dscene->data.bvh.use_indexed_triangles = !for_displacement && use_indexed_triangles;
+
+  if (!for_displacement) {
+    bvh_stats.use_indexed_triangles = use_indexed_triangles;
+    bvh_stats.triangles_size = dscene->prim_tri_verts.size() * sizeof(float4) +
+                               dscene->prim_tri_index.size() * sizeof(uint);
+  }
+}
+
+/* Everything other than vertex positions and object transforms that the structure
+ * of the scene BVH depends on. As long as this stays the same, all primitive and
+ * object indices in the BVH are still valid and it can be refit. */
+static void compute_scene_bvh_topology(Scene *scene, vector<int> &topology)
+{
+  topology.clear();
+  topology.reserve(scene->objects.size() * 8);
+
+  foreach (Object *object, scene->objects) {
+    Mesh *mesh = object->mesh;
+    topology.push_back(object->is_traceable());
+    topology.push_back(mesh->is_instanced());
+    topology.push_back(mesh->num_triangles());
+    topology.push_back(mesh->num_curves());
+    topology.push_back(mesh->tri_offset);
+    topology.push_back(mesh->curve_offset);
+    topology.push_back(mesh->use_motion_blur);
+    topology.push_back(mesh->motion_steps);
+  }
+}
+
+/* Move packed BVH data to the device, for layouts that have their own packing
+ * and need no global arrays shared with other BVH's. */
+template<typename T> static void bvh_copy_to_device(device_vector<T> &dvector, array<T> &data)
+{
+  if (data.size()) {
+    dvector.steal_data(data);
+    dvector.copy_to_device();
+  }
+}
+
+/* Copy the global array to the device, or only the top level range after the
+ * instance BVH's when those are already on the device. Arrays that changed size
+ * since the last copy are reallocated and copied in full by the device. */
+template<typename T>
+static void bvh_copy_global_to_device(device_vector<T> &dvector,
+                                      size_t top_level_offset,
+                                      bool copy_instances)
+{
+  if (dvector.size()) {
+    if (copy_instances) {
+      dvector.copy_to_device();
+    }
+    else if (top_level_offset < dvector.size()) {
+      dvector.copy_to_device(top_level_offset, dvector.size() - top_level_offset);
+    }
+  }
+}
+
+bool MeshManager::device_update_bvh_instances(DeviceScene *dscene,
+                                              Scene *scene,
+                                              const BVHParams &bparams)
+{
+  /* Unique instanced meshes in the order of first use, along with everything their
+   * packed data depends on besides the mesh BVH itself. */
+  vector<Mesh *> instance_meshes;
+  vector<int> instance_key;
+  set<Mesh *> used_meshes;
+
+  instance_key.push_back(bparams.bvh_layout);
+  instance_key.push_back(bparams.num_motion_triangle_steps);
+  instance_key.push_back(bparams.num_motion_curve_steps);
+
+  foreach (Object *object, scene->objects) {
+    Mesh *mesh = object->mesh;
+
+    /* We assume that if mesh doesn't need own BVH it was already included
+     * into a top-level BVH and no packing here is needed. */
+    if (mesh->need_build_bvh(bparams.bvh_layout) && used_meshes.insert(mesh).second) {
+      instance_meshes.push_back(mesh);
+      instance_key.push_back(mesh->tri_offset);
+      instance_key.push_back(mesh->curve_offset);
+    }
+  }
+
+  if (instance_meshes == bvh_instance_meshes && instance_key == bvh_instance_key) {
+    VLOG(1) << "Keeping " << instance_meshes.size() << " packed instance BVHs.";
+    return false;
+  }
+
+  VLOG(1) << "Packing " << instance_meshes.size() << " instance BVHs.";
+
+  PackedBVHOffsets size;
+  foreach (Mesh *mesh, instance_meshes) {
+    size.add(mesh->bvh->pack);
+  }
+
+  dscene->bvh_nodes.alloc(size.nodes);
+  dscene->bvh_leaf_nodes.alloc(size.leaf_nodes);
+  dscene->prim_tri_index.alloc(size.prims);
+  dscene->prim_tri_verts.alloc(size.prim_tri_verts);
+  dscene->prim_type.alloc(size.prims);
+  dscene->prim_visibility.alloc(size.prims);
+  dscene->prim_index.alloc(size.prims);
+  dscene->prim_object.alloc(size.prims);
+  if (bparams.num_motion_curve_steps > 0 || bparams.num_motion_triangle_steps > 0) {
+    dscene->prim_time.alloc(size.prims);
+  }
+  else {
+    dscene->prim_time.free();
+  }
+
+  bvh_instance_nodes.clear();
+
+  PackedBVHOffsets offsets;
+  foreach (Mesh *mesh, instance_meshes) {
+    BVH *bvh = mesh->bvh;
+    bvh->pack_global(dscene, offsets);
+    bvh_instance_nodes[mesh] = bvh->global_root_index(offsets);
+    offsets.add(bvh->pack);
+  }
+
+  bvh_instance_meshes.swap(instance_meshes);
+  bvh_instance_key.swap(instance_key);
+  bvh_instances_size = size;
+  return true;
 }
 
+/* The scene BVH only holds the top level, with non-instanced meshes built into
+ * it. Instanced meshes have BVH's of their own, which are packed at the start of
+ * the global arrays by device_update_bvh_instances(), and the top level pack is
+ * appended after them. Since the top level pack never contains instance data,
+ * it can be refit in place and repacked without touching the instances. */
 void MeshManager::device_update_bvh(Device *device,
                                     DeviceScene *dscene,
                                     Scene *scene,
+                                    bool topology_changed,
                                     Progress &progress)
 {
-  /* bvh build */
-  progress.set_status("Updating Scene BVH", "Building");
-
   BVHParams bparams;
   bparams.top_level = true;
   bparams.bvh_layout = BVHParams::best_bvh_layout(scene->params.bvh_layout,
@@ -1985,22 +2275,59 @@ void MeshManager::device_update_bvh(Device *device,
                                 scene->params.use_bvh_unaligned_nodes;
   bparams.num_motion_triangle_steps = scene->params.num_bvh_time_steps;
   bparams.num_motion_curve_steps = scene->params.num_bvh_time_steps;
+  bparams.use_indexed_triangles = scene->params.use_bvh_indexed_triangles &&
+                                  BVHParams::layout_supports_indexed_triangles(
+                                      bparams.bvh_layout);
   bparams.bvh_type = scene->params.bvh_type;
   bparams.curve_flags = dscene->data.curve.curveflags;
   bparams.curve_subdivisions = dscene->data.curve.subdivisions;
 
   VLOG(1) << "Using " << bvh_layout_name(bparams.bvh_layout) << " layout.";
 
+  /* Keep the BVH for refitting when updates with only deformation are expected,
+   * for animation renders with persistent data and for interactive updates. */
+  const bool keep_bvh = (bparams.bvh_layout & (BVH_LAYOUT_BVH2 | BVH_LAYOUT_BVH4 |
+                                               BVH_LAYOUT_BVH8 | BVH_LAYOUT_BVH8_QUANTIZED)) &&
+                        (scene->params.persistent_data ||
+                         scene->params.bvh_type == SceneParams::BVH_DYNAMIC);
+
+  vector<int> topology;
+  if (keep_bvh) {
+    compute_scene_bvh_topology(scene, topology);
+  }
+
+  const bool refit = keep_bvh && scene_bvh && !topology_changed &&
+                     !scene_bvh->params.modified(bparams) && topology == scene_bvh_topology;
+
+  BVH *bvh;
+
+  if (refit) {
+    progress.set_status("Updating Scene BVH", "Refitting");
+
+    bvh = scene_bvh;
+    bvh->meshes = scene->meshes;
+    bvh->objects = scene->objects;
+    bvh->refit(progress);
+  }
+  else {
+    progress.set_status("Updating Scene BVH", "Building");
+
+    delete scene_bvh;
+    scene_bvh = NULL;
+
 #ifdef WITH_EMBREE
-  if (bparams.bvh_layout == BVH_LAYOUT_EMBREE) {
-    if (dscene->data.bvh.scene) {
-      BVHEmbree::destroy(dscene->data.bvh.scene);
+    if (bparams.bvh_layout == BVH_LAYOUT_EMBREE) {
+      if (dscene->data.bvh.scene) {
+        BVHEmbree::destroy(dscene->data.bvh.scene);
+      }
     }
-  }
 #endif
 
-  BVH *bvh = BVH::create(bparams, scene->meshes, scene->objects);
-  bvh->build(progress, &device->stats);
+    bvh = BVH::create(bparams, scene->meshes, scene->objects);
+    bvh->build(progress, &device->stats);
+  }
+
+  VLOG(1) << (refit ? "Refit" : "Built") << " scene BVH.";
 
   if (progress.get_cancel()) {
 #ifdef WITH_EMBREE
@@ -2011,6 +2338,7 @@ void MeshManager::device_update_bvh(Device *device,
     }
 #endif
     delete bvh;
+    scene_bvh = NULL;
     return;
   }
 
@@ -2019,54 +2347,90 @@ void MeshManager::device_update_bvh(Device *device,
 
   PackedBVH &pack = bvh->pack;
 
-  if (pack.nodes.size()) {
-    dscene->bvh_nodes.steal_data(pack.nodes);
-    dscene->bvh_nodes.copy_to_device();
-  }
-  if (pack.leaf_nodes.size()) {
-    dscene->bvh_leaf_nodes.steal_data(pack.leaf_nodes);
-    dscene->bvh_leaf_nodes.copy_to_device();
-  }
-  if (pack.object_node.size()) {
-    dscene->object_node.steal_data(pack.object_node);
-    dscene->object_node.copy_to_device();
-  }
-  if (pack.prim_tri_index.size()) {
-    dscene->prim_tri_index.steal_data(pack.prim_tri_index);
-    dscene->prim_tri_index.copy_to_device();
-  }
-  if (pack.prim_tri_verts.size()) {
-    dscene->prim_tri_verts.steal_data(pack.prim_tri_verts);
-    dscene->prim_tri_verts.copy_to_device();
-  }
-  if (pack.prim_type.size()) {
-    dscene->prim_type.steal_data(pack.prim_type);
-    dscene->prim_type.copy_to_device();
-  }
-  if (pack.prim_visibility.size()) {
-    dscene->prim_visibility.steal_data(pack.prim_visibility);
-    dscene->prim_visibility.copy_to_device();
-  }
-  if (pack.prim_index.size()) {
-    dscene->prim_index.steal_data(pack.prim_index);
-    dscene->prim_index.copy_to_device();
+  if (bparams.bvh_layout &
+      (BVH_LAYOUT_BVH2 | BVH_LAYOUT_BVH4 | BVH_LAYOUT_BVH8 | BVH_LAYOUT_BVH8_QUANTIZED)) {
+    /* Instance BVH's come first in the global arrays and are only packed again
+     * when they changed, the top level BVH is appended after them. */
+    const bool copy_instances = device_update_bvh_instances(dscene, scene, bparams);
+
+    PackedBVHOffsets size = bvh_instances_size;
+    size.add(pack);
+
+    dscene->bvh_nodes.resize(size.nodes);
+    dscene->bvh_leaf_nodes.resize(size.leaf_nodes);
+    dscene->prim_tri_index.resize(size.prims);
+    dscene->prim_tri_verts.resize(size.prim_tri_verts);
+    dscene->prim_type.resize(size.prims);
+    dscene->prim_visibility.resize(size.prims);
+    dscene->prim_index.resize(size.prims);
+    dscene->prim_object.resize(size.prims);
+    if (bparams.num_motion_curve_steps > 0 || bparams.num_motion_triangle_steps > 0) {
+      dscene->prim_time.resize(size.prims);
+    }
+
+    bvh->pack_global(dscene, bvh_instances_size);
+
+    /* Node indexes for instanced objects. */
+    int *object_node = dscene->object_node.alloc(scene->objects.size());
+    for (size_t i = 0; i < scene->objects.size(); i++) {
+      map<Mesh *, int>::iterator it = bvh_instance_nodes.find(scene->objects[i]->mesh);
+      object_node[i] = (it != bvh_instance_nodes.end()) ? it->second : 0;
+    }
+
+    /* Unchanged instance BVH's stay on the device, only the top level range
+     * after them is copied. */
+    const PackedBVHOffsets &offset = bvh_instances_size;
+    bvh_copy_global_to_device(dscene->bvh_nodes, offset.nodes, copy_instances);
+    bvh_copy_global_to_device(dscene->bvh_leaf_nodes, offset.leaf_nodes, copy_instances);
+    bvh_copy_global_to_device(dscene->object_node, 0, true);
+    bvh_copy_global_to_device(dscene->prim_tri_index, offset.prims, copy_instances);
+    bvh_copy_global_to_device(dscene->prim_tri_verts, offset.prim_tri_verts, copy_instances);
+    bvh_copy_global_to_device(dscene->prim_type, offset.prims, copy_instances);
+    bvh_copy_global_to_device(dscene->prim_visibility, offset.prims, copy_instances);
+    bvh_copy_global_to_device(dscene->prim_index, offset.prims, copy_instances);
+    bvh_copy_global_to_device(dscene->prim_object, offset.prims, copy_instances);
+    bvh_copy_global_to_device(dscene->prim_time, offset.prims, copy_instances);
+
+    dscene->data.bvh.root = bvh->global_root_index(bvh_instances_size);
   }
-  if (pack.prim_object.size()) {
-    dscene->prim_object.steal_data(pack.prim_object);
-    dscene->prim_object.copy_to_device();
-  }
-  if (pack.prim_time.size()) {
-    dscene->prim_time.steal_data(pack.prim_time);
-    dscene->prim_time.copy_to_device();
+  else {
+    device_free_bvh(dscene);
+
+    bvh_copy_to_device(dscene->bvh_nodes, pack.nodes);
+    bvh_copy_to_device(dscene->bvh_leaf_nodes, pack.leaf_nodes);
+    bvh_copy_to_device(dscene->object_node, pack.object_node);
+    bvh_copy_to_device(dscene->prim_tri_index, pack.prim_tri_index);
+    bvh_copy_to_device(dscene->prim_tri_verts, pack.prim_tri_verts);
+    bvh_copy_to_device(dscene->prim_type, pack.prim_type);
+    bvh_copy_to_device(dscene->prim_visibility, pack.prim_visibility);
+    bvh_copy_to_device(dscene->prim_index, pack.prim_index);
+    bvh_copy_to_device(dscene->prim_object, pack.prim_object);
+    bvh_copy_to_device(dscene->prim_time, pack.prim_time);
+
+    dscene->data.bvh.root = pack.root_index;
   }
 
-  dscene->data.bvh.root = pack.root_index;
   dscene->data.bvh.bvh_layout = bparams.bvh_layout;
   dscene->data.bvh.use_bvh_steps = (scene->params.num_bvh_time_steps != 0);
 
+  bvh_stats.layout = bvh_layout_name(bparams.bvh_layout);
+  bvh_stats.nodes_size = dscene->bvh_nodes.size() * sizeof(int4);
+  bvh_stats.leaf_nodes_size = dscene->bvh_leaf_nodes.size() * sizeof(int4);
+  bvh_stats.full_precision_nodes_size = 0;
+  if (bparams.bvh_layout == BVH_LAYOUT_BVH8_QUANTIZED) {
+    bvh_stats.full_precision_nodes_size = BVH8::full_precision_nodes_size(
+        dscene->bvh_nodes.data(), dscene->bvh_nodes.size());
+  }
+
   bvh->copy_to_device(progress, dscene);
 
-  delete bvh;
+  if (keep_bvh) {
+    scene_bvh = bvh;
+    scene_bvh_topology.swap(topology);
+  }
+  else {
+    delete bvh;
+  }
 }
 
 void MeshManager::device_update_preprocess(Device *device, Scene *scene, Progress &progress)
@@ -2260,11 +2624,15 @@ void MeshManager::device_update(Device *device,
     scene->object_manager->device_update_flags(device, dscene, scene, progress, false);
   }
 
-  /* Device update. */
-  device_free(device, dscene);
+  /* Device update. The BVH arrays are kept, so packed instance BVH's can be
+   * reused when only the top level BVH changes. */
+  device_free_meshes(device, dscene);
 
   mesh_calc_offset(scene);
+  device_update_residency(dscene, scene);
   if (true_displacement_used) {
+    /* Triangle vertices for displacement are written to the BVH arrays. */
+    device_free_bvh(dscene);
     device_update_mesh(device, dscene, scene, true, progress);
   }
   if (progress.get_cancel())
@@ -2297,13 +2665,32 @@ void MeshManager::device_update(Device *device,
 
   /* Device re-update after displacement. */
   if (displacement_done) {
-    device_free(device, dscene);
+    device_free_meshes(device, dscene);
 
     device_update_attributes(device, dscene, scene, progress);
     if (progress.get_cancel())
       return;
   }
 
+  /* Topology changes require the scene BVH to be rebuilt, otherwise it can be refit.
+   * Test before building mesh BVHs, as that clears the rebuild tags. */
+  bool topology_changed = (total_tess_needed != 0);
+  bool instances_changed = false;
+  foreach (Mesh *mesh, scene->meshes) {
+    if (mesh->need_update && mesh->need_update_rebuild) {
+      topology_changed = true;
+    }
+    if (mesh->need_update && mesh->need_build_bvh(bvh_layout)) {
+      instances_changed = true;
+    }
+  }
+
+  /* Packed instance BVH's are outdated once their mesh BVH is rebuilt or refit. */
+  if (instances_changed) {
+    device_free_bvh(dscene);
+  }
+
+  const double bvh_start_time = time_dt();
   TaskPool pool;
 
   size_t i = 0;
@@ -2337,10 +2724,12 @@ void MeshManager::device_update(Device *device,
   if (progress.get_cancel())
     return;
 
-  device_update_bvh(device, dscene, scene, progress);
+  device_update_bvh(device, dscene, scene, topology_changed, progress);
   if (progress.get_cancel())
     return;
 
+  bvh_stats.build_time = time_dt() - bvh_start_time;
+
   device_update_mesh(device, dscene, scene, false, progress);
   if (progress.get_cancel())
     return;
@@ -2359,6 +2748,12 @@ void MeshManager::device_update(Device *device,
 }
 
 void MeshManager::device_free(Device *device, DeviceScene *dscene)
+{
+  device_free_bvh(dscene);
+  device_free_meshes(device, dscene);
+}
+
+void MeshManager::device_free_bvh(DeviceScene *dscene)
 {
   dscene->bvh_nodes.free();
   dscene->bvh_leaf_nodes.free();
@@ -2370,6 +2765,15 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
   dscene->prim_index.free();
   dscene->prim_object.free();
   dscene->prim_time.free();
+
+  bvh_instance_meshes.clear();
+  bvh_instance_key.clear();
+  bvh_instance_nodes.clear();
+  bvh_instances_size = PackedBVHOffsets();
+}
+
+void MeshManager::device_free_meshes(Device *device, DeviceScene *dscene)
+{
   dscene->tri_shader.free();
   dscene->tri_vnormal.free();
   dscene->tri_vindex.free();
@@ -2411,7 +2815,12 @@ void MeshManager::collect_statistics(const Scene *scene, RenderStats *stats)
   foreach (Mesh *mesh, scene->meshes) {
     stats->mesh.geometry.add_entry(
         NamedSizeEntry(string(mesh->name.c_str()), mesh->get_total_size_in_bytes()));
+    if (mesh->out_of_core) {
+      stats->mesh.num_out_of_core_meshes++;
+    }
   }
+  stats->mesh.mapped_size = scene->dscene.geometry_residency.mapped_size;
+  stats->bvh = bvh_stats;
 }
 
 bool Mesh::need_attribute(Scene *scene, AttributeStandard std)
@@ -19,9 +19,11 @@
 
 #include "graph/node.h"
 
+#include "bvh/bvh.h"
 #include "bvh/bvh_params.h"
 #include "render/attribute.h"
 #include "render/shader.h"
+#include "render/stats.h"
 
 #include "util/util_array.h"
 #include "util/util_boundbox.h"
@@ -41,7 +43,6 @@ class Device;
 class DeviceScene;
 class Mesh;
 class Progress;
-class RenderStats;
 class Scene;
 class SceneParams;
 class AttributeRequest;
@@ -284,6 +285,9 @@ class Mesh : public Node {
 
   size_t num_subd_verts;
 
+  /* Packed geometry is paged out to disk, to stay within the geometry memory limit. */
+  bool out_of_core;
+
  private:
   unordered_map<int, int> vert_to_stitching_key_map; /* real vert index -> stitching index */
   unordered_multimap<int, int>
@@ -402,6 +406,9 @@ class MeshManager {
   /* Calculate verts/triangles/curves offsets in global arrays. */
   void mesh_calc_offset(Scene *scene);
 
+  /* Choose meshes to page out to disk when geometry exceeds the memory limit. */
+  void device_update_residency(DeviceScene *dscene, Scene *scene);
+
   void device_update_object(Device *device, DeviceScene *dscene, Scene *scene, Progress &progress);
 
   void device_update_mesh(Device *device,
@@ -415,11 +422,36 @@ class MeshManager {
                                 Scene *scene,
                                 Progress &progress);
 
-  void device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress &progress);
+  void device_update_bvh(Device *device,
+                         DeviceScene *dscene,
+                         Scene *scene,
+                         bool topology_changed,
+                         Progress &progress);
+
+  /* Returns true when the instance BVH's were packed again. */
+  bool device_update_bvh_instances(DeviceScene *dscene, Scene *scene, const BVHParams &bparams);
 
   void device_update_displacement_images(Device *device, Scene *scene, Progress &progress);
 
   void device_update_volume_images(Device *device, Scene *scene, Progress &progress);
+
+  void device_free_bvh(DeviceScene *dscene);
+  void device_free_meshes(Device *device, DeviceScene *dscene);
+
+  /* Scene BVH kept around for refitting when only vertex positions or object
+   * transforms change, along with the topology it was built for. */
+  BVH *scene_bvh;
+  vector<int> scene_bvh_topology;
+
+  /* BVH's of instanced meshes packed at the start of the global BVH arrays. They
+   * stay there while unchanged, so updates only pack the top level BVH after them. */
+  vector<Mesh *> bvh_instance_meshes;
+  vector<int> bvh_instance_key;
+  map<Mesh *, int> bvh_instance_nodes;
+  PackedBVHOffsets bvh_instances_size;
+
+  /* Statistics of the last BVH update, for render statistics. */
+  BVHStats bvh_stats;
 };
 
 CCL_NAMESPACE_END
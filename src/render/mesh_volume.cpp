@@ -21,6 +21,7 @@
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
+#include "util/util_sparse_grid.h"
 #include "util/util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -360,6 +361,25 @@ void VolumeMeshBuilder::convert_quads_to_tris(const vector<QuadData> &quads,
 struct VoxelAttributeGrid {
   float *data;
   int channels;
+  /* Tile index of sparse grids, NULL for dense grids. */
+  const int *grid_index;
+
+  bool tile_is_empty(const int3 &resolution, int x, int y, int z) const
+  {
+    return grid_index && grid_index[sparse_grid_tile_index(resolution, x, y, z)] == -1;
+  }
+
+  float value(const int3 &resolution, int x, int y, int z, int c) const
+  {
+    if (grid_index) {
+      const int tile = grid_index[sparse_grid_tile_index(resolution, x, y, z)];
+      if (tile == -1) {
+        return 0.0f;
+      }
+      return data[sparse_grid_voxel_offset(tile, x, y, z) * channels + c];
+    }
+    return data[compute_voxel_index(resolution, x, y, z) * channels + c];
+  }
 };
 
 void MeshManager::create_volume_mesh(Scene *scene, Mesh *mesh, Progress &progress)
@@ -368,6 +388,7 @@ void MeshManager::create_volume_mesh(Scene *scene, Mesh *mesh, Progress &progres
   progress.set_status("Updating Mesh", msg);
 
   vector<VoxelAttributeGrid> voxel_grids;
+  size_t voxel_grids_memory = 0;
 
   /* Compute volume parameters. */
   VolumeParams volume_params;
@@ -394,7 +415,13 @@ void MeshManager::create_volume_mesh(Scene *scene, Mesh *mesh, Progress &progres
     VoxelAttributeGrid voxel_grid;
     voxel_grid.data = static_cast<float *>(image_memory->host_pointer);
     voxel_grid.channels = image_memory->data_elements;
+    voxel_grid.grid_index = scene->image_manager->image_grid_index(voxel->slot);
     voxel_grids.push_back(voxel_grid);
+
+    voxel_grids_memory += image_memory->memory_size();
+    if (voxel_grid.grid_index) {
+      voxel_grids_memory += sparse_grid_index_size(resolution) * sizeof(int);
+    }
   }
 
   if (voxel_grids.empty()) {
@@ -447,19 +474,48 @@ void MeshManager::create_volume_mesh(Scene *scene, Mesh *mesh, Progress &progres
   VolumeMeshBuilder builder(&volume_params);
   const float isovalue = mesh->volume_isovalue;
 
-  for (int z = 0; z < resolution.z; ++z) {
-    for (int y = 0; y < resolution.y; ++y) {
-      for (int x = 0; x < resolution.x; ++x) {
-        size_t voxel_index = compute_voxel_index(resolution, x, y, z);
+  /* Visit the grids one tile at a time, so that tiles which are empty in all
+   * sparse grids are handled without looking at their voxels. */
+  for (int tz = 0; tz < resolution.z; tz += SPARSE_GRID_TILE_SIZE) {
+    for (int ty = 0; ty < resolution.y; ty += SPARSE_GRID_TILE_SIZE) {
+      for (int tx = 0; tx < resolution.x; tx += SPARSE_GRID_TILE_SIZE) {
+        const int3 tile_end = make_int3(min(tx + SPARSE_GRID_TILE_SIZE, resolution.x),
+                                        min(ty + SPARSE_GRID_TILE_SIZE, resolution.y),
+                                        min(tz + SPARSE_GRID_TILE_SIZE, resolution.z));
 
+        bool tile_is_empty = true;
         for (size_t i = 0; i < voxel_grids.size(); ++i) {
-          const VoxelAttributeGrid &voxel_grid = voxel_grids[i];
-          const int channels = voxel_grid.channels;
+          tile_is_empty &= voxel_grids[i].tile_is_empty(resolution, tx, ty, tz);
+        }
 
-          for (int c = 0; c < channels; c++) {
-            if (voxel_grid.data[voxel_index * channels + c] >= isovalue) {
-              builder.add_node_with_padding(x, y, z);
-              break;
+        /* All voxels of empty tiles are zero. */
+        if (tile_is_empty) {
+          if (0.0f >= isovalue) {
+            for (int z = tz; z < tile_end.z; ++z) {
+              for (int y = ty; y < tile_end.y; ++y) {
+                for (int x = tx; x < tile_end.x; ++x) {
+                  builder.add_node_with_padding(x, y, z);
+                }
+              }
+            }
+          }
+          continue;
+        }
+
+        for (int z = tz; z < tile_end.z; ++z) {
+          for (int y = ty; y < tile_end.y; ++y) {
+            for (int x = tx; x < tile_end.x; ++x) {
+              for (size_t i = 0; i < voxel_grids.size(); ++i) {
+                const VoxelAttributeGrid &voxel_grid = voxel_grids[i];
+                const int channels = voxel_grid.channels;
+
+                for (int c = 0; c < channels; c++) {
+                  if (voxel_grid.value(resolution, x, y, z, c) >= isovalue) {
+                    builder.add_node_with_padding(x, y, z);
+                    break;
+                  }
+                }
+              }
             }
           }
         }
@@ -499,9 +555,7 @@ void MeshManager::create_volume_mesh(Scene *scene, Mesh *mesh, Progress &progres
                  (1024.0 * 1024.0)
           << "Mb.";
 
-  VLOG(1) << "Memory usage volume grid: "
-          << (resolution.x * resolution.y * resolution.z * sizeof(float)) / (1024.0 * 1024.0)
-          << "Mb.";
+  VLOG(1) << "Memory usage volume grid: " << voxel_grids_memory / (1024.0 * 1024.0) << "Mb.";
 }
 
 CCL_NAMESPACE_END
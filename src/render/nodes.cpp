@@ -266,6 +266,10 @@ NODE_DEFINE(ImageTextureNode)
   SOCKET_FLOAT(projection_blend, "Projection Blend", 0.0f);
 
   SOCKET_IN_POINT(vector, "Vector", make_float3(0.0f, 0.0f, 0.0f), SocketType::LINK_TEXTURE_UV);
+  SOCKET_IN_POINT(
+      vector_dx, "VectorDx", make_float3(0.0f, 0.0f, 0.0f), SocketType::SVM_INTERNAL);
+  SOCKET_IN_POINT(
+      vector_dy, "VectorDy", make_float3(0.0f, 0.0f, 0.0f), SocketType::SVM_INTERNAL);
 
   SOCKET_OUT_COLOR(color, "Color");
   SOCKET_OUT_FLOAT(alpha, "Alpha");
@@ -415,6 +419,20 @@ void ImageTextureNode::compile(SVMCompiler &compiler)
     int vector_offset = tex_mapping.compile_begin(compiler, vector_in);
     uint flags = 0;
 
+    /* Shifted vectors are only linked when images use the texture cache. */
+    ShaderInput *vector_dx_in = input("VectorDx");
+    ShaderInput *vector_dy_in = input("VectorDy");
+    const bool use_derivatives = (projection != NODE_IMAGE_PROJ_BOX) && vector_dx_in->link &&
+                                 vector_dy_in->link;
+    int vector_dx_offset = SVM_STACK_INVALID;
+    int vector_dy_offset = SVM_STACK_INVALID;
+
+    if (use_derivatives) {
+      flags |= NODE_IMAGE_USE_DERIVATIVES;
+      vector_dx_offset = tex_mapping.compile_begin(compiler, vector_dx_in);
+      vector_dy_offset = tex_mapping.compile_begin(compiler, vector_dy_in);
+    }
+
     if (compress_as_srgb) {
       flags |= NODE_IMAGE_COMPRESS_AS_SRGB;
     }
@@ -446,6 +464,10 @@ void ImageTextureNode::compile(SVMCompiler &compiler)
                                                flags),
                         projection);
 
+      if (use_derivatives) {
+        compiler.add_node(vector_dx_offset, vector_dy_offset, 0, 0);
+      }
+
       if (num_nodes > 0) {
         for (int i = 0; i < num_nodes; i++) {
           int4 node;
@@ -474,6 +496,10 @@ void ImageTextureNode::compile(SVMCompiler &compiler)
                         __float_as_int(projection_blend));
     }
 
+    if (use_derivatives) {
+      tex_mapping.compile_end(compiler, vector_dx_in, vector_dx_offset);
+      tex_mapping.compile_end(compiler, vector_dy_in, vector_dy_offset);
+    }
     tex_mapping.compile_end(compiler, vector_in, vector_offset);
   }
   else {
@@ -81,6 +81,10 @@ class ImageSlotTextureNode : public TextureNode {
   }
   ~ImageSlotTextureNode();
   void add_image_user() const;
+  bool has_slot_dependency()
+  {
+    return true;
+  }
   ImageManager *image_manager;
   vector<int> slots;
 };
@@ -115,6 +119,9 @@ class ImageTextureNode : public ImageSlotTextureNode {
   float3 vector;
   ccl::vector<int> tiles;
 
+  /* Vector shifted by ray differentials, for mipmap level selection. */
+  float3 vector_dx, vector_dy;
+
   /* Runtime. */
   bool is_float;
   bool compress_as_srgb;
@@ -197,6 +204,10 @@ class OutputAOVNode : public ShaderNode {
  public:
   SHADER_NODE_CLASS(OutputAOVNode)
   virtual void simplify_settings(Scene *scene);
+  bool has_slot_dependency()
+  {
+    return true;
+  }
 
   float value;
   float3 color;
@@ -362,6 +373,10 @@ class PointDensityTextureNode : public ShaderNode {
   {
     return true;
   }
+  bool has_slot_dependency()
+  {
+    return true;
+  }
 
   void add_image();
 
@@ -394,6 +409,10 @@ class IESLightNode : public TextureNode {
   {
     return NODE_GROUP_LEVEL_2;
   }
+  bool has_slot_dependency()
+  {
+    return true;
+  }
 
   ustring filename;
   ustring ies;
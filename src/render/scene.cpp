@@ -34,9 +34,12 @@
 #include "render/tables.h"
 
 #include "util/util_foreach.h"
+#include "util/util_function.h"
 #include "util/util_guarded_allocator.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
+#include "util/util_set.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -73,6 +76,8 @@ DeviceScene::DeviceScene(Device *device)
       lights(device, "__lights", MEM_TEXTURE),
       light_background_marginal_cdf(device, "__light_background_marginal_cdf", MEM_TEXTURE),
       light_background_conditional_cdf(device, "__light_background_conditional_cdf", MEM_TEXTURE),
+      light_tree_nodes(device, "__light_tree_nodes", MEM_TEXTURE),
+      light_tree_prim_map(device, "__light_tree_prim_map", MEM_TEXTURE),
       particles(device, "__particles", MEM_TEXTURE),
       svm_nodes(device, "__svm_nodes", MEM_TEXTURE),
       shaders(device, "__shaders", MEM_TEXTURE),
@@ -81,6 +86,24 @@ DeviceScene::DeviceScene(Device *device)
       ies_lights(device, "__ies", MEM_TEXTURE)
 {
   memset((void *)&data, 0, sizeof(data));
+
+  /* Mesh geometry and attributes are paged out per mesh when they don't fit in
+   * memory. BVH arrays are accessed by every ray and always stay in memory. */
+  device_memory *geometry[] = {&tri_shader,
+                               &tri_vnormal,
+                               &tri_vindex,
+                               &tri_patch,
+                               &tri_patch_uv,
+                               &curves,
+                               &curve_keys,
+                               &patches,
+                               &attributes_float,
+                               &attributes_float2,
+                               &attributes_float3,
+                               &attributes_uchar4};
+  for (size_t i = 0; i < sizeof(geometry) / sizeof(*geometry); i++) {
+    geometry[i]->residency = &geometry_residency;
+  }
 }
 
 Scene::Scene(const SceneParams &params_, Device *device)
@@ -137,7 +160,7 @@ void Scene::free_memory(bool final)
     camera->device_free(device, &dscene, this);
     film->device_free(device, &dscene, this);
     background->device_free(device, &dscene);
-    integrator->device_free(device, &dscene);
+    integrator->device_free(device, &dscene, this);
 
     object_manager->device_free(device, &dscene);
     mesh_manager->device_free(device, &dscene);
@@ -175,6 +198,121 @@ void Scene::free_memory(bool final)
   }
 }
 
+/* Scene Update Graph
+ *
+ * Manager updates, each with the updates that compute data it uses. Updates run
+ * on the task scheduler once their dependencies are done. Most updates write to
+ * the device and to shared device scene data, which is not thread safe, so these
+ * run one at a time, in the order they were added when multiple are ready.
+ * Concurrent updates don't access the device and run in parallel with them. */
+
+class SceneUpdateGraph {
+ public:
+  typedef function<void(Progress &progress)> UpdateFunction;
+
+  SceneUpdateGraph(Device *device, Progress &progress)
+      : device(device), progress(progress), exclusive_running(false)
+  {
+  }
+
+  int add(const char *status, const UpdateFunction &update, bool concurrent = false)
+  {
+    Node node;
+    node.status = status;
+    node.update = update;
+    node.concurrent = concurrent;
+    node.num_dependencies = 0;
+    nodes.push_back(node);
+    return nodes.size() - 1;
+  }
+
+  void depends(int node, int dependency)
+  {
+    nodes[node].num_dependencies++;
+    nodes[dependency].dependents.push_back(node);
+  }
+
+  void run()
+  {
+    {
+      thread_scoped_lock lock(mutex);
+      for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].num_dependencies == 0) {
+          schedule(i);
+        }
+      }
+      schedule_exclusive();
+    }
+
+    pool.wait_work();
+  }
+
+ protected:
+  struct Node {
+    string status;
+    UpdateFunction update;
+    bool concurrent;
+    int num_dependencies;
+    vector<int> dependents;
+  };
+
+  /* Must be called with the mutex locked. */
+  void schedule(int index)
+  {
+    if (nodes[index].concurrent) {
+      pool.push(function_bind(&SceneUpdateGraph::run_node, this, index));
+    }
+    else {
+      ready_exclusive.insert(index);
+    }
+  }
+
+  void schedule_exclusive()
+  {
+    if (!exclusive_running && !ready_exclusive.empty()) {
+      const int index = *ready_exclusive.begin();
+      ready_exclusive.erase(ready_exclusive.begin());
+      exclusive_running = true;
+      pool.push(function_bind(&SceneUpdateGraph::run_node, this, index));
+    }
+  }
+
+  void run_node(int index)
+  {
+    Node &node = nodes[index];
+
+    /* Once cancelled, remaining updates are skipped but still complete. */
+    if (!progress.get_cancel() && !device->have_error()) {
+      if (!node.status.empty()) {
+        progress.set_status(node.status);
+      }
+      node.update(progress);
+    }
+
+    thread_scoped_lock lock(mutex);
+    if (!node.concurrent) {
+      exclusive_running = false;
+    }
+    foreach (int dependent, node.dependents) {
+      if (--nodes[dependent].num_dependencies == 0) {
+        schedule(dependent);
+      }
+    }
+    schedule_exclusive();
+  }
+
+  Device *device;
+  Progress &progress;
+
+  vector<Node> nodes;
+
+  thread_mutex mutex;
+  set<int> ready_exclusive;
+  bool exclusive_running;
+
+  TaskPool pool;
+};
+
 void Scene::device_update(Device *device_, Progress &progress)
 {
   if (!device)
@@ -182,114 +320,125 @@ void Scene::device_update(Device *device_, Progress &progress)
 
   bool print_stats = need_data_update();
 
-  /* The order of updates is important, because there's dependencies between
-   * the different managers, using data computed by previous managers.
+  /* The updates depend on data computed by other managers:
    *
-   * - Image manager uploads images used by shaders.
+   * - Image manager uploads images used by shaders, and loads them in parallel
+   *   with other updates. Meshes load the images they need for displacement
+   *   and volume bounds themselves.
    * - Camera may be used for adaptive subdivision.
+   * - Lookup tables are uploaded after shaders and camera added their tables.
    * - Displacement shader must have all shader data available.
    * - Light manager needs lookup tables and final mesh data to compute emission CDF.
    * - Film needs light manager to run for use_light_visibility
    * - Lookup tables are done a second time to handle film tables
    */
-
-  progress.set_status("Updating Shaders");
-  shader_manager->device_update(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Background");
-  background->device_update(device, &dscene, this);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Camera");
-  camera->device_update(device, &dscene, this);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  mesh_manager->device_update_preprocess(device, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Objects");
-  object_manager->device_update(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Hair Systems");
-  curve_system_manager->device_update(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Particle Systems");
-  particle_system_manager->device_update(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Meshes");
-  mesh_manager->device_update(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Objects Flags");
-  object_manager->device_update_flags(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Images");
-  image_manager->device_update(device, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Camera Volume");
-  camera->device_update_volume(device, &dscene, this);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Lookup Tables");
-  lookup_tables->device_update(device, &dscene);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Lights");
-  light_manager->device_update(device, &dscene, this, progress);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Integrator");
-  integrator->device_update(device, &dscene, this);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Film");
-  film->device_update(device, &dscene, this);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Lookup Tables");
-  lookup_tables->device_update(device, &dscene);
-
-  if (progress.get_cancel() || device->have_error())
-    return;
-
-  progress.set_status("Updating Baking");
-  bake_manager->device_update(device, &dscene, this, progress);
+  SceneUpdateGraph graph(device, progress);
+
+  const int shaders = graph.add(
+      "Updating Shaders",
+      function_bind(&ShaderManager::device_update, shader_manager, device, &dscene, this, _1));
+
+  const int background_update = graph.add(
+      "Updating Background",
+      function_bind(&Background::device_update, background, device, &dscene, this));
+  graph.depends(background_update, shaders);
+
+  const int camera_update = graph.add(
+      "Updating Camera", function_bind(&Camera::device_update, camera, device, &dscene, this));
+
+  const int meshes_preprocess = graph.add(
+      "",
+      function_bind(&MeshManager::device_update_preprocess, mesh_manager, device, this, _1));
+  graph.depends(meshes_preprocess, shaders);
+
+  const int images_preprocess = graph.add(
+      "Updating Images",
+      function_bind(&ImageManager::device_update_preprocess, image_manager, device));
+  graph.depends(images_preprocess, shaders);
+
+  const int images_load = graph.add(
+      "",
+      function_bind(&ImageManager::device_load_images, image_manager, device, this, _1),
+      true);
+  graph.depends(images_load, images_preprocess);
+
+  const int objects = graph.add(
+      "Updating Objects",
+      function_bind(&ObjectManager::device_update, object_manager, device, &dscene, this, _1));
+  graph.depends(objects, camera_update);
+  graph.depends(objects, meshes_preprocess);
+
+  const int hair = graph.add(
+      "Updating Hair Systems",
+      function_bind(
+          &CurveSystemManager::device_update, curve_system_manager, device, &dscene, this, _1));
+
+  const int particles = graph.add("Updating Particle Systems",
+                                  function_bind(&ParticleSystemManager::device_update,
+                                                particle_system_manager,
+                                                device,
+                                                &dscene,
+                                                this,
+                                                _1));
+
+  const int meshes = graph.add(
+      "Updating Meshes",
+      function_bind(&MeshManager::device_update, mesh_manager, device, &dscene, this, _1));
+  graph.depends(meshes, objects);
+  graph.depends(meshes, hair);
+  graph.depends(meshes, particles);
+
+  const int objects_flags = graph.add(
+      "Updating Objects Flags",
+      function_bind(
+          &ObjectManager::device_update_flags, object_manager, device, &dscene, this, _1, true));
+  graph.depends(objects_flags, meshes);
+
+  const int images_upload = graph.add(
+      "Updating Images",
+      function_bind(&ImageManager::device_upload_images, image_manager, device));
+  graph.depends(images_upload, images_load);
+
+  const int camera_volume = graph.add(
+      "Updating Camera Volume",
+      function_bind(&Camera::device_update_volume, camera, device, &dscene, this));
+  graph.depends(camera_volume, objects_flags);
+
+  const int lookup_tables_update = graph.add(
+      "Updating Lookup Tables",
+      function_bind(&LookupTables::device_update, lookup_tables, device, &dscene));
+  graph.depends(lookup_tables_update, shaders);
+  graph.depends(lookup_tables_update, camera_update);
+
+  const int lights = graph.add(
+      "Updating Lights",
+      function_bind(&LightManager::device_update, light_manager, device, &dscene, this, _1));
+  graph.depends(lights, background_update);
+  graph.depends(lights, objects_flags);
+  graph.depends(lights, images_upload);
+  graph.depends(lights, lookup_tables_update);
+
+  const int integrator_update = graph.add(
+      "Updating Integrator",
+      function_bind(&Integrator::device_update, integrator, device, &dscene, this));
+  graph.depends(integrator_update, lights);
+
+  const int film_update = graph.add(
+      "Updating Film", function_bind(&Film::device_update, film, device, &dscene, this));
+  graph.depends(film_update, integrator_update);
+
+  const int film_lookup_tables = graph.add(
+      "Updating Lookup Tables",
+      function_bind(&LookupTables::device_update, lookup_tables, device, &dscene));
+  graph.depends(film_lookup_tables, film_update);
+
+  const int bake = graph.add(
+      "Updating Baking",
+      function_bind(&BakeManager::device_update, bake_manager, device, &dscene, this, _1));
+  graph.depends(bake, camera_volume);
+  graph.depends(bake, film_lookup_tables);
+
+  graph.run();
 
   if (progress.get_cancel() || device->have_error())
     return;
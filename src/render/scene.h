@@ -62,6 +62,10 @@ class RenderStats;
 
 class DeviceScene {
  public:
+  /* Residency of mesh geometry and attributes, which may be paged out to disk.
+   * Declared first so it outlives the memory attached to it. */
+  DeviceMemoryResidency geometry_residency;
+
   /* BVH */
   device_vector<int4> bvh_nodes;
   device_vector<int4> bvh_leaf_nodes;
@@ -107,6 +111,8 @@ class DeviceScene {
   device_vector<KernelLight> lights;
   device_vector<float2> light_background_marginal_cdf;
   device_vector<float2> light_background_conditional_cdf;
+  device_vector<KernelLightTreeNode> light_tree_nodes;
+  device_vector<int> light_tree_prim_map;
 
   /* particles */
   device_vector<KernelParticle> particles;
@@ -167,8 +173,21 @@ class SceneParams {
   bool use_bvh_spatial_split;
   bool use_bvh_unaligned_nodes;
   int num_bvh_time_steps;
+  /* Share triangle vertices between the mesh and the BVH when the layout supports it. */
+  bool use_bvh_indexed_triangles;
   bool persistent_data;
   int texture_limit;
+  /* Memory budget in megabytes for image textures loaded on demand, zero to load
+   * images fully into memory. */
+  int texture_cache_size;
+  /* Memory budget in megabytes for mesh geometry and attributes, zero for no
+   * limit. Meshes that don't fit are paged in from files in the cache path,
+   * or the system temporary directory when empty. */
+  int geometry_memory_limit;
+  string geometry_cache_path;
+  /* Directory where SVM nodes of compiled shaders are kept to be reused by later
+   * sessions, disabled when empty. */
+  string shader_cache_path;
 
   bool background;
 
@@ -180,8 +199,11 @@ class SceneParams {
     use_bvh_spatial_split = false;
     use_bvh_unaligned_nodes = true;
     num_bvh_time_steps = 0;
+    use_bvh_indexed_triangles = false;
     persistent_data = false;
     texture_limit = 0;
+    texture_cache_size = 0;
+    geometry_memory_limit = 0;
     background = true;
   }
 
@@ -192,7 +214,12 @@ class SceneParams {
              use_bvh_spatial_split == params.use_bvh_spatial_split &&
              use_bvh_unaligned_nodes == params.use_bvh_unaligned_nodes &&
              num_bvh_time_steps == params.num_bvh_time_steps &&
-             persistent_data == params.persistent_data && texture_limit == params.texture_limit);
+             use_bvh_indexed_triangles == params.use_bvh_indexed_triangles &&
+             persistent_data == params.persistent_data && texture_limit == params.texture_limit &&
+             texture_cache_size == params.texture_cache_size &&
+             geometry_memory_limit == params.geometry_memory_limit &&
+             geometry_cache_path == params.geometry_cache_path &&
+             shader_cache_path == params.shader_cache_path);
   }
 };
 
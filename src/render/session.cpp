@@ -72,6 +72,10 @@ Session::Session(const SessionParams &params_)
     display = new DisplayBuffer(device, params.display_buffer_linear);
   }
 
+  /* Tiles can move between devices when each of them has its own buffers. */
+  tile_manager.use_work_stealing = (buffers == NULL);
+  tiles_idle_time = 0.0;
+
   session_thread = NULL;
   scene = NULL;
 
@@ -387,8 +391,12 @@ bool Session::acquire_tile(Device *tile_device, RenderTile &rtile)
   Tile *tile;
   int device_num = device->device_number(tile_device);
 
-  if (!tile_manager.next_tile(tile, device_num))
+  if (!tile_manager.next_tile(tile, device_num)) {
+    if (tiles_idle_time == 0.0) {
+      tiles_idle_time = time_dt();
+    }
     return false;
+  }
 
   /* fill render tile */
   rtile.x = tile_manager.state.buffer.full_x + tile->x;
@@ -656,6 +664,25 @@ void Session::run_cpu()
 
     device->task_wait();
 
+    if (!no_tiles) {
+      /* Measure how long devices waited for the last tiles of the pass. */
+      thread_scoped_lock tile_lock(tile_mutex);
+      const double tail_time = (tiles_idle_time != 0.0) ? time_dt() - tiles_idle_time : 0.0;
+
+      tile_stats.num_passes++;
+      tile_stats.num_tiles += tile_manager.state.num_tiles;
+      tile_stats.num_stolen_tiles += tile_manager.state.num_stolen_tiles;
+      tile_stats.num_split_tiles += tile_manager.state.num_split_tiles;
+      tile_stats.tail_time += tail_time;
+      tile_stats.max_tail_time = max(tile_stats.max_tail_time, tail_time);
+      tiles_idle_time = 0.0;
+
+      VLOG(2) << "Rendered " << tile_manager.state.num_tiles << " tiles, "
+              << tile_manager.state.num_stolen_tiles << " stolen, "
+              << tile_manager.state.num_split_tiles << " split, tail time " << tail_time
+              << "s.";
+    }
+
     {
       thread_scoped_lock reset_lock(delayed_reset.mutex);
       thread_scoped_lock buffers_lock(buffers_mutex);
@@ -896,11 +923,12 @@ bool Session::update_scene()
   }
 
   /* number of samples is needed by multi jittered
-   * sampling pattern and by baking */
+   * sampling pattern, by adaptive sampling and by baking */
   Integrator *integrator = scene->integrator;
   BakeManager *bake_manager = scene->bake_manager;
 
-  if (integrator->sampling_pattern == SAMPLING_PATTERN_CMJ || bake_manager->get_baking()) {
+  if (integrator->sampling_pattern == SAMPLING_PATTERN_CMJ || bake_manager->get_baking() ||
+      Pass::contains(scene->film->passes, PASS_ADAPTIVE_AUX_BUFFER)) {
     int aa_samples = tile_manager.num_samples;
 
     if (aa_samples != integrator->aa_samples) {
@@ -1025,6 +1053,13 @@ void Session::render()
   task.requested_tile_size = params.tile_size;
   task.passes_size = tile_manager.params.get_passes_size();
 
+  if (Pass::contains(scene->film->passes, PASS_ADAPTIVE_AUX_BUFFER)) {
+    const KernelIntegrator &kintegrator = scene->dscene.data.integrator;
+    task.adaptive_sampling.use = true;
+    task.adaptive_sampling.min_samples = kintegrator.adaptive_min_samples;
+    task.adaptive_sampling.adaptive_step = kintegrator.adaptive_step;
+  }
+
   if (params.run_denoising) {
     task.denoising = params.denoising;
 
@@ -1126,6 +1161,7 @@ void Session::device_free()
 void Session::collect_statistics(RenderStats *render_stats)
 {
   scene->collect_statistics(render_stats);
+  render_stats->tiles = tile_stats;
   if (params.use_profiling && (params.device.type == DEVICE_CPU)) {
     render_stats->collect_profiling(scene, profiler);
   }
@@ -219,6 +219,11 @@ class Session {
 
   double reset_time;
 
+  /* Tile scheduling statistics, and the time at which a device first ran out
+   * of tiles in the current pass. */
+  TileStats tile_stats;
+  double tiles_idle_time;
+
   /* progressive refine */
   double last_update_time;
   bool update_progressive_refine(bool cancel);
@@ -198,7 +198,7 @@ string NamedSampleCountStats::full_report(int indent_level)
 
 /* Mesh statistics. */
 
-MeshStats::MeshStats()
+MeshStats::MeshStats() : num_out_of_core_meshes(0), mapped_size(0)
 {
 }
 
@@ -207,6 +207,12 @@ string MeshStats::full_report(int indent_level)
   const string indent(indent_level * kIndentNumSpaces, ' ');
   string result = "";
   result += indent + "Geometry:\n" + geometry.full_report(indent_level + 1);
+  if (num_out_of_core_meshes != 0) {
+    result += indent +
+              string_printf("Out of core: %d meshes, %s mapped from disk\n",
+                            num_out_of_core_meshes,
+                            string_human_readable_size(mapped_size).c_str());
+  }
   return result;
 }
 
@@ -221,6 +227,71 @@ string ImageStats::full_report(int indent_level)
   const string indent(indent_level * kIndentNumSpaces, ' ');
   string result = "";
   result += indent + "Textures:\n" + textures.full_report(indent_level + 1);
+  if (!texture_cache.empty()) {
+    result += indent + "Texture cache:\n" + texture_cache;
+  }
+  return result;
+}
+
+/* BVH statistics. */
+
+BVHStats::BVHStats()
+    : nodes_size(0),
+      leaf_nodes_size(0),
+      full_precision_nodes_size(0),
+      triangles_size(0),
+      use_indexed_triangles(false),
+      build_time(0.0)
+{
+}
+
+string BVHStats::full_report(int indent_level)
+{
+  const string indent(indent_level * kIndentNumSpaces, ' ');
+  string result = "";
+  result += string_printf("%sLayout: %s\n", indent.c_str(), layout.c_str());
+  result += string_printf(
+      "%sInner nodes: %s\n", indent.c_str(), string_human_readable_size(nodes_size).c_str());
+  if (full_precision_nodes_size != 0) {
+    result += string_printf("%sInner nodes at full precision: %s (%.1f%% saved)\n",
+                            indent.c_str(),
+                            string_human_readable_size(full_precision_nodes_size).c_str(),
+                            100.0 * (1.0 - (double)nodes_size / full_precision_nodes_size));
+  }
+  result += string_printf(
+      "%sLeaf nodes: %s\n", indent.c_str(), string_human_readable_size(leaf_nodes_size).c_str());
+  result += string_printf("%sTriangles: %s (%s)\n",
+                          indent.c_str(),
+                          string_human_readable_size(triangles_size).c_str(),
+                          (use_indexed_triangles) ? "indexed" : "copied");
+  result += string_printf("%sBuild time: %.2fs\n", indent.c_str(), build_time);
+  return result;
+}
+
+/* Tile statistics. */
+
+TileStats::TileStats()
+    : num_passes(0),
+      num_tiles(0),
+      num_stolen_tiles(0),
+      num_split_tiles(0),
+      tail_time(0.0),
+      max_tail_time(0.0)
+{
+}
+
+string TileStats::full_report(int indent_level)
+{
+  const string indent(indent_level * kIndentNumSpaces, ' ');
+  string result = "";
+  result += string_printf("%sPasses: %d\n", indent.c_str(), num_passes);
+  result += string_printf("%sTiles: %d\n", indent.c_str(), num_tiles);
+  result += string_printf("%sStolen tiles: %d\n", indent.c_str(), num_stolen_tiles);
+  result += string_printf("%sSplit tiles: %d\n", indent.c_str(), num_split_tiles);
+  result += string_printf("%sTail time: %.2fs (max %.2fs per pass)\n",
+                          indent.c_str(),
+                          tail_time,
+                          max_tail_time);
   return result;
 }
 
@@ -305,7 +376,9 @@ string RenderStats::full_report()
 {
   string result = "";
   result += "Mesh statistics:\n" + mesh.full_report(1);
+  result += "BVH statistics:\n" + bvh.full_report(1);
   result += "Image statistics:\n" + image.full_report(1);
+  result += "Tile statistics:\n" + tiles.full_report(1);
   if (has_profiling) {
     result += "Kernel statistics:\n" + kernel.full_report(1);
     result += "Shader statistics:\n" + shaders.full_report(1);
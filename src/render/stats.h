@@ -122,6 +122,11 @@ class MeshStats {
    * memory like BVH.
    */
   NamedSizeStats geometry;
+
+  /* Meshes over the geometry memory limit, and the size of the device
+   * arrays backed by files on disk instead of RAM. */
+  int num_out_of_core_meshes;
+  size_t mapped_size;
 };
 
 /* Statistics about images held in memory. */
@@ -133,6 +138,54 @@ class ImageStats {
   string full_report(int indent_level = 0);
 
   NamedSizeStats textures;
+
+  /* Report of the texture cache, empty when images are fully loaded. */
+  string texture_cache;
+};
+
+/* Statistics about tile scheduling, accumulated over all rendered passes. */
+class TileStats {
+ public:
+  TileStats();
+
+  /* Generate full human-readable report. */
+  string full_report(int indent_level = 0);
+
+  int num_passes;
+  int num_tiles;
+  int num_stolen_tiles;
+  int num_split_tiles;
+
+  /* Time from the first device running out of tiles until the last tile of
+   * the pass was done. */
+  double tail_time;
+  double max_tail_time;
+};
+
+/* Statistics about the BVH used for ray traversal. */
+class BVHStats {
+ public:
+  BVHStats();
+
+  /* Generate full human-readable report. */
+  string full_report(int indent_level = 0);
+
+  string layout;
+
+  /* Memory used by inner and leaf nodes, in bytes. */
+  size_t nodes_size;
+  size_t leaf_nodes_size;
+
+  /* Memory inner nodes would use with full precision bounds, for layouts with
+   * quantized nodes. Zero for other layouts. */
+  size_t full_precision_nodes_size;
+
+  /* Memory used by triangle vertices and their indices for intersection, in bytes. */
+  size_t triangles_size;
+  bool use_indexed_triangles;
+
+  /* Time spent building and packing all BVH's in the last update. */
+  double build_time;
 };
 
 /* Render process statistics. */
@@ -149,7 +202,9 @@ class RenderStats {
   bool has_profiling;
 
   MeshStats mesh;
+  BVHStats bvh;
   ImageStats image;
+  TileStats tiles;
   NamedNestedSampleStats kernel;
   NamedSampleCountStats shaders;
   NamedSampleCountStats objects;
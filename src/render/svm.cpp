@@ -25,14 +25,178 @@
 
 #include "util/util_logging.h"
 #include "util/util_foreach.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
 #include "util/util_progress.h"
 #include "util/util_task.h"
+#include "util/util_version.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Shader Cache */
+
+/* Version of the files in the shader cache path, to be increased whenever the
+ * nodes generated for a graph or the file layout change. */
+static const uint SVM_SHADER_CACHE_VERSION = 1;
+
+/* Offset for named attribute IDs, beyond the attribute IDs of any scene. */
+static const uint SVM_NAMED_ATTRIBUTE_OFFSET = (1 << 20);
+
+enum SVMShaderFlag {
+  SVM_SHADER_HAS_SURFACE = (1 << 0),
+  SVM_SHADER_HAS_SURFACE_EMISSION = (1 << 1),
+  SVM_SHADER_HAS_SURFACE_TRANSPARENT = (1 << 2),
+  SVM_SHADER_HAS_SURFACE_BSSRDF = (1 << 3),
+  SVM_SHADER_HAS_BUMP = (1 << 4),
+  SVM_SHADER_HAS_BSSRDF_BUMP = (1 << 5),
+  SVM_SHADER_HAS_VOLUME = (1 << 6),
+  SVM_SHADER_HAS_DISPLACEMENT = (1 << 7),
+  SVM_SHADER_HAS_SURFACE_SPATIAL_VARYING = (1 << 8),
+  SVM_SHADER_HAS_VOLUME_SPATIAL_VARYING = (1 << 9),
+  SVM_SHADER_HAS_OBJECT_DEPENDENCY = (1 << 10),
+  SVM_SHADER_HAS_ATTRIBUTE_DEPENDENCY = (1 << 11),
+  SVM_SHADER_HAS_INTEGRATOR_DEPENDENCY = (1 << 12),
+};
+
+/* Shader flags which are set by SVMCompiler::generate(). */
+static uint svm_shader_flags(const Shader *shader)
+{
+  uint flags = 0;
+  flags |= (shader->has_surface) ? SVM_SHADER_HAS_SURFACE : 0;
+  flags |= (shader->has_surface_emission) ? SVM_SHADER_HAS_SURFACE_EMISSION : 0;
+  flags |= (shader->has_surface_transparent) ? SVM_SHADER_HAS_SURFACE_TRANSPARENT : 0;
+  flags |= (shader->has_surface_bssrdf) ? SVM_SHADER_HAS_SURFACE_BSSRDF : 0;
+  flags |= (shader->has_bump) ? SVM_SHADER_HAS_BUMP : 0;
+  flags |= (shader->has_bssrdf_bump) ? SVM_SHADER_HAS_BSSRDF_BUMP : 0;
+  flags |= (shader->has_volume) ? SVM_SHADER_HAS_VOLUME : 0;
+  flags |= (shader->has_displacement) ? SVM_SHADER_HAS_DISPLACEMENT : 0;
+  flags |= (shader->has_surface_spatial_varying) ? SVM_SHADER_HAS_SURFACE_SPATIAL_VARYING : 0;
+  flags |= (shader->has_volume_spatial_varying) ? SVM_SHADER_HAS_VOLUME_SPATIAL_VARYING : 0;
+  flags |= (shader->has_object_dependency) ? SVM_SHADER_HAS_OBJECT_DEPENDENCY : 0;
+  flags |= (shader->has_attribute_dependency) ? SVM_SHADER_HAS_ATTRIBUTE_DEPENDENCY : 0;
+  flags |= (shader->has_integrator_dependency) ? SVM_SHADER_HAS_INTEGRATOR_DEPENDENCY : 0;
+  return flags;
+}
+
+static void svm_set_shader_flags(Shader *shader, uint flags)
+{
+  shader->has_surface = (flags & SVM_SHADER_HAS_SURFACE) != 0;
+  shader->has_surface_emission = (flags & SVM_SHADER_HAS_SURFACE_EMISSION) != 0;
+  shader->has_surface_transparent = (flags & SVM_SHADER_HAS_SURFACE_TRANSPARENT) != 0;
+  shader->has_surface_bssrdf = (flags & SVM_SHADER_HAS_SURFACE_BSSRDF) != 0;
+  shader->has_bump = (flags & SVM_SHADER_HAS_BUMP) != 0;
+  shader->has_bssrdf_bump = (flags & SVM_SHADER_HAS_BSSRDF_BUMP) != 0;
+  shader->has_volume = (flags & SVM_SHADER_HAS_VOLUME) != 0;
+  shader->has_displacement = (flags & SVM_SHADER_HAS_DISPLACEMENT) != 0;
+  shader->has_surface_spatial_varying = (flags & SVM_SHADER_HAS_SURFACE_SPATIAL_VARYING) != 0;
+  shader->has_volume_spatial_varying = (flags & SVM_SHADER_HAS_VOLUME_SPATIAL_VARYING) != 0;
+  shader->has_object_dependency = (flags & SVM_SHADER_HAS_OBJECT_DEPENDENCY) != 0;
+  shader->has_attribute_dependency = (flags & SVM_SHADER_HAS_ATTRIBUTE_DEPENDENCY) != 0;
+  shader->has_integrator_dependency = (flags & SVM_SHADER_HAS_INTEGRATOR_DEPENDENCY) != 0;
+}
+
+static bool svm_shader_cacheable(const ShaderGraph *graph)
+{
+  foreach (ShaderNode *node, graph->nodes) {
+    if (node->has_slot_dependency()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Hash of everything the SVM nodes of a shader are generated from, which is the
+ * same in every session. Named attributes are hashed by name, their IDs in the
+ * nodes are set by the session that loads them. */
+static string svm_shader_hash(Shader *shader, bool has_bump, bool background)
+{
+  MD5Hash md5;
+
+  map<ShaderNode *, int> node_index;
+  foreach (ShaderNode *node, shader->graph->nodes) {
+    const int index = node_index.size();
+    node_index[node] = index;
+  }
+
+  foreach (ShaderNode *node, shader->graph->nodes) {
+    node->hash(md5);
+    /* Copies of nodes for bump mapping only differ in how they are compiled. */
+    md5.append((const uint8_t *)&node->bump, sizeof(node->bump));
+
+    foreach (ShaderInput *input, node->inputs) {
+      int link[2] = {-1, -1};
+      if (input->link) {
+        ShaderNode *parent = input->link->parent;
+        link[0] = node_index[parent];
+        for (int i = 0; i < parent->outputs.size(); i++) {
+          if (parent->outputs[i] == input->link) {
+            link[1] = i;
+          }
+        }
+      }
+      md5.append((const uint8_t *)link, sizeof(link));
+    }
+  }
+
+  const int settings[4] = {shader->used, shader->displacement_method, has_bump, background};
+  md5.append((const uint8_t *)settings, sizeof(settings));
+
+  return md5.get_hex();
+}
+
+template<typename T> static void svm_cache_write(vector<uint8_t> &data, const T &value)
+{
+  const uint8_t *bytes = (const uint8_t *)&value;
+  data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+static void svm_cache_write(vector<uint8_t> &data, const string &str)
+{
+  svm_cache_write(data, (uint)str.size());
+  data.insert(data.end(), str.begin(), str.end());
+}
+
+/* Reads values from a shader cache file, failing at the end of the file. */
+class SVMCacheReader {
+ public:
+  explicit SVMCacheReader(const vector<uint8_t> &data) : data(data), offset(0)
+  {
+  }
+
+  template<typename T> bool read(T &value)
+  {
+    if (data.size() - offset < sizeof(T)) {
+      return false;
+    }
+    memcpy((void *)&value, &data[offset], sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  bool read(string &str)
+  {
+    uint size;
+    if (!read(size) || data.size() - offset < size) {
+      return false;
+    }
+    str.assign((const char *)&data[offset], size);
+    offset += size;
+    return true;
+  }
+
+ protected:
+  const vector<uint8_t> &data;
+  size_t offset;
+};
+
+static string svm_shader_cache_filename(Scene *scene, const string &key)
+{
+  return path_join(scene->params.shader_cache_path, key + ".svm");
+}
+
 /* Shader Manager */
 
-SVMShaderManager::SVMShaderManager()
+SVMShaderManager::SVMShaderManager() : num_updates(0)
 {
 }
 
@@ -42,12 +206,15 @@ SVMShaderManager::~SVMShaderManager()
 
 void SVMShaderManager::reset(Scene * /*scene*/)
 {
+  thread_scoped_lock lock(cache_mutex);
+  cache.clear();
 }
 
 void SVMShaderManager::device_update_shader(Scene *scene,
                                             Shader *shader,
                                             Progress *progress,
-                                            array<int4> *svm_nodes)
+                                            array<int4> *svm_nodes,
+                                            SVMCompiler::Summary *summary)
 {
   if (progress->get_cancel()) {
     return;
@@ -56,14 +223,201 @@ void SVMShaderManager::device_update_shader(Scene *scene,
 
   svm_nodes->push_back_slow(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
 
-  SVMCompiler::Summary summary;
+  const double time_start = time_dt();
+
   SVMCompiler compiler(scene);
   compiler.background = (shader == scene->default_background);
-  compiler.compile(shader, *svm_nodes, 0, &summary);
+  const bool has_bump = compiler.finalize(shader, summary);
+
+  /* Reuse the nodes of an identical graph compiled before, by this manager or by
+   * an earlier session that stored them in the shader cache path. */
+  const bool use_cache = svm_shader_cacheable(shader->graph);
+  string key;
+  if (use_cache) {
+    key = svm_shader_hash(shader, has_bump, compiler.background);
+
+    thread_scoped_lock lock(cache_mutex);
+    map<string, CachedShader>::iterator it = cache.find(key);
+    if (it == cache.end() && !scene->params.shader_cache_path.empty()) {
+      CachedShader cached;
+      if (load_cached_shader(scene, key, cached)) {
+        it = cache.insert(std::make_pair(key, cached)).first;
+      }
+    }
+    if (it != cache.end()) {
+      CachedShader &cached = it->second;
+      cached.update = num_updates;
+      *svm_nodes = cached.svm_nodes;
+      svm_set_shader_flags(shader, cached.shader_flags);
+
+      summary->num_svm_nodes = svm_nodes->size() - 1;
+      summary->peak_stack_usage = cached.peak_stack_usage;
+      summary->time_total = time_dt() - time_start;
+
+      VLOG(2) << "Compilation summary:\n"
+              << "Shader name: " << shader->name << " (cached)\n"
+              << summary->full_report();
+      return;
+    }
+  }
+
+  compiler.generate(shader, has_bump, *svm_nodes, 0, summary);
+  summary->time_total = time_dt() - time_start;
+
+  if (use_cache) {
+    vector<CachedAttribute> attributes;
+    const bool save = !scene->params.shader_cache_path.empty() &&
+                      find_cached_attributes(
+                          scene, shader, has_bump, compiler, *svm_nodes, attributes);
+
+    thread_scoped_lock lock(cache_mutex);
+    CachedShader &cached = cache[key];
+    cached.svm_nodes = *svm_nodes;
+    cached.peak_stack_usage = summary->peak_stack_usage;
+    cached.shader_flags = svm_shader_flags(shader);
+    cached.update = num_updates;
+
+    if (save) {
+      save_cached_shader(scene, key, cached, attributes);
+    }
+  }
 
   VLOG(2) << "Compilation summary:\n"
           << "Shader name: " << shader->name << "\n"
-          << summary.full_report();
+          << summary->full_report();
+}
+
+/* Find where the IDs of named attributes are in the nodes, by generating them
+ * again with those IDs offset and comparing. Fails if the nodes differ in any
+ * other way, in which case they are not stored. */
+bool SVMShaderManager::find_cached_attributes(Scene *scene,
+                                              Shader *shader,
+                                              bool has_bump,
+                                              const SVMCompiler &compiler,
+                                              const array<int4> &svm_nodes,
+                                              vector<CachedAttribute> &attributes)
+{
+  attributes.clear();
+
+  if (compiler.named_attributes.empty()) {
+    return true;
+  }
+
+  SVMCompiler offset_compiler(scene);
+  offset_compiler.background = compiler.background;
+  offset_compiler.named_attribute_offset = SVM_NAMED_ATTRIBUTE_OFFSET;
+
+  array<int4> offset_nodes;
+  offset_nodes.push_back_slow(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+  offset_compiler.generate(shader, has_bump, offset_nodes, 0);
+
+  if (offset_nodes.size() != svm_nodes.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < svm_nodes.size(); i++) {
+    for (int component = 0; component < 4; component++) {
+      const uint id = svm_nodes[i][component];
+      const uint offset_id = offset_nodes[i][component];
+      if (id == offset_id) {
+        continue;
+      }
+
+      map<uint, ustring>::const_iterator it = compiler.named_attributes.find(id);
+      if (it == compiler.named_attributes.end() ||
+          offset_id != id + SVM_NAMED_ATTRIBUTE_OFFSET) {
+        return false;
+      }
+
+      CachedAttribute attribute;
+      attribute.node = i;
+      attribute.component = component;
+      attribute.name = it->second;
+      attributes.push_back(attribute);
+    }
+  }
+
+  return true;
+}
+
+bool SVMShaderManager::load_cached_shader(Scene *scene, const string &key, CachedShader &cached)
+{
+  const string filename = svm_shader_cache_filename(scene, key);
+
+  vector<uint8_t> data;
+  if (!path_exists(filename) || !path_read_binary(filename, data)) {
+    return false;
+  }
+
+  SVMCacheReader reader(data);
+  uint version, num_nodes, num_attributes;
+  string cycles_version;
+
+  if (!reader.read(version) || version != SVM_SHADER_CACHE_VERSION ||
+      !reader.read(cycles_version) || cycles_version != CYCLES_VERSION_STRING ||
+      !reader.read(cached.shader_flags) || !reader.read(cached.peak_stack_usage) ||
+      !reader.read(num_nodes) || num_nodes > data.size() / sizeof(int4)) {
+    VLOG(1) << "Ignoring outdated shader cache file " << filename << ".";
+    return false;
+  }
+
+  cached.svm_nodes.resize(num_nodes);
+  for (uint i = 0; i < num_nodes; i++) {
+    if (!reader.read(cached.svm_nodes[i])) {
+      return false;
+    }
+  }
+
+  /* Named attributes get the IDs of this session. */
+  if (!reader.read(num_attributes)) {
+    return false;
+  }
+  for (uint i = 0; i < num_attributes; i++) {
+    int node, component;
+    string name;
+    if (!reader.read(node) || !reader.read(component) || !reader.read(name) || node < 0 ||
+        (uint)node >= num_nodes || component < 0 || component >= 4) {
+      return false;
+    }
+    cached.svm_nodes[node][component] = scene->shader_manager->get_attribute_id(ustring(name));
+  }
+
+  VLOG(1) << "Loaded shader from cache file " << filename << ".";
+  return true;
+}
+
+void SVMShaderManager::save_cached_shader(Scene *scene,
+                                          const string &key,
+                                          const CachedShader &cached,
+                                          const vector<CachedAttribute> &attributes)
+{
+  /* Named attributes are stored by name, without the IDs of this session. */
+  array<int4> svm_nodes = cached.svm_nodes;
+  foreach (const CachedAttribute &attribute, attributes) {
+    svm_nodes[attribute.node][attribute.component] = 0;
+  }
+
+  vector<uint8_t> data;
+  svm_cache_write(data, SVM_SHADER_CACHE_VERSION);
+  svm_cache_write(data, string(CYCLES_VERSION_STRING));
+  svm_cache_write(data, cached.shader_flags);
+  svm_cache_write(data, cached.peak_stack_usage);
+  svm_cache_write(data, (uint)svm_nodes.size());
+  for (size_t i = 0; i < svm_nodes.size(); i++) {
+    svm_cache_write(data, svm_nodes[i]);
+  }
+
+  svm_cache_write(data, (uint)attributes.size());
+  foreach (const CachedAttribute &attribute, attributes) {
+    svm_cache_write(data, attribute.node);
+    svm_cache_write(data, attribute.component);
+    svm_cache_write(data, attribute.name.string());
+  }
+
+  const string filename = svm_shader_cache_filename(scene, key);
+  if (!path_write_binary(filename, data)) {
+    VLOG(1) << "Failed to write shader cache file " << filename << ".";
+  }
 }
 
 void SVMShaderManager::device_update(Device *device,
@@ -87,19 +441,32 @@ void SVMShaderManager::device_update(Device *device,
   device_update_shaders_used(scene);
 
   /* Build all shaders. */
+  num_updates++;
   TaskPool task_pool;
   vector<array<int4>> shader_svm_nodes(num_shaders);
+  vector<SVMCompiler::Summary> summaries(num_shaders);
   for (int i = 0; i < num_shaders; i++) {
     task_pool.push(function_bind(&SVMShaderManager::device_update_shader,
                                  this,
                                  scene,
                                  scene->shaders[i],
                                  &progress,
-                                 &shader_svm_nodes[i]),
+                                 &shader_svm_nodes[i],
+                                 &summaries[i]),
                    false);
   }
   task_pool.wait_work();
 
+  /* Forget the nodes of graphs no shader has anymore. */
+  for (map<string, CachedShader>::iterator it = cache.begin(); it != cache.end();) {
+    if (it->second.update != num_updates) {
+      cache.erase(it++);
+    }
+    else {
+      ++it;
+    }
+  }
+
   if (progress.get_cancel()) {
     return;
   }
@@ -178,6 +545,7 @@ SVMCompiler::SVMCompiler(Scene *scene) : scene(scene)
   background = false;
   mix_weight_offset = SVM_STACK_INVALID;
   compile_failed = false;
+  named_attribute_offset = 0;
 }
 
 int SVMCompiler::stack_size(SocketType::Type type)
@@ -403,7 +771,9 @@ void SVMCompiler::add_node(const float4 &f)
 
 uint SVMCompiler::attribute(ustring name)
 {
-  return scene->shader_manager->get_attribute_id(name);
+  const uint id = scene->shader_manager->get_attribute_id(name);
+  named_attributes[id] = name;
+  return id + named_attribute_offset;
 }
 
 uint SVMCompiler::attribute(AttributeStandard std)
@@ -834,12 +1204,21 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
 }
 
 void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Summary *summary)
+{
+  const double time_start = time_dt();
+
+  const bool has_bump = finalize(shader, summary);
+  generate(shader, has_bump, svm_nodes, index, summary);
+
+  if (summary != NULL) {
+    summary->time_total = time_dt() - time_start;
+  }
+}
+
+bool SVMCompiler::finalize(Shader *shader, Summary *summary)
 {
   /* copy graph for shader with bump mapping */
   ShaderNode *output = shader->graph->output();
-  int start_num_svm_nodes = svm_nodes.size();
-
-  const double time_start = time_dt();
 
   bool has_bump = (shader->displacement_method != DISPLACE_TRUE) &&
                   output->input("Surface")->link && output->input("Displacement")->link;
@@ -853,6 +1232,14 @@ void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Sum
                             shader->displacement_method == DISPLACE_BOTH);
   }
 
+  return has_bump;
+}
+
+void SVMCompiler::generate(
+    Shader *shader, bool has_bump, array<int4> &svm_nodes, int index, Summary *summary)
+{
+  int start_num_svm_nodes = svm_nodes.size();
+
   current_shader = shader;
 
   shader->has_surface = false;
@@ -907,7 +1294,6 @@ void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Sum
 
   /* Fill in summary information. */
   if (summary != NULL) {
-    summary->time_total = time_dt() - time_start;
     summary->peak_stack_usage = max_stack_use;
     summary->num_svm_nodes = svm_nodes.size() - start_num_svm_nodes;
   }
@@ -22,6 +22,7 @@
 #include "render/shader.h"
 
 #include "util/util_array.h"
+#include "util/util_map.h"
 #include "util/util_set.h"
 #include "util/util_string.h"
 #include "util/util_thread.h"
@@ -37,25 +38,6 @@ class ShaderInput;
 class ShaderNode;
 class ShaderOutput;
 
-/* Shader Manager */
-
-class SVMShaderManager : public ShaderManager {
- public:
-  SVMShaderManager();
-  ~SVMShaderManager();
-
-  void reset(Scene *scene);
-
-  void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress &progress);
-  void device_free(Device *device, DeviceScene *dscene, Scene *scene);
-
- protected:
-  void device_update_shader(Scene *scene,
-                            Shader *shader,
-                            Progress *progress,
-                            array<int4> *svm_nodes);
-};
-
 /* Graph Compiler */
 
 class SVMCompiler {
@@ -96,6 +78,13 @@ class SVMCompiler {
   SVMCompiler(Scene *scene);
   void compile(Shader *shader, array<int4> &svm_nodes, int index, Summary *summary = NULL);
 
+  /* The two steps of compile(), for callers that look at the finalized graph
+   * before generating nodes. finalize() returns whether a bump shader is to
+   * be generated. */
+  bool finalize(Shader *shader, Summary *summary = NULL);
+  void generate(
+      Shader *shader, bool has_bump, array<int4> &svm_nodes, int index, Summary *summary = NULL);
+
   int stack_assign(ShaderOutput *output);
   int stack_assign(ShaderInput *input);
   int stack_assign_if_linked(ShaderInput *input);
@@ -127,6 +116,13 @@ class SVMCompiler {
   ShaderGraph *current_graph;
   bool background;
 
+  /* Names of the attributes looked up by name, by their ID. Their IDs are only
+   * valid in the current session, unlike those of standard attributes. */
+  map<uint, ustring> named_attributes;
+  /* Offset added to the IDs of named attributes in the generated nodes, to find
+   * where the IDs are stored by comparing with nodes generated without it. */
+  uint named_attribute_offset;
+
  protected:
   /* stack */
   struct Stack {
@@ -223,6 +219,62 @@ class SVMCompiler {
   bool compile_failed;
 };
 
+/* Shader Manager */
+
+class SVMShaderManager : public ShaderManager {
+ public:
+  SVMShaderManager();
+  ~SVMShaderManager();
+
+  void reset(Scene *scene);
+
+  void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress &progress);
+  void device_free(Device *device, DeviceScene *dscene, Scene *scene);
+
+ protected:
+  /* SVM nodes generated from a finalized shader graph, reused for shaders
+   * with an identical graph and by later updates. */
+  struct CachedShader {
+    array<int4> svm_nodes;
+    int peak_stack_usage;
+    /* Shader flags set by the compiler, see svm_shader_flags(). */
+    uint shader_flags;
+    /* Last device update that used the nodes. */
+    int update;
+  };
+
+  /* Location of the ID of a named attribute in cached nodes, so nodes stored
+   * on disk can get the IDs of the session that loads them. */
+  struct CachedAttribute {
+    int node;
+    int component;
+    ustring name;
+  };
+
+  thread_mutex cache_mutex;
+  map<string, CachedShader> cache;
+  int num_updates;
+
+  void device_update_shader(Scene *scene,
+                            Shader *shader,
+                            Progress *progress,
+                            array<int4> *svm_nodes,
+                            SVMCompiler::Summary *summary);
+
+  /* Shaders stored in the shader cache path, to reuse nodes across sessions. */
+  bool find_cached_attributes(Scene *scene,
+                              Shader *shader,
+                              bool has_bump,
+                              const SVMCompiler &compiler,
+                              const array<int4> &svm_nodes,
+                              vector<CachedAttribute> &attributes);
+  bool load_cached_shader(Scene *scene, const string &key, CachedShader &cached);
+  void save_cached_shader(Scene *scene,
+                          const string &key,
+                          const CachedShader &cached,
+                          const vector<CachedAttribute> &attributes);
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __SVM_H__ */
@@ -106,6 +106,7 @@ TileManager::TileManager(bool progressive_,
   preserve_tile_device = preserve_tile_device_;
   background = background_;
   schedule_denoising = false;
+  use_work_stealing = false;
 
   range_start_sample = 0;
   range_num_samples = -1;
@@ -157,6 +158,8 @@ void TileManager::reset(BufferParams &params_, int num_samples_)
   state.resolution_divider = get_divider(params.width, params.height, start_resolution);
   state.render_tiles.clear();
   state.denoising_tiles.clear();
+  state.num_stolen_tiles = 0;
+  state.num_split_tiles = 0;
   device_free();
 }
 
@@ -374,6 +377,7 @@ void TileManager::set_tiles()
   int image_h = max(1, params.height / resolution);
 
   state.num_tiles = gen_tiles(!background);
+  state.tiles.reserve(state.tiles.size() + SPLIT_TILES_PER_DEVICE * num_devices);
 
   state.buffer.width = image_w;
   state.buffer.height = image_h;
@@ -491,15 +495,102 @@ bool TileManager::next_tile(Tile *&tile, int device)
     return true;
   }
 
-  if (state.render_tiles[logical_device].empty())
+  int idx;
+  if (!state.render_tiles[logical_device].empty()) {
+    idx = state.render_tiles[logical_device].front();
+    state.render_tiles[logical_device].pop_front();
+  }
+  else if (!steal_tile(logical_device, idx)) {
     return false;
+  }
+
+  split_tile(idx, logical_device);
 
-  int idx = state.render_tiles[logical_device].front();
-  state.render_tiles[logical_device].pop_front();
   tile = &state.tiles[idx];
   return true;
 }
 
+/* Takes a tile from the device with the most tiles left. The tile is taken from
+ * the end of its list, which that device would have rendered last. */
+bool TileManager::steal_tile(int logical_device, int &index)
+{
+  if (!use_work_stealing) {
+    return false;
+  }
+
+  int victim = -1;
+  size_t victim_num_tiles = 0;
+  for (int i = 0; i < state.render_tiles.size(); i++) {
+    const list<int> &tiles = state.render_tiles[i];
+    /* Tiles which already have buffers are bound to the device they were allocated on. */
+    if (tiles.size() > victim_num_tiles && state.tiles[tiles.back()].buffers == NULL) {
+      victim = i;
+      victim_num_tiles = tiles.size();
+    }
+  }
+
+  if (victim == -1) {
+    return false;
+  }
+
+  index = state.render_tiles[victim].back();
+  state.render_tiles[victim].pop_back();
+
+  /* Later samples of progressive refine and denoising follow the tile. */
+  state.tiles[index].device = logical_device;
+  state.num_stolen_tiles++;
+
+  return true;
+}
+
+/* When there are fewer tiles left than devices, some devices are about to run
+ * out of work while others still render whole tiles. Split the tile into
+ * pieces which the other devices can pick up or steal. */
+void TileManager::split_tile(int index, int logical_device)
+{
+  if (!use_work_stealing || schedule_denoising || state.tiles[index].buffers != NULL) {
+    return;
+  }
+
+  size_t num_remaining = 0;
+  foreach (const list<int> &tiles, state.render_tiles) {
+    num_remaining += tiles.size();
+  }
+  if (num_remaining >= (size_t)num_devices) {
+    return;
+  }
+
+  const Tile tile = state.tiles[index];
+  const int num_x = (tile.w >= 2 * MIN_SPLIT_TILE_SIZE) ? 2 : 1;
+  const int num_y = (tile.h >= 2 * MIN_SPLIT_TILE_SIZE) ? 2 : 1;
+  const int num_pieces = num_x * num_y;
+
+  if (num_pieces == 1 || state.tiles.size() + num_pieces - 1 > state.tiles.capacity()) {
+    return;
+  }
+
+  /* The tile keeps the first piece, the others are rendered next. */
+  const int w = tile.w / num_x, h = tile.h / num_y;
+  for (int y = 0; y < num_y; y++) {
+    for (int x = 0; x < num_x; x++) {
+      if (x == 0 && y == 0) {
+        continue;
+      }
+      const int piece_w = (x == num_x - 1) ? tile.w - x * w : w;
+      const int piece_h = (y == num_y - 1) ? tile.h - y * h : h;
+      const int piece_index = state.tiles.size();
+      state.tiles.push_back(Tile(
+          piece_index, tile.x + x * w, tile.y + y * h, piece_w, piece_h, logical_device));
+      state.render_tiles[logical_device].push_front(piece_index);
+    }
+  }
+
+  state.tiles[index].w = w;
+  state.tiles[index].h = h;
+  state.num_tiles += num_pieces - 1;
+  state.num_split_tiles++;
+}
+
 bool TileManager::done()
 {
   int end_sample = (range_num_samples == -1) ? num_samples :
@@ -513,6 +604,9 @@ bool TileManager::next()
   if (done())
     return false;
 
+  state.num_stolen_tiles = 0;
+  state.num_split_tiles = 0;
+
   if (progressive && state.resolution_divider > pixel_size) {
     state.sample = 0;
     state.resolution_divider = max(state.resolution_divider / 2, pixel_size);
@@ -86,6 +86,11 @@ class TileManager {
      * Each list in each vector is for one logical device. */
     vector<list<int>> render_tiles;
     vector<list<int>> denoising_tiles;
+
+    /* Number of tiles taken from the list of another device, and of tiles split
+     * into smaller pieces near the end of the frame, since the last next(). */
+    int num_stolen_tiles;
+    int num_split_tiles;
   } state;
 
   int num_samples;
@@ -128,7 +133,19 @@ class TileManager {
   /* Schedule tiles for denoising after they've been rendered. */
   bool schedule_denoising;
 
+  /* Let devices which ran out of tiles take tiles from other devices, and split
+   * the remaining tiles into smaller pieces near the end of the frame. Only
+   * possible when every tile gets its own buffers, since shared buffers are
+   * sliced between devices. */
+  bool use_work_stealing;
+
  protected:
+  /* Extra tiles which may be created by splitting, per device. Reserved ahead
+   * so tile pointers handed out stay valid. */
+  enum { SPLIT_TILES_PER_DEVICE = 16 };
+  /* Tiles are not split into pieces smaller than this. */
+  enum { MIN_SPLIT_TILE_SIZE = 16 };
+
   void set_tiles();
 
   bool progressive;
@@ -161,6 +178,9 @@ class TileManager {
   int gen_tiles(bool sliced);
   void gen_render_tiles();
 
+  bool steal_tile(int logical_device, int &index);
+  void split_tile(int index, int logical_device);
+
   int get_neighbor_index(int index, int neighbor);
   bool check_neighbor_state(int index, Tile::State state);
 };
@@ -0,0 +1,283 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "bvh/bvh_binning.h"
+#include "bvh/bvh_build.h"
+#include "bvh/bvh_node.h"
+
+#include "render/mesh.h"
+#include "render/object.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_math.h"
+#include "util/util_hash.h"
+#include "util/util_progress.h"
+#include "util/util_system.h"
+#include "util/util_task.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+float3 random_point(uint seed, uint i)
+{
+  return make_float3(hash_uint3_to_float(seed, i, 0),
+                     hash_uint3_to_float(seed, i, 1),
+                     hash_uint3_to_float(seed, i, 2)) *
+         100.0f;
+}
+
+/* Small boxes scattered through the scene, like the references of a triangle soup. */
+BVHRange make_references(int num, vector<BVHReference> &references)
+{
+  BoundBox bounds = BoundBox::empty, center = BoundBox::empty;
+
+  references.clear();
+  for (int i = 0; i < num; i++) {
+    const float3 P = random_point(1, i);
+    const BoundBox prim_bounds(P, P + make_float3(0.1f, 0.2f, 0.3f));
+    references.push_back(BVHReference(prim_bounds, i, 0, PRIMITIVE_TRIANGLE));
+    bounds.grow(prim_bounds);
+    center.grow(prim_bounds.center2());
+  }
+
+  return BVHRange(bounds, center, 0, num);
+}
+
+/* Checks that the bounds of the range are exactly those of its references. */
+void check_range(const BVHRange &range, const vector<BVHReference> &references)
+{
+  BoundBox bounds = BoundBox::empty, center = BoundBox::empty;
+  for (int i = range.start(); i < range.end(); i++) {
+    bounds.grow(references[i].bounds());
+    center.grow(references[i].bounds().center2());
+  }
+
+  EXPECT_TRUE(bounds.min == range.bounds().min && bounds.max == range.bounds().max);
+  EXPECT_TRUE(center.min == range.cent_bounds().min && center.max == range.cent_bounds().max);
+}
+
+vector<int> sorted_prim_indices(const vector<BVHReference> &references, int start, int end)
+{
+  vector<int> indices;
+  for (int i = start; i < end; i++) {
+    indices.push_back(references[i].prim_index());
+  }
+  sort(indices.begin(), indices.end());
+  return indices;
+}
+
+void split_references(int num)
+{
+  vector<BVHReference> references;
+  const BVHRange root = make_references(num, references);
+
+  BVHObjectBinning range(root, &references[0]);
+  BVHObjectBinning left, right;
+  range.split(&references[0], left, right);
+
+  /* Partition keeps all references and splits them into two non-empty ranges. */
+  ASSERT_GT(left.size(), 0);
+  ASSERT_GT(right.size(), 0);
+  EXPECT_EQ(left.start(), 0);
+  EXPECT_EQ(right.start(), left.size());
+  EXPECT_EQ(left.size() + right.size(), num);
+
+  vector<int> all_indices;
+  for (int i = 0; i < num; i++) {
+    all_indices.push_back(i);
+  }
+  EXPECT_EQ(sorted_prim_indices(references, 0, num), all_indices);
+
+  check_range(left, references);
+  check_range(right, references);
+
+  /* Centroids are separated along the split dimension. */
+  bool separated = false;
+  for (int dim = 0; dim < 3; dim++) {
+    separated |= left.cent_bounds().max[dim] <= right.cent_bounds().min[dim];
+  }
+  EXPECT_TRUE(separated);
+
+  /* The split only depends on the set of references, not their order. */
+  vector<BVHReference> reversed(references.rbegin(), references.rend());
+  BVHObjectBinning reversed_range(root, &reversed[0]);
+  BVHObjectBinning reversed_left, reversed_right;
+  reversed_range.split(&reversed[0], reversed_left, reversed_right);
+
+  EXPECT_EQ(reversed_range.splitSAH, range.splitSAH);
+  EXPECT_EQ(sorted_prim_indices(reversed, 0, reversed_left.size()),
+            sorted_prim_indices(references, 0, left.size()));
+}
+
+/* Triangle soup with some larger triangles, which overlap enough to be split. */
+void make_triangle_soup(Mesh &mesh, int num_triangles)
+{
+  mesh.reserve_mesh(num_triangles * 3, num_triangles);
+  for (int i = 0; i < num_triangles; i++) {
+    const float3 P = random_point(2, i);
+    const float size = (i % 16 == 0) ? 20.0f : 0.5f;
+    mesh.add_vertex(P);
+    mesh.add_vertex(P + make_float3(size, 0.0f, 0.0f));
+    mesh.add_vertex(P + make_float3(0.0f, size, size * 0.5f));
+    mesh.add_triangle(3 * i, 3 * i + 1, 3 * i + 2, 0, false);
+  }
+}
+
+/* Counts how many leaves reference each slot of the packed arrays. */
+void count_leaf_prims(const BVHNode *node, vector<int> &count)
+{
+  if (node->is_leaf()) {
+    const LeafNode *leaf = (const LeafNode *)node;
+    for (int i = leaf->lo; i < leaf->hi; i++) {
+      ASSERT_GE(i, 0);
+      ASSERT_LT(i, (int)count.size());
+      count[i]++;
+    }
+    return;
+  }
+
+  for (int i = 0; i < node->num_children(); i++) {
+    count_leaf_prims(node->get_child(i), count);
+  }
+}
+
+}  // namespace
+
+TEST(bvh_build, binning_split)
+{
+  TaskScheduler::init(0);
+  split_references(1000);
+  TaskScheduler::exit();
+}
+
+TEST(bvh_build, binning_split_parallel)
+{
+  /* Large enough to be binned and partitioned in parallel. */
+  TaskScheduler::init(0);
+  split_references(200000);
+  TaskScheduler::exit();
+}
+
+TEST(bvh_build, spatial_split)
+{
+  /* Large enough for the root to be binned in parallel. */
+  const int num_triangles = 1 << 16;
+
+  Mesh mesh;
+  make_triangle_soup(mesh, num_triangles);
+
+  Object object;
+  object.mesh = &mesh;
+  vector<Object *> objects;
+  objects.push_back(&object);
+
+  BVHParams params;
+  params.use_spatial_split = true;
+
+  TaskScheduler::init(0);
+
+  array<int> prim_type, prim_index, prim_object;
+  array<float2> prim_time;
+  Progress progress;
+
+  BVHBuild bvh_build(objects, prim_type, prim_index, prim_object, prim_time, params, progress);
+  BVHNode *root = bvh_build.run();
+
+  TaskScheduler::exit();
+
+  ASSERT_TRUE(root != NULL);
+
+  /* Split triangles are referenced multiple times, but every slot of the
+   * packed arrays belongs to exactly one leaf. */
+  EXPECT_GT(prim_index.size(), (size_t)num_triangles);
+  EXPECT_EQ(prim_type.size(), prim_index.size());
+  EXPECT_EQ(prim_object.size(), prim_index.size());
+
+  vector<int> count(prim_index.size(), 0);
+  count_leaf_prims(root, count);
+  for (size_t i = 0; i < count.size(); i++) {
+    EXPECT_EQ(count[i], 1);
+  }
+
+  vector<bool> found(num_triangles, false);
+  for (size_t i = 0; i < prim_index.size(); i++) {
+    ASSERT_GE(prim_index[i], 0);
+    ASSERT_LT(prim_index[i], num_triangles);
+    found[prim_index[i]] = true;
+  }
+  for (int i = 0; i < num_triangles; i++) {
+    EXPECT_TRUE(found[i]);
+  }
+
+  root->deleteSubtree();
+}
+
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(bvh_build, DISABLED_benchmark)
+{
+  const int num_triangles = 1 << 18;
+
+  Mesh mesh;
+  make_triangle_soup(mesh, num_triangles);
+
+  Object object;
+  object.mesh = &mesh;
+  vector<Object *> objects;
+  objects.push_back(&object);
+
+  /* Report build throughput as the number of threads grows. */
+  const int max_threads = system_cpu_thread_count();
+  for (int use_spatial_split = 0; use_spatial_split < 2; use_spatial_split++) {
+    BVHParams params;
+    params.use_spatial_split = use_spatial_split;
+
+    for (int num_threads = 1;; num_threads = min(num_threads * 2, max_threads)) {
+      TaskScheduler::init(num_threads);
+
+      array<int> prim_type, prim_index, prim_object;
+      array<float2> prim_time;
+      Progress progress;
+
+      const double start_time = time_dt();
+      BVHBuild bvh_build(objects, prim_type, prim_index, prim_object, prim_time, params, progress);
+      BVHNode *root = bvh_build.run();
+      const double build_time = time_dt() - start_time;
+
+      EXPECT_GE(prim_index.size(), (size_t)num_triangles);
+      EXPECT_TRUE(root != NULL);
+      if (root != NULL) {
+        root->deleteSubtree();
+      }
+
+      TaskScheduler::exit();
+
+      printf("BVH build%s with %d threads: %.2f M triangles/s\n",
+             use_spatial_split ? " (spatial splits)" : "",
+             num_threads,
+             num_triangles / build_time * 1e-6);
+
+      if (num_threads == max_threads) {
+        break;
+      }
+    }
+  }
+}
+
+CCL_NAMESPACE_END
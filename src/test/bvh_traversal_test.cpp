@@ -0,0 +1,638 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The BVH traversal kernel is compiled into this test, with AVX2 and packet
+ * traversal when the test is built with AVX2 flags, see CMakeLists.txt. */
+
+#include "util/util_optimization.h"
+
+#if defined(WITH_CYCLES_OPTIMIZED_KERNEL_AVX2) && defined(__AVX2__)
+#  define __KERNEL_SSE__
+#  define __KERNEL_SSE2__
+#  define __KERNEL_SSE3__
+#  define __KERNEL_SSSE3__
+#  define __KERNEL_SSE41__
+#  define __KERNEL_AVX__
+#  define __KERNEL_AVX2__
+#endif
+
+#include "testing/testing.h"
+
+#include <sstream>
+
+#include "bvh/bvh.h"
+#include "bvh/bvh_params.h"
+
+#include "render/mesh.h"
+#include "render/object.h"
+
+#include "kernel/kernel.h"
+#include "kernel/kernel_compat_cpu.h"
+#include "kernel/kernel_math.h"
+#include "kernel/kernel_types.h"
+#include "kernel/split/kernel_split_data.h"
+#include "kernel/kernel_globals.h"
+#include "kernel/kernels/cpu/kernel_cpu_image.h"
+#include "kernel/kernel_random.h"
+#include "kernel/kernel_projection.h"
+#include "kernel/geom/geom.h"
+#include "kernel/bvh/bvh.h"
+
+#include "util/util_hash.h"
+#include "util/util_path.h"
+#include "util/util_progress.h"
+#include "util/util_system.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+const char *example_objects[] = {"cube.xml", "sphere.xml", "suzanne.xml"};
+
+#ifdef __KERNEL_AVX2__
+const BVHLayout default_layout = BVH_LAYOUT_BVH8;
+#else
+const BVHLayout default_layout = BVH_LAYOUT_BVH2;
+#endif
+
+template<typename T> bool read_attribute(const string &xml, const string &name, vector<T> &values)
+{
+  const string key = " " + name + "=\"";
+  size_t start = xml.find(key);
+  if (start == string::npos) {
+    return false;
+  }
+  start += key.size();
+
+  std::istringstream stream(xml.substr(start, xml.find('"', start) - start));
+  T value;
+  while (stream >> value) {
+    values.push_back(value);
+  }
+  return !values.empty();
+}
+
+/* Read the mesh of an example object, with polygons split into triangle fans
+ * like the XML reader of the standalone application does. */
+bool read_example_mesh(const string &filename, Mesh &mesh)
+{
+  string xml;
+  vector<float> P;
+  vector<int> nverts, verts;
+  if (!path_read_text(path_join(CYCLES_EXAMPLES_DIR, path_join("objects", filename)), xml) ||
+      !read_attribute(xml, "P", P) || !read_attribute(xml, "nverts", nverts) ||
+      !read_attribute(xml, "verts", verts)) {
+    return false;
+  }
+
+  int num_triangles = 0;
+  for (size_t i = 0; i < nverts.size(); i++) {
+    num_triangles += nverts[i] - 2;
+  }
+
+  mesh.reserve_mesh(P.size() / 3, num_triangles);
+  for (size_t i = 0; i + 2 < P.size(); i += 3) {
+    mesh.add_vertex(make_float3(P[i], P[i + 1], P[i + 2]));
+  }
+
+  int index_offset = 0;
+  for (size_t i = 0; i < nverts.size(); i++) {
+    for (int j = 0; j < nverts[i] - 2; j++) {
+      mesh.add_triangle(verts[index_offset],
+                        verts[index_offset + j + 1],
+                        verts[index_offset + j + 2],
+                        0,
+                        false);
+    }
+    index_offset += nverts[i];
+  }
+
+  mesh.compute_bounds();
+  return true;
+}
+
+/* Kernel data for a single mesh, traversed without instancing. */
+class TraversalScene {
+ public:
+  Mesh mesh;
+  Object object;
+  BVH *bvh;
+  KernelGlobals *kg;
+
+  /* Mesh vertices and triangle vertex indices for indexed triangles. */
+  array<float4> verts;
+  array<uint4> tri_vindex;
+
+  TraversalScene() : bvh(NULL), kg(NULL)
+  {
+  }
+
+  ~TraversalScene()
+  {
+    delete kg;
+    delete bvh;
+  }
+
+  bool load(const string &filename,
+            BVHLayout layout = default_layout,
+            bool use_indexed_triangles = false)
+  {
+    if (!read_example_mesh(filename, mesh)) {
+      return false;
+    }
+
+    object.mesh = &mesh;
+    object.bounds = mesh.bounds;
+
+    build(layout, use_indexed_triangles);
+    return true;
+  }
+
+  void build(BVHLayout layout = default_layout, bool use_indexed_triangles = false)
+  {
+    vector<Mesh *> meshes(1, &mesh);
+    vector<Object *> objects(1, &object);
+
+    BVHParams params;
+    params.bvh_layout = layout;
+    params.use_indexed_triangles = use_indexed_triangles;
+
+    Progress progress;
+    delete bvh;
+    bvh = BVH::create(params, meshes, objects);
+    bvh->build(progress);
+
+    copy_to_kernel();
+  }
+
+  /* Move the object like a transform applied to the mesh does for objects
+   * that are not instanced, without updating the BVH. */
+  void apply_transform(const Transform &tfm)
+  {
+    object.tfm = tfm;
+    object.apply_transform(false);
+    object.tfm = transform_identity();
+    mesh.compute_bounds();
+    object.bounds = mesh.bounds;
+  }
+
+  void refit()
+  {
+    Progress progress;
+    bvh->refit(progress);
+
+    copy_to_kernel();
+  }
+
+  void copy_to_kernel()
+  {
+    const BVHParams &params = bvh->params;
+    const bool use_indexed_triangles = params.use_indexed_triangles;
+
+    PackedBVH &pack = bvh->pack;
+    delete kg;
+    kg = new KernelGlobals();
+    kernel_tex_copy(kg, "__bvh_nodes", pack.nodes.data(), pack.nodes.size());
+    kernel_tex_copy(kg, "__bvh_leaf_nodes", pack.leaf_nodes.data(), pack.leaf_nodes.size());
+    kernel_tex_copy(
+        kg, "__prim_tri_index", pack.prim_tri_index.data(), pack.prim_tri_index.size());
+    if (use_indexed_triangles) {
+      verts.resize(mesh.verts.size());
+      for (size_t i = 0; i < mesh.verts.size(); i++) {
+        verts[i] = float3_to_float4(mesh.verts[i]);
+      }
+      tri_vindex.resize(mesh.num_triangles());
+      for (size_t i = 0; i < mesh.num_triangles(); i++) {
+        const Mesh::Triangle t = mesh.get_triangle(i);
+        tri_vindex[i] = make_uint4(t.v[0], t.v[1], t.v[2], -1);
+      }
+      kernel_tex_copy(kg, "__prim_tri_verts", verts.data(), verts.size());
+      kernel_tex_copy(kg, "__tri_vindex", tri_vindex.data(), tri_vindex.size());
+    }
+    else {
+      kernel_tex_copy(
+          kg, "__prim_tri_verts", pack.prim_tri_verts.data(), pack.prim_tri_verts.size());
+    }
+    kernel_tex_copy(kg, "__prim_type", pack.prim_type.data(), pack.prim_type.size());
+    kernel_tex_copy(
+        kg, "__prim_visibility", pack.prim_visibility.data(), pack.prim_visibility.size());
+    kernel_tex_copy(kg, "__prim_index", pack.prim_index.data(), pack.prim_index.size());
+    kernel_tex_copy(kg, "__prim_object", pack.prim_object.data(), pack.prim_object.size());
+
+    kernel_data.bvh.root = pack.root_index;
+    kernel_data.bvh.bvh_layout = params.bvh_layout;
+    kernel_data.bvh.use_indexed_triangles = use_indexed_triangles;
+  }
+
+  /* Camera rays through a grid of pixels, in rows like the CPU device traces them. */
+  void camera_rays(int resolution, vector<Ray> &rays) const
+  {
+    const float3 center = mesh.bounds.center();
+    const float radius = len(mesh.bounds.size()) * 0.5f;
+    const float3 P = center + make_float3(0.3f, -2.5f, 0.6f) * radius;
+    const float3 forward = normalize(center - P);
+    const float3 right = normalize(cross(forward, make_float3(0.0f, 0.0f, 1.0f)));
+    const float3 up = cross(right, forward);
+
+    rays.resize(resolution * resolution);
+    for (int y = 0; y < resolution; y++) {
+      for (int x = 0; x < resolution; x++) {
+        const float u = (x + 0.5f) / resolution - 0.5f, v = (y + 0.5f) / resolution - 0.5f;
+        Ray &ray = rays[x + y * resolution];
+        ray.P = P;
+        ray.D = normalize(forward + (u * right + v * up) * 0.8f);
+        ray.t = FLT_MAX;
+        ray.time = 0.5f;
+      }
+    }
+  }
+
+  /* Rays from points below the mesh towards a light above it. */
+  void shadow_rays(int resolution, vector<Ray> &rays) const
+  {
+    const float3 center = mesh.bounds.center();
+    const float radius = len(mesh.bounds.size()) * 0.5f;
+    const float3 light = center + make_float3(0.2f, 0.1f, 3.0f) * radius;
+
+    rays.resize(resolution * resolution);
+    for (int y = 0; y < resolution; y++) {
+      for (int x = 0; x < resolution; x++) {
+        const float u = (x + 0.5f) / resolution - 0.5f, v = (y + 0.5f) / resolution - 0.5f;
+        Ray &ray = rays[x + y * resolution];
+        ray.P = center + make_float3(u * 2.0f, v * 2.0f, -1.5f) * radius;
+        ray.D = normalize_len(light - ray.P, &ray.t);
+        ray.time = 0.5f;
+      }
+    }
+  }
+
+  /* Rays in random directions from random points, as for indirect bounces. */
+  void random_rays(int num, vector<Ray> &rays) const
+  {
+    const float3 center = mesh.bounds.center();
+    const float radius = len(mesh.bounds.size()) * 0.5f;
+
+    rays.resize(num);
+    for (int i = 0; i < num; i++) {
+      const float3 offset = make_float3(hash_uint3_to_float(i, 0, 0),
+                                        hash_uint3_to_float(i, 1, 0),
+                                        hash_uint3_to_float(i, 2, 0));
+      const float3 dir = make_float3(hash_uint3_to_float(i, 3, 0),
+                                     hash_uint3_to_float(i, 4, 0),
+                                     hash_uint3_to_float(i, 5, 0));
+      Ray &ray = rays[i];
+      ray.P = center + (offset * 2.0f - make_float3(1.0f, 1.0f, 1.0f)) * radius;
+      ray.D = normalize(dir - make_float3(0.5f, 0.5f, 0.5f));
+      ray.t = FLT_MAX;
+      ray.time = 0.5f;
+    }
+  }
+
+  uint intersect_single(const Ray *rays, int num_rays, uint visibility, Intersection *isects)
+  {
+    uint hit_mask = 0;
+    for (int i = 0; i < num_rays; i++) {
+      if (scene_intersect(kg, &rays[i], visibility, &isects[i])) {
+        hit_mask |= (1u << i);
+      }
+    }
+    return hit_mask;
+  }
+
+  uint intersect_packet(const Ray *rays, int num_rays, uint visibility, Intersection *isects)
+  {
+    return scene_intersect_packet(kg, rays, num_rays, visibility, isects);
+  }
+};
+
+/* Compare packet against single ray traversal, for all rays in packets of
+ * consecutive rays. */
+void check_packets(TraversalScene &scene, const vector<Ray> &rays, uint visibility)
+{
+  int num_hits = 0;
+
+  for (size_t start = 0; start < rays.size(); start += BVH_PACKET_SIZE) {
+    const int num_rays = min((int)(rays.size() - start), BVH_PACKET_SIZE);
+    Intersection single[BVH_PACKET_SIZE], packet[BVH_PACKET_SIZE];
+
+    const uint single_mask = scene.intersect_single(&rays[start], num_rays, visibility, single);
+    const uint packet_mask = scene.intersect_packet(&rays[start], num_rays, visibility, packet);
+    ASSERT_EQ(packet_mask, single_mask);
+
+    for (int i = 0; i < num_rays; i++) {
+      if (single_mask & (1u << i)) {
+        num_hits++;
+        if (visibility != PATH_RAY_SHADOW_OPAQUE) {
+          EXPECT_FLOAT_EQ(packet[i].t, single[i].t);
+        }
+      }
+      else {
+        EXPECT_EQ(packet[i].prim, PRIM_NONE);
+      }
+    }
+  }
+
+  /* Make sure rays are actually hitting the mesh. */
+  EXPECT_GT(num_hits, 0);
+}
+
+/* Compare closest hits of two scenes with the same mesh, which must be the
+ * same triangles of the mesh, whatever order their BVHs store them in. Unless
+ * the leaves are the same, distances can differ in rounding, since BVH8 leaves
+ * intersect up to eight triangles at once. */
+void check_same_hits(TraversalScene &a,
+                     TraversalScene &b,
+                     const vector<Ray> &rays,
+                     bool same_leaves = true)
+{
+  int num_hits = 0;
+
+  for (size_t i = 0; i < rays.size(); i++) {
+    Intersection a_isect, b_isect;
+    const bool a_hit = scene_intersect(a.kg, &rays[i], PATH_RAY_ALL_VISIBILITY, &a_isect);
+    const bool b_hit = scene_intersect(b.kg, &rays[i], PATH_RAY_ALL_VISIBILITY, &b_isect);
+    ASSERT_EQ(b_hit, a_hit);
+    if (a_hit) {
+      num_hits++;
+      EXPECT_EQ(b.bvh->pack.prim_index[b_isect.prim], a.bvh->pack.prim_index[a_isect.prim]);
+      if (same_leaves) {
+        EXPECT_EQ(b_isect.t, a_isect.t);
+      }
+      else {
+        EXPECT_NEAR(b_isect.t, a_isect.t, 1e-5f * max(a_isect.t, 1.0f));
+      }
+    }
+  }
+
+  EXPECT_GT(num_hits, 0);
+}
+
+/* Rays per second when traced in packets or one by one. */
+double trace_rays(TraversalScene &scene, const vector<Ray> &rays, uint visibility, bool packets)
+{
+  const int num_passes = 8;
+  Intersection isects[BVH_PACKET_SIZE];
+
+  const double start_time = time_dt();
+  for (int pass = 0; pass < num_passes; pass++) {
+    for (size_t start = 0; start < rays.size(); start += BVH_PACKET_SIZE) {
+      const int num_rays = min((int)(rays.size() - start), BVH_PACKET_SIZE);
+      if (packets) {
+        scene.intersect_packet(&rays[start], num_rays, visibility, isects);
+      }
+      else {
+        scene.intersect_single(&rays[start], num_rays, visibility, isects);
+      }
+    }
+  }
+  return num_passes * rays.size() / (time_dt() - start_time);
+}
+
+bool have_kernel_support()
+{
+#ifdef __KERNEL_AVX2__
+  if (!system_cpu_support_avx2()) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+}  // namespace
+
+TEST(bvh_traversal, packet_matches_single_ray)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    TraversalScene scene;
+    ASSERT_TRUE(scene.load(example_objects[i])) << example_objects[i];
+
+    vector<Ray> rays;
+    scene.camera_rays(64, rays);
+    check_packets(scene, rays, PATH_RAY_CAMERA);
+
+    scene.shadow_rays(64, rays);
+    check_packets(scene, rays, PATH_RAY_SHADOW_OPAQUE);
+
+    /* Incoherent rays, which can't be culled by the packet frustum. */
+    scene.random_rays(4096, rays);
+    check_packets(scene, rays, PATH_RAY_DIFFUSE);
+  }
+}
+
+#ifdef __KERNEL_AVX2__
+/* Closest hits of quantized and full precision nodes must be the same, since
+ * quantized bounds are conservative. */
+TEST(bvh_traversal, quantized_matches_full_precision)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    TraversalScene full, quantized;
+    ASSERT_TRUE(full.load(example_objects[i], BVH_LAYOUT_BVH8)) << example_objects[i];
+    ASSERT_TRUE(quantized.load(example_objects[i], BVH_LAYOUT_BVH8_QUANTIZED))
+        << example_objects[i];
+    EXPECT_LT(quantized.bvh->pack.nodes.size(), full.bvh->pack.nodes.size());
+
+    vector<Ray> rays;
+    full.camera_rays(64, rays);
+    check_same_hits(full, quantized, rays);
+    check_packets(quantized, rays, PATH_RAY_CAMERA);
+
+    full.shadow_rays(64, rays);
+    check_packets(quantized, rays, PATH_RAY_SHADOW_OPAQUE);
+
+    full.random_rays(4096, rays);
+    check_same_hits(full, quantized, rays);
+  }
+}
+#endif
+
+/* Triangles looked up through vertex indices must give exactly the same hits
+ * as triangles copied into the BVH, with less memory. */
+TEST(bvh_traversal, indexed_matches_copied_triangles)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+  const BVHLayout layouts[] = {BVH_LAYOUT_BVH2, default_layout};
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    for (int j = 0; j < sizeof(layouts) / sizeof(*layouts); j++) {
+      TraversalScene copied, indexed;
+      ASSERT_TRUE(copied.load(example_objects[i], layouts[j])) << example_objects[i];
+      ASSERT_TRUE(indexed.load(example_objects[i], layouts[j], true)) << example_objects[i];
+      EXPECT_EQ(indexed.bvh->pack.prim_tri_verts.size(), (size_t)0);
+      EXPECT_LT(indexed.verts.size(), copied.bvh->pack.prim_tri_verts.size());
+
+      vector<Ray> rays;
+      copied.camera_rays(64, rays);
+      check_same_hits(copied, indexed, rays);
+      check_packets(indexed, rays, PATH_RAY_CAMERA);
+
+      copied.shadow_rays(64, rays);
+      check_packets(indexed, rays, PATH_RAY_SHADOW_OPAQUE);
+
+      copied.random_rays(4096, rays);
+      check_same_hits(copied, indexed, rays);
+    }
+  }
+}
+
+/* Refitting the BVH of a moved object keeps its tree, but must find the same
+ * triangles as a BVH built for the new vertex positions. */
+TEST(bvh_traversal, refit_matches_rebuild)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+  const Transform tfm = transform_translate(0.4f, -0.3f, 0.2f) *
+                        transform_rotate(0.7f, normalize(make_float3(1.0f, 2.0f, 0.5f))) *
+                        transform_scale(1.3f, 0.8f, 1.1f);
+
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    TraversalScene refit, rebuilt;
+    ASSERT_TRUE(refit.load(example_objects[i])) << example_objects[i];
+    ASSERT_TRUE(rebuilt.load(example_objects[i])) << example_objects[i];
+
+    refit.apply_transform(tfm);
+    refit.refit();
+    rebuilt.apply_transform(tfm);
+    rebuilt.build();
+
+    vector<Ray> rays;
+    rebuilt.camera_rays(64, rays);
+    check_same_hits(rebuilt, refit, rays, false);
+    rebuilt.random_rays(64 * 64, rays);
+    check_same_hits(rebuilt, refit, rays, false);
+  }
+}
+
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(bvh_traversal, DISABLED_benchmark)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+#ifndef __KERNEL_AVX2__
+  printf("Packet traversal needs AVX2, packets fall back to single rays.\n");
+#endif
+
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    TraversalScene scene;
+    ASSERT_TRUE(scene.load(example_objects[i])) << example_objects[i];
+
+    vector<Ray> rays;
+    scene.camera_rays(512, rays);
+    const double camera_single = trace_rays(scene, rays, PATH_RAY_CAMERA, false);
+    const double camera_packet = trace_rays(scene, rays, PATH_RAY_CAMERA, true);
+
+    scene.shadow_rays(512, rays);
+    const double shadow_single = trace_rays(scene, rays, PATH_RAY_SHADOW_OPAQUE, false);
+    const double shadow_packet = trace_rays(scene, rays, PATH_RAY_SHADOW_OPAQUE, true);
+
+    printf("%s (%d triangles): camera rays %.2f / %.2f Mrays/s, shadow rays %.2f / %.2f "
+           "Mrays/s (single / packet)\n",
+           example_objects[i],
+           (int)scene.mesh.num_triangles(),
+           camera_single * 1e-6,
+           camera_packet * 1e-6,
+           shadow_single * 1e-6,
+           shadow_packet * 1e-6);
+  }
+}
+
+#ifdef __KERNEL_AVX2__
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(bvh_traversal, DISABLED_quantized_benchmark)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    TraversalScene full, quantized;
+    ASSERT_TRUE(full.load(example_objects[i], BVH_LAYOUT_BVH8)) << example_objects[i];
+    ASSERT_TRUE(quantized.load(example_objects[i], BVH_LAYOUT_BVH8_QUANTIZED))
+        << example_objects[i];
+
+    vector<Ray> rays;
+    full.camera_rays(512, rays);
+    const double camera_full = trace_rays(full, rays, PATH_RAY_CAMERA, false);
+    const double camera_quantized = trace_rays(quantized, rays, PATH_RAY_CAMERA, false);
+
+    full.random_rays(512 * 512, rays);
+    const double random_full = trace_rays(full, rays, PATH_RAY_DIFFUSE, false);
+    const double random_quantized = trace_rays(quantized, rays, PATH_RAY_DIFFUSE, false);
+
+    printf("%s: nodes %s / %s, camera rays %.2f / %.2f Mrays/s, random rays %.2f / %.2f "
+           "Mrays/s (full precision / quantized)\n",
+           example_objects[i],
+           string_human_readable_size(full.bvh->pack.nodes.size() * sizeof(int4)).c_str(),
+           string_human_readable_size(quantized.bvh->pack.nodes.size() * sizeof(int4)).c_str(),
+           camera_full * 1e-6,
+           camera_quantized * 1e-6,
+           random_full * 1e-6,
+           random_quantized * 1e-6);
+  }
+}
+#endif
+
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(bvh_traversal, DISABLED_indexed_triangles_benchmark)
+{
+  if (!have_kernel_support()) {
+    return;
+  }
+
+  for (int i = 0; i < sizeof(example_objects) / sizeof(*example_objects); i++) {
+    TraversalScene copied, indexed;
+    ASSERT_TRUE(copied.load(example_objects[i])) << example_objects[i];
+    ASSERT_TRUE(indexed.load(example_objects[i], default_layout, true)) << example_objects[i];
+
+    vector<Ray> rays;
+    copied.camera_rays(512, rays);
+    const double camera_copied = trace_rays(copied, rays, PATH_RAY_CAMERA, false);
+    const double camera_indexed = trace_rays(indexed, rays, PATH_RAY_CAMERA, false);
+
+    copied.random_rays(512 * 512, rays);
+    const double random_copied = trace_rays(copied, rays, PATH_RAY_DIFFUSE, false);
+    const double random_indexed = trace_rays(indexed, rays, PATH_RAY_DIFFUSE, false);
+
+    const size_t indexed_size = indexed.verts.size() * sizeof(float4) +
+                                indexed.tri_vindex.size() * sizeof(uint4);
+    printf("%s: triangles %s / %s, camera rays %.2f / %.2f Mrays/s, random rays %.2f / %.2f "
+           "Mrays/s (copied / indexed)\n",
+           example_objects[i],
+           string_human_readable_size(copied.bvh->pack.prim_tri_verts.size() * sizeof(float4))
+               .c_str(),
+           string_human_readable_size(indexed_size).c_str(),
+           camera_copied * 1e-6,
+           camera_indexed * 1e-6,
+           random_copied * 1e-6,
+           random_indexed * 1e-6);
+  }
+}
+
+CCL_NAMESPACE_END
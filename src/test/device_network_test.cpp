@@ -0,0 +1,252 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "device/device.h"
+#include "device/device_network.h"
+
+#include "util/util_thread.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Connected client and server sockets over the loopback interface. */
+struct LoopbackSockets {
+  LoopbackSockets()
+      : acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)),
+        client(io_service),
+        server(io_service)
+  {
+    client.connect(acceptor.local_endpoint());
+    acceptor.accept(server);
+  }
+
+  boost::asio::io_service io_service;
+  tcp::acceptor acceptor;
+  tcp::socket client;
+  tcp::socket server;
+};
+
+/* Send buffers the way NetworkDevice::mem_copy_to() does. */
+void send_buffers(tcp::socket *socket, NetworkError *error, vector<char> *data, int num_copies)
+{
+  network_device_memory mem(NULL);
+  device_memory &device_mem = mem;
+  mem.data_size = data->size();
+  mem.host_pointer = &(*data)[0];
+  mem.device_pointer = 1;
+
+  for (int i = 0; i < num_copies; i++) {
+    RPCSend snd(*socket, error, "mem_copy_to");
+    snd.add(device_mem);
+    snd.add(string());
+    snd.add_buffer(mem.host_pointer, mem.memory_size());
+    snd.write();
+  }
+
+  mem.host_pointer = 0;
+}
+
+}  // namespace
+
+TEST(device_network, rpc_arguments)
+{
+  LoopbackSockets sockets;
+  NetworkError error;
+
+  vector<float> data(1000);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = (float)i;
+  }
+
+  RenderTile tile;
+  tile.x = 64;
+  tile.w = 32;
+  tile.buffer = 7;
+
+  {
+    RPCSend snd(sockets.client, &error, "test");
+    snd.add(42);
+    snd.add(string("name"));
+    snd.add(tile);
+    snd.add_buffer(&data[0], data.size() * sizeof(float));
+    snd.write();
+  }
+
+  RPCReceive rcv(sockets.server, &error);
+  EXPECT_EQ(rcv.name, "test");
+
+  int value = 0;
+  string name;
+  RenderTile received_tile;
+  rcv.read(value);
+  rcv.read(name);
+  rcv.read(received_tile);
+  EXPECT_EQ(value, 42);
+  EXPECT_EQ(name, "name");
+  EXPECT_EQ(received_tile.x, 64);
+  EXPECT_EQ(received_tile.w, 32);
+  EXPECT_EQ(received_tile.buffer, (device_ptr)7);
+
+  /* Chunks are read in place. */
+  vector<float> received_data(data.size());
+  rcv.read_buffer(&received_data[0], received_data.size() * sizeof(float));
+  EXPECT_EQ(received_data, data);
+
+  EXPECT_FALSE(error.have_error());
+}
+
+TEST(device_network, rpc_skip_unread_buffers)
+{
+  LoopbackSockets sockets;
+  NetworkError error;
+
+  vector<char> data(1000, 1);
+  {
+    RPCSend snd(sockets.client, &error, "first");
+    snd.add_buffer(&data[0], data.size());
+    snd.write();
+  }
+  {
+    RPCSend snd(sockets.client, &error, "second");
+    snd.write();
+  }
+
+  {
+    RPCReceive rcv(sockets.server, &error);
+    EXPECT_EQ(rcv.name, "first");
+  }
+  {
+    RPCReceive rcv(sockets.server, &error);
+    EXPECT_EQ(rcv.name, "second");
+  }
+
+  EXPECT_FALSE(error.have_error());
+}
+
+TEST(device_network, rpc_version_mismatch)
+{
+  LoopbackSockets sockets;
+  NetworkError error;
+
+  RPCHeader header;
+  header.magic = RPC_MAGIC;
+  header.version = RPC_VERSION + 1;
+  header.payload_size = 0;
+  header.chunks_size = 0;
+  boost::asio::write(sockets.client, boost::asio::buffer(&header, sizeof(header)));
+
+  RPCReceive rcv(sockets.server, &error);
+  EXPECT_TRUE(error.have_error());
+  EXPECT_EQ(rcv.name, "");
+}
+
+TEST(device_network, buffer_hash)
+{
+  vector<char> a(NETWORK_CACHE_MIN_SIZE, 1), b(NETWORK_CACHE_MIN_SIZE, 1);
+  EXPECT_EQ(network_buffer_hash(&a[0], a.size()), network_buffer_hash(&b[0], b.size()));
+
+  b[b.size() - 1] = 2;
+  EXPECT_NE(network_buffer_hash(&a[0], a.size()), network_buffer_hash(&b[0], b.size()));
+  EXPECT_NE(network_buffer_hash(&a[0], a.size()), network_buffer_hash(&a[0], a.size() - 1));
+}
+
+TEST(device_network, buffer_cache)
+{
+  NetworkBufferCache cache(3000);
+
+  vector<char> a(1000, 'a'), b(1000, 'b'), c(1000, 'c'), d(1000, 'd');
+  cache.insert("a", &a[0], a.size());
+  cache.insert("b", &b[0], b.size());
+  cache.insert("c", &c[0], c.size());
+  EXPECT_EQ(cache.memory_size(), (size_t)3000);
+
+  /* Content is copied out, and must match the requested size. */
+  vector<char> data(1000);
+  EXPECT_TRUE(cache.find("a", &data[0], data.size()));
+  EXPECT_EQ(data, a);
+  EXPECT_FALSE(cache.find("a", &data[0], data.size() - 1));
+
+  /* Least recently used buffer is evicted first. */
+  cache.insert("d", &d[0], d.size());
+  EXPECT_EQ(cache.memory_size(), (size_t)3000);
+  EXPECT_TRUE(cache.find("a", &data[0], data.size()));
+  EXPECT_FALSE(cache.find("b", &data[0], data.size()));
+  EXPECT_TRUE(cache.find("c", &data[0], data.size()));
+  EXPECT_TRUE(cache.find("d", &data[0], data.size()));
+  EXPECT_EQ(data, d);
+
+  /* Buffers larger than the cache are not stored. */
+  vector<char> e(4000, 'e');
+  cache.insert("e", &e[0], e.size());
+  EXPECT_FALSE(cache.find("e", &e[0], e.size()));
+  EXPECT_TRUE(cache.find("a", &data[0], data.size()));
+}
+
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(device_network, DISABLED_benchmark)
+{
+  /* Scene upload throughput over the loopback interface, with the server
+   * receiving buffers in place like DeviceServer. */
+  const size_t sizes[] = {4 * 1024, 1024 * 1024, 64 * 1024 * 1024};
+
+  for (int i = 0; i < 3; i++) {
+    const size_t size = sizes[i];
+    const int num_copies = max((int)((256 * 1024 * 1024) / size), 4);
+
+    LoopbackSockets sockets;
+    NetworkError client_error, server_error;
+
+    vector<char> data(size, 1);
+    vector<char> received_data(size);
+
+    const double start_time = time_dt();
+
+    thread client(function_bind(
+        &send_buffers, &sockets.client, &client_error, &data, num_copies));
+
+    for (int copy = 0; copy < num_copies; copy++) {
+      RPCReceive rcv(sockets.server, &server_error);
+      ASSERT_EQ(rcv.name, "mem_copy_to");
+
+      string name, hash;
+      network_device_memory mem(NULL);
+      rcv.read(mem, name);
+      rcv.read(hash);
+      ASSERT_EQ(mem.memory_size(), size);
+
+      rcv.read_buffer(&received_data[0], mem.memory_size());
+    }
+
+    client.join();
+    const double total_time = time_dt() - start_time;
+
+    EXPECT_FALSE(client_error.have_error());
+    EXPECT_FALSE(server_error.have_error());
+    EXPECT_EQ(received_data, data);
+
+    printf("Network upload of %d buffers of %s: %.1f MB/s, %.1f calls/s\n",
+           num_copies,
+           string_human_readable_size(size).c_str(),
+           num_copies * size / total_time / (1024.0 * 1024.0),
+           num_copies / total_time);
+  }
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "kernel/filter/filter.h"
+
+#include "util/util_math.h"
+#include "util/util_optimization.h"
+#include "util/util_system.h"
+#include "util/util_time.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Non-local means kernels of one CPU architecture. */
+struct NLMKernels {
+  void (*calc_difference)(
+      int, int, float *, float *, float *, float *, int *, int, int, int, float, float);
+  void (*blur)(float *, float *, int *, int, int);
+  void (*calc_weight)(float *, float *, int *, int, int);
+  void (*update_output)(
+      int, int, float *, float *, float *, float *, float *, int *, int, int, int);
+  void (*normalize)(float *, float *, int *, int);
+};
+
+#define NLM_KERNELS(arch) \
+  { \
+    kernel_##arch##_filter_nlm_calc_difference, kernel_##arch##_filter_nlm_blur, \
+        kernel_##arch##_filter_nlm_calc_weight, kernel_##arch##_filter_nlm_update_output, \
+        kernel_##arch##_filter_nlm_normalize \
+  }
+
+/* Color image with variance, laid out like the denoiser buffers. The width is
+ * not a multiple of eight so the last group of each row is a float4. */
+struct NLMImage {
+  NLMImage(int width, int height) : width(width), height(height), w(align_up(width, 4))
+  {
+    pass_stride = w * height;
+    image.resize(3 * pass_stride);
+    variance.resize(3 * pass_stride);
+
+    uint seed = 1;
+    for (int i = 0; i < 3 * pass_stride; i++) {
+      seed = seed * 1103515245u + 12345u;
+      const float noise = (float)((seed >> 8) & 0xffff) / 65535.0f;
+      const int x = (i % pass_stride) % w, y = (i % pass_stride) / w;
+      image[i] = 0.5f + 0.25f * sinf(x * 0.3f) * cosf(y * 0.2f) + 0.1f * noise;
+      variance[i] = 0.01f + 0.01f * noise;
+    }
+  }
+
+  int width, height, w, pass_stride;
+  vector<float> image, variance;
+};
+
+void run_nlm(
+    const NLMKernels &kernels, NLMImage &img, int r, int f, vector<float> &out, float *scale)
+{
+  const float a = 1.0f, k_2 = 0.25f;
+  const int w = img.w, h = img.height;
+
+  vector<float> difference(w * h), blur_difference(w * h), weight_accum(w * h, 0.0f);
+  out.assign(w * h, 0.0f);
+
+  for (int i = 0; i < (2 * r + 1) * (2 * r + 1); i++) {
+    int dy = i / (2 * r + 1) - r;
+    int dx = i % (2 * r + 1) - r;
+
+    int local_rect[4] = {
+        max(0, -dx), max(0, -dy), img.width - max(0, dx), img.height - max(0, dy)};
+    kernels.calc_difference(dx,
+                            dy,
+                            &img.image[0],
+                            &img.variance[0],
+                            scale,
+                            &difference[0],
+                            local_rect,
+                            w,
+                            img.pass_stride,
+                            0,
+                            a,
+                            k_2);
+
+    kernels.blur(&difference[0], &blur_difference[0], local_rect, w, f);
+    kernels.calc_weight(&blur_difference[0], &difference[0], local_rect, w, f);
+    kernels.blur(&difference[0], &blur_difference[0], local_rect, w, f);
+
+    kernels.update_output(dx,
+                          dy,
+                          &blur_difference[0],
+                          &img.image[0],
+                          &difference[0],
+                          &out[0],
+                          &weight_accum[0],
+                          local_rect,
+                          img.pass_stride,
+                          w,
+                          f);
+  }
+
+  int local_rect[4] = {0, 0, img.width, img.height};
+  kernels.normalize(&out[0], &weight_accum[0], local_rect, w);
+}
+
+bool have_avx2_kernels()
+{
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+  return system_cpu_support_avx2();
+#else
+  return false;
+#endif
+}
+
+}  // namespace
+
+TEST(filter_nlm, avx2_matches_cpu)
+{
+  if (!have_avx2_kernels()) {
+    return;
+  }
+
+  const NLMKernels cpu_kernels = NLM_KERNELS(cpu);
+  const NLMKernels avx2_kernels = NLM_KERNELS(cpu_avx2);
+
+  NLMImage img(61, 37);
+
+  for (int use_scale = 0; use_scale < 2; use_scale++) {
+    /* The variance doubles as a scale image, it only has to be positive. */
+    float *scale = use_scale ? &img.variance[0] : NULL;
+
+    vector<float> cpu_out, avx2_out;
+    run_nlm(cpu_kernels, img, 4, 2, cpu_out, scale);
+    run_nlm(avx2_kernels, img, 4, 2, avx2_out, scale);
+
+    for (int y = 0; y < img.height; y++) {
+      for (int x = 0; x < img.width; x++) {
+        const float expected = cpu_out[y * img.w + x];
+        EXPECT_NEAR(avx2_out[y * img.w + x], expected, 1e-4f * fabsf(expected))
+            << "x=" << x << " y=" << y;
+      }
+    }
+  }
+}
+
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(filter_nlm, DISABLED_benchmark)
+{
+  if (!have_avx2_kernels()) {
+    return;
+  }
+
+  const NLMKernels cpu_kernels = NLM_KERNELS(cpu);
+  const NLMKernels avx2_kernels = NLM_KERNELS(cpu_avx2);
+
+  /* Default denoiser settings, on a tile with its neighbor overlap. */
+  NLMImage img(3 * 64 + 2 * 8, 3 * 64 + 2 * 8);
+  const int r = 8, f = 4;
+  vector<float> out;
+
+  double start_time = time_dt();
+  run_nlm(cpu_kernels, img, r, f, out, NULL);
+  const double cpu_time = time_dt() - start_time;
+
+  start_time = time_dt();
+  run_nlm(avx2_kernels, img, r, f, out, NULL);
+  const double avx2_time = time_dt() - start_time;
+
+  printf("NLM filter of %dx%d pixels: %.3fs CPU, %.3fs AVX2 (%.2fx)\n",
+         img.width,
+         img.height,
+         cpu_time,
+         avx2_time,
+         cpu_time / avx2_time);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "kernel/kernel_compat_cpu.h"
+#include "kernel/kernel_math.h"
+#include "util/util_atomic.h"
+#include "kernel/kernel_types.h"
+#include "kernel/split/kernel_split_data.h"
+#include "kernel/kernel_globals.h"
+#include "kernel/kernel_write_passes.h"
+#include "kernel/kernel_adaptive_sampling.h"
+
+#include "device/device_task.h"
+
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Render buffer of a single tile with the combined pass and the adaptive sampling passes,
+ * rendered like the CPU device does, with a fixed radiance per pixel and sample. */
+class AdaptiveTile {
+ public:
+  AdaptiveTile(int width, int height) : width(width), height(height), kg(&globals)
+  {
+    kernel_data.film.pass_flag = PASSMASK(COMBINED) | PASSMASK(ADAPTIVE_AUX_BUFFER) |
+                                 PASSMASK(SAMPLE_COUNT);
+    kernel_data.film.light_pass_flag = 0;
+    kernel_data.film.use_light_pass = 0;
+    kernel_data.film.pass_denoising_data = 0;
+    kernel_data.film.pass_combined = 0;
+    kernel_data.film.pass_adaptive_aux_buffer = 4;
+    kernel_data.film.pass_sample_count = 8;
+    kernel_data.film.pass_stride = 12;
+    kernel_data.integrator.adaptive_threshold = 0.01f;
+
+    adaptive_sampling.use = true;
+    adaptive_sampling.min_samples = 4;
+    adaptive_sampling.adaptive_step = 4;
+
+    buffer.resize(width * height * kernel_data.film.pass_stride, 0.0f);
+  }
+
+  /* Returns the number of samples taken before the tile converged. */
+  int render(int num_samples, float3 (*radiance)(int x, int y, int sample))
+  {
+    for (int sample = 0; sample < num_samples; sample++) {
+      for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+          float *pixel = pixel_buffer(x, y);
+          if (!kernel_adaptive_sample_pixel(kg, pixel)) {
+            continue;
+          }
+
+          const float3 L = radiance(x, y, sample);
+          kernel_write_pass_float4(pixel + kernel_data.film.pass_combined,
+                                   make_float4(L.x, L.y, L.z, 1.0f));
+          kernel_adaptive_write_aux_buffer(kg, pixel, sample, L);
+        }
+      }
+
+      if (adaptive_sampling.need_filter(sample) && filter(sample + 1)) {
+        return sample + 1;
+      }
+    }
+
+    return num_samples;
+  }
+
+  void adjust_samples(int num_samples)
+  {
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        kernel_adaptive_adjust_samples(kg, pixel_buffer(x, y), num_samples);
+      }
+    }
+  }
+
+  float *pixel_buffer(int x, int y)
+  {
+    return &buffer[(x + y * width) * kernel_data.film.pass_stride];
+  }
+
+  float sample_count(int x, int y)
+  {
+    return pixel_buffer(x, y)[kernel_data.film.pass_sample_count];
+  }
+
+  int width, height;
+  KernelGlobals globals;
+  KernelGlobals *kg;
+  AdaptiveSampling adaptive_sampling;
+  vector<float> buffer;
+
+ protected:
+  /* Returns true when all pixels of the tile have converged. */
+  bool filter(int num_samples)
+  {
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        kernel_do_adaptive_stopping(kg, pixel_buffer(x, y), num_samples);
+      }
+    }
+
+    bool any = false;
+    for (int y = 0; y < height; y++) {
+      any |= kernel_do_adaptive_filter_x(kg, &buffer[0], y, 0, width, 0, width);
+    }
+    for (int x = 0; x < width; x++) {
+      any |= kernel_do_adaptive_filter_y(kg, &buffer[0], x, 0, height, 0, width);
+    }
+
+    return !any;
+  }
+};
+
+float3 constant_radiance(int x, int y, int /*sample*/)
+{
+  return make_float3(0.1f * x, 0.05f * y, 0.5f);
+}
+
+/* Noise free on the left half of the tile, and alternating between a dark and a bright
+ * sample on the right half, which never converges within the tested number of samples. */
+float3 half_noisy_radiance(int x, int y, int sample)
+{
+  if (x < 4) {
+    return constant_radiance(x, y, sample);
+  }
+  return make_float3((sample & 1) ? 1.8f : 0.2f);
+}
+
+}  // namespace
+
+TEST(kernel_adaptive_sampling, converged_tile_stops_early)
+{
+  AdaptiveTile tile(8, 8);
+
+  /* The first filter step after the minimum number of samples marks all pixels. */
+  EXPECT_EQ(tile.render(64, constant_radiance), 8);
+
+  for (int y = 0; y < tile.height; y++) {
+    for (int x = 0; x < tile.width; x++) {
+      EXPECT_EQ(tile.sample_count(x, y), 8.0f) << "x=" << x << " y=" << y;
+    }
+  }
+}
+
+TEST(kernel_adaptive_sampling, adjust_samples_keeps_film_output)
+{
+  const int num_samples = 64;
+  AdaptiveTile tile(8, 8);
+
+  EXPECT_EQ(tile.render(num_samples, half_noisy_radiance), num_samples);
+
+  /* The film divides each pixel by its own sample count before the adjustment. */
+  vector<float4> expected;
+  for (int y = 0; y < tile.height; y++) {
+    for (int x = 0; x < tile.width; x++) {
+      const float *combined = tile.pixel_buffer(x, y);
+      const float inv_samples = 1.0f / tile.sample_count(x, y);
+      expected.push_back(make_float4(combined[0], combined[1], combined[2], combined[3]) *
+                         inv_samples);
+    }
+  }
+
+  /* Pixels away from the noisy half stopped early, their neighbors kept sampling. */
+  EXPECT_EQ(tile.sample_count(0, 0), 8.0f);
+  EXPECT_EQ(tile.sample_count(3, 0), (float)num_samples);
+
+  tile.adjust_samples(num_samples);
+
+  /* Afterwards the whole tile is divided by the tile's sample count. */
+  for (int y = 0; y < tile.height; y++) {
+    for (int x = 0; x < tile.width; x++) {
+      const float *combined = tile.pixel_buffer(x, y);
+      const float4 &value = expected[x + y * tile.width];
+      EXPECT_EQ(tile.sample_count(x, y), (float)num_samples);
+      EXPECT_NEAR(combined[0] / num_samples, value.x, 1e-6f) << "x=" << x << " y=" << y;
+      EXPECT_NEAR(combined[1] / num_samples, value.y, 1e-6f) << "x=" << x << " y=" << y;
+      EXPECT_NEAR(combined[2] / num_samples, value.z, 1e-6f) << "x=" << x << " y=" << y;
+      EXPECT_NEAR(combined[3] / num_samples, value.w, 1e-6f) << "x=" << x << " y=" << y;
+    }
+  }
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "kernel/kernel_compat_cpu.h"
+#include "kernel/kernel_math.h"
+#include "util/util_atomic.h"
+#include "kernel/kernel_types.h"
+#include "kernel/split/kernel_split_data.h"
+#include "kernel/kernel_globals.h"
+#include "kernel/split/kernel_shader_sort.h"
+
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Run the shader sort kernel over a queue of paths with the given shaders,
+ * and return the sorted queue. */
+vector<int> sort_queue(const vector<int> &shaders)
+{
+  const int num_paths = shaders.size();
+
+  KernelGlobals globals;
+  KernelGlobals *kg = &globals;
+  kernel_data.integrator.max_closures = 1;
+  kg->global_id = make_int2(0, 0);
+
+  vector<int> queue_index(NUM_QUEUES, 0);
+  queue_index[QUEUE_ACTIVE_AND_REGENERATED_RAYS] = num_paths;
+  vector<int> queue_data(NUM_QUEUES * num_paths, QUEUE_EMPTY_SLOT);
+  vector<char> ray_state(num_paths, RAY_ACTIVE);
+  vector<ShaderData> sd(num_paths);
+
+  for (int i = 0; i < num_paths; i++) {
+    queue_data[QUEUE_ACTIVE_AND_REGENERATED_RAYS * num_paths + i] = i;
+    sd[i].shader = shaders[i];
+  }
+
+  kernel_split_params.queue_index = &queue_index[0];
+  kernel_split_params.queue_size = num_paths;
+  kernel_split_state.queue_data = &queue_data[0];
+  kernel_split_state.ray_state = &ray_state[0];
+  kernel_split_state._sd = &sd[0];
+
+  /* Indices past the filled part of the block are never written by the sort,
+   * fill them with values that point far outside of the block. */
+  ShaderSortLocals locals;
+  memset(&locals, 0xff, sizeof(locals));
+
+  kernel_shader_sort(kg, &locals);
+
+  EXPECT_EQ(queue_index[QUEUE_SHADER_SORTED_RAYS], num_paths);
+  return vector<int>(queue_data.begin() + QUEUE_SHADER_SORTED_RAYS * num_paths,
+                     queue_data.begin() + (QUEUE_SHADER_SORTED_RAYS + 1) * num_paths);
+}
+
+}  // namespace
+
+TEST(kernel_shader_sort, stable_partial_block)
+{
+  /* Five paths take three merge passes, so the result ends up in the
+   * temporary indices that are only filled up to the queue size. */
+  vector<int> shaders;
+  shaders.push_back(3);
+  shaders.push_back(1);
+  shaders.push_back(3);
+  shaders.push_back(1);
+  shaders.push_back(2);
+
+  const int expected[] = {1, 3, 4, 0, 2};
+  vector<int> sorted = sort_queue(shaders);
+  EXPECT_EQ(sorted, vector<int>(expected, expected + 5));
+}
+
+TEST(kernel_shader_sort, stable_equal_shaders)
+{
+  /* Paths with the same shader keep their queue order. */
+  vector<int> shaders(100, 7);
+  shaders[50] = 1;
+
+  vector<int> sorted = sort_queue(shaders);
+  EXPECT_EQ(sorted[0], 50);
+  for (int i = 1; i < 100; i++) {
+    EXPECT_EQ(sorted[i], (i <= 50) ? i - 1 : i);
+  }
+}
+
+CCL_NAMESPACE_END
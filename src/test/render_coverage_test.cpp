@@ -0,0 +1,203 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/buffers.h"
+#include "render/coverage.h"
+#include "render/film.h"
+#include "kernel/kernel_compat_cpu.h"
+#include "kernel/split/kernel_split_data.h"
+#include "kernel/kernel_globals.h"
+#include "kernel/kernel_id_passes.h"
+#include "kernel/kernel_types.h"
+#include "util/util_algorithm.h"
+#include "util/util_map.h"
+#include "util/util_string.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Object cryptomatte layer of a tile, accumulated with accurate coverage. */
+class CoverageTile {
+ public:
+  CoverageTile(int width, int height, int depth) : kg(&globals), buffers(NULL), coverage(NULL)
+  {
+    kernel_data.film.cryptomatte_passes = CRYPT_OBJECT | CRYPT_ACCURATE;
+    kernel_data.film.cryptomatte_depth = depth;
+    kernel_data.film.pass_cryptomatte = 0;
+
+    /* Every cryptomatte pass holds two IDs. */
+    for (int i = 0; i < depth; i++) {
+      Pass::add(PASS_CRYPTOMATTE, buffers.params.passes, string_printf("Crypto%02d", i).c_str());
+    }
+    pass_stride = buffers.params.get_passes_size();
+    buffer.resize(width * height * pass_stride, ID_NONE);
+
+    tile.w = width;
+    tile.h = height;
+    tile.stride = width;
+    tile.buffer = (device_ptr)&buffer[0];
+    tile.buffers = &buffers;
+
+    coverage = new Coverage(kg, tile);
+    coverage->init_path_trace();
+  }
+
+  ~CoverageTile()
+  {
+    delete coverage;
+  }
+
+  void write(int x, int y, float id, float weight)
+  {
+    coverage->init_pixel(x, y);
+    kernel_write_id_coverage(kg->coverage_object, id, weight);
+    reference[y * tile.w + x][id] += weight;
+  }
+
+  void finalize()
+  {
+    coverage->finalize();
+  }
+
+  const float2 *pixel_slots(int x, int y) const
+  {
+    return (const float2 *)&buffer[(y * tile.w + x) * pass_stride];
+  }
+
+  int num_pass_slots() const
+  {
+    return 2 * kernel_data.film.cryptomatte_depth;
+  }
+
+  /* The coverage as written by the previous implementation, which kept an
+   * unordered_map per pixel that was sorted when finishing the tile. */
+  void reference_slots(int x, int y, vector<float2> &slots) const
+  {
+    const int num_slots = num_pass_slots();
+    slots.assign(num_slots, make_float2(ID_NONE, 0.0f));
+
+    map<int, map<float, float>>::const_iterator it = reference.find(y * tile.w + x);
+    if (it == reference.end()) {
+      return;
+    }
+
+    vector<pair<float, float>> sorted_pixel;
+    for (map<float, float>::const_iterator id = it->second.begin(); id != it->second.end();
+         ++id) {
+      sorted_pixel.push_back(std::make_pair(id->second, id->first));
+    }
+    std::sort(sorted_pixel.begin(), sorted_pixel.end(), std::greater<pair<float, float>>());
+    if (sorted_pixel.size() > num_slots) {
+      float leftover = 0.0f;
+      for (size_t i = num_slots; i < sorted_pixel.size(); i++) {
+        leftover += sorted_pixel[i].first;
+      }
+      sorted_pixel[num_slots - 1].first += leftover;
+    }
+    const int limit = std::min((size_t)num_slots, sorted_pixel.size());
+    for (int i = 0; i < limit; ++i) {
+      kernel_write_id_slots(
+          (float *)&slots[0], num_slots, sorted_pixel[i].second, sorted_pixel[i].first);
+    }
+  }
+
+  KernelGlobals globals;
+  KernelGlobals *kg;
+  RenderBuffers buffers;
+  RenderTile tile;
+  int pass_stride;
+  vector<float> buffer;
+  Coverage *coverage;
+  map<int, map<float, float>> reference;
+};
+
+}  // namespace
+
+TEST(render_coverage, full_table_keeps_most_coverage)
+{
+  /* Four pass slots and a hash table of eight IDs per pixel. */
+  CoverageTile tile(1, 1, 2);
+
+  /* Fill the table with IDs of little coverage, then add IDs with more
+   * coverage over multiple samples. */
+  float total = 0.0f;
+  for (int i = 1; i <= 16; i++) {
+    tile.write(0, 0, (float)i, 0.001f * i);
+    total += 0.001f * i;
+  }
+  for (int sample = 0; sample < 4; sample++) {
+    tile.write(0, 0, 101.0f, 0.125f);
+    tile.write(0, 0, 102.0f, 0.1f);
+    tile.write(0, 0, 103.0f, 0.05f);
+    total += 0.125f + 0.1f + 0.05f;
+  }
+  tile.finalize();
+
+  const float2 *slots = tile.pixel_slots(0, 0);
+  EXPECT_EQ(slots[0].x, 101.0f);
+  EXPECT_NEAR(slots[0].y, 0.5f, 1e-6f);
+  EXPECT_EQ(slots[1].x, 102.0f);
+  EXPECT_NEAR(slots[1].y, 0.4f, 1e-6f);
+  EXPECT_EQ(slots[2].x, 103.0f);
+  EXPECT_NEAR(slots[2].y, 0.2f, 1e-6f);
+
+  /* The coverage of all other IDs ends up in the last slot. */
+  EXPECT_NE(slots[3].x, ID_NONE);
+  float sum = 0.0f;
+  for (int i = 0; i < tile.num_pass_slots(); i++) {
+    sum += slots[i].y;
+  }
+  EXPECT_NEAR(sum, total, 1e-5f);
+}
+
+TEST(render_coverage, matches_map_coverage)
+{
+  CoverageTile tile(3, 2, 2);
+
+  /* Pixels with no ID, fewer IDs than pass slots and more IDs than pass
+   * slots, with IDs seen over multiple samples. */
+  for (int sample = 0; sample < 8; sample++) {
+    for (int y = 0; y < 2; y++) {
+      for (int x = 0; x < 3; x++) {
+        const int pixel = y * 3 + x;
+        for (int i = 0; i < pixel; i++) {
+          const float id = 1.0f + ((i * 7 + sample) % (pixel + 1));
+          tile.write(x, y, id, 0.01f * (1 + i) + 0.001f * sample);
+        }
+      }
+    }
+  }
+  tile.finalize();
+
+  vector<float2> expected;
+  for (int y = 0; y < 2; y++) {
+    for (int x = 0; x < 3; x++) {
+      tile.reference_slots(x, y, expected);
+      const float2 *slots = tile.pixel_slots(x, y);
+      for (int i = 0; i < tile.num_pass_slots(); i++) {
+        EXPECT_EQ(slots[i].x, expected[i].x) << "x=" << x << " y=" << y << " slot=" << i;
+        EXPECT_NEAR(slots[i].y, expected[i].y, 1e-6f)
+            << "x=" << x << " y=" << y << " slot=" << i;
+      }
+    }
+  }
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/denoising.h"
+
+#include "util/util_foreach.h"
+#include "util/util_math.h"
+#include "util/util_path.h"
+#include "util/util_string.h"
+#include "util/util_unique_ptr.h"
+#include "util/util_vector.h"
+
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/imageio.h>
+
+OIIO_NAMESPACE_USING
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Combined pass with all denoising passes of a view layer. */
+const char *denoise_channels[] = {"View Layer.Combined.R",
+                                  "View Layer.Combined.G",
+                                  "View Layer.Combined.B",
+                                  "View Layer.Combined.A",
+                                  "View Layer.Noisy Image.R",
+                                  "View Layer.Noisy Image.G",
+                                  "View Layer.Noisy Image.B",
+                                  "View Layer.Denoising Depth.Z",
+                                  "View Layer.Denoising Normal.X",
+                                  "View Layer.Denoising Normal.Y",
+                                  "View Layer.Denoising Normal.Z",
+                                  "View Layer.Denoising Shadowing.X",
+                                  "View Layer.Denoising Albedo.R",
+                                  "View Layer.Denoising Albedo.G",
+                                  "View Layer.Denoising Albedo.B",
+                                  "View Layer.Denoising Variance.R",
+                                  "View Layer.Denoising Variance.G",
+                                  "View Layer.Denoising Variance.B",
+                                  "View Layer.Denoising Intensity.X"};
+const int num_denoise_channels = sizeof(denoise_channels) / sizeof(*denoise_channels);
+
+string temp_filepath()
+{
+  return path_join(Filesystem::temp_directory_path(),
+                   Filesystem::unique_path("cycles-denoise-%%%%%%%%.exr"));
+}
+
+/* Noisy frame of a smooth gradient that moves from frame to frame, written in
+ * tiles so bands of scanlines don't line up with the tiles of the inputs. */
+bool write_frame(const string &filepath, int width, int height, int frame)
+{
+  ImageSpec spec(width, height, num_denoise_channels, TypeDesc::FLOAT);
+  spec.channelnames.assign(denoise_channels, denoise_channels + num_denoise_channels);
+  spec.tile_width = 8;
+  spec.tile_height = 8;
+  spec.attribute("cycles.View Layer.samples", TypeDesc::STRING, "16");
+
+  vector<float> pixels((size_t)width * height * num_denoise_channels);
+  uint state = 1 + frame;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      float *pixel = &pixels[((size_t)y * width + x) * num_denoise_channels];
+      const float base = 0.5f + 0.25f * sinf((x + frame) * 0.3f) * cosf(y * 0.2f);
+
+      for (int c = 0; c < 3; c++) {
+        state = state * 1103515245u + 12345u;
+        const float noise = (float)((state >> 8) & 0xffff) / 65535.0f - 0.5f;
+        pixel[c] = pixel[4 + c] = base + 0.2f * noise;
+        pixel[12 + c] = 0.8f;
+        pixel[15 + c] = 0.01f + 0.01f * fabsf(noise);
+      }
+      pixel[3] = 1.0f;
+      pixel[7] = 5.0f + 0.01f * x;
+      pixel[8] = 0.0f;
+      pixel[9] = 0.0f;
+      pixel[10] = 1.0f;
+      pixel[11] = 1.0f;
+      pixel[18] = base;
+    }
+  }
+
+  unique_ptr<ImageOutput> out(ImageOutput::create(filepath));
+  if (!out || !out->open(filepath, spec)) {
+    return false;
+  }
+  const bool ok = out->write_image(TypeDesc::FLOAT, pixels.data());
+  return out->close() && ok;
+}
+
+bool read_image(const string &filepath, ImageSpec &spec, vector<float> &pixels)
+{
+  unique_ptr<ImageInput> in(ImageInput::open(filepath));
+  if (!in) {
+    return false;
+  }
+  spec = in->spec();
+  pixels.resize((size_t)spec.width * spec.height * spec.nchannels);
+  const bool ok = in->read_image(TypeDesc::FLOAT, pixels.data());
+  return in->close() && ok;
+}
+
+}  // namespace
+
+class RenderDenoising : public testing::Test {
+ protected:
+  static const int width = 37, height = 70, num_frames = 3;
+  vector<string> inputs;
+  vector<string> outputs;
+
+  virtual void SetUp()
+  {
+    for (int frame = 0; frame < num_frames; frame++) {
+      inputs.push_back(temp_filepath());
+      ASSERT_TRUE(write_frame(inputs.back(), width, height, frame)) << inputs.back();
+    }
+  }
+
+  virtual void TearDown()
+  {
+    foreach (const string &filepath, inputs) {
+      path_remove(filepath);
+    }
+    foreach (const string &filepath, outputs) {
+      path_remove(filepath);
+    }
+  }
+
+  /* Denoise all frames with their neighbors, with a small tile size and filter
+   * radius, so that the scanlines loaded around bands don't cover the frame. */
+  void denoise(size_t memory_budget, vector<vector<float>> &frames)
+  {
+    vector<string> frame_outputs;
+    for (int frame = 0; frame < num_frames; frame++) {
+      frame_outputs.push_back(temp_filepath());
+    }
+    outputs.insert(outputs.end(), frame_outputs.begin(), frame_outputs.end());
+
+    DeviceInfo device_info;
+    Denoiser denoiser(device_info);
+    denoiser.input = inputs;
+    denoiser.output = frame_outputs;
+    denoiser.tile_size = make_int2(16, 16);
+    denoiser.memory_budget = memory_budget;
+    denoiser.params.radius = 2;
+    denoiser.params.neighbor_frames = 1;
+    ASSERT_TRUE(denoiser.run()) << denoiser.error;
+
+    frames.resize(num_frames);
+    for (int frame = 0; frame < num_frames; frame++) {
+      ImageSpec spec;
+      ASSERT_TRUE(read_image(frame_outputs[frame], spec, frames[frame]))
+          << frame_outputs[frame];
+
+      /* Output is written in scanlines, also for tiled inputs. */
+      EXPECT_EQ(spec.tile_width, 0);
+      EXPECT_EQ(spec.nchannels, num_denoise_channels);
+    }
+  }
+};
+
+/* Denoising in bands of one tile row, one output frame at a time, must give
+ * the same frames as denoising all of them with all scanlines at once. The
+ * neighbors of later frames are reopened after earlier frames are saved. */
+TEST_F(RenderDenoising, bands_match_single_band)
+{
+  vector<vector<float>> expected, banded;
+  denoise((size_t)-1, expected);
+  denoise(0, banded);
+
+  for (int frame = 0; frame < num_frames; frame++) {
+    ASSERT_EQ(banded[frame].size(), expected[frame].size());
+    for (size_t i = 0; i < expected[frame].size(); i++) {
+      const float value = expected[frame][i];
+      EXPECT_NEAR(banded[frame][i], value, 1e-5f * max(fabsf(value), 1.0f))
+          << "frame=" << frame << " index=" << i;
+    }
+  }
+}
+
+CCL_NAMESPACE_END
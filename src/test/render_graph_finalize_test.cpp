@@ -21,6 +21,7 @@
 #include "render/scene.h"
 #include "render/nodes.h"
 #include "util/util_array.h"
+#include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_string.h"
 #include "util/util_vector.h"
@@ -1528,4 +1529,40 @@ TEST_F(RenderGraph, constant_fold_convert_color_float_color)
   graph.finalize(scene);
 }
 
+/*
+ * Tests:
+ *  - Texture coordinates of images loaded through the texture cache are copied
+ *    and shifted by ray differentials, to select mipmap levels.
+ */
+TEST_F(RenderGraph, image_texture_derivatives)
+{
+  EXPECT_ANY_MESSAGE(log);
+
+  scene->params.texture_cache_size = 64;
+
+  builder.add_node(ShaderNodeBuilder<TextureCoordinateNode>("Coordinate"))
+      .add_node(ShaderNodeBuilder<ImageTextureNode>("Image"))
+      .add_connection("Coordinate::UV", "Image::Vector")
+      .output_color("Image::Color");
+
+  graph.finalize(scene);
+
+  ShaderNode *image = NULL;
+  foreach (ShaderNode *node, graph.nodes) {
+    if (node->name == "Image") {
+      image = node;
+    }
+  }
+  ASSERT_TRUE(image != NULL);
+
+  ShaderInput *vector_dx = image->input("VectorDx");
+  ShaderInput *vector_dy = image->input("VectorDy");
+  ASSERT_TRUE(vector_dx->link != NULL);
+  ASSERT_TRUE(vector_dy->link != NULL);
+  EXPECT_EQ(vector_dx->link->name(), ustring("UV"));
+  EXPECT_EQ(vector_dx->link->parent->bump, SHADER_BUMP_DX);
+  EXPECT_EQ(vector_dy->link->parent->bump, SHADER_BUMP_DY);
+  EXPECT_EQ(image->input("Vector")->link->parent->bump, SHADER_BUMP_NONE);
+}
+
 CCL_NAMESPACE_END
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/jitter.h"
+
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Checks that every elementary interval of the first num_points points contains
+ * exactly one point. */
+void check_elementary_intervals(const vector<float2> &points, int num_points)
+{
+  int log_num_points = 0;
+  while ((1 << log_num_points) < num_points) {
+    log_num_points++;
+  }
+
+  for (int k = 0; k <= log_num_points; k++) {
+    const int columns = 1 << k;
+    const int rows = 1 << (log_num_points - k);
+    vector<int> count(num_points, 0);
+
+    for (int i = 0; i < num_points; i++) {
+      const int x = (int)(points[i].x * columns);
+      const int y = (int)(points[i].y * rows);
+      count[x * rows + y]++;
+    }
+
+    for (int i = 0; i < num_points; i++) {
+      EXPECT_EQ(count[i], 1) << "points " << num_points << " columns " << columns;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(render_jitter, pmj02_stratification)
+{
+  const int size = 1024;
+  vector<float2> points(size);
+  progressive_multi_jitter_02_generate_2D(&points[0], size, 42);
+
+  for (int i = 0; i < size; i++) {
+    EXPECT_GE(points[i].x, 0.0f);
+    EXPECT_LT(points[i].x, 1.0f);
+    EXPECT_GE(points[i].y, 0.0f);
+    EXPECT_LT(points[i].y, 1.0f);
+  }
+
+  /* Every power of two prefix is stratified, not just the full sequence. */
+  for (int num_points = 1; num_points <= size; num_points *= 2) {
+    check_elementary_intervals(points, num_points);
+  }
+}
+
+TEST(render_jitter, pmj02_seed)
+{
+  const int size = 64;
+  vector<float2> a(size), b(size), c(size);
+  progressive_multi_jitter_02_generate_2D(&a[0], size, 1);
+  progressive_multi_jitter_02_generate_2D(&b[0], size, 1);
+  progressive_multi_jitter_02_generate_2D(&c[0], size, 2);
+
+  int num_different = 0;
+  for (int i = 0; i < size; i++) {
+    EXPECT_EQ(a[i].x, b[i].x);
+    EXPECT_EQ(a[i].y, b[i].y);
+    num_different += (a[i].x != c[i].x || a[i].y != c[i].y);
+  }
+  EXPECT_GT(num_different, 0);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/light_tree.h"
+
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+LightTreePrimitive make_primitive(float3 P, float3 N, float energy, int index)
+{
+  LightTreePrimitive prim;
+  prim.bounds = BoundBox(P - make_float3(0.1f, 0.1f, 0.1f), P + make_float3(0.1f, 0.1f, 0.1f));
+  prim.cone = LightTreeCone(N, 0.0f);
+  prim.energy = energy;
+  prim.area = 1.0f;
+  prim.index = index;
+  return prim;
+}
+
+/* Checks that every node covers the emitters of its children. */
+void check_node(const vector<KernelLightTreeNode> &nodes, int index, int *num_leaves)
+{
+  const KernelLightTreeNode &knode = nodes[index];
+
+  if (knode.second_child == -1) {
+    EXPECT_EQ(knode.num_emitters, 1);
+    (*num_leaves)++;
+    return;
+  }
+
+  const KernelLightTreeNode &first = nodes[index + 1];
+  const KernelLightTreeNode &second = nodes[knode.second_child];
+
+  EXPECT_EQ(first.first_emitter, knode.first_emitter);
+  EXPECT_EQ(second.first_emitter, first.first_emitter + first.num_emitters);
+  EXPECT_EQ(first.num_emitters + second.num_emitters, knode.num_emitters);
+  EXPECT_NEAR(first.energy + second.energy, knode.energy, 1e-4f * knode.energy);
+
+  for (int i = 0; i < 3; i++) {
+    EXPECT_LE(knode.bounds_min[i], min(first.bounds_min[i], second.bounds_min[i]));
+    EXPECT_GE(knode.bounds_max[i], max(first.bounds_max[i], second.bounds_max[i]));
+  }
+
+  check_node(nodes, index + 1, num_leaves);
+  check_node(nodes, knode.second_child, num_leaves);
+}
+
+}  // namespace
+
+TEST(render_light_tree, cone_merge)
+{
+  const LightTreeCone a(make_float3(0.0f, 0.0f, 1.0f), 0.0f);
+  const LightTreeCone b(make_float3(1.0f, 0.0f, 0.0f), 0.0f);
+
+  const LightTreeCone ab = merge(a, b);
+  EXPECT_NEAR(ab.theta_o, M_PI_4_F, 1e-5f);
+  EXPECT_NEAR(dot(ab.axis, normalize(make_float3(1.0f, 0.0f, 1.0f))), 1.0f, 1e-5f);
+
+  /* Normals are two-sided, so opposite normals are bounded by a cone without spread. */
+  const LightTreeCone c(make_float3(0.0f, 0.0f, -1.0f), 0.0f);
+  EXPECT_NEAR(merge(a, c).theta_o, 0.0f, 1e-5f);
+}
+
+TEST(render_light_tree, build)
+{
+  vector<LightTreePrimitive> prims;
+  for (int i = 0; i < 100; i++) {
+    const float3 P = make_float3((i % 10) * 2.0f, (i / 10) * 3.0f, (i % 7) * 0.5f);
+    const float3 N = normalize(make_float3((i % 3) - 1.0f, 1.0f, (i % 5) * 0.25f));
+    prims.push_back(make_primitive(P, N, 1.0f + (i % 4), i));
+  }
+
+  LightTree tree(prims);
+  const vector<KernelLightTreeNode> &nodes = tree.get_nodes();
+
+  ASSERT_EQ(nodes.size(), 2 * prims.size() - 1);
+  EXPECT_EQ(nodes[0].first_emitter, 0);
+  EXPECT_EQ(nodes[0].num_emitters, 100);
+
+  int num_leaves = 0;
+  check_node(nodes, 0, &num_leaves);
+  EXPECT_EQ(num_leaves, 100);
+
+  /* Building must only reorder the primitives. */
+  vector<bool> found(prims.size(), false);
+  for (size_t i = 0; i < prims.size(); i++) {
+    EXPECT_FALSE(found[prims[i].index]);
+    found[prims[i].index] = true;
+  }
+}
+
+TEST(render_light_tree, coincident)
+{
+  vector<LightTreePrimitive> prims;
+  for (int i = 0; i < 5; i++) {
+    prims.push_back(make_primitive(make_float3(1.0f, 2.0f, 3.0f), make_float3(0, 0, 1), 1.0f, i));
+  }
+
+  LightTree tree(prims);
+
+  int num_leaves = 0;
+  check_node(tree.get_nodes(), 0, &num_leaves);
+  EXPECT_EQ(num_leaves, 5);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/merge.h"
+
+#include "util/util_foreach.h"
+#include "util/util_path.h"
+#include "util/util_string.h"
+#include "util/util_unique_ptr.h"
+#include "util/util_vector.h"
+
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/imageio.h>
+
+OIIO_NAMESPACE_USING
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Passes that are averaged, summed and copied, and channels outside of any
+ * render layer, which are merged as if rendered with one sample. */
+const char *merge_channels[] = {"View Layer.Combined.R",
+                                "View Layer.Combined.G",
+                                "View Layer.Combined.B",
+                                "View Layer.Combined.A",
+                                "View Layer.Depth.Z",
+                                "View Layer.Debug Render Time.X",
+                                "View Layer.Normal.X",
+                                "View Layer.Normal.Y",
+                                "View Layer.Normal.Z",
+                                "Mask",
+                                "IndexMA"};
+const int num_merge_channels = sizeof(merge_channels) / sizeof(*merge_channels);
+
+enum MergeOp { MERGE_AVERAGE, MERGE_SUM, MERGE_COPY, MERGE_AVERAGE_UNLAYERED };
+const MergeOp merge_ops[] = {MERGE_AVERAGE,
+                             MERGE_AVERAGE,
+                             MERGE_AVERAGE,
+                             MERGE_AVERAGE,
+                             MERGE_COPY,
+                             MERGE_SUM,
+                             MERGE_AVERAGE,
+                             MERGE_AVERAGE,
+                             MERGE_AVERAGE,
+                             MERGE_AVERAGE_UNLAYERED,
+                             MERGE_COPY};
+
+string temp_filepath()
+{
+  return path_join(Filesystem::temp_directory_path(),
+                   Filesystem::unique_path("cycles-merge-%%%%%%%%.exr"));
+}
+
+/* Render result with the given number of samples, in tiles whose height
+ * doesn't divide the image height. */
+bool write_render(
+    const string &filepath, int width, int height, int samples, int seed, vector<float> &pixels)
+{
+  ImageSpec spec(width, height, num_merge_channels, TypeDesc::FLOAT);
+  spec.channelnames.assign(merge_channels, merge_channels + num_merge_channels);
+  spec.tile_width = 4;
+  spec.tile_height = 4;
+  spec.attribute("cycles.View Layer.samples", TypeDesc::STRING, string_printf("%d", samples));
+
+  pixels.resize((size_t)width * height * num_merge_channels);
+  uint state = 1 + seed;
+  for (size_t i = 0; i < pixels.size(); i++) {
+    state = state * 1103515245u + 12345u;
+    pixels[i] = (float)((state >> 8) & 0xffff) / 65535.0f;
+  }
+
+  unique_ptr<ImageOutput> out(ImageOutput::create(filepath));
+  if (!out || !out->open(filepath, spec)) {
+    return false;
+  }
+  const bool ok = out->write_image(TypeDesc::FLOAT, pixels.data());
+  return out->close() && ok;
+}
+
+bool read_image(const string &filepath, ImageSpec &spec, vector<float> &pixels)
+{
+  unique_ptr<ImageInput> in(ImageInput::open(filepath));
+  if (!in) {
+    return false;
+  }
+  spec = in->spec();
+  pixels.resize((size_t)spec.width * spec.height * spec.nchannels);
+  const bool ok = in->read_image(TypeDesc::FLOAT, pixels.data());
+  return in->close() && ok;
+}
+
+}  // namespace
+
+class RenderMerge : public testing::Test {
+ protected:
+  static const int width = 13, height = 11;
+  vector<string> inputs;
+  vector<string> outputs;
+  vector<int> input_samples;
+  vector<vector<float>> input_pixels;
+
+  virtual void SetUp()
+  {
+    const int samples[] = {16, 32, 8};
+    input_samples.assign(samples, samples + sizeof(samples) / sizeof(*samples));
+    input_pixels.resize(input_samples.size());
+
+    for (int i = 0; i < input_samples.size(); i++) {
+      inputs.push_back(temp_filepath());
+      ASSERT_TRUE(
+          write_render(inputs.back(), width, height, input_samples[i], i, input_pixels[i]))
+          << inputs.back();
+    }
+  }
+
+  virtual void TearDown()
+  {
+    foreach (const string &filepath, inputs) {
+      path_remove(filepath);
+    }
+    foreach (const string &filepath, outputs) {
+      path_remove(filepath);
+    }
+  }
+
+  void merge(size_t memory_budget, ImageSpec &spec, vector<float> &pixels)
+  {
+    outputs.push_back(temp_filepath());
+
+    ImageMerger merger;
+    merger.input = inputs;
+    merger.output = outputs.back();
+    merger.memory_budget = memory_budget;
+    ASSERT_TRUE(merger.run()) << merger.error;
+
+    ASSERT_TRUE(read_image(outputs.back(), spec, pixels)) << outputs.back();
+  }
+
+  /* Merged value of a channel of a pixel, computed from the input pixels. */
+  float expected_value(size_t pixel, int channel) const
+  {
+    int total_samples = 0;
+    for (int i = 0; i < input_samples.size(); i++) {
+      total_samples += (merge_ops[channel] == MERGE_AVERAGE) ? input_samples[i] : 1;
+    }
+
+    float value = 0.0f;
+    for (int i = 0; i < input_pixels.size(); i++) {
+      const float input = input_pixels[i][pixel * num_merge_channels + channel];
+      switch (merge_ops[channel]) {
+        case MERGE_AVERAGE:
+          value += (float)input_samples[i] / (float)total_samples * input;
+          break;
+        case MERGE_AVERAGE_UNLAYERED:
+          value += 1.0f / (float)total_samples * input;
+          break;
+        case MERGE_SUM:
+          value += input;
+          break;
+        case MERGE_COPY:
+          /* First image wins. */
+          return input;
+      }
+    }
+    return value;
+  }
+};
+
+/* Averaged passes are weighted by the samples of each input, summed passes
+ * are added and other passes are taken from the first input. */
+TEST_F(RenderMerge, merged_values)
+{
+  ImageSpec spec;
+  vector<float> pixels;
+  merge((size_t)256 * 1024 * 1024, spec, pixels);
+
+  ASSERT_EQ(spec.nchannels, num_merge_channels);
+  EXPECT_EQ(spec.get_string_attribute("cycles.View Layer.samples"), "56");
+
+  for (int channel = 0; channel < num_merge_channels; channel++) {
+    ASSERT_EQ(spec.channelnames[channel], merge_channels[channel]);
+    for (size_t pixel = 0; pixel < (size_t)width * height; pixel++) {
+      EXPECT_NEAR(pixels[pixel * num_merge_channels + channel],
+                  expected_value(pixel, channel),
+                  1e-6f)
+          << spec.channelnames[channel] << " pixel=" << pixel;
+    }
+  }
+}
+
+/* Merging in bands of scanlines must give exactly the same image as merging
+ * all scanlines at once. */
+TEST_F(RenderMerge, bands_match_single_band)
+{
+  ImageSpec spec;
+  vector<float> pixels;
+  merge((size_t)256 * 1024 * 1024, spec, pixels);
+  EXPECT_EQ(spec.nchannels, num_merge_channels);
+
+  /* Scanline size of the output and all inputs, to get bands of one row of
+   * input tiles and bands of two rows that don't divide the image height. */
+  const size_t scanline_size = (size_t)width * num_merge_channels * (inputs.size() + 1) *
+                               sizeof(float);
+  const size_t budgets[] = {1, 9 * scanline_size};
+
+  for (int i = 0; i < sizeof(budgets) / sizeof(*budgets); i++) {
+    ImageSpec band_spec;
+    vector<float> band_pixels;
+    merge(budgets[i], band_spec, band_pixels);
+
+    /* Output is written in scanlines, also for tiled inputs. */
+    EXPECT_EQ(band_spec.tile_width, 0);
+    EXPECT_EQ(band_spec.channelnames, spec.channelnames);
+    ASSERT_EQ(band_pixels.size(), pixels.size());
+    for (size_t j = 0; j < pixels.size(); j++) {
+      EXPECT_EQ(band_pixels[j], pixels[j]) << "budget=" << budgets[i] << " index=" << j;
+    }
+  }
+}
+
+CCL_NAMESPACE_END
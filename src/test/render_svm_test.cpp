@@ -0,0 +1,253 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "device/device.h"
+#include "render/graph.h"
+#include "render/nodes.h"
+#include "render/scene.h"
+#include "render/shader.h"
+#include "render/svm.h"
+#include "util/util_array.h"
+#include "util/util_path.h"
+#include "util/util_progress.h"
+
+#include <OpenImageIO/filesystem.h>
+
+OIIO_NAMESPACE_USING
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Shader manager which compiles single shaders like a device update does. */
+class SVMShaderCompiler : public SVMShaderManager {
+ public:
+  void compile(Scene *scene,
+               Shader *shader,
+               array<int4> &svm_nodes,
+               SVMCompiler::Summary &summary)
+  {
+    Progress progress;
+    device_update_shader(scene, shader, &progress, &svm_nodes, &summary);
+  }
+
+  size_t num_cached() const
+  {
+    return cache.size();
+  }
+
+  /* Load nodes stored in the shader cache path, like a later session does. */
+  bool load(Scene *scene, const string &key, array<int4> &svm_nodes)
+  {
+    CachedShader cached;
+    if (!load_cached_shader(scene, key, cached)) {
+      return false;
+    }
+    svm_nodes = cached.svm_nodes;
+    return true;
+  }
+};
+
+/* Noise texture emission, optionally with the noise used for bump mapping, which
+ * adds copies of the noise nodes that only differ in their bump offset. */
+Shader *create_noise_shader(bool use_bump)
+{
+  ShaderGraph *graph = new ShaderGraph();
+
+  ShaderNode *noise = graph->add(new NoiseTextureNode());
+  ShaderNode *emission = graph->add(new EmissionNode());
+  graph->connect(noise->output("Color"), emission->input("Color"));
+  graph->connect(emission->output("Emission"), graph->output()->input("Surface"));
+
+  if (use_bump) {
+    ShaderNode *displacement = graph->add(new DisplacementNode());
+    graph->connect(noise->output("Fac"), displacement->input("Height"));
+    graph->connect(displacement->output("Displacement"),
+                   graph->output()->input("Displacement"));
+  }
+
+  Shader *shader = new Shader();
+  shader->name = (use_bump) ? "noise_bump" : "noise";
+  shader->displacement_method = DISPLACE_BUMP;
+  shader->set_graph(graph);
+  return shader;
+}
+
+/* Emission of a color attribute looked up by name, whose ID depends on the
+ * attributes looked up before it. */
+Shader *create_attribute_shader()
+{
+  ShaderGraph *graph = new ShaderGraph();
+
+  AttributeNode *attribute = new AttributeNode();
+  attribute->attribute = ustring("paint");
+  graph->add(attribute);
+  ShaderNode *emission = graph->add(new EmissionNode());
+  graph->connect(attribute->output("Color"), emission->input("Color"));
+  graph->connect(emission->output("Emission"), graph->output()->input("Surface"));
+
+  Shader *shader = new Shader();
+  shader->name = "attribute";
+  shader->set_graph(graph);
+  return shader;
+}
+
+void expect_same_nodes(const array<int4> &a, const array<int4> &b)
+{
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].x, b[i].x) << "node " << i;
+    EXPECT_EQ(a[i].y, b[i].y) << "node " << i;
+    EXPECT_EQ(a[i].z, b[i].z) << "node " << i;
+    EXPECT_EQ(a[i].w, b[i].w) << "node " << i;
+  }
+}
+
+}  // namespace
+
+class RenderSVM : public testing::Test {
+ protected:
+  Stats stats;
+  Profiler profiler;
+  DeviceInfo device_info;
+  Device *device_cpu;
+  SceneParams scene_params;
+  Scene *scene;
+
+  virtual void SetUp()
+  {
+    device_cpu = Device::create(device_info, stats, profiler, true);
+    scene = new Scene(scene_params, device_cpu);
+  }
+
+  virtual void TearDown()
+  {
+    delete scene;
+    delete device_cpu;
+  }
+
+  /* Compiles two identical shaders with one manager, so the second one reuses
+   * the nodes of the first, and a third one with a manager of its own. */
+  void test_cache_hit(bool use_bump)
+  {
+    Shader *cached_shader = create_noise_shader(use_bump);
+    Shader *hit_shader = create_noise_shader(use_bump);
+    Shader *fresh_shader = create_noise_shader(use_bump);
+
+    SVMShaderCompiler cache_compiler, fresh_compiler;
+    array<int4> cached_nodes, hit_nodes, fresh_nodes;
+    SVMCompiler::Summary cached_summary, hit_summary, fresh_summary;
+
+    cache_compiler.compile(scene, cached_shader, cached_nodes, cached_summary);
+    cache_compiler.compile(scene, hit_shader, hit_nodes, hit_summary);
+    EXPECT_EQ(cache_compiler.num_cached(), 1);
+
+    fresh_compiler.compile(scene, fresh_shader, fresh_nodes, fresh_summary);
+
+    expect_same_nodes(hit_nodes, fresh_nodes);
+    expect_same_nodes(cached_nodes, fresh_nodes);
+    EXPECT_EQ(hit_summary.num_svm_nodes, fresh_summary.num_svm_nodes);
+    EXPECT_EQ(hit_summary.peak_stack_usage, fresh_summary.peak_stack_usage);
+
+    EXPECT_EQ(hit_shader->has_surface, fresh_shader->has_surface);
+    EXPECT_EQ(hit_shader->has_surface_emission, fresh_shader->has_surface_emission);
+    EXPECT_EQ(hit_shader->has_bump, fresh_shader->has_bump);
+    EXPECT_EQ(hit_shader->has_bump, use_bump);
+    EXPECT_EQ(hit_shader->has_displacement, fresh_shader->has_displacement);
+    EXPECT_EQ(hit_shader->has_attribute_dependency, fresh_shader->has_attribute_dependency);
+
+    delete cached_shader;
+    delete hit_shader;
+    delete fresh_shader;
+  }
+};
+
+TEST_F(RenderSVM, cache_hit_matches_fresh_compile)
+{
+  test_cache_hit(false);
+}
+
+TEST_F(RenderSVM, cache_hit_matches_fresh_compile_bump)
+{
+  test_cache_hit(true);
+}
+
+TEST_F(RenderSVM, cache_separates_bump)
+{
+  Shader *shader = create_noise_shader(false);
+  Shader *bump_shader = create_noise_shader(true);
+
+  SVMShaderCompiler compiler;
+  array<int4> nodes, bump_nodes;
+  SVMCompiler::Summary summary, bump_summary;
+
+  compiler.compile(scene, shader, nodes, summary);
+  compiler.compile(scene, bump_shader, bump_nodes, bump_summary);
+  EXPECT_EQ(compiler.num_cached(), 2);
+  EXPECT_NE(nodes.size(), bump_nodes.size());
+
+  delete shader;
+  delete bump_shader;
+}
+
+/* Nodes stored in the shader cache path by one session are loaded by another,
+ * with the attribute IDs of that session. */
+TEST_F(RenderSVM, cache_path_remaps_attributes)
+{
+  const string cache_path = path_join(Filesystem::temp_directory_path(),
+                                      Filesystem::unique_path("cycles-svm-%%%%%%%%"));
+  scene->params.shader_cache_path = cache_path;
+
+  Shader *shader = create_attribute_shader();
+  SVMShaderCompiler compiler;
+  array<int4> nodes;
+  SVMCompiler::Summary summary;
+  compiler.compile(scene, shader, nodes, summary);
+
+  std::vector<string> files;
+  Filesystem::get_directory_entries(cache_path, files);
+  ASSERT_EQ(files.size(), 1);
+  const string filename = path_filename(files[0]);
+  const string key = filename.substr(0, filename.size() - strlen(".svm"));
+
+  /* Another session, which looked up another attribute first. */
+  Scene *session_scene = new Scene(scene_params, device_cpu);
+  session_scene->shader_manager->get_attribute_id(ustring("other"));
+  EXPECT_NE(session_scene->shader_manager->get_attribute_id(ustring("paint")),
+            scene->shader_manager->get_attribute_id(ustring("paint")));
+
+  SVMShaderCompiler session_compiler;
+  array<int4> loaded_nodes;
+  EXPECT_TRUE(session_compiler.load(session_scene, key, loaded_nodes));
+
+  Shader *session_shader = create_attribute_shader();
+  SVMShaderCompiler fresh_compiler;
+  array<int4> fresh_nodes;
+  SVMCompiler::Summary fresh_summary;
+  fresh_compiler.compile(session_scene, session_shader, fresh_nodes, fresh_summary);
+
+  expect_same_nodes(loaded_nodes, fresh_nodes);
+
+  delete shader;
+  delete session_shader;
+  delete session_scene;
+  path_remove(files[0]);
+  path_remove(cache_path);
+}
+
+CCL_NAMESPACE_END
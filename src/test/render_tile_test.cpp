@@ -0,0 +1,118 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/tile.h"
+
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+const int image_size = 256;
+
+void reset_tile_manager(TileManager &tile_manager)
+{
+  BufferParams buffer_params;
+  buffer_params.width = buffer_params.full_width = image_size;
+  buffer_params.height = buffer_params.full_height = image_size;
+
+  tile_manager.use_work_stealing = true;
+  tile_manager.reset(buffer_params, 1);
+  ASSERT_TRUE(tile_manager.next());
+}
+
+/* Acquires tiles for the device until it runs out, counting how often each
+ * pixel is covered. */
+int render_tiles(TileManager &tile_manager, int device, vector<int> &coverage)
+{
+  int num_tiles = 0;
+  Tile *tile;
+  while (tile_manager.next_tile(tile, device)) {
+    for (int y = tile->y; y < tile->y + tile->h; y++) {
+      for (int x = tile->x; x < tile->x + tile->w; x++) {
+        coverage[y * image_size + x]++;
+      }
+    }
+    EXPECT_EQ(tile->device, device);
+    num_tiles++;
+  }
+  return num_tiles;
+}
+
+}  // namespace
+
+TEST(render_tile, work_stealing)
+{
+  /* Like a progressive refine render on two devices, where each device has its
+   * own list of tiles. */
+  TileManager tile_manager(
+      false, 1, make_int2(64, 64), INT_MAX, true, true, TILE_LEFT_TO_RIGHT, 2);
+  reset_tile_manager(tile_manager);
+
+  /* The first device renders all of its own tiles, steals the tiles of the
+   * second device and splits the last ones. */
+  vector<int> coverage(image_size * image_size, 0);
+  const int num_tiles = render_tiles(tile_manager, 0, coverage);
+
+  EXPECT_GT(tile_manager.state.num_stolen_tiles, 0);
+  EXPECT_GT(tile_manager.state.num_split_tiles, 0);
+  EXPECT_EQ(num_tiles, tile_manager.state.num_tiles);
+  EXPECT_EQ(render_tiles(tile_manager, 1, coverage), 0);
+
+  for (int i = 0; i < coverage.size(); i++) {
+    EXPECT_EQ(coverage[i], 1);
+  }
+}
+
+TEST(render_tile, split_shared_list)
+{
+  /* Tiles of a final render are shared by all devices, the last one is split. */
+  TileManager tile_manager(
+      false, 1, make_int2(64, 64), INT_MAX, false, true, TILE_LEFT_TO_RIGHT, 2);
+  reset_tile_manager(tile_manager);
+
+  vector<int> coverage(image_size * image_size, 0);
+  const int num_tiles = render_tiles(tile_manager, 0, coverage) +
+                        render_tiles(tile_manager, 1, coverage);
+
+  EXPECT_EQ(tile_manager.state.num_stolen_tiles, 0);
+  EXPECT_GT(tile_manager.state.num_split_tiles, 0);
+  EXPECT_GT(num_tiles, 16);
+  EXPECT_EQ(num_tiles, tile_manager.state.num_tiles);
+
+  for (int i = 0; i < coverage.size(); i++) {
+    EXPECT_EQ(coverage[i], 1);
+  }
+}
+
+TEST(render_tile, no_stealing)
+{
+  /* Without stealing devices only get their own tiles, which are never split. */
+  TileManager tile_manager(
+      false, 1, make_int2(64, 64), INT_MAX, true, true, TILE_LEFT_TO_RIGHT, 2);
+  reset_tile_manager(tile_manager);
+  tile_manager.use_work_stealing = false;
+
+  vector<int> coverage(image_size * image_size, 0);
+  EXPECT_EQ(render_tiles(tile_manager, 0, coverage), 8);
+  EXPECT_EQ(render_tiles(tile_manager, 1, coverage), 8);
+  EXPECT_EQ(tile_manager.state.num_split_tiles, 0);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_mapped_malloc.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* File backed memory is not supported on Windows. */
+#ifndef _WIN32
+TEST(util_mapped_malloc, read_after_release)
+{
+  const size_t num_values = 1024 * 1024;
+  int *mem = (int *)util_mapped_malloc(num_values * sizeof(int), "");
+  ASSERT_TRUE(mem != NULL);
+  EXPECT_TRUE(util_mapped_is_mapped(mem));
+  EXPECT_TRUE(util_mapped_is_mapped(mem + num_values / 2));
+  EXPECT_EQ(mem[0], 0);
+
+  for (size_t i = 0; i < num_values; i++) {
+    mem[i] = (int)i;
+  }
+
+  /* Released pages are read back from the file. */
+  util_mapped_release(mem + 1000, 100000 * sizeof(int));
+  util_mapped_release(mem, num_values * sizeof(int));
+
+  bool equal = true;
+  for (size_t i = 0; i < num_values; i++) {
+    equal = equal && (mem[i] == (int)i);
+  }
+  EXPECT_TRUE(equal);
+
+  EXPECT_TRUE(util_mapped_free(mem));
+  EXPECT_FALSE(util_mapped_is_mapped(mem));
+}
+#endif /* _WIN32 */
+
+TEST(util_mapped_malloc, not_mapped)
+{
+  int value = 0;
+  EXPECT_FALSE(util_mapped_is_mapped(&value));
+  EXPECT_FALSE(util_mapped_free(&value));
+
+  /* Releasing memory that is not mapped does nothing. */
+  util_mapped_release(&value, sizeof(value));
+  EXPECT_EQ(value, 0);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_sparse_grid.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Resolution that is not a multiple of the tile size, to cover padded tiles. */
+const int3 resolution = make_int3(19, 10, 21);
+
+size_t dense_index(int x, int y, int z)
+{
+  return x + resolution.x * (y + (size_t)resolution.y * z);
+}
+
+float sparse_value(const vector<int> &index, const vector<float> &tiles, int x, int y, int z)
+{
+  const int tile = index[sparse_grid_tile_index(resolution, x, y, z)];
+  return (tile == -1) ? 0.0f : tiles[sparse_grid_voxel_offset(tile, x, y, z)];
+}
+
+}  // namespace
+
+TEST(util_sparse_grid, index_size)
+{
+  EXPECT_EQ(sparse_grid_index_size(make_int3(8, 8, 8)), (size_t)1);
+  EXPECT_EQ(sparse_grid_index_size(make_int3(9, 8, 8)), (size_t)2);
+  EXPECT_EQ(sparse_grid_index_size(resolution), (size_t)(3 * 2 * 3));
+}
+
+TEST(util_sparse_grid, empty)
+{
+  vector<float> voxels(dense_index(0, 0, resolution.z), 0.0f);
+  vector<int> index(sparse_grid_index_size(resolution));
+
+  EXPECT_EQ(sparse_grid_build_index(&voxels[0], resolution, &index[0]), 0);
+  for (size_t i = 0; i < index.size(); i++) {
+    EXPECT_EQ(index[i], -1);
+  }
+}
+
+TEST(util_sparse_grid, lookup)
+{
+  vector<float> voxels(dense_index(0, 0, resolution.z), 0.0f);
+  voxels[dense_index(0, 0, 0)] = 1.0f;
+  voxels[dense_index(7, 7, 7)] = 2.0f;
+  voxels[dense_index(18, 9, 20)] = 3.0f;
+  voxels[dense_index(8, 3, 16)] = -4.0f;
+
+  vector<int> index(sparse_grid_index_size(resolution));
+  const int num_tiles = sparse_grid_build_index(&voxels[0], resolution, &index[0]);
+  EXPECT_EQ(num_tiles, 3);
+
+  vector<float> tiles(num_tiles * SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE *
+                      SPARSE_GRID_TILE_SIZE);
+  sparse_grid_fill_tiles(&voxels[0], resolution, &index[0], &tiles[0]);
+
+  /* Every voxel reads back the same as in the dense grid. */
+  for (int z = 0; z < resolution.z; z++) {
+    for (int y = 0; y < resolution.y; y++) {
+      for (int x = 0; x < resolution.x; x++) {
+        EXPECT_EQ(sparse_value(index, tiles, x, y, z), voxels[dense_index(x, y, z)]);
+      }
+    }
+  }
+}
+
+TEST(util_sparse_grid, float4)
+{
+  vector<float4> voxels(dense_index(0, 0, resolution.z), make_float4(0.0f, 0.0f, 0.0f, 0.0f));
+  voxels[dense_index(10, 2, 3)] = make_float4(0.0f, 0.0f, 0.0f, 0.5f);
+
+  vector<int> index(sparse_grid_index_size(resolution));
+  const int num_tiles = sparse_grid_build_index(&voxels[0], resolution, &index[0]);
+  ASSERT_EQ(num_tiles, 1);
+  EXPECT_EQ(index[sparse_grid_tile_index(resolution, 10, 2, 3)], 0);
+
+  vector<float4> tiles(SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE);
+  sparse_grid_fill_tiles(&voxels[0], resolution, &index[0], &tiles[0]);
+  EXPECT_EQ(tiles[sparse_grid_voxel_offset(0, 10, 2, 3)].w, 0.5f);
+  EXPECT_EQ(tiles[sparse_grid_voxel_offset(0, 11, 2, 3)].w, 0.0f);
+}
+
+CCL_NAMESPACE_END
@@ -16,7 +16,9 @@
 
 #include "testing/testing.h"
 
+#include "util/util_system.h"
 #include "util/util_task.h"
+#include "util/util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -26,6 +28,27 @@ void task_run()
 {
 }
 
+/* Recursively split work like BVH building does, pushing tasks from within tasks. */
+void task_split(TaskPool *pool, int depth)
+{
+  if (depth > 0) {
+    pool->push(function_bind(&task_split, pool, depth - 1), true);
+    pool->push(function_bind(&task_split, pool, depth - 1), true);
+  }
+}
+
+/* Wait for a separate pool from within a task, like nested parallel loops do. */
+void task_wait_nested_pool(int *num_tasks_handled)
+{
+  TaskPool pool;
+  for (int i = 0; i < 10; ++i) {
+    pool.push(function_bind(task_run));
+  }
+  TaskPool::Summary summary;
+  pool.wait_work(&summary);
+  *num_tasks_handled = summary.num_tasks_handled;
+}
+
 }  // namespace
 
 TEST(util_task, basic)
@@ -56,4 +79,92 @@ TEST(util_task, multiple_times)
   }
 }
 
+TEST(util_task, push_from_tasks)
+{
+  TaskScheduler::init(0);
+  TaskPool pool;
+  for (int i = 0; i < 100; ++i) {
+    pool.push(function_bind(task_split, &pool, 4));
+  }
+  TaskPool::Summary summary;
+  pool.wait_work(&summary);
+  TaskScheduler::exit();
+  EXPECT_EQ(summary.num_tasks_handled, 100 * 31);
+}
+
+TEST(util_task, nested_pool_wait_work)
+{
+  /* With a single worker thread the nested pools only make progress when
+   * wait_work() runs their tasks in the thread that waits for them. */
+  TaskScheduler::init(1);
+  TaskPool pool;
+  int num_tasks_handled[10] = {0};
+  for (int i = 0; i < 10; ++i) {
+    pool.push(function_bind(task_wait_nested_pool, &num_tasks_handled[i]));
+  }
+  pool.wait_work();
+  TaskScheduler::exit();
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(num_tasks_handled[i], 10);
+  }
+}
+
+TEST(util_task, cancel)
+{
+  TaskScheduler::init(1);
+  TaskPool pool;
+  for (int i = 0; i < 10000; ++i) {
+    pool.push(function_bind(task_run), (i % 2) == 0);
+  }
+  pool.cancel();
+  EXPECT_TRUE(pool.finished());
+  TaskScheduler::exit();
+}
+
+TEST(util_task, thread_node)
+{
+  TaskScheduler::init(0);
+  EXPECT_EQ(TaskScheduler::thread_node(0), -1);
+  for (int thread_id = 1; thread_id <= TaskScheduler::num_threads(); ++thread_id) {
+    const int node = TaskScheduler::thread_node(thread_id);
+    EXPECT_GE(node, -1);
+    EXPECT_LT(node, system_cpu_num_numa_nodes());
+  }
+  TaskScheduler::exit();
+}
+
+/* Only prints timings, run it with --gtest_also_run_disabled_tests. */
+TEST(util_task, DISABLED_benchmark)
+{
+  /* Throughput of tiny tasks, pushed from one thread and pushed from within
+   * other tasks, with contention increasing with the number of threads. */
+  const int num_threads[] = {1, 8, 64};
+  const int num_tasks = 200000;
+  const int depth = 16;
+
+  for (int i = 0; i < 3; i++) {
+    TaskScheduler::init(num_threads[i]);
+
+    double start_time = time_dt();
+    TaskPool pool;
+    for (int task = 0; task < num_tasks; ++task) {
+      pool.push(function_bind(task_run));
+    }
+    pool.wait_work();
+    const double flat_time = time_dt() - start_time;
+
+    start_time = time_dt();
+    pool.push(function_bind(task_split, &pool, depth), true);
+    pool.wait_work();
+    const double nested_time = time_dt() - start_time;
+
+    TaskScheduler::exit();
+
+    printf("%d threads: %.0f tasks/s pushed from one thread, %.0f tasks/s pushed from tasks\n",
+           num_threads[i],
+           num_tasks / flat_time,
+           ((2 << depth) - 1) / nested_time);
+  }
+}
+
 CCL_NAMESPACE_END
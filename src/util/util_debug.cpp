@@ -32,7 +32,9 @@ DebugFlags::CPU::CPU()
       sse3(true),
       sse2(true),
       bvh_layout(BVH_LAYOUT_DEFAULT),
-      split_kernel(false)
+      split_kernel(false),
+      packet_camera_rays(false),
+      numa_replicate(false)
 {
   reset();
 }
@@ -63,6 +65,9 @@ void DebugFlags::CPU::reset()
   else if (getenv("CYCLES_BVH4") != NULL) {
     bvh_layout = BVH_LAYOUT_BVH4;
   }
+  else if (getenv("CYCLES_BVH8_QUANTIZED") != NULL) {
+    bvh_layout = BVH_LAYOUT_BVH8_QUANTIZED;
+  }
   else if (getenv("CYCLES_BVH8") != NULL) {
     bvh_layout = BVH_LAYOUT_BVH8;
   }
@@ -71,6 +76,8 @@ void DebugFlags::CPU::reset()
   }
 
   split_kernel = false;
+  packet_camera_rays = (getenv("CYCLES_CPU_PACKET_CAMERA_RAYS") != NULL);
+  numa_replicate = (getenv("CYCLES_CPU_NUMA_REPLICATE") != NULL);
 }
 
 DebugFlags::CUDA::CUDA() : adaptive_compile(false), split_kernel(false)
@@ -153,7 +160,9 @@ std::ostream &operator<<(std::ostream &os, DebugFlagsConstRef debug_flags)
      << "  SSE3       : " << string_from_bool(debug_flags.cpu.sse3) << "\n"
      << "  SSE2       : " << string_from_bool(debug_flags.cpu.sse2) << "\n"
      << "  BVH layout : " << bvh_layout_name(debug_flags.cpu.bvh_layout) << "\n"
-     << "  Split      : " << string_from_bool(debug_flags.cpu.split_kernel) << "\n";
+     << "  Split      : " << string_from_bool(debug_flags.cpu.split_kernel) << "\n"
+     << "  Packets    : " << string_from_bool(debug_flags.cpu.packet_camera_rays) << "\n"
+     << "  NUMA copy  : " << string_from_bool(debug_flags.cpu.numa_replicate) << "\n";
 
   os << "CUDA flags:\n"
      << "  Adaptive Compile : " << string_from_bool(debug_flags.cuda.adaptive_compile) << "\n";
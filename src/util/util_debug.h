@@ -82,6 +82,13 @@ class DebugFlags {
 
     /* Whether split kernel is used */
     bool split_kernel;
+
+    /* Whether camera rays of neighboring pixels are traced together as packets. */
+    bool packet_camera_rays;
+
+    /* Whether scene data is copied to the memory of every NUMA node that
+     * render threads run on. */
+    bool numa_replicate;
   };
 
   /* Descriptor of CUDA feature-set to be used. */
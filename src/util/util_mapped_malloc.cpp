@@ -0,0 +1,173 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_mapped_malloc.h"
+#include "util/util_map.h"
+#include "util/util_path.h"
+#include "util/util_thread.h"
+#include "util/util_vector.h"
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <stdint.h>
+#  include <stdlib.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+CCL_NAMESPACE_BEGIN
+
+#ifndef _WIN32
+
+namespace {
+
+/* Size of every mapped allocation, by start address. */
+thread_mutex mapped_mutex;
+map<const char *, size_t> mapped_sizes;
+
+string mapped_directory(const string &directory)
+{
+  if (!directory.empty()) {
+    return directory;
+  }
+  const char *tmpdir = getenv("TMPDIR");
+  return (tmpdir && tmpdir[0]) ? tmpdir : "/tmp";
+}
+
+/* Find the allocation containing the address, or the end of the map. */
+map<const char *, size_t>::iterator mapped_find(const char *ptr)
+{
+  map<const char *, size_t>::iterator it = mapped_sizes.upper_bound(ptr);
+  if (it == mapped_sizes.begin()) {
+    return mapped_sizes.end();
+  }
+  --it;
+  return (ptr < it->first + it->second) ? it : mapped_sizes.end();
+}
+
+}  // namespace
+
+void *util_mapped_malloc(size_t size, const string &directory)
+{
+  if (size == 0) {
+    return NULL;
+  }
+
+  const string filename = path_join(mapped_directory(directory), "cycles_mapped_XXXXXX");
+  vector<char> filename_template(filename.begin(), filename.end());
+  filename_template.push_back('\0');
+
+  const int fd = mkstemp(&filename_template[0]);
+  if (fd == -1) {
+    return NULL;
+  }
+  /* The file stays around until the memory is unmapped. */
+  unlink(&filename_template[0]);
+
+#  ifdef __linux__
+  /* Reserve disk space, running out of it when pages are written back would
+   * crash instead of failing here. */
+  const bool have_space = (posix_fallocate(fd, 0, size) == 0);
+#  else
+  const bool have_space = (ftruncate(fd, size) == 0);
+#  endif
+  if (!have_space) {
+    close(fd);
+    return NULL;
+  }
+
+  void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    return NULL;
+  }
+
+  thread_scoped_lock lock(mapped_mutex);
+  mapped_sizes[(const char *)ptr] = size;
+  return ptr;
+}
+
+bool util_mapped_free(void *ptr)
+{
+  size_t size;
+  {
+    thread_scoped_lock lock(mapped_mutex);
+    map<const char *, size_t>::iterator it = mapped_sizes.find((const char *)ptr);
+    if (it == mapped_sizes.end()) {
+      return false;
+    }
+    size = it->second;
+    mapped_sizes.erase(it);
+  }
+
+  munmap(ptr, size);
+  return true;
+}
+
+bool util_mapped_is_mapped(const void *ptr)
+{
+  thread_scoped_lock lock(mapped_mutex);
+  return mapped_find((const char *)ptr) != mapped_sizes.end();
+}
+
+void util_mapped_release(void *ptr, size_t size)
+{
+  thread_scoped_lock lock(mapped_mutex);
+  map<const char *, size_t>::iterator it = mapped_find((const char *)ptr);
+  if (it == mapped_sizes.end()) {
+    return;
+  }
+
+  /* Only whole pages can be dropped, pages shared with data outside of the
+   * range stay in memory. */
+  const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t allocation_end = (uintptr_t)(it->first + it->second);
+  const uintptr_t begin = ((uintptr_t)ptr + page_size - 1) & ~(page_size - 1);
+  const uintptr_t range_end = (uintptr_t)ptr + size;
+  const uintptr_t end = ((range_end < allocation_end) ? range_end : allocation_end) &
+                        ~(page_size - 1);
+  if (end <= begin) {
+    return;
+  }
+
+  msync((void *)begin, end - begin, MS_SYNC);
+  madvise((void *)begin, end - begin, MADV_DONTNEED);
+}
+
+#else /* _WIN32 */
+
+void *util_mapped_malloc(size_t /*size*/, const string & /*directory*/)
+{
+  return NULL;
+}
+
+bool util_mapped_free(void * /*ptr*/)
+{
+  return false;
+}
+
+bool util_mapped_is_mapped(const void * /*ptr*/)
+{
+  return false;
+}
+
+void util_mapped_release(void * /*ptr*/, size_t /*size*/)
+{
+}
+
+#endif /* _WIN32 */
+
+CCL_NAMESPACE_END
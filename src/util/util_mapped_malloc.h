@@ -0,0 +1,52 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_MAPPED_MALLOC_H__
+#define __UTIL_MAPPED_MALLOC_H__
+
+#include "util/util_string.h"
+#include "util/util_types.h"
+
+/* Memory backed by a file on disk instead of RAM and swap.
+ *
+ * Each allocation maps its own temporary file, which is removed when the
+ * memory is freed or the process exits. Pages are read from the file when
+ * accessed and can be dropped by the operating system under memory pressure,
+ * so data larger than RAM can still be used at the cost of disk reads. */
+
+CCL_NAMESPACE_BEGIN
+
+/* Allocate memory backed by a new file in the given directory, or in the
+ * system temporary directory when empty. Returns NULL when file backed memory
+ * is not supported or the file could not be created. The memory is page
+ * aligned and initialized to zero. */
+void *util_mapped_malloc(size_t size, const string &directory);
+
+/* Free memory allocated by util_mapped_malloc. Returns false and does nothing
+ * if the memory was not allocated by it. */
+bool util_mapped_free(void *ptr);
+
+/* Test if the memory was allocated by util_mapped_malloc. */
+bool util_mapped_is_mapped(const void *ptr);
+
+/* Write the pages fully inside the range back to their file and drop them
+ * from memory, they are read back when accessed again. Ranges of memory that
+ * was not allocated by util_mapped_malloc are ignored. */
+void util_mapped_release(void *ptr, size_t size);
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_MAPPED_MALLOC_H__ */
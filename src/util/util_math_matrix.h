@@ -154,11 +154,27 @@ ccl_device_inline void math_trimatrix_add_gramian(ccl_global float *A,
                                                   const float *ccl_restrict v,
                                                   float weight)
 {
+#ifdef __KERNEL_AVX2__
+  /* Rows of the packed matrix are contiguous on the CPU, so they are updated
+   * eight columns at a time with the remainder masked out. */
+  const __m256i lane = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  for (int row = 0; row < n; row++) {
+    float *A_row = &MATHS(A, row, 0, 1);
+    const avxf v_row(v[row]);
+    for (int col = 0; col <= row; col += 8) {
+      const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(row + 1 - col), lane);
+      const avxf A_col = _mm256_maskload_ps(A_row + col, active);
+      const avxf v_col = _mm256_maskload_ps(v + col, active);
+      _mm256_maskstore_ps(A_row + col, active, A_col + v_row * v_col * weight);
+    }
+  }
+#else
   for (int row = 0; row < n; row++) {
     for (int col = 0; col <= row; col++) {
       MATHS(A, row, col, 1) += v[row] * v[col] * weight;
     }
   }
+#endif
 }
 
 /* Transpose matrix A inplace. */
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_SPARSE_GRID_H__
+#define __UTIL_SPARSE_GRID_H__
+
+#include <string.h>
+
+#include "util/util_texture.h"
+#include "util/util_types.h"
+
+/* Sparse Volume Grids
+ *
+ * Voxels are grouped in tiles of SPARSE_GRID_TILE_SIZE^3 voxels, and only tiles
+ * with non-zero voxels are stored. The index has one entry per tile, which is
+ * the position of the tile in the stored tiles, or -1 for empty tiles.
+ *
+ * Voxels within a tile are stored in x, y, z order, and tiles at the boundary of
+ * the grid are padded with zeros. */
+
+CCL_NAMESPACE_BEGIN
+
+ccl_device_inline int3 sparse_grid_tiles_resolution(int3 resolution)
+{
+  return make_int3((resolution.x + SPARSE_GRID_TILE_SIZE - 1) >> SPARSE_GRID_TILE_SHIFT,
+                   (resolution.y + SPARSE_GRID_TILE_SIZE - 1) >> SPARSE_GRID_TILE_SHIFT,
+                   (resolution.z + SPARSE_GRID_TILE_SIZE - 1) >> SPARSE_GRID_TILE_SHIFT);
+}
+
+ccl_device_inline size_t sparse_grid_index_size(int3 resolution)
+{
+  const int3 tiles = sparse_grid_tiles_resolution(resolution);
+  return (size_t)tiles.x * tiles.y * tiles.z;
+}
+
+ccl_device_inline size_t sparse_grid_tile_index(int3 resolution, int x, int y, int z)
+{
+  const int3 tiles = sparse_grid_tiles_resolution(resolution);
+  return (size_t)(x >> SPARSE_GRID_TILE_SHIFT) +
+         (size_t)tiles.x * ((y >> SPARSE_GRID_TILE_SHIFT) +
+                            (size_t)tiles.y * (z >> SPARSE_GRID_TILE_SHIFT));
+}
+
+ccl_device_inline size_t sparse_grid_voxel_offset(int tile, int x, int y, int z)
+{
+  const int mask = SPARSE_GRID_TILE_SIZE - 1;
+  return ((size_t)tile << (3 * SPARSE_GRID_TILE_SHIFT)) + (x & mask) +
+         ((y & mask) << SPARSE_GRID_TILE_SHIFT) + ((z & mask) << (2 * SPARSE_GRID_TILE_SHIFT));
+}
+
+#ifndef __KERNEL_GPU__
+
+inline bool sparse_grid_is_zero(float value)
+{
+  return value == 0.0f;
+}
+
+inline bool sparse_grid_is_zero(const float4 &value)
+{
+  return value.x == 0.0f && value.y == 0.0f && value.z == 0.0f && value.w == 0.0f;
+}
+
+/* Fill in the index for a dense grid, returning the number of non-empty tiles. */
+template<typename T>
+int sparse_grid_build_index(const T *voxels, int3 resolution, int *index)
+{
+  const size_t index_size = sparse_grid_index_size(resolution);
+  for (size_t i = 0; i < index_size; i++) {
+    index[i] = -1;
+  }
+
+  int num_tiles = 0;
+  for (int z = 0; z < resolution.z; z++) {
+    for (int y = 0; y < resolution.y; y++) {
+      for (int x = 0; x < resolution.x; x++) {
+        const T &value = voxels[x + resolution.x * (y + (size_t)resolution.y * z)];
+        if (sparse_grid_is_zero(value)) {
+          continue;
+        }
+
+        int &tile = index[sparse_grid_tile_index(resolution, x, y, z)];
+        if (tile == -1) {
+          tile = num_tiles++;
+        }
+      }
+    }
+  }
+
+  return num_tiles;
+}
+
+/* Copy voxels of a dense grid into the non-empty tiles, which must have been
+ * allocated to hold the number of tiles found while building the index. */
+template<typename T>
+void sparse_grid_fill_tiles(const T *voxels, int3 resolution, const int *index, T *tiles)
+{
+  const size_t index_size = sparse_grid_index_size(resolution);
+  size_t num_voxels = 0;
+  for (size_t i = 0; i < index_size; i++) {
+    if (index[i] != -1) {
+      num_voxels += SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE * SPARSE_GRID_TILE_SIZE;
+    }
+  }
+  memset((void *)tiles, 0, sizeof(T) * num_voxels);
+
+  for (int z = 0; z < resolution.z; z++) {
+    for (int y = 0; y < resolution.y; y++) {
+      for (int x = 0; x < resolution.x; x++) {
+        const int tile = index[sparse_grid_tile_index(resolution, x, y, z)];
+        if (tile != -1) {
+          tiles[sparse_grid_voxel_offset(tile, x, y, z)] =
+              voxels[x + resolution.x * (y + (size_t)resolution.y * z)];
+        }
+      }
+    }
+  }
+}
+
+#endif /* __KERNEL_GPU__ */
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_SPARSE_GRID_H__ */
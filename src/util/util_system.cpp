@@ -145,6 +145,19 @@ int system_cpu_num_active_group_processors()
   return numaAPI_GetNumCurrentNodesProcessors();
 }
 
+void *system_cpu_numa_allocate_on_node(size_t size, int node)
+{
+  if (!system_cpu_ensure_initialized()) {
+    return NULL;
+  }
+  return numaAPI_AllocateOnNode(size, node);
+}
+
+void system_cpu_numa_free(void *start, size_t size)
+{
+  numaAPI_Free(start, size);
+}
+
 #if !defined(_WIN32) || defined(FREE_WINDOWS)
 static void __cpuid(int data[4], int selector)
 {
@@ -52,6 +52,12 @@ bool system_cpu_run_thread_on_node(int node);
  * thread affinity). */
 int system_cpu_num_active_group_processors();
 
+/* Allocate memory on a specific node, which must be freed with
+ * system_cpu_numa_free(). Returns NULL if the allocation failed or NUMA is not
+ * supported. */
+void *system_cpu_numa_allocate_on_node(size_t size, int node);
+void system_cpu_numa_free(void *start, size_t size);
+
 string system_cpu_brand_string();
 int system_cpu_bits();
 bool system_cpu_support_sse2();
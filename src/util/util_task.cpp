@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include "util/util_atomic.h"
+#include "util/util_deque.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_system.h"
@@ -71,26 +73,10 @@ void TaskPool::wait_work(Summary *stats)
   while (num != 0) {
     num_lock.unlock();
 
-    thread_scoped_lock queue_lock(TaskScheduler::queue_mutex);
-
     /* find task from this pool. if we get a task from another pool,
      * we can get into deadlock */
     TaskScheduler::Entry work_entry;
-    bool found_entry = false;
-    list<TaskScheduler::Entry>::iterator it;
-
-    for (it = TaskScheduler::queue.begin(); it != TaskScheduler::queue.end(); it++) {
-      TaskScheduler::Entry &entry = *it;
-
-      if (entry.pool == this) {
-        work_entry = entry;
-        found_entry = true;
-        TaskScheduler::queue.erase(it);
-        break;
-      }
-    }
-
-    queue_lock.unlock();
+    bool found_entry = TaskScheduler::pop(this, work_entry);
 
     /* if found task, do it, otherwise wait until other tasks are done */
     if (found_entry) {
@@ -189,14 +175,65 @@ void TaskPool::num_increase()
 thread_mutex TaskScheduler::mutex;
 int TaskScheduler::users = 0;
 vector<thread *> TaskScheduler::threads;
+vector<int> TaskScheduler::thread_nodes;
 bool TaskScheduler::do_exit = false;
 
-list<TaskScheduler::Entry> TaskScheduler::queue;
-thread_mutex TaskScheduler::queue_mutex;
-thread_condition_variable TaskScheduler::queue_cond;
+/* Tasks pushed to the front have priority. The thread owning the queue runs
+ * them most recent first, like a stack, and other threads steal the oldest ones,
+ * which for recursive tasks are the largest. Other tasks run in the order they
+ * were pushed.
+ *
+ * The lock is only contended when other threads steal from the queue. */
+struct TaskScheduler::TaskQueue {
+  thread_mutex lock;
+  deque<Entry> priority;
+  deque<Entry> normal;
+
+  /* Take a task from the given end of a queue, or search the queue for a task
+   * from the given pool. */
+  static bool take(deque<Entry> &queue, TaskPool *pool, bool back, Entry &entry)
+  {
+    if (queue.empty()) {
+      return false;
+    }
+
+    if (pool == NULL) {
+      if (back) {
+        entry = queue.back();
+        queue.pop_back();
+      }
+      else {
+        entry = queue.front();
+        queue.pop_front();
+      }
+      return true;
+    }
+
+    for (deque<Entry>::iterator it = queue.begin(); it != queue.end(); it++) {
+      if (it->pool == pool) {
+        entry = *it;
+        queue.erase(it);
+        return true;
+      }
+    }
+
+    return false;
+  }
+};
+
+TaskScheduler::TaskQueue TaskScheduler::shared_queue;
+vector<TaskScheduler::TaskQueue *> TaskScheduler::thread_queues;
+
+int TaskScheduler::num_queued = 0;
+int TaskScheduler::num_parked = 0;
+thread_mutex TaskScheduler::park_mutex;
+thread_condition_variable TaskScheduler::park_cond;
 
 namespace {
 
+/* ID of the worker thread, zero for other threads. */
+thread_local int worker_thread_id = 0;
+
 /* Get number of processors on each of the available nodes. The result is sized
  * by the highest node index, and element corresponds to number of processors on
  * that node.
@@ -237,28 +274,40 @@ vector<int> distribute_threads_on_nodes(const int num_threads)
 {
   /* Start with all threads unassigned to any specific NUMA node. */
   vector<int> thread_nodes(num_threads, -1);
+  vector<int> num_per_node_processors;
+  get_per_node_num_processors(&num_per_node_processors);
+  if (num_per_node_processors.size() == 0) {
+    /* Error was already reported, here we can't do anything, so we simply
+     * leave default affinity to all the worker threads. */
+    return thread_nodes;
+  }
+  const int num_nodes = num_per_node_processors.size();
+  const int num_total_node_processors = get_num_total_processors(num_per_node_processors);
+  int num_available_nodes = 0;
+  foreach (int num_node_processors, num_per_node_processors) {
+    if (num_node_processors != 0) {
+      ++num_available_nodes;
+    }
+  }
   const int num_active_group_processors = system_cpu_num_active_group_processors();
   VLOG(1) << "Detected " << num_active_group_processors << " processors "
-          << "in active group.";
-  if (num_active_group_processors >= num_threads) {
+          << "in active group, " << num_available_nodes << " available NUMA nodes.";
+  if (num_active_group_processors >= num_threads &&
+      (num_available_nodes <= 1 || num_active_group_processors < num_total_node_processors)) {
     /* If the current thread is set up in a way that its affinity allows to
      * use at least requested number of threads we do not explicitly set
      * affinity to the worker threads.
      * This way we allow users to manually edit affinity of the parent
      * thread, and here we follow that affinity. This way it's possible to
      * have two Cycles/Blender instances running manually set to a different
-     * dies on a CPU. */
+     * dies on a CPU.
+     *
+     * Without a manually restricted affinity on a machine with multiple NUMA
+     * nodes threads are still pinned to nodes, so that they keep using the
+     * memory local to their node. */
     VLOG(1) << "Not setting thread group affinity.";
     return thread_nodes;
   }
-  vector<int> num_per_node_processors;
-  get_per_node_num_processors(&num_per_node_processors);
-  if (num_per_node_processors.size() == 0) {
-    /* Error was already reported, here we can't do anything, so we simply
-     * leave default affinity to all the worker threads. */
-    return thread_nodes;
-  }
-  const int num_nodes = num_per_node_processors.size();
   int thread_index = 0;
   /* First pass: fill in all the nodes to their maximum.
    *
@@ -268,7 +317,6 @@ vector<int> distribute_threads_on_nodes(const int num_threads)
    * TODO(sergey): Consider picking up fastest nodes if number of threads
    * fits on them. For example, on Threadripper2 we might consider using nodes
    * 0 and 2 if user requested 32 render threads. */
-  const int num_total_node_processors = get_num_total_processors(num_per_node_processors);
   int current_node_index = 0;
   while (thread_index < num_total_node_processors && thread_index < num_threads) {
     const int num_node_processors = num_per_node_processors[current_node_index];
@@ -302,6 +350,7 @@ vector<int> distribute_threads_on_nodes(const int num_threads)
       current_node_index = (current_node_index + 1) % num_nodes;
     }
     VLOG(1) << "Scheduling thread " << thread_index << " to node " << current_node_index << ".";
+    thread_nodes[thread_index] = current_node_index;
     ++thread_index;
     current_node_index = (current_node_index + 1) % num_nodes;
   }
@@ -329,9 +378,14 @@ void TaskScheduler::init(int num_threads)
   VLOG(1) << "Creating pool of " << num_threads << " threads.";
 
   /* Compute distribution on NUMA nodes. */
-  vector<int> thread_nodes = distribute_threads_on_nodes(num_threads);
+  thread_nodes = distribute_threads_on_nodes(num_threads);
 
   /* Launch threads that will be waiting for work. */
+  thread_queues.resize(num_threads);
+  for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
+    thread_queues[thread_index] = new TaskQueue();
+  }
+
   threads.resize(num_threads);
   for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
     threads[thread_index] = new thread(function_bind(&TaskScheduler::thread_run, thread_index + 1),
@@ -346,10 +400,10 @@ void TaskScheduler::exit()
   if (users == 0) {
     VLOG(1) << "De-initializing thread pool of task scheduler.";
     /* stop all waiting threads */
-    TaskScheduler::queue_mutex.lock();
+    park_mutex.lock();
     do_exit = true;
-    TaskScheduler::queue_cond.notify_all();
-    TaskScheduler::queue_mutex.unlock();
+    park_cond.notify_all();
+    park_mutex.unlock();
 
     /* delete threads */
     foreach (thread *t, threads) {
@@ -357,6 +411,12 @@ void TaskScheduler::exit()
       delete t;
     }
     threads.clear();
+    thread_nodes.clear();
+
+    foreach (TaskQueue *queue, thread_queues) {
+      delete queue;
+    }
+    thread_queues.clear();
   }
 }
 
@@ -364,34 +424,94 @@ void TaskScheduler::free_memory()
 {
   assert(users == 0);
   threads.free_memory();
+  thread_nodes.free_memory();
+  thread_queues.free_memory();
 }
 
-bool TaskScheduler::thread_wait_pop(Entry &entry)
+int TaskScheduler::thread_node(int thread_id)
 {
-  thread_scoped_lock queue_lock(queue_mutex);
+  if (thread_id == 0 || thread_id > (int)thread_nodes.size()) {
+    return -1;
+  }
+  return thread_nodes[thread_id - 1];
+}
 
-  while (queue.empty() && !do_exit)
-    queue_cond.wait(queue_lock);
+TaskScheduler::TaskQueue *TaskScheduler::thread_queue(int thread_id)
+{
+  return (thread_id == 0) ? &shared_queue : thread_queues[thread_id - 1];
+}
 
-  if (queue.empty()) {
-    assert(do_exit);
+bool TaskScheduler::pop(TaskPool *pool, Entry &entry)
+{
+  const int thread_id = worker_thread_id;
+  const int num_queues = thread_queues.size() + 1;
+  bool found = false;
+
+  /* Tasks of the own queue first, most recent priority tasks first. */
+  TaskQueue *own_queue = thread_queue(thread_id);
+  own_queue->lock.lock();
+  found = TaskQueue::take(own_queue->priority, pool, true, entry) ||
+          TaskQueue::take(own_queue->normal, pool, false, entry);
+  own_queue->lock.unlock();
+
+  /* Steal from other queues, priority tasks of all queues first. */
+  if (!found && atomic_add_and_fetch_int32(&num_queued, 0) <= 0) {
     return false;
   }
 
-  entry = queue.front();
-  queue.pop_front();
+  for (int priority = 1; priority >= 0 && !found; priority--) {
+    for (int i = 1; i < num_queues && !found; i++) {
+      TaskQueue *queue = thread_queue((thread_id + i) % num_queues);
+      queue->lock.lock();
+      found = (priority) ? TaskQueue::take(queue->priority, pool, false, entry) :
+                           TaskQueue::take(queue->normal, pool, false, entry);
+      queue->lock.unlock();
+    }
+  }
 
-  return true;
+  if (found) {
+    atomic_sub_and_fetch_int32(&num_queued, 1);
+  }
+
+  return found;
+}
+
+bool TaskScheduler::thread_wait_pop(int thread_id, Entry &entry)
+{
+  for (;;) {
+    if (pop(NULL, entry)) {
+      return true;
+    }
+
+    /* Sleep until tasks are pushed. The counters are updated with full memory
+     * barriers, so either this thread sees the new task or the pushing thread
+     * sees this thread sleeping. */
+    thread_scoped_lock park_lock(park_mutex);
+    atomic_add_and_fetch_int32(&num_parked, 1);
+    while (atomic_add_and_fetch_int32(&num_queued, 0) <= 0 && !do_exit) {
+      THREADING_DEBUG("thread %d parked in TaskScheduler::thread_wait_pop\n", thread_id);
+      park_cond.wait(park_lock);
+    }
+    atomic_sub_and_fetch_int32(&num_parked, 1);
+
+    /* Tasks may have been taken by other threads since, in which case keep
+     * waiting unless exiting. */
+    if (do_exit && atomic_add_and_fetch_int32(&num_queued, 0) <= 0) {
+      return false;
+    }
+  }
 }
 
 void TaskScheduler::thread_run(int thread_id)
 {
   Entry entry;
 
+  worker_thread_id = thread_id;
+
   /* todo: test affinity/denormal mask */
 
   /* keep popping off tasks */
-  while (thread_wait_pop(entry)) {
+  while (thread_wait_pop(thread_id, entry)) {
     /* run task */
     entry.task->run(thread_id);
 
@@ -407,39 +527,43 @@ void TaskScheduler::push(Entry &entry, bool front)
 {
   entry.pool->num_increase();
 
-  /* add entry to queue */
-  TaskScheduler::queue_mutex.lock();
+  /* add entry to the queue of this thread */
+  TaskQueue *queue = thread_queue(worker_thread_id);
+  queue->lock.lock();
   if (front)
-    TaskScheduler::queue.push_front(entry);
+    queue->priority.push_back(entry);
   else
-    TaskScheduler::queue.push_back(entry);
-
-  TaskScheduler::queue_cond.notify_one();
-  TaskScheduler::queue_mutex.unlock();
+    queue->normal.push_back(entry);
+  queue->lock.unlock();
+
+  /* wake up a sleeping thread */
+  atomic_add_and_fetch_int32(&num_queued, 1);
+  if (atomic_add_and_fetch_int32(&num_parked, 0) > 0) {
+    thread_scoped_lock park_lock(park_mutex);
+    park_cond.notify_one();
+  }
 }
 
 void TaskScheduler::clear(TaskPool *pool)
 {
-  thread_scoped_lock queue_lock(TaskScheduler::queue_mutex);
-
-  /* erase all tasks from this pool from the queue */
-  list<Entry>::iterator it = queue.begin();
+  /* erase all tasks from this pool from the queues */
+  const int num_queues = thread_queues.size() + 1;
+  Entry entry;
   int done = 0;
 
-  while (it != queue.end()) {
-    Entry &entry = *it;
+  for (int i = 0; i < num_queues; i++) {
+    TaskQueue *queue = thread_queue(i);
 
-    if (entry.pool == pool) {
+    queue->lock.lock();
+    while (TaskQueue::take(queue->priority, pool, false, entry) ||
+           TaskQueue::take(queue->normal, pool, false, entry)) {
       done++;
       delete entry.task;
-
-      it = queue.erase(it);
     }
-    else
-      it++;
+    queue->lock.unlock();
   }
 
-  queue_lock.unlock();
+  atomic_sub_and_fetch_int32(&num_queued, done);
 
   /* notify done */
   pool->num_decrease(done);
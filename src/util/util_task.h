@@ -122,8 +122,11 @@ class TaskPool {
 
 /* Task Scheduler
  *
- * Central scheduler that holds running threads ready to execute tasks. A singe
- * queue holds the task from all pools. */
+ * Central scheduler that holds running threads ready to execute tasks. Every
+ * worker thread has its own queue for the tasks it pushes, and steals tasks from
+ * the queues of other threads when it runs out of work. Tasks pushed from other
+ * threads go into one shared queue. Idle worker threads sleep until new tasks
+ * are pushed. */
 
 class TaskScheduler {
  public:
@@ -137,6 +140,10 @@ class TaskScheduler {
     return threads.size();
   }
 
+  /* NUMA node the worker thread with the given ID runs on, or -1 if it may run
+   * on any node. */
+  static int thread_node(int thread_id);
+
   /* test if any session is using the scheduler */
   static bool active()
   {
@@ -151,17 +158,30 @@ class TaskScheduler {
     TaskPool *pool;
   };
 
+  struct TaskQueue;
+
   static thread_mutex mutex;
   static int users;
   static vector<thread *> threads;
+  static vector<int> thread_nodes;
   static bool do_exit;
 
-  static list<Entry> queue;
-  static thread_mutex queue_mutex;
-  static thread_condition_variable queue_cond;
+  /* Queue shared by threads other than the worker threads, and one queue per
+   * worker thread. */
+  static TaskQueue shared_queue;
+  static vector<TaskQueue *> thread_queues;
+
+  /* Number of tasks in all queues, and number of sleeping worker threads. */
+  static int num_queued;
+  static int num_parked;
+  static thread_mutex park_mutex;
+  static thread_condition_variable park_cond;
 
   static void thread_run(int thread_id);
-  static bool thread_wait_pop(Entry &entry);
+  static bool thread_wait_pop(int thread_id, Entry &entry);
+
+  static TaskQueue *thread_queue(int thread_id);
+  static bool pop(TaskPool *pool, Entry &entry);
 
   static void push(Entry &entry, bool front);
   static void clear(TaskPool *pool);
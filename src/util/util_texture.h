@@ -31,6 +31,10 @@ CCL_NAMESPACE_BEGIN
 /* Texture type. */
 #define kernel_tex_type(tex) (tex & IMAGE_DATA_TYPE_MASK)
 
+/* Size of tiles of sparse volume grids, in voxels along each axis. */
+#define SPARSE_GRID_TILE_SHIFT 3
+#define SPARSE_GRID_TILE_SIZE (1 << SPARSE_GRID_TILE_SHIFT)
+
 /* Interpolation types for textures
  * cuda also use texture space to store other objects */
 typedef enum InterpolationType {
@@ -97,6 +101,12 @@ typedef struct TextureInfo {
   uint interpolation, extension;
   /* Dimensions. */
   uint width, height, depth;
+  /* Handle of image loaded on demand through the texture cache, zero for images
+   * with all pixels in data. Only used by the CPU device. */
+  uint64_t cache_image;
+  /* Tile index of sparse volume grids, with data holding only non-empty tiles.
+   * Zero for dense images. Only used by the CPU device. */
+  uint64_t grid_index;
 } TextureInfo;
 
 CCL_NAMESPACE_END
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_texture_cache.h"
+
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/texture.h>
+
+#include "util/util_algorithm.h"
+#include "util/util_logging.h"
+
+CCL_NAMESPACE_BEGIN
+
+OIIO_NAMESPACE_USING
+
+/* Tile size of written files, small enough to not load much more than what
+ * lookups touch, large enough to keep the number of tiles manageable. */
+#define TEXTURE_CACHE_TILE_SIZE 64
+
+struct TextureCacheImage {
+  TextureSystem *texture_system;
+  TextureSystem::TextureHandle *handle;
+  int channels;
+};
+
+TextureCache::TextureCache()
+{
+  TextureSystem *ts = TextureSystem::create(false);
+
+  /* Files are written tiled and mipmapped, so never generate these on the fly,
+   * which would need the full image in memory. */
+  ts->attribute("autotile", 0);
+  ts->attribute("automip", 0);
+  ts->attribute("accept_untiled", 0);
+
+  texture_system = ts;
+}
+
+TextureCache::~TextureCache()
+{
+  for (map<string, TextureCacheImage *>::iterator it = images.begin(); it != images.end(); it++) {
+    delete it->second;
+  }
+
+  TextureSystem::destroy((TextureSystem *)texture_system, true);
+}
+
+void TextureCache::set_max_memory(size_t max_memory_mb)
+{
+  TextureSystem *ts = (TextureSystem *)texture_system;
+  ts->attribute("max_memory_MB", (float)max_memory_mb);
+}
+
+uint64_t TextureCache::get_image(const string &filename)
+{
+  thread_scoped_lock lock(images_mutex);
+
+  map<string, TextureCacheImage *>::iterator it = images.find(filename);
+  if (it != images.end()) {
+    return (uint64_t)it->second;
+  }
+
+  TextureSystem *ts = (TextureSystem *)texture_system;
+  ustring ufilename(filename);
+
+  TextureSystem::TextureHandle *handle = ts->get_texture_handle(ufilename);
+  int channels = 0;
+  if (!handle || !ts->good(handle) ||
+      !ts->get_texture_info(ufilename, 0, ustring("channels"), TypeDesc::INT, &channels)) {
+    VLOG(1) << "Failed to open cached texture " << filename << ": " << ts->geterror();
+    return 0;
+  }
+
+  TextureCacheImage *image = new TextureCacheImage();
+  image->texture_system = ts;
+  image->handle = handle;
+  image->channels = min(channels, 4);
+
+  images[filename] = image;
+  return (uint64_t)image;
+}
+
+bool TextureCache::write_image(const string &filename,
+                               const void *pixels,
+                               ImageDataType type,
+                               size_t width,
+                               size_t height)
+{
+  TypeDesc format;
+  int channels = 4;
+
+  switch (type) {
+    case IMAGE_DATA_TYPE_FLOAT:
+      channels = 1;
+      ATTR_FALLTHROUGH;
+    case IMAGE_DATA_TYPE_FLOAT4:
+      format = TypeDesc::FLOAT;
+      break;
+    case IMAGE_DATA_TYPE_HALF:
+      channels = 1;
+      ATTR_FALLTHROUGH;
+    case IMAGE_DATA_TYPE_HALF4:
+      format = TypeDesc::HALF;
+      break;
+    case IMAGE_DATA_TYPE_BYTE:
+      channels = 1;
+      ATTR_FALLTHROUGH;
+    case IMAGE_DATA_TYPE_BYTE4:
+      format = TypeDesc::UINT8;
+      break;
+    case IMAGE_DATA_TYPE_USHORT:
+      channels = 1;
+      ATTR_FALLTHROUGH;
+    case IMAGE_DATA_TYPE_USHORT4:
+      format = TypeDesc::UINT16;
+      break;
+    default:
+      return false;
+  }
+
+  /* Alpha is already associated or packed as needed by the kernel, store the
+   * channels as is. */
+  ImageSpec spec(width, height, channels, format);
+  spec.alpha_channel = -1;
+
+  ImageBuf flipped;
+  if (!ImageBufAlgo::flip(flipped, ImageBuf(spec, (void *)pixels))) {
+    return false;
+  }
+
+  ImageSpec config;
+  config.tile_width = TEXTURE_CACHE_TILE_SIZE;
+  config.tile_height = TEXTURE_CACHE_TILE_SIZE;
+  config.tile_depth = 1;
+  config.set_format(format);
+  config.attribute("compression", "zip");
+  config.attribute("maketx:fixnan", "box3");
+
+  if (!ImageBufAlgo::make_texture(ImageBufAlgo::MakeTxTexture, flipped, filename, config)) {
+    VLOG(1) << "Failed to write cached texture " << filename << ": " << OIIO::geterror();
+    return false;
+  }
+
+  /* Reload the file if it was opened before. */
+  TextureSystem *ts = (TextureSystem *)texture_system;
+  ts->invalidate(ustring(filename));
+
+  return true;
+}
+
+string TextureCache::stats() const
+{
+  TextureSystem *ts = (TextureSystem *)texture_system;
+  return ts->getstats(1, true);
+}
+
+float4 texture_cache_lookup(
+    const TextureInfo &info, float x, float y, float2 duv_dx, float2 duv_dy)
+{
+  const TextureCacheImage *image = (const TextureCacheImage *)info.cache_image;
+
+  TextureOpt options;
+  switch (info.extension) {
+    case EXTENSION_EXTEND:
+      options.swrap = options.twrap = TextureOpt::WrapClamp;
+      break;
+    case EXTENSION_CLIP:
+      options.swrap = options.twrap = TextureOpt::WrapBlack;
+      break;
+    default:
+      options.swrap = options.twrap = TextureOpt::WrapPeriodic;
+      break;
+  }
+  switch (info.interpolation) {
+    case INTERPOLATION_CLOSEST:
+      options.interpmode = TextureOpt::InterpClosest;
+      break;
+    case INTERPOLATION_LINEAR:
+      options.interpmode = TextureOpt::InterpBilinear;
+      break;
+    case INTERPOLATION_SMART:
+      options.interpmode = TextureOpt::InterpSmartBicubic;
+      break;
+    default:
+      options.interpmode = TextureOpt::InterpBicubic;
+      break;
+  }
+
+  /* Files are stored top row first, flip the t coordinate and its derivatives. */
+  float result[4];
+  if (!image->texture_system->texture(image->handle,
+                                      NULL,
+                                      options,
+                                      x,
+                                      1.0f - y,
+                                      duv_dx.x,
+                                      -duv_dx.y,
+                                      duv_dy.x,
+                                      -duv_dy.y,
+                                      image->channels,
+                                      result)) {
+    return make_float4(
+        TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A);
+  }
+
+  if (image->channels == 1) {
+    return make_float4(result[0], result[0], result[0], 1.0f);
+  }
+  return make_float4(result[0], result[1], result[2], result[3]);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2011-2019 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_TEXTURE_CACHE_H__
+#define __UTIL_TEXTURE_CACHE_H__
+
+#include "util/util_map.h"
+#include "util/util_string.h"
+#include "util/util_texture.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct TextureCacheImage;
+
+/* Texture Cache
+ *
+ * Image textures stored on disk as tiled and mipmapped files, of which only the
+ * tiles of the mipmap levels touched by lookups are loaded. Loaded tiles are kept
+ * up to a memory budget, with the least recently used tiles evicted first.
+ *
+ * Built on a private OpenImageIO texture system, so that the memory budget does
+ * not interact with the texture system shared by OSL. */
+
+class TextureCache {
+ public:
+  TextureCache();
+  ~TextureCache();
+
+  /* Maximum memory used by loaded tiles, in megabytes. */
+  void set_max_memory(size_t max_memory_mb);
+
+  /* Handle for lookups into a tiled and mipmapped file, stored in TextureInfo.
+   * Returns zero if the file can't be opened. */
+  uint64_t get_image(const string &filename);
+
+  /* Write pixels of the given type as a tiled and mipmapped file. Rows are stored
+   * bottom to top as in image textures, and flipped in the file. */
+  bool write_image(const string &filename,
+                   const void *pixels,
+                   ImageDataType type,
+                   size_t width,
+                   size_t height);
+
+  /* Memory and disk read statistics, for logging. */
+  string stats() const;
+
+ protected:
+  void *texture_system;
+
+  thread_mutex images_mutex;
+  map<string, TextureCacheImage *> images;
+};
+
+/* Filtered lookup of an image loaded through the texture cache. The derivatives
+ * of the texture coordinates select the mipmap levels, zero derivatives sample
+ * the full resolution image. */
+float4 texture_cache_lookup(
+    const TextureInfo &info, float x, float y, float2 duv_dx, float2 duv_dy);
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_TEXTURE_CACHE_H__ */